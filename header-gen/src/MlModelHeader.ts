@@ -7,5 +7,8 @@ export type MlModelHeader = {
     samples_period: number;
     samples_length: number;
     sample_dimensions: number;
+    // Format of the model after the header, 0 for ML4F (default) or 1 for a
+    // layer graph, see ml_model_format_t in mlrunner/mlrunner.h
+    model_format?: number;
     actions: { threshold: number, label: string }[];
 };
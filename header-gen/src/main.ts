@@ -22,7 +22,7 @@
  *     uint16_t samples_period;
  *     uint16_t samples_length;
  *     uint16_t sample_dimensions;
- *     uint8_t reserved[8];
+ *     uint8_t reserved[8];     // reserved[0] is the model format
  *     const uint8_t number_of_actions;
  *     const ml_header_action_t actions[0];
  * } ml_model_header_t;
@@ -78,8 +78,9 @@ export function generateBlob(data: MlModelHeader): ArrayBuffer {
     offset = addToView(view, offset, data.samples_length, CONST_SIZES.samples_length);
     offset = addToView(view, offset, data.sample_dimensions, CONST_SIZES.sample_dimensions);
 
-    // Add reserved bytes as zeros
-    for (let i = 0; i < CONST_SIZES.reserved; i++) {
+    // The first reserved byte is the model format, the rest are zeros
+    offset = addToView(view, offset, data.model_format ?? 0, 1);
+    for (let i = 1; i < CONST_SIZES.reserved; i++) {
         offset = addToView(view, offset, 0, 1);
     }
 
@@ -44,6 +44,25 @@ describe('Test the blob and code generators', () => {
                 '    0x72694307, 0x00656C63, \n' +
                 '};\n',
             expectedDs: 'const headerBlob = hex`4C444F4D38001900500003000000000000000003CDCC4C3F065368616B650000CDCC4C3F065374696C6C0000CDCC4C3F07436972636C6500`;\n',
+        }, {
+            headerData: {
+                samples_period: 25,
+                samples_length: 80,
+                sample_dimensions: 3,
+                model_format: 1,
+                actions: [
+                    { threshold: 0.8, label: "Shake" },
+                    { threshold: 0.8, label: "Still" },
+                    { threshold: 0.8, label: "Circle" }
+                ]
+            },
+            expectedC: 'const uint32_t header_data[14] = {\n' +
+                '    0x4D4F444C, 0x00190038, 0x01030050, 0x00000000, \n' +
+                '    0x03000000, 0x3F4CCCCD, 0x61685306, 0x0000656B, \n' +
+                '    0x3F4CCCCD, 0x69745306, 0x00006C6C, 0x3F4CCCCD, \n' +
+                '    0x72694307, 0x00656C63, \n' +
+                '};\n',
+            expectedDs: 'const headerBlob = hex`4C444F4D38001900500003010000000000000003CDCC4C3F065368616B650000CDCC4C3F065374696C6C0000CDCC4C3F07436972636C6500`;\n',
         }
     ];
 
@@ -0,0 +1,837 @@
+/**
+ * @brief Host benchmark for the data processor and the filters.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * Times each filter function, recordData() and getProcessedData() for a range
+ * of window sizes and sample dimensions, using a synthetic accelerometer-like
+ * signal, and reports the time per sample and per inference.
+ * Each measurement is repeated and the median is reported.
+ *
+ * The example models, and any model given with --model, are invoked in the
+ * Thumb emulator to report their cost in instructions and memory accesses.
+ * Layer graph models are run natively by the interpreter, and are timed
+ * layer by layer, to compare the kernels.
+ * ml_calcPrediction() and ml4f_argmax() are timed for a range of class counts.
+ * Finally, the mlstats latency percentiles of all the model runs are printed.
+ *
+ * Every measurement is kept as a metric with the median and the median
+ * absolute deviation (MAD) of its repeats. --json saves them as a baseline,
+ * and --compare checks them against a baseline: a metric regresses when it
+ * is slower by more than --threshold percent and by more than the noise of
+ * both runs (BENCH_NOISE_MADS scaled MADs), and then the exit code is 1.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "mldataprocessor.h"
+#include "filterdataprocessor.h"
+#include "mlrunner.h"
+#include "mlgraph.h"
+#include "mlstats.h"
+#include "ml4f_host.h"
+#include "examplemodels.h"
+#include "graphbuilder.h"
+#include "jsonreader.h"
+#include "modelloader.h"
+#include "ml4f.h"
+
+// Number of samples (or window elements) processed per measurement
+#define BENCH_SAMPLES           2000000
+#define BENCH_SAMPLES_QUICK     20000
+#define BENCH_REPEATS           5
+#define BENCH_REPEATS_QUICK     3
+#define BENCH_MAX_REPEATS       31
+#define BENCH_MAX_DIMENSIONS    6
+#define BENCH_INVOKES           20
+#define BENCH_INVOKES_QUICK     2
+#define BENCH_MAX_MODEL_FILES   8
+// Samples per recordData() call for the batched recording
+#define BENCH_BATCH             8
+#define BENCH_MAX_METRICS       1024
+#define BENCH_BASELINE_VERSION  1
+// Default minimum slowdown, in percent, for a metric to regress
+#define BENCH_REGRESSION_PERCENT 10.0
+// The slowdown must also be larger than this many MADs of the two runs,
+// scaled to the standard deviation of normally distributed noise
+#define BENCH_NOISE_MADS        3.0
+#define BENCH_MAD_SCALE         1.4826
+
+typedef struct {
+    char name[64];
+    int window;
+    int dims;
+    char unit[16];
+    double median;
+    double mad;
+} BenchMetric_t;
+
+typedef struct {
+    const char *name;
+    MldpFilter_t filter;
+    int out_size;   // 0 for the window size
+} BenchFilter_t;
+
+typedef struct {
+    const char *name;
+    const MlDataFilters_t *filters;
+    int filter_size;
+    int flags;
+} BenchPipeline_t;
+
+#define BENCH_MAX_WINDOW        1000
+static const int window_sizes[] = {42, 80, 250, BENCH_MAX_WINDOW};
+static const int dimensions[] = {1, 3, BENCH_MAX_DIMENSIONS};
+
+static const BenchFilter_t bench_filters[] = {
+    {"filterMax", filterMax, 1},
+    {"filterMin", filterMin, 1},
+    {"filterMean", filterMean, 1},
+    {"filterStdDev", filterStdDev, 1},
+    {"filterPeaks", filterPeaks, 1},
+    {"filterTotalAcc", filterTotalAcc, 1},
+    {"filterZcr", filterZcr, 1},
+    {"filterRms", filterRms, 1},
+    {"filterPassThrough", filterPassThrough, 0},
+    {"filterMlTrainer", filterMlTrainer, MLDP_ML_TRAINER_FEATURES},
+};
+
+static const int class_counts[] = {2, 4, 8, 16, 32};
+
+static const MlDataFilters_t ml_trainer_filters[] = {
+    {1, filterMax, MLDP_FILTER_NONE, NULL},
+    {1, filterMean, MLDP_FILTER_NONE, NULL},
+    {1, filterMin, MLDP_FILTER_NONE, NULL},
+    {1, filterStdDev, MLDP_FILTER_NONE, NULL},
+    {1, filterPeaks, MLDP_FILTER_NONE, NULL},
+    {1, filterTotalAcc, MLDP_FILTER_NONE, NULL},
+    {1, filterZcr, MLDP_FILTER_NONE, NULL},
+    {1, filterRms, MLDP_FILTER_NONE, NULL},
+};
+
+static const MlDataFilters_t ml_trainer_fused_filters[] = {
+    {MLDP_ML_TRAINER_FEATURES, filterMlTrainer, MLDP_FILTER_INTERLEAVED_OUTPUT, NULL},
+};
+
+static const BenchPipeline_t pipelines[] = {
+    {"filters", ml_trainer_filters, 8, MLDP_CONFIG_NONE},
+    {"filters+incremental", ml_trainer_filters, 8,
+        MLDP_CONFIG_INCREMENTAL_STATS | MLDP_CONFIG_INCREMENTAL_MIN_MAX | MLDP_CONFIG_STREAMING_PEAKS},
+    {"fused", ml_trainer_fused_filters, 1, MLDP_CONFIG_NONE},
+    {"fused+streaming", ml_trainer_fused_filters, 1, MLDP_CONFIG_STREAMING_PEAKS},
+    {"fused+streaming+int16", ml_trainer_fused_filters, 1, MLDP_CONFIG_STREAMING_PEAKS | MLDP_CONFIG_INT16_SAMPLES},
+};
+
+// The signal is in g, stored in milli-g by the int16 pipelines
+static const float sample_scale[BENCH_MAX_DIMENSIONS] = {1000.0f, 1000.0f, 1000.0f, 1000.0f, 1000.0f, 1000.0f};
+
+#define ARRAY_LEN(array) ((int)(sizeof(array) / sizeof((array)[0])))
+
+static int bench_samples = BENCH_SAMPLES;
+static int bench_repeats = BENCH_REPEATS;
+static int bench_invokes = BENCH_INVOKES;
+static bool bench_quick = false;
+
+static BenchMetric_t metrics[BENCH_MAX_METRICS];
+static int metrics_len = 0;
+
+// Written with the filter outputs, so that the compiler can't drop the calls
+static volatile float sink;
+
+static double nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int compareDouble(const void *a, const void *b) {
+    const double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *values, const int len) {
+    qsort(values, len, sizeof(double), compareDouble);
+    return (len % 2) ? values[len / 2] : (values[len / 2 - 1] + values[len / 2]) / 2.0;
+}
+
+/**
+ * Keep the median and the MAD of the repeats of a measurement as a metric.
+ *
+ * @return The median.
+ */
+static double addMetric(
+    const char *name, const int window, const int dims, const char *unit, double *values, const int len
+) {
+    const double mid = median(values, len);
+    double deviations[BENCH_MAX_REPEATS];
+    for (int i = 0; i < len; i++) {
+        deviations[i] = fabs(values[i] - mid);
+    }
+    if (metrics_len < BENCH_MAX_METRICS) {
+        BenchMetric_t *metric = &metrics[metrics_len++];
+        snprintf(metric->name, sizeof(metric->name), "%s", name);
+        snprintf(metric->unit, sizeof(metric->unit), "%s", unit);
+        metric->window = window;
+        metric->dims = dims;
+        metric->median = mid;
+        metric->mad = median(deviations, len);
+    }
+    return mid;
+}
+
+/**
+ * Generate an accelerometer-like signal in g, with a slow movement, some
+ * noise and occasional spikes, so that all the filters have work to do.
+ * The output is deterministic.
+ */
+static float* generateSamples(const int len) {
+    float *samples = (float *)malloc(len * sizeof(float));
+    if (samples == NULL) {
+        return NULL;
+    }
+    uint32_t seed = 12345;
+    for (int i = 0; i < len; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        const float noise = ((float)(seed >> 8) / (float)(1 << 24) - 0.5f) * 0.1f;
+        const float spike = ((seed >> 4) % 97 == 0) ? 1.5f : 0.0f;
+        samples[i] = 0.8f * sinf((float)i * 0.15f) + 0.3f * sinf((float)i * 0.031f) + noise + spike;
+    }
+    return samples;
+}
+
+static void printHeader() {
+    printf("%-40s %7s %5s %12s %14s\n", "benchmark", "window", "dims", "ns/sample", "ns/inference");
+}
+
+// Negative values are printed as not applicable
+static void printResult(
+    const char *name, const int window, const int dims, const double ns_sample, const double ns_inference
+) {
+    printf("%-40s %7d %5d ", name, window, dims);
+    if (ns_sample >= 0) printf("%12.2f ", ns_sample); else printf("%12s ", "-");
+    if (ns_inference >= 0) printf("%14.1f\n", ns_inference); else printf("%14s\n", "-");
+}
+
+static void benchFilter(const BenchFilter_t *bench, const float *samples, const int window) {
+    static float out[BENCH_MAX_WINDOW];
+    const int out_size = bench->out_size > 0 ? bench->out_size : window;
+    const int calls = bench_samples / window + 1;
+    double results[BENCH_MAX_REPEATS];
+
+    for (int r = 0; r < bench_repeats; r++) {
+        const double start = nowNs();
+        for (int i = 0; i < calls; i++) {
+            // Move the window through the signal, as the processor would
+            bench->filter(&samples[i % window], window, out, out_size);
+            sink = out[0];
+        }
+        results[r] = (nowNs() - start) / calls;
+    }
+    double ns_call = addMetric(bench->name, window, 1, "ns/inference", results, bench_repeats);
+    printResult(bench->name, window, 1, ns_call / window, ns_call);
+
+    // The window variant, with the window wrapped around the ring buffer
+    const MldpWindowFilter_t window_filter = mldp_getWindowFilter(bench->filter);
+    if (window_filter == NULL) {
+        return;
+    }
+    for (int r = 0; r < bench_repeats; r++) {
+        const double start = nowNs();
+        for (int i = 0; i < calls; i++) {
+            const int head_size = window - window / 3;
+            const MlDataWindow_t data = {
+                .head = &samples[i % window + window - head_size],
+                .head_size = head_size,
+                .tail = &samples[i % window],
+                .tail_size = window - head_size,
+            };
+            window_filter(&data, out, out_size);
+            sink = out[0];
+        }
+        results[r] = (nowNs() - start) / calls;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "%sWindow", bench->name);
+    ns_call = addMetric(name, window, 1, "ns/inference", results, bench_repeats);
+    printResult(name, window, 1, ns_call / window, ns_call);
+}
+
+/**
+ * Time recordData() for each sample, and for batches of BENCH_BATCH samples,
+ * and getProcessedData() running an inference after every sample, which is
+ * the worst case for the processor.
+ */
+static int benchPipeline(const BenchPipeline_t *bench, const float *samples, const int window, const int dims) {
+    int features = 0;
+    for (int i = 0; i < bench->filter_size; i++) {
+        features += bench->filters[i].out_size;
+    }
+    const MlDataProcessorConfig_t config = {
+        .samples = window,
+        .dimensions = dims,
+        .output_length = features * dims,
+        .filter_size = bench->filter_size,
+        .filters = bench->filters,
+        .flags = bench->flags,
+        .sample_scale = sample_scale,
+    };
+    FilterDataProcessor_t *fdp = filterDataProcessor_create();
+    if (fdp == NULL || filterDataProcessor_init(fdp, &config) != MLDP_SUCCESS) {
+        fprintf(stderr, "Failed to initialise the data processor for %s\n", bench->name);
+        filterDataProcessor_destroy(fdp);
+        return -1;
+    }
+
+    // Each sample takes consecutive values from the signal for its dimensions
+    int sample_i = 0;
+    for (int i = 0; i < window; i++) {
+        filterDataProcessor_recordData(fdp, &samples[sample_i], dims);
+        sample_i = (sample_i + dims) % window;
+    }
+
+    const int record_samples = bench_samples / dims + 1;
+    const int inferences = bench_samples / (window * dims) + 1;
+    double record_results[BENCH_MAX_REPEATS], batch_results[BENCH_MAX_REPEATS];
+    double inference_results[BENCH_MAX_REPEATS];
+    for (int r = 0; r < bench_repeats; r++) {
+        double start = nowNs();
+        for (int i = 0; i < record_samples; i++) {
+            filterDataProcessor_recordData(fdp, &samples[sample_i], dims);
+            sample_i = (sample_i + dims) % window;
+        }
+        record_results[r] = (nowNs() - start) / record_samples;
+
+        start = nowNs();
+        for (int i = 0; i < record_samples; i += BENCH_BATCH) {
+            filterDataProcessor_recordData(fdp, &samples[sample_i], dims * BENCH_BATCH);
+            sample_i = (sample_i + dims) % window;
+        }
+        batch_results[r] = (nowNs() - start) / record_samples;
+
+        double inference_ns = 0;
+        for (int i = 0; i < inferences; i++) {
+            filterDataProcessor_recordData(fdp, &samples[sample_i], dims);
+            sample_i = (sample_i + dims) % window;
+            start = nowNs();
+            const float *out = filterDataProcessor_getProcessedData(fdp);
+            inference_ns += nowNs() - start;
+            if (out == NULL) {
+                fprintf(stderr, "Failed to process the data for %s\n", bench->name);
+                filterDataProcessor_destroy(fdp);
+                return -1;
+            }
+            sink = out[0];
+        }
+        inference_results[r] = inference_ns / inferences;
+    }
+    filterDataProcessor_destroy(fdp);
+
+    char name[64];
+    snprintf(name, sizeof(name), "recordData[%s]", bench->name);
+    printResult(name, window, dims, addMetric(name, window, dims, "ns/sample", record_results, bench_repeats), -1);
+    snprintf(name, sizeof(name), "recordData[%s] x%d", bench->name, BENCH_BATCH);
+    printResult(name, window, dims, addMetric(name, window, dims, "ns/sample", batch_results, bench_repeats), -1);
+    snprintf(name, sizeof(name), "getProcessedData[%s]", bench->name);
+    printResult(name, window, dims, -1,
+                addMetric(name, window, dims, "ns/inference", inference_results, bench_repeats));
+    return 0;
+}
+
+/**
+ * Fill a float or int8 tensor with the signal, the values don't change the
+ * cost much as long as they aren't all zero.
+ */
+static void fillTensor(void *tensor, const bool int8, const int len, const float *samples) {
+    for (int i = 0; i < len; i++) {
+        if (int8) {
+            ((int8_t *)tensor)[i] = (int8_t)(samples[i % BENCH_MAX_DIMENSIONS] * 50.0f);
+        } else {
+            ((float *)tensor)[i] = samples[i % BENCH_MAX_DIMENSIONS];
+        }
+    }
+}
+
+/**
+ * Run the set model through ml_predict(), so that mlstats records the time
+ * of each stage, from the float input to the predicted action.
+ */
+static int recordModelStages(const float *samples) {
+    ml_actions_t *actions = ml_allocateActions();
+    ml_predictions_t *predictions = ml_allocatePredictions();
+    int result = (actions != NULL && predictions != NULL && ml_getActions(actions)) ? 0 : -1;
+    for (int i = 0; i < bench_invokes && result == 0; i++) {
+        if (!ml_predict(samples, ml_getInputLength(), actions, predictions)) {
+            result = -1;
+        }
+    }
+    free(actions);
+    free(predictions);
+    return result;
+}
+
+/**
+ * Invoke a model with a synthetic input and report the emulator statistics,
+ * which are the same for every invoke, and the host time per inference.
+ */
+static int benchModel(const char *name, const void *model, const float *samples) {
+    if (!ml_setModel(model)) {
+        fprintf(stderr, "Invalid model %s\n", name);
+        return -1;
+    }
+    fillTensor(ml_getInputTensor(), ml_getInputBuffer() == NULL, ml_getInputLength(), samples);
+
+    double results[BENCH_MAX_REPEATS];
+    for (int r = 0; r < bench_repeats; r++) {
+        const double start = nowNs();
+        for (int i = 0; i < bench_invokes; i++) {
+            if (!ml_invokeModel()) {
+                fprintf(stderr, "Failed to invoke the model %s\n", name);
+                ml_removeModels();
+                return -1;
+            }
+        }
+        results[r] = (nowNs() - start) / bench_invokes;
+    }
+    if (recordModelStages(samples) != 0) {
+        fprintf(stderr, "Failed to run the model %s\n", name);
+        ml_removeModels();
+        return -1;
+    }
+    const double ns_inference = addMetric(name, 0, 0, "ns/inference", results, bench_repeats);
+    const ml_model_header_t *header = (const ml_model_header_t *)model;
+    if (header->reserved[ML_MODEL_FORMAT_INDEX] == ML_MODEL_FORMAT_GRAPH) {
+        // Not emulated, so there are no instruction counts
+        printf("%-40s %12s %10s %10s %10s %14.1f\n", name, "-", "-", "-", "-", ns_inference);
+        ml_removeModels();
+        return 0;
+    }
+    // The emulated instructions are the same on every run, any increase is
+    // more code on the device
+    const ThumbEmuStats_t *stats = ml4f_last_invoke_stats();
+    double instructions = (double)stats->instructions;
+    addMetric(name, 0, 0, "instructions", &instructions, 1);
+    printf("%-40s %12llu %10llu %10llu %10llu %14.1f\n", name,
+           (unsigned long long)stats->instructions, (unsigned long long)stats->fp_instructions,
+           (unsigned long long)stats->loads, (unsigned long long)stats->stores, ns_inference);
+    ml_removeModels();
+    return 0;
+}
+
+static int benchModels(const char **model_files, const int model_files_len, const float *samples) {
+    printf("\n%-40s %12s %10s %10s %10s %14s\n",
+           "model", "instructions", "fp", "loads", "stores", "ns/inference");
+    for (int m = 0; m < example_models_len; m++) {
+        if (benchModel(example_models[m].name, example_models[m].model, samples) != 0) {
+            return -1;
+        }
+    }
+    for (int m = 0; m < model_files_len; m++) {
+        size_t size;
+        void *model = modelLoader_load(model_files[m], &size);
+        if (model == NULL) {
+            fprintf(stderr, "Failed to load the model %s\n", model_files[m]);
+            return -1;
+        }
+        const int result = benchModel(model_files[m], model, samples);
+        free(model);
+        if (result != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static const char *layerName(const uint32_t type) {
+    switch (type) {
+        case MLGRAPH_LAYER_DENSE: return "dense";
+        case MLGRAPH_LAYER_CONV1D: return "conv1d";
+        case MLGRAPH_LAYER_MAX_POOL1D: return "maxPool1d";
+        case MLGRAPH_LAYER_AVG_POOL1D: return "avgPool1d";
+        case MLGRAPH_LAYER_GLOBAL_AVG_POOL1D: return "globalAvgPool1d";
+        case MLGRAPH_LAYER_ACTIVATION: return "activation";
+        default: return "unknown";
+    }
+}
+
+/**
+ * Time each layer of a graph model with mlgraph_invoke_layer(), and the
+ * whole model with ml_invokeModel().
+ */
+static int benchGraph(const char *name, const void *model, const float *samples) {
+    const ml_model_header_t *header = (const ml_model_header_t *)model;
+    const mlgraph_header_t *graph = (const mlgraph_header_t *)((const uint8_t *)model + header->header_size);
+    if (!ml_setModel(model)) {
+        fprintf(stderr, "Invalid graph model %s\n", name);
+        return -1;
+    }
+    uint8_t *arena = (uint8_t *)ml_getInputTensor() - graph->input_offset;
+    const int calls = bench_invokes * 50;
+    double results[BENCH_MAX_REPEATS];
+    char layer_name[64];
+    for (uint32_t l = 0; l < graph->num_layers; l++) {
+        const mlgraph_layer_t *layer = mlgraph_layer(graph, l);
+        for (int r = 0; r < bench_repeats; r++) {
+            fillTensor(arena + layer->input_offset, graph->data_type == MLGRAPH_TYPE_INT8,
+                       layer->in_length * layer->in_channels, samples);
+            const double start = nowNs();
+            for (int i = 0; i < calls; i++) {
+                mlgraph_invoke_layer(graph, arena, l);
+            }
+            results[r] = (nowNs() - start) / calls;
+        }
+        snprintf(layer_name, sizeof(layer_name), "%s[%u] %s %ux%u->%ux%u", name, (unsigned)l,
+                 layerName(layer->type), (unsigned)layer->in_length, (unsigned)layer->in_channels,
+                 (unsigned)layer->out_length, (unsigned)layer->out_channels);
+        printf("%-40s %12s %10s %10s %10s %14.1f\n", layer_name, "-", "-", "-", "-",
+               addMetric(layer_name, 0, 0, "ns/inference", results, bench_repeats));
+    }
+    ml_removeModels();
+
+    snprintf(layer_name, sizeof(layer_name), "%s total", name);
+    return benchModel(layer_name, model, samples);
+}
+
+/**
+ * Graph models shaped like the ml-trainer dense model and a small 1D
+ * convolutional model, with arbitrary weights as only the cost matters.
+ * The int8 versions are calibrated with inputs taken from the signal.
+ */
+static void *buildBenchGraph(const bool conv, const bool int8, const float *samples) {
+    static const char *labels[] = {"a", "b", "c", "d"};
+    static float weights[16 * 5 * 16];
+    for (int i = 0; i < ARRAY_LEN(weights); i++) {
+        weights[i] = samples[i % BENCH_MAX_DIMENSIONS] * 0.1f;
+    }
+    size_t size;
+    GraphBuilder_t builder;
+    if (conv) {
+        graphBuilder_init(&builder, 80, 3);
+        graphBuilder_conv1d(&builder, 16, 5, 1, 2, weights, weights, MLGRAPH_ACTIVATION_RELU);
+        graphBuilder_maxPool1d(&builder, 2, 2, 0);
+        graphBuilder_conv1d(&builder, 16, 5, 1, 2, weights, weights, MLGRAPH_ACTIVATION_RELU);
+        graphBuilder_globalAvgPool1d(&builder);
+        graphBuilder_dense(&builder, 4, weights, weights, MLGRAPH_ACTIVATION_NONE);
+        graphBuilder_activation(&builder, MLGRAPH_ACTIVATION_SOFTMAX);
+    } else {
+        graphBuilder_init(&builder, 1, MLDP_ML_TRAINER_FEATURES * 3);
+        graphBuilder_dense(&builder, 16, weights, weights, MLGRAPH_ACTIVATION_RELU);
+        graphBuilder_dense(&builder, 4, weights, weights, MLGRAPH_ACTIVATION_SOFTMAX);
+    }
+    if (int8) {
+        // The signal has enough samples for a few inputs of 80x3
+        graphBuilder_quantize(&builder, samples, 4);
+    }
+    void *model = graphBuilder_build(&builder, 25, 80, 3, labels, 4, &size);
+    graphBuilder_free(&builder);
+    return model;
+}
+
+static int benchGraphs(const float *samples) {
+    static const char *names[] = {"graph_dense", "graph_conv", "graph_dense_int8", "graph_conv_int8"};
+    for (int g = 0; g < ARRAY_LEN(names); g++) {
+        void *model = buildBenchGraph(g % 2, g >= 2, samples);
+        const int result = model != NULL ? benchGraph(names[g], model, samples) : -1;
+        free(model);
+        if (result != 0) {
+            fprintf(stderr, "Failed to benchmark %s\n", names[g]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Time ml_calcPrediction() and ml4f_argmax() with the model outputs of each
+ * class count, half of the classes above their threshold.
+ */
+static int benchPredictions(const float *samples) {
+    printf("\n%-40s %7s %14s\n", "prediction", "classes", "ns/call");
+    const int calls = bench_samples / 10 + 1;
+    for (int c = 0; c < ARRAY_LEN(class_counts); c++) {
+        const int classes = class_counts[c];
+        ml_actions_t *actions = (ml_actions_t *)malloc(sizeof(ml_actions_t) + classes * sizeof(ml_action_t));
+        float *outputs = (float *)malloc(classes * sizeof(float));
+        if (actions == NULL || outputs == NULL) {
+            free(actions);
+            free(outputs);
+            return -1;
+        }
+        actions->len = classes;
+        for (int i = 0; i < classes; i++) {
+            outputs[i] = fabsf(samples[i]) / classes;
+            actions->action[i].threshold = (i % 2) ? outputs[i] * 2.0f : outputs[i] / 2.0f;
+            actions->action[i].label = "";
+        }
+
+        double calc_results[BENCH_MAX_REPEATS], argmax_results[BENCH_MAX_REPEATS];
+        for (int r = 0; r < bench_repeats; r++) {
+            double start = nowNs();
+            for (int i = 0; i < calls; i++) {
+                sink = (float)ml_calcPrediction(actions, outputs, classes);
+            }
+            calc_results[r] = (nowNs() - start) / calls;
+            start = nowNs();
+            for (int i = 0; i < calls; i++) {
+                sink = (float)ml4f_argmax(outputs, classes);
+            }
+            argmax_results[r] = (nowNs() - start) / calls;
+        }
+        free(actions);
+        free(outputs);
+
+        char name[64];
+        snprintf(name, sizeof(name), "ml_calcPrediction %d classes", classes);
+        printf("%-40s %7d %14.2f\n", "ml_calcPrediction", classes,
+               addMetric(name, 0, 0, "ns/inference", calc_results, bench_repeats));
+        snprintf(name, sizeof(name), "ml4f_argmax %d classes", classes);
+        printf("%-40s %7d %14.2f\n", "ml4f_argmax", classes,
+               addMetric(name, 0, 0, "ns/inference", argmax_results, bench_repeats));
+    }
+    return 0;
+}
+
+static bool saveBaseline(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return false;
+    }
+    fprintf(file, "{\n  \"version\": %d,\n  \"quick\": %s,\n  \"repeats\": %d,\n  \"metrics\": [\n",
+            BENCH_BASELINE_VERSION, bench_quick ? "true" : "false", bench_repeats);
+    for (int i = 0; i < metrics_len; i++) {
+        const BenchMetric_t *metric = &metrics[i];
+        fprintf(file, "    {\"name\": \"%s\", \"window\": %d, \"dims\": %d, \"unit\": \"%s\", "
+                "\"median\": %.9g, \"mad\": %.9g}%s\n", metric->name, metric->window, metric->dims,
+                metric->unit, metric->median, metric->mad, i + 1 < metrics_len ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+// After the JSON_OBJECT_START of a metric
+static bool readBaselineMetric(JsonReader_t *json, BenchMetric_t *metric) {
+    memset(metric, 0, sizeof(*metric));
+    JsonToken_t token;
+    while ((token = jsonReader_next(json)) == JSON_KEY) {
+        char key[16];
+        snprintf(key, sizeof(key), "%.*s", (int)sizeof(key) - 1, json->string);
+        const JsonToken_t value = jsonReader_next(json);
+        if (strcmp(key, "name") == 0 && value == JSON_STRING) {
+            snprintf(metric->name, sizeof(metric->name), "%.*s", (int)sizeof(metric->name) - 1, json->string);
+        } else if (strcmp(key, "unit") == 0 && value == JSON_STRING) {
+            snprintf(metric->unit, sizeof(metric->unit), "%.*s", (int)sizeof(metric->unit) - 1, json->string);
+        } else if (strcmp(key, "window") == 0 && value == JSON_NUMBER) {
+            metric->window = (int)json->number;
+        } else if (strcmp(key, "dims") == 0 && value == JSON_NUMBER) {
+            metric->dims = (int)json->number;
+        } else if (strcmp(key, "median") == 0 && value == JSON_NUMBER) {
+            metric->median = json->number;
+        } else if (strcmp(key, "mad") == 0 && value == JSON_NUMBER) {
+            metric->mad = json->number;
+        } else if (!jsonReader_skip(json, value)) {
+            return false;
+        }
+    }
+    return token == JSON_OBJECT_END;
+}
+
+/**
+ * Read the metrics of a baseline saved with --json.
+ *
+ * @return The number of metrics, or -1 if the file can't be read.
+ */
+static int loadBaseline(const char *path, BenchMetric_t *baseline, bool *quick) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+    JsonReader_t *json = (JsonReader_t *)malloc(sizeof(JsonReader_t));
+    int len = json != NULL ? 0 : -1;
+    if (json != NULL) {
+        jsonReader_init(json, file);
+        len = jsonReader_next(json) == JSON_OBJECT_START ? 0 : -1;
+    }
+    JsonToken_t token;
+    while (len >= 0 && (token = jsonReader_next(json)) == JSON_KEY) {
+        if (strcmp(json->string, "quick") == 0) {
+            *quick = jsonReader_next(json) == JSON_TRUE;
+        } else if (strcmp(json->string, "metrics") == 0) {
+            if (jsonReader_next(json) != JSON_ARRAY_START) {
+                len = -1;
+                break;
+            }
+            while (len >= 0 && (token = jsonReader_next(json)) == JSON_OBJECT_START) {
+                len = len < BENCH_MAX_METRICS && readBaselineMetric(json, &baseline[len]) ? len + 1 : -1;
+            }
+            len = token == JSON_ARRAY_END ? len : -1;
+        } else if (!jsonReader_skip(json, jsonReader_next(json))) {
+            len = -1;
+        }
+    }
+    if (len >= 0 && (token != JSON_OBJECT_END || jsonReader_next(json) != JSON_END)) {
+        len = -1;
+    }
+    free(json);
+    fclose(file);
+    return len;
+}
+
+static const BenchMetric_t *findMetric(const BenchMetric_t *list, const int len, const BenchMetric_t *metric) {
+    for (int i = 0; i < len; i++) {
+        if (strcmp(list[i].name, metric->name) == 0 && strcmp(list[i].unit, metric->unit) == 0 &&
+                list[i].window == metric->window && list[i].dims == metric->dims) {
+            return &list[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Compare the metrics of this run with a baseline, a metric regresses when
+ * it's slower than the baseline by more than threshold_percent and by more
+ * than the noise of the two runs.
+ *
+ * @return The number of regressions, or -1 if the baseline can't be read.
+ */
+static int compareBaseline(const char *path, const double threshold_percent) {
+    BenchMetric_t *baseline = (BenchMetric_t *)malloc(BENCH_MAX_METRICS * sizeof(BenchMetric_t));
+    bool quick = false;
+    const int baseline_len = baseline != NULL ? loadBaseline(path, baseline, &quick) : -1;
+    if (baseline_len < 0) {
+        fprintf(stderr, "Failed to read the baseline %s\n", path);
+        free(baseline);
+        return -1;
+    }
+    printf("\nCompared with %s (regression threshold %.1f%%, %.1f MADs)\n", path, threshold_percent,
+           BENCH_NOISE_MADS);
+    if (quick != bench_quick) {
+        printf("Warning: the baseline was run %s --quick\n", quick ? "with" : "without");
+    }
+    printf("%-40s %7s %5s %14s %14s %8s\n", "benchmark", "window", "dims", "baseline", "current", "change");
+    int regressions = 0, improvements = 0, missing = 0;
+    for (int i = 0; i < metrics_len; i++) {
+        const BenchMetric_t *current = &metrics[i];
+        const BenchMetric_t *base = findMetric(baseline, baseline_len, current);
+        if (base == NULL) {
+            missing++;
+            continue;
+        }
+        const double diff = current->median - base->median;
+        const double noise = BENCH_NOISE_MADS * BENCH_MAD_SCALE * (base->mad + current->mad);
+        const double limit = fmax(base->median * threshold_percent / 100.0, noise);
+        if (fabs(diff) <= limit) {
+            continue;
+        }
+        regressions += diff > 0;
+        improvements += diff < 0;
+        printf("%-40s %7d %5d %14.2f %14.2f %+7.1f%% %s %s\n", current->name, current->window, current->dims,
+               base->median, current->median, base->median > 0 ? diff / base->median * 100.0 : 0.0,
+               current->unit, diff > 0 ? "REGRESSED" : "improved");
+    }
+    printf("%d metrics: %d regressed, %d improved, %d not in the baseline\n", metrics_len, regressions,
+           improvements, missing);
+    free(baseline);
+    return regressions;
+}
+
+static void printStatsLine(const char *line, void *context) {
+    (void)context;
+    fputs(line, stdout);
+}
+
+static void printUsage(const char *program) {
+    printf("Usage: %s [--quick] [--repeats N] [--model FILE]... [--json FILE] [--compare FILE [--threshold PERCENT]]\n",
+           program);
+    printf("  --quick             Run fewer iterations, to check the benchmark works\n");
+    printf("  --repeats N         Repeat each measurement N times, up to %d\n", BENCH_MAX_REPEATS);
+    printf("  --model FILE        Also report the cost of the model in FILE, an\n");
+    printf("                      autogenerated.ts or a binary model with its header\n");
+    printf("  --json FILE         Save the median and MAD of every measurement as a baseline\n");
+    printf("  --compare FILE      Fail if a measurement regressed from the baseline in FILE\n");
+    printf("  --threshold PERCENT Minimum slowdown to regress, %.0f%% by default\n", BENCH_REGRESSION_PERCENT);
+}
+
+int main(int argc, char **argv) {
+    const char *model_files[BENCH_MAX_MODEL_FILES];
+    int model_files_len = 0;
+    const char *json_path = NULL;
+    const char *compare_path = NULL;
+    double threshold_percent = BENCH_REGRESSION_PERCENT;
+    int repeats = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            bench_samples = BENCH_SAMPLES_QUICK;
+            bench_repeats = BENCH_REPEATS_QUICK;
+            bench_invokes = BENCH_INVOKES_QUICK;
+            bench_quick = true;
+        } else if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc) {
+            repeats = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            compare_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold_percent = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc && model_files_len < BENCH_MAX_MODEL_FILES) {
+            model_files[model_files_len++] = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+    if (repeats != 0) {
+        if (repeats < 1 || repeats > BENCH_MAX_REPEATS) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        bench_repeats = repeats;
+    }
+
+    // Enough signal for the largest window in all dimensions, plus the
+    // window offsets used by benchFilter()
+    const int max_window = window_sizes[ARRAY_LEN(window_sizes) - 1];
+    float *samples = generateSamples(max_window * (BENCH_MAX_DIMENSIONS + 1));
+    if (samples == NULL) {
+        fprintf(stderr, "Failed to allocate the samples\n");
+        return 1;
+    }
+
+    printHeader();
+    for (int w = 0; w < ARRAY_LEN(window_sizes); w++) {
+        for (int f = 0; f < ARRAY_LEN(bench_filters); f++) {
+            benchFilter(&bench_filters[f], samples, window_sizes[w]);
+        }
+    }
+    for (int w = 0; w < ARRAY_LEN(window_sizes); w++) {
+        for (int d = 0; d < ARRAY_LEN(dimensions); d++) {
+            for (int p = 0; p < ARRAY_LEN(pipelines); p++) {
+                if (benchPipeline(&pipelines[p], samples, window_sizes[w], dimensions[d]) != 0) {
+                    free(samples);
+                    return 1;
+                }
+            }
+        }
+    }
+    mlstats_reset();
+    if (benchModels(model_files, model_files_len, samples) != 0 || benchGraphs(samples) != 0 ||
+            benchPredictions(samples) != 0) {
+        free(samples);
+        return 1;
+    }
+    printf("\n");
+    mlstats_dump(printStatsLine, NULL);
+    free(samples);
+
+    if (json_path != NULL && !saveBaseline(json_path)) {
+        fprintf(stderr, "Failed to write the baseline %s\n", json_path);
+        return 1;
+    }
+    if (compare_path != NULL) {
+        return compareBaseline(compare_path, threshold_percent) != 0 ? 1 : 0;
+    }
+    return 0;
+}
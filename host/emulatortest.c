@@ -0,0 +1,122 @@
+/**
+ * @brief Test the models running in the Thumb emulator.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * Runs the example models, and the model of a modeltest data set with its
+ * expected filter output as the input, comparing the predictions against
+ * the expected model output.
+ * The data set is the testdata.h header found in the include path.
+ *
+ * Usage: emulatortest <autogenerated.ts> <tolerance>
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "mlrunner.h"
+#include "ml4f.h"
+#include "ml4f_host.h"
+#include "examplemodels.h"
+#include "modelloader.h"
+#include "testdata.h"
+
+#define MAX_MODEL_INPUT     1024
+#define MAX_MODEL_OUTPUT    16
+
+static void printStats(const char *name) {
+    const ThumbEmuStats_t *stats = ml4f_last_invoke_stats();
+    printf("%s: %llu instructions (%llu FP), %llu loads, %llu stores\n", name,
+           (unsigned long long)stats->instructions, (unsigned long long)stats->fp_instructions,
+           (unsigned long long)stats->loads, (unsigned long long)stats->stores);
+}
+
+// The example models end with a softmax, so the outputs add up to 1
+static int testExampleModels() {
+    static float input[MAX_MODEL_INPUT];
+    int failures = 0;
+    for (int m = 0; m < example_models_len; m++) {
+        const ExampleModel_t *example = &example_models[m];
+        if (!ml_setModel(example->model) || ml_getInputLength() > MAX_MODEL_INPUT ||
+                ml_getOutputLength() > MAX_MODEL_OUTPUT) {
+            printf("%s: FAIL, invalid model\n", example->name);
+            failures++;
+            continue;
+        }
+        const int in_len = ml_getInputLength(), out_len = ml_getOutputLength();
+        for (int i = 0; i < in_len; i++) {
+            input[i] = sinf((float)i * 0.1f);
+        }
+        float output[MAX_MODEL_OUTPUT];
+        if (!ml_runModel(input, in_len, output, out_len)) {
+            printf("%s: FAIL, the model didn't run\n", example->name);
+            failures++;
+            continue;
+        }
+        float sum = 0.0f;
+        for (int i = 0; i < out_len; i++) {
+            sum += output[i];
+        }
+        printStats(example->name);
+        if (!isfinite(sum) || fabsf(sum - 1.0f) > 1e-4f) {
+            printf("%s: FAIL, outputs add up to %f\n", example->name, sum);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+static int testDataSet(const char *model_path, const float tolerance) {
+    size_t size;
+    void *model = modelLoader_load(model_path, &size);
+    if (model == NULL || !ml_setModel(model)) {
+        printf("%s: FAIL, can't load the model\n", model_path);
+        free(model);
+        return 1;
+    }
+    if (ml_getInputLength() != ML_TEST_FILTER_OUTPUT_SIZE || ml_getOutputLength() != ML_TEST_MODEL_OUTPUT_SIZE) {
+        printf("%s: FAIL, the model doesn't match the test data\n", model_path);
+        ml_removeModels();
+        free(model);
+        return 1;
+    }
+
+    int failures = 0;
+    float max_diff = 0.0f;
+    for (int r = 0; r < ML_TEST_RECORDINGS; r++) {
+        float output[ML_TEST_MODEL_OUTPUT_SIZE];
+        if (!ml_runModel(test_filter_output[r], ML_TEST_FILTER_OUTPUT_SIZE, output, ML_TEST_MODEL_OUTPUT_SIZE)) {
+            printf("Recording %d: FAIL, the model didn't run\n", r);
+            failures++;
+            continue;
+        }
+        float diff = 0.0f;
+        for (int i = 0; i < ML_TEST_MODEL_OUTPUT_SIZE; i++) {
+            diff = fmaxf(diff, fabsf(output[i] - test_model_output[r][i]));
+        }
+        max_diff = fmaxf(max_diff, diff);
+        const int argmax = ml4f_argmax(output, ML_TEST_MODEL_OUTPUT_SIZE);
+        if (diff > tolerance || argmax != ml4f_argmax(test_model_output[r], ML_TEST_MODEL_OUTPUT_SIZE)) {
+            printf("Recording %d: FAIL, max difference %f, prediction %d\n", r, diff, argmax);
+            failures++;
+        }
+    }
+    printStats(model_path);
+    printf("%d recordings, max difference %g, tolerance %g\n", ML_TEST_RECORDINGS, max_diff, tolerance);
+
+    ml_removeModels();
+    free(model);
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        printf("Usage: %s <autogenerated.ts> <tolerance>\n", argv[0]);
+        return 1;
+    }
+    int failures = testExampleModels();
+    failures += testDataSet(argv[1], strtof(argv[2], NULL));
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,38 @@
+/**
+ * @brief The example models from the mlrunner directory, made available
+ * together to the host programs.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * @details
+ * Each example header is meant to be the only one included in the firmware,
+ * so their symbols are renamed here to include both.
+ */
+#include "examplemodels.h"
+
+#define DEVICE_MLRUNNER_USE_EXAMPLE_MODEL 1
+#define example_model                   example_model1
+#define example_mlDataFilters           example_model1_filters
+#define example_mlDataFiltersLen        example_model1_filters_len
+#include "example_model1.h"
+#undef DEVICE_MLRUNNER_USE_EXAMPLE_MODEL
+#undef example_model
+#undef example_mlDataFilters
+#undef example_mlDataFiltersLen
+#undef ml4f_model_example_header_len
+#undef ml4f_model_example_size
+#undef ml4f_full_model_size
+
+#define DEVICE_MLRUNNER_USE_EXAMPLE_MODEL 2
+#define example_model                   example_model2
+#define example_mlDataFilters           example_model2_filters
+#define example_mlDataFiltersLen        example_model2_filters_len
+#include "example_model2.h"
+
+const ExampleModel_t example_models[] = {
+    {"example_model1", example_model1, sizeof(example_model1), example_model1_filters, example_model1_filters_len},
+    {"example_model2", example_model2, sizeof(example_model2), example_model2_filters, example_model2_filters_len},
+};
+const int example_models_len = sizeof(example_models) / sizeof(example_models[0]);
@@ -0,0 +1,32 @@
+/**
+ * @brief The example models from the mlrunner directory, made available
+ * together to the host programs.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+
+#include <stddef.h>
+#include "mldataprocessor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ExampleModel_s {
+    const char *name;
+    // Model with the ml_model_header_t, as used by ml_setModel()
+    const void *model;
+    size_t size;
+    const MlDataFilters_t *filters;
+    int filters_len;
+} ExampleModel_t;
+
+extern const ExampleModel_t example_models[];
+extern const int example_models_len;
+
+#ifdef __cplusplus
+}
+#endif
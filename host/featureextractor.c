@@ -0,0 +1,441 @@
+/**
+ * @brief Extract the features of the data processor from recording files,
+ * in parallel, into columnar feature files.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ */
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "featureextractor.h"
+#include "filterdataprocessor.h"
+#include "mldataprocessor.h"
+
+_Static_assert(sizeof(FeatureFileHeader_t) == 64, "The header layout is part of the file format");
+_Static_assert(sizeof(FeatureFileRow_t) == 12, "The row layout is part of the file format");
+
+// The accelerometer samples are int16 milli-g
+#define FEATURE_SAMPLE_SCALE    1000.0f
+#define FEATURE_MAX_DIMENSIONS  8
+// Samples converted per recordDataInt16() call
+#define FEATURE_CHUNK           16
+// Recordings a thread takes from its own queue at a time
+#define FEATURE_BATCH           16
+#define FEATURE_MAX_THREADS     256
+
+// In the output order of filterMlTrainer()
+static const char *feature_names[MLDP_ML_TRAINER_FEATURES] = {
+    "max", "mean", "min", "stddev", "peaks", "totalAcc", "zcr", "rms",
+};
+
+// The data processor configuration of testextension.cpp
+static const MlDataFilters_t ml_trainer_fused_filters[] = {
+    {MLDP_ML_TRAINER_FEATURES, filterMlTrainer, MLDP_FILTER_INTERLEAVED_OUTPUT, NULL},
+};
+
+// Recordings left in the queue of a thread, taken from the front by the
+// thread and from the back by the others
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t begin;
+    uint32_t end;
+} WorkQueue_t;
+
+typedef struct {
+    const MlRecording_t *recording;
+    const FeatureExtractorConfig_t *config;
+    MlDataProcessorConfig_t processor_config;
+    float sample_scale[FEATURE_MAX_DIMENSIONS];
+    uint32_t columns;
+    uint32_t rows;
+    const uint32_t *first_row;      // Per recording
+    FeatureFileRow_t *file_rows;
+    float *file_columns;
+    WorkQueue_t *queues;
+    int threads;
+} Extraction_t;
+
+typedef struct {
+    Extraction_t *extraction;
+    pthread_t thread;
+    int id;
+    uint32_t steals;
+    bool failed;
+} Worker_t;
+
+static bool isHeaderValid(const FeatureFileHeader_t *header) {
+    const uint64_t names_size = (uint64_t)header->columns * FEATURE_FILE_NAME_SIZE;
+    const uint64_t rows_size = (uint64_t)header->rows * sizeof(FeatureFileRow_t);
+    const uint64_t columns_size = (uint64_t)header->rows * header->columns * sizeof(float);
+    return header->magic == FEATURE_FILE_MAGIC &&
+           header->version == FEATURE_FILE_VERSION &&
+           header->header_size == sizeof(FeatureFileHeader_t) &&
+           header->names_offset % 4 == 0 && header->rows_offset % 4 == 0 && header->columns_offset % 4 == 0 &&
+           header->names_offset >= sizeof(FeatureFileHeader_t) &&
+           header->names_offset + names_size <= header->file_size &&
+           header->rows_offset + rows_size <= header->file_size &&
+           header->columns_offset + columns_size <= header->file_size;
+}
+
+static int16_t toInt16(const float value) {
+    const float scaled = value * FEATURE_SAMPLE_SCALE;
+    if (!(scaled > INT16_MIN)) {
+        return INT16_MIN;
+    }
+    if (scaled > INT16_MAX) {
+        return INT16_MAX;
+    }
+    return (int16_t)lrintf(scaled);
+}
+
+uint32_t featureExtractor_rows(const uint32_t samples, const uint32_t window, const uint32_t stride) {
+    if (samples < window || window == 0) {
+        return 0;
+    }
+    if (stride == 0) {
+        return 1;
+    }
+    // The first inference is when the window is full and stride samples have
+    // been recorded, then every multiple of stride samples
+    const uint32_t first = window > stride ? window : stride;
+    if (samples < first) {
+        return 0;
+    }
+    return 1 + samples / stride - first / stride;
+}
+
+// The int16 files with the accelerometer scale are recorded as they are,
+// the rest are converted to milli-g as the accelerometer samples
+static size_t readChunk(const MlRecording_t *recording, const uint32_t r, const uint32_t first, const size_t count,
+                        int16_t *out) {
+    const MlRecordingHeader_t *header = &recording->header;
+    if (header->sample_type == MLRECORDING_INT16 && header->sample_scale == FEATURE_SAMPLE_SCALE) {
+        return mlrecording_readSamplesInt16(recording, r, first, count, out);
+    }
+    float samples[FEATURE_CHUNK * FEATURE_MAX_DIMENSIONS];
+    const size_t len = mlrecording_readSamples(recording, r, first, count, samples);
+    for (size_t i = 0; i < len * header->dimensions; i++) {
+        out[i] = toInt16(samples[i]);
+    }
+    return len;
+}
+
+static void writeRow(Extraction_t *extraction, const uint32_t row, const FeatureFileRow_t *file_row,
+                     const float *features) {
+    extraction->file_rows[row] = *file_row;
+    for (uint32_t c = 0; c < extraction->columns; c++) {
+        extraction->file_columns[(size_t)c * extraction->rows + row] = features[c];
+    }
+}
+
+/**
+ * Record the samples of a recording, and write a row each time the device
+ * would run the model, as testextension.cpp does every
+ * mlSampleCountsPerInference samples.
+ */
+static bool extractRecording(Extraction_t *extraction, FilterDataProcessor_t *fdp, void *arena,
+                             const size_t arena_size, float *features, const uint32_t r) {
+    const MlRecordingEntry_t *entry = mlrecording_entry(extraction->recording, r);
+    const uint32_t dimensions = extraction->recording->header.dimensions;
+    const uint32_t stride = extraction->config->stride;
+    if (featureExtractor_rows(entry->samples, extraction->config->window, stride) == 0) {
+        return true;
+    }
+    if (filterDataProcessor_initArena(fdp, &extraction->processor_config, arena, arena_size) != MLDP_SUCCESS) {
+        return false;
+    }
+    uint32_t row = extraction->first_row[r];
+    uint32_t since_row = 0;
+    uint32_t sample = 0;
+    while (sample < entry->samples) {
+        // Up to the next row, one sample at a time while it waits for the
+        // window to be filled
+        uint32_t len = entry->samples - sample;
+        if (stride > 0) {
+            len = since_row < stride && stride - since_row < len ? stride - since_row : len;
+            len = since_row >= stride ? 1 : len;
+        }
+        len = len < FEATURE_CHUNK ? len : FEATURE_CHUNK;
+        int16_t samples[FEATURE_CHUNK * FEATURE_MAX_DIMENSIONS];
+        if (readChunk(extraction->recording, r, sample, len, samples) != len ||
+                filterDataProcessor_recordDataInt16(fdp, samples, (int)(len * dimensions)) != MLDP_SUCCESS) {
+            return false;
+        }
+        sample += len;
+        since_row += len;
+        const bool row_due = stride > 0 ? since_row >= stride : sample == entry->samples;
+        if (!row_due || !filterDataProcessor_isDataReady(fdp)) {
+            continue;
+        }
+        since_row = stride > 0 ? since_row % stride : 0;
+        // As runModel() in testextension.cpp gets the model input
+        if (filterDataProcessor_writeProcessedData(fdp, features, extraction->columns) != MLDP_SUCCESS) {
+            return false;
+        }
+        const FeatureFileRow_t file_row = {.recording = r, .end_sample = sample, .label = entry->label};
+        writeRow(extraction, row++, &file_row, features);
+    }
+    // The rows of each recording are placed before they are calculated
+    return row == extraction->first_row[r + 1];
+}
+
+// Take recordings from the front of the queue of the worker, or steal the
+// back half of the recordings left in the queue of another one
+static bool takeWork(Worker_t *worker, uint32_t *begin, uint32_t *end) {
+    Extraction_t *extraction = worker->extraction;
+    WorkQueue_t *own = &extraction->queues[worker->id];
+    pthread_mutex_lock(&own->lock);
+    *begin = own->begin;
+    *end = own->end - own->begin > FEATURE_BATCH ? own->begin + FEATURE_BATCH : own->end;
+    own->begin = *end;
+    pthread_mutex_unlock(&own->lock);
+    if (*begin < *end) {
+        return true;
+    }
+
+    for (int i = 1; i < extraction->threads; i++) {
+        WorkQueue_t *victim = &extraction->queues[(worker->id + i) % extraction->threads];
+        pthread_mutex_lock(&victim->lock);
+        const uint32_t left = victim->end - victim->begin;
+        const uint32_t middle = victim->end - (left + 1) / 2;
+        const uint32_t stolen_end = victim->end;
+        victim->end = middle;
+        pthread_mutex_unlock(&victim->lock);
+        if (left > 0) {
+            worker->steals++;
+            pthread_mutex_lock(&own->lock);
+            own->begin = middle;
+            own->end = stolen_end;
+            pthread_mutex_unlock(&own->lock);
+            return takeWork(worker, begin, end);
+        }
+    }
+    return false;
+}
+
+static void *runWorker(void *context) {
+    Worker_t *worker = (Worker_t *)context;
+    Extraction_t *extraction = worker->extraction;
+    const size_t arena_size = filterDataProcessor_getArenaSize(&extraction->processor_config);
+    FilterDataProcessor_t *fdp = filterDataProcessor_create();
+    void *arena = arena_size > 0 ? aligned_alloc(MLDP_ARENA_ALIGNMENT,
+        (arena_size + MLDP_ARENA_ALIGNMENT - 1) / MLDP_ARENA_ALIGNMENT * MLDP_ARENA_ALIGNMENT) : NULL;
+    float *features = (float *)malloc(extraction->columns * sizeof(float));
+    worker->failed = fdp == NULL || arena == NULL || features == NULL;
+
+    uint32_t begin, end;
+    while (!worker->failed && takeWork(worker, &begin, &end)) {
+        for (uint32_t r = begin; r < end && !worker->failed; r++) {
+            worker->failed = !extractRecording(extraction, fdp, arena, arena_size, features, r);
+        }
+    }
+    // The others finish the queue of a worker that failed, the result is
+    // discarded anyway
+    filterDataProcessor_destroy(fdp);
+    free(arena);
+    free(features);
+    return NULL;
+}
+
+static void writeHeader(FeatureFileHeader_t *header, const uint32_t columns, const uint32_t rows,
+                        const FeatureExtractorConfig_t *config) {
+    memset(header, 0, sizeof(*header));
+    header->magic = FEATURE_FILE_MAGIC;
+    header->version = FEATURE_FILE_VERSION;
+    header->header_size = sizeof(FeatureFileHeader_t);
+    header->columns = columns;
+    header->rows = rows;
+    header->window = config->window;
+    header->stride = config->stride;
+    header->names_offset = sizeof(FeatureFileHeader_t);
+    header->rows_offset = header->names_offset + (uint64_t)columns * FEATURE_FILE_NAME_SIZE;
+    header->columns_offset = header->rows_offset + (uint64_t)rows * sizeof(FeatureFileRow_t);
+    header->file_size = header->columns_offset + (uint64_t)rows * columns * sizeof(float);
+}
+
+static void writeColumnNames(char *names, const uint32_t dimensions) {
+    for (uint32_t f = 0; f < MLDP_ML_TRAINER_FEATURES; f++) {
+        for (uint32_t d = 0; d < dimensions; d++) {
+            char *name = names + (f * dimensions + d) * FEATURE_FILE_NAME_SIZE;
+            if (dimensions <= 3) {
+                snprintf(name, FEATURE_FILE_NAME_SIZE, "%s_%c", feature_names[f], (char)('x' + d));
+            } else {
+                snprintf(name, FEATURE_FILE_NAME_SIZE, "%s_%u", feature_names[f], (unsigned)d);
+            }
+        }
+    }
+}
+
+static bool runThreads(Extraction_t *extraction, FeatureExtractorStats_t *stats) {
+    const int threads = extraction->threads;
+    Worker_t *workers = (Worker_t *)calloc(threads, sizeof(Worker_t));
+    extraction->queues = (WorkQueue_t *)calloc(threads, sizeof(WorkQueue_t));
+    if (workers == NULL || extraction->queues == NULL) {
+        free(workers);
+        free(extraction->queues);
+        return false;
+    }
+    const uint32_t recordings = extraction->recording->header.recordings;
+    for (int t = 0; t < threads; t++) {
+        pthread_mutex_init(&extraction->queues[t].lock, NULL);
+        extraction->queues[t].begin = (uint32_t)((uint64_t)recordings * t / threads);
+        extraction->queues[t].end = (uint32_t)((uint64_t)recordings * (t + 1) / threads);
+        workers[t].extraction = extraction;
+        workers[t].id = t;
+    }
+    // The calling thread is the first worker
+    int started = 1;
+    for (; started < threads; started++) {
+        if (pthread_create(&workers[started].thread, NULL, runWorker, &workers[started]) != 0) {
+            break;
+        }
+    }
+    runWorker(&workers[0]);
+    // The queues of the threads that didn't start are taken by the others
+    for (int t = 1; t < started; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+    bool success = true;
+    for (int t = 0; t < threads; t++) {
+        success = success && !workers[t].failed;
+        stats->steals += workers[t].steals;
+        pthread_mutex_destroy(&extraction->queues[t].lock);
+    }
+    free(workers);
+    free(extraction->queues);
+    return success;
+}
+
+bool featureExtractor_run(
+    const MlRecording_t *recording, const FeatureExtractorConfig_t *config, const char *path,
+    FeatureExtractorStats_t *stats) {
+    FeatureExtractorStats_t local_stats;
+    stats = stats != NULL ? stats : &local_stats;
+    memset(stats, 0, sizeof(*stats));
+    const uint32_t dimensions = recording->header.dimensions;
+    if (dimensions == 0 || dimensions > FEATURE_MAX_DIMENSIONS || config->window == 0) {
+        return false;
+    }
+
+    Extraction_t extraction = {
+        .recording = recording,
+        .config = config,
+        .columns = MLDP_ML_TRAINER_FEATURES * dimensions,
+        .threads = config->threads < 1 ? 1 : config->threads > FEATURE_MAX_THREADS ? FEATURE_MAX_THREADS : config->threads,
+    };
+    for (uint32_t d = 0; d < dimensions; d++) {
+        extraction.sample_scale[d] = FEATURE_SAMPLE_SCALE;
+    }
+    const MlDataProcessorConfig_t processor_config = {
+        .samples = (int)config->window,
+        .dimensions = (int)dimensions,
+        .output_length = (int)extraction.columns,
+        .filter_size = 1,
+        .filters = ml_trainer_fused_filters,
+        .flags = MLDP_CONFIG_STREAMING_PEAKS | MLDP_CONFIG_INT16_SAMPLES,
+        .sample_scale = extraction.sample_scale,
+    };
+    memcpy(&extraction.processor_config, &processor_config, sizeof(processor_config));
+    if (filterDataProcessor_getArenaSize(&extraction.processor_config) == 0) {
+        return false;
+    }
+
+    // The rows of each recording are known before processing it, so the
+    // threads write them straight into their place in the file
+    uint32_t *first_row = (uint32_t *)malloc((recording->header.recordings + 1) * sizeof(uint32_t));
+    if (first_row == NULL) {
+        return false;
+    }
+    uint64_t rows = 0;
+    for (uint32_t r = 0; r < recording->header.recordings; r++) {
+        first_row[r] = (uint32_t)rows;
+        const uint32_t recording_rows = featureExtractor_rows(
+            mlrecording_entry(recording, r)->samples, config->window, config->stride);
+        stats->skipped += recording_rows == 0;
+        rows += recording_rows;
+    }
+    if (rows > UINT32_MAX) {
+        free(first_row);
+        return false;
+    }
+    first_row[recording->header.recordings] = (uint32_t)rows;
+    extraction.rows = (uint32_t)rows;
+    extraction.first_row = first_row;
+
+    FeatureFileHeader_t header;
+    writeHeader(&header, extraction.columns, extraction.rows, config);
+    const int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    void *data = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, (off_t)header.file_size) == 0) {
+        data = mmap(NULL, header.file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (data == MAP_FAILED) {
+        free(first_row);
+        return false;
+    }
+    uint8_t *bytes = (uint8_t *)data;
+    memcpy(bytes, &header, sizeof(header));
+    writeColumnNames((char *)(bytes + header.names_offset), dimensions);
+    extraction.file_rows = (FeatureFileRow_t *)(bytes + header.rows_offset);
+    extraction.file_columns = (float *)(bytes + header.columns_offset);
+
+    bool success = runThreads(&extraction, stats);
+    success = msync(data, header.file_size, MS_SYNC) == 0 && success;
+    munmap(data, header.file_size);
+    free(first_row);
+    stats->rows = extraction.rows;
+    return success;
+}
+
+bool featureFile_open(FeatureFile_t *file, const void *data, const size_t size) {
+    memset(file, 0, sizeof(*file));
+    if (data == NULL || ((uintptr_t)data % 4) != 0 || size < sizeof(FeatureFileHeader_t)) {
+        return false;
+    }
+    FeatureFileHeader_t header;
+    memcpy(&header, data, sizeof(header));
+    if (header.file_size > size || !isHeaderValid(&header)) {
+        return false;
+    }
+    // The column names must be null terminated
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (uint32_t c = 0; c < header.columns; c++) {
+        if (bytes[header.names_offset + (uint64_t)(c + 1) * FEATURE_FILE_NAME_SIZE - 1] != '\0') {
+            return false;
+        }
+    }
+    file->header = header;
+    file->data = bytes;
+    return true;
+}
+
+const char *featureFile_columnName(const FeatureFile_t *file, const uint32_t column) {
+    if (column >= file->header.columns) {
+        return NULL;
+    }
+    return (const char *)(file->data + file->header.names_offset + (uint64_t)column * FEATURE_FILE_NAME_SIZE);
+}
+
+const FeatureFileRow_t *featureFile_row(const FeatureFile_t *file, const uint32_t row) {
+    if (row >= file->header.rows) {
+        return NULL;
+    }
+    return (const FeatureFileRow_t *)(file->data + file->header.rows_offset) + row;
+}
+
+const float *featureFile_column(const FeatureFile_t *file, const uint32_t column) {
+    if (column >= file->header.columns) {
+        return NULL;
+    }
+    return (const float *)(file->data + file->header.columns_offset) + (uint64_t)column * file->header.rows;
+}
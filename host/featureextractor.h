@@ -0,0 +1,111 @@
+/**
+ * @brief Extract the features of the data processor from recording files,
+ * in parallel, into columnar feature files.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * @details
+ * The features are calculated with the data processor configuration of
+ * testextension.cpp (the fused ML-Trainer filter, with streaming peaks and
+ * the samples stored as int16 milli-g), so they are the same bytes the model
+ * gets on the device.
+ * Each recording is recorded into a data processor reset for it, so its
+ * features don't depend on the other recordings, or on the thread that
+ * processes it. The recordings are split between the threads, and the
+ * threads that run out of recordings steal half of the ones left to another
+ * thread.
+ *
+ * The feature file has a FeatureFileHeader_t, the names of the columns, a
+ * FeatureFileRow_t per row, and then the float values of each column, one
+ * column after the other, all little endian and 4 byte aligned.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mlrecording.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FEATURE_FILE_MAGIC      0x54464C4D  // "MLFT"
+#define FEATURE_FILE_VERSION    1
+#define FEATURE_FILE_NAME_SIZE  16
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t columns;           // Features per row
+    uint32_t rows;
+    uint32_t window;            // Samples per window
+    uint32_t stride;            // Samples between rows, 0 for one per recording
+    uint64_t names_offset;      // FEATURE_FILE_NAME_SIZE bytes per column
+    uint64_t rows_offset;       // FeatureFileRow_t per row
+    uint64_t columns_offset;    // rows floats per column
+    uint64_t file_size;
+    uint32_t reserved[2];
+} FeatureFileHeader_t;
+
+typedef struct {
+    uint32_t recording;         // Index of the recording in the recording file
+    uint32_t end_sample;        // Samples of the recording up to the end of the window
+    uint32_t label;             // Label of the recording, or MLRECORDING_NO_LABEL
+} FeatureFileRow_t;
+
+typedef struct {
+    uint32_t window;            // Samples per window, the model samples length
+    // Samples between rows, as the inferences on the device, or 0 for a row
+    // from the last window of each recording, as ML-Trainer does
+    uint32_t stride;
+    int threads;
+} FeatureExtractorConfig_t;
+
+typedef struct {
+    uint32_t rows;
+    uint32_t skipped;           // Recordings shorter than the window
+    uint32_t steals;            // Times a thread took recordings from another
+} FeatureExtractorStats_t;
+
+typedef struct {
+    FeatureFileHeader_t header;
+    const uint8_t *data;
+} FeatureFile_t;
+
+/**
+ * @brief Number of rows of a recording, the windows the device runs the
+ * model on when the inferences are stride samples apart.
+ */
+uint32_t featureExtractor_rows(const uint32_t samples, const uint32_t window, const uint32_t stride);
+
+/**
+ * @brief Extract the features of all the recordings into a feature file.
+ *
+ * @param stats Output of the rows written and the work stealing, can be NULL.
+ * @return False if the recordings can't be processed or the file can't be
+ *         written.
+ */
+bool featureExtractor_run(
+    const MlRecording_t *recording, const FeatureExtractorConfig_t *config, const char *path,
+    FeatureExtractorStats_t *stats);
+
+/**
+ * @brief Read a feature file in place, checking its header and sections.
+ *
+ * @param data The file contents, 4-byte aligned, e.g. from recordingFile_map().
+ * @return False if it isn't a valid feature file.
+ */
+bool featureFile_open(FeatureFile_t *file, const void *data, const size_t size);
+
+const char *featureFile_columnName(const FeatureFile_t *file, const uint32_t column);
+const FeatureFileRow_t *featureFile_row(const FeatureFile_t *file, const uint32_t row);
+// The rows values of a column
+const float *featureFile_column(const FeatureFile_t *file, const uint32_t column);
+
+#ifdef __cplusplus
+}
+#endif
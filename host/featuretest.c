@@ -0,0 +1,216 @@
+/**
+ * @brief Test the parallel feature extraction of featureextractor.c.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * Extracts the features of an ML-Trainer export with different numbers of
+ * threads, and checks every value has the same bytes as the ones the
+ * default data processor produces when it's fed one sample at a time and
+ * runs the inference loop of testextension.cpp. The feature files must be
+ * the same whatever the number of threads, and for the same samples stored
+ * as float or int16.
+ *
+ * Usage: featuretest <ML-Trainer export.json>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "featureextractor.h"
+#include "mldataprocessor.h"
+#include "mlrecording.h"
+#include "recordingfile.h"
+#include "trainerjson.h"
+#include "testcheck.h"
+
+#define TEST_FILE       "featuretest.mlfeat"
+#define TEST_DIMENSIONS 3
+#define TEST_FEATURES   (MLDP_ML_TRAINER_FEATURES * TEST_DIMENSIONS)
+#define TEST_WINDOW     42
+// Shorter than the inference period of the extension, for several rows per
+// recording
+#define TEST_STRIDE     4
+
+typedef struct {
+    void *data;
+    size_t size;
+} TestFile_t;
+
+static bool addRecording(const TrainerRecording_t *recording, void *context) {
+    RecordingWriter_t *writer = (RecordingWriter_t *)context;
+    const int label = recordingWriter_label(writer, recording->action);
+    return label >= 0 && recordingWriter_add(writer, label, recording->samples, recording->len, NULL, NULL);
+}
+
+static void *buildRecording(const char *path, const mlrecording_sample_type_t type, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    RecordingWriter_t writer;
+    recordingWriter_init(&writer, type, TEST_DIMENSIONS, 1000.0f, 20, 0, 0);
+    const bool read = file != NULL && trainerJson_read(file, addRecording, &writer, NULL, 0);
+    if (file != NULL) {
+        fclose(file);
+    }
+    void *data = read ? recordingWriter_build(&writer, size) : NULL;
+    recordingWriter_free(&writer);
+    return data;
+}
+
+// Extract the features and read the whole file back
+static bool extract(const MlRecording_t *recording, const uint32_t stride, const int threads, TestFile_t *out) {
+    const FeatureExtractorConfig_t config = {.window = TEST_WINDOW, .stride = stride, .threads = threads};
+    out->data = NULL;
+    if (!featureExtractor_run(recording, &config, TEST_FILE, NULL)) {
+        return false;
+    }
+    size_t size;
+    const void *mapped = recordingFile_map(TEST_FILE, &size);
+    out->data = mapped != NULL ? malloc(size) : NULL;
+    if (out->data != NULL) {
+        memcpy(out->data, mapped, size);
+        out->size = size;
+    }
+    recordingFile_unmap(mapped, size);
+    return out->data != NULL;
+}
+
+/**
+ * The rows of each recording with the default data processor, one sample at
+ * a time, as testextension.cpp records and runs the model.
+ * Returns the failures, and the rows checked in rows.
+ */
+static int checkReference(const MlRecording_t *recording, const FeatureFile_t *file, const uint32_t stride,
+                          uint32_t *rows) {
+    static const MlDataFilters_t filters[] = {
+        {MLDP_ML_TRAINER_FEATURES, filterMlTrainer, MLDP_FILTER_INTERLEAVED_OUTPUT, NULL},
+    };
+    static const float scale[TEST_DIMENSIONS] = {1000.0f, 1000.0f, 1000.0f};
+    const MlDataProcessorConfig_t config = {
+        .samples = TEST_WINDOW,
+        .dimensions = TEST_DIMENSIONS,
+        .output_length = TEST_FEATURES,
+        .filter_size = 1,
+        .filters = filters,
+        .flags = MLDP_CONFIG_STREAMING_PEAKS | MLDP_CONFIG_INT16_SAMPLES,
+        .sample_scale = scale,
+    };
+    int failures = 0;
+    *rows = 0;
+    for (uint32_t r = 0; r < recording->header.recordings; r++) {
+        const MlRecordingEntry_t *entry = mlrecording_entry(recording, r);
+        if (mlDataProcessor.init(&config) != MLDP_SUCCESS) {
+            return failures + 1;
+        }
+        uint32_t samples_since_inference = 0;
+        for (uint32_t s = 0; s < entry->samples; s++) {
+            int16_t sample[TEST_DIMENSIONS];
+            mlrecording_readSamplesInt16(recording, r, s, 1, sample);
+            mlDataProcessor.recordDataInt16(sample, TEST_DIMENSIONS);
+            samples_since_inference++;
+            const bool due = stride > 0 ? samples_since_inference >= stride : s + 1 == entry->samples;
+            if (!due || !mlDataProcessor.isDataReady()) {
+                continue;
+            }
+            samples_since_inference = stride > 0 ? samples_since_inference % stride : 0;
+            float features[TEST_FEATURES];
+            mlDataProcessor.writeProcessedData(features, TEST_FEATURES);
+
+            const FeatureFileRow_t *row = featureFile_row(file, *rows);
+            if (row == NULL || row->recording != r || row->end_sample != s + 1 || row->label != entry->label) {
+                printf("FAIL: row %u of recording %u at sample %u\n", (unsigned)*rows, (unsigned)r, (unsigned)s + 1);
+                mlDataProcessor.deinit();
+                return failures + 1;
+            }
+            for (uint32_t c = 0; c < TEST_FEATURES; c++) {
+                const float value = featureFile_column(file, c)[*rows];
+                if (memcmp(&value, &features[c], sizeof(float)) != 0) {
+                    printf("FAIL: row %u %s is %.9g instead of %.9g\n", (unsigned)*rows,
+                           featureFile_columnName(file, c), value, features[c]);
+                    failures++;
+                }
+            }
+            (*rows)++;
+        }
+        mlDataProcessor.deinit();
+    }
+    return failures;
+}
+
+static int testExtraction(const MlRecording_t *recording, const MlRecording_t *float_recording, const uint32_t stride) {
+    int failures = 0;
+    TestFile_t single, multi, other, from_float;
+    failures += check("extract 1 thread", extract(recording, stride, 1, &single));
+    failures += check("extract 4 threads", extract(recording, stride, 4, &multi));
+    failures += check("extract 3 threads", extract(recording, stride, 3, &other));
+    failures += check("extract float", extract(float_recording, stride, 4, &from_float));
+    if (failures == 0) {
+        failures += check("same file with 4 threads", multi.size == single.size &&
+                          memcmp(multi.data, single.data, single.size) == 0);
+        failures += check("same file with 3 threads", other.size == single.size &&
+                          memcmp(other.data, single.data, single.size) == 0);
+        failures += check("same file from float", from_float.size == single.size &&
+                          memcmp(from_float.data, single.data, single.size) == 0);
+
+        FeatureFile_t file;
+        uint32_t rows = 0;
+        const bool opened = featureFile_open(&file, single.data, single.size);
+        failures += check("open feature file", opened);
+        if (opened) {
+            failures += check("columns", file.header.columns == TEST_FEATURES &&
+                              strcmp(featureFile_columnName(&file, 0), "max_x") == 0 &&
+                              strcmp(featureFile_columnName(&file, TEST_FEATURES - 1), "rms_z") == 0);
+            failures += checkReference(recording, &file, stride, &rows);
+            failures += check("all rows checked", rows == file.header.rows && rows > 0);
+
+            // Invalid files
+            failures += check("truncated file", !featureFile_open(&file, single.data, single.size - 1));
+            ((FeatureFileHeader_t *)single.data)->magic++;
+            failures += check("invalid magic", !featureFile_open(&file, single.data, single.size));
+        }
+        printf("Stride %u: %u rows %s\n", (unsigned)stride, (unsigned)rows, failures ? "FAIL" : "PASS");
+    }
+    free(single.data);
+    free(multi.data);
+    free(other.data);
+    free(from_float.data);
+    return failures;
+}
+
+static int testRows() {
+    int failures = 0;
+    failures += check("rows shorter than the window", featureExtractor_rows(41, 42, 0) == 0 &&
+                      featureExtractor_rows(41, 42, 12) == 0);
+    failures += check("rows per recording", featureExtractor_rows(42, 42, 0) == 1 &&
+                      featureExtractor_rows(100, 42, 0) == 1);
+    // At the full window, then at each multiple of the stride
+    failures += check("rows with a stride", featureExtractor_rows(42, 42, 12) == 1 &&
+                      featureExtractor_rows(47, 42, 12) == 1 && featureExtractor_rows(48, 42, 12) == 2 &&
+                      featureExtractor_rows(60, 42, 12) == 3);
+    failures += check("rows with a long stride", featureExtractor_rows(49, 42, 50) == 0 &&
+                      featureExtractor_rows(50, 42, 50) == 1 && featureExtractor_rows(100, 42, 50) == 2);
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        printf("Usage: %s <ML-Trainer export.json>\n", argv[0]);
+        return 1;
+    }
+    int failures = testRows();
+    size_t size, float_size;
+    void *data = buildRecording(argv[1], MLRECORDING_INT16, &size);
+    void *float_data = buildRecording(argv[1], MLRECORDING_FLOAT32, &float_size);
+    MlRecording_t recording, float_recording;
+    if (!check("read the export", data != NULL && mlrecording_open(&recording, data, size) &&
+               float_data != NULL && mlrecording_open(&float_recording, float_data, float_size))) {
+        failures += testExtraction(&recording, &float_recording, 0);
+        failures += testExtraction(&recording, &float_recording, TEST_STRIDE);
+    } else {
+        failures++;
+    }
+    free(data);
+    free(float_data);
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
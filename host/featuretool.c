@@ -0,0 +1,175 @@
+/**
+ * @brief Extract the features the device calculates from a recording file,
+ * with a thread per core, into a columnar feature file.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * The window is the samples length of the model given with --model, or
+ * --window. By default there's a row per recording, from its last window,
+ * --stride adds a row every stride samples, as the inferences on the device.
+ * --scaling repeats the extraction with 1, 2, 4... threads up to --threads,
+ * and prints the throughput of each one.
+ *
+ * Usage: mlrunner_features [options] <recording.mlrec> <output.mlfeat>
+ *        mlrunner_features info <features.mlfeat>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "featureextractor.h"
+#include "mldataprocessor.h"
+#include "mlrecording.h"
+#include "mlrunner.h"
+#include "modelloader.h"
+#include "recordingfile.h"
+
+static void printUsage(const char *name) {
+    printf("Usage: %s [options] <recording.mlrec> <output.mlfeat>\n", name);
+    printf("       %s info <features.mlfeat>\n", name);
+    printf("  --model <autogenerated.ts>  Use the samples length of the model as the window\n");
+    printf("  --window <samples>          Samples per window, without a model\n");
+    printf("  --stride <samples>          Add a row every stride samples, instead of one per recording\n");
+    printf("  --threads <count>           Threads to use, one per core by default\n");
+    printf("  --scaling                   Time 1, 2, 4... threads up to --threads\n");
+}
+
+static double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// The window of the model, which also has to take the features extracted
+static uint32_t modelWindow(const char *path, const uint32_t dimensions) {
+    size_t size;
+    void *model = modelLoader_load(path, &size);
+    uint32_t window = 0;
+    if (model != NULL && ml_setModel(model)) {
+        if ((uint32_t)ml_getSampleDimensions() == dimensions &&
+                (uint32_t)ml_getInputLength() == MLDP_ML_TRAINER_FEATURES * dimensions) {
+            window = (uint32_t)ml_getSamplesLength();
+        }
+        ml_removeModels();
+    }
+    free(model);
+    return window;
+}
+
+static int extract(const MlRecording_t *recording, FeatureExtractorConfig_t *config, const bool scaling,
+                   const char *output) {
+    const int max_threads = config->threads;
+    double single_thread = 0.0;
+    // Doubling the threads, the last count is always max_threads
+    for (int threads = scaling ? 1 : max_threads;; threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+        config->threads = threads;
+        FeatureExtractorStats_t stats;
+        const double start = nowSeconds();
+        if (!featureExtractor_run(recording, config, output, &stats)) {
+            printf("Can't extract the features to %s\n", output);
+            return 1;
+        }
+        const double seconds = nowSeconds() - start;
+        single_thread = threads == 1 ? seconds : single_thread;
+        printf("%s: %u rows of %u features, %u recordings shorter than the window\n", output,
+               (unsigned)stats.rows, (unsigned)MLDP_ML_TRAINER_FEATURES * recording->header.dimensions,
+               (unsigned)stats.skipped);
+        printf("  %d threads, %u steals: %.3f s, %.0f recordings/s, %.0f samples/s", threads,
+               (unsigned)stats.steals, seconds, recording->header.recordings / seconds,
+               recording->header.total_samples / seconds);
+        if (single_thread > 0.0 && threads > 1) {
+            printf(", %.2fx", single_thread / seconds);
+        }
+        printf("\n");
+        if (threads == max_threads) {
+            break;
+        }
+    }
+    return 0;
+}
+
+static int info(const char *path) {
+    size_t size;
+    const void *data = recordingFile_map(path, &size);
+    FeatureFile_t file;
+    if (data == NULL || !featureFile_open(&file, data, size)) {
+        printf("%s: not a valid feature file\n", path);
+        recordingFile_unmap(data, size);
+        return 1;
+    }
+    const FeatureFileHeader_t *header = &file.header;
+    printf("%s: version %u, %llu bytes\n", path, header->version, (unsigned long long)header->file_size);
+    printf("  %u rows of %u features, window of %u samples, ", (unsigned)header->rows,
+           (unsigned)header->columns, (unsigned)header->window);
+    if (header->stride > 0) {
+        printf("a row every %u samples\n", (unsigned)header->stride);
+    } else {
+        printf("a row per recording\n");
+    }
+    // The range of each column
+    for (uint32_t c = 0; c < header->columns; c++) {
+        const float *column = featureFile_column(&file, c);
+        float min = 0.0f, max = 0.0f;
+        for (uint32_t row = 0; row < header->rows; row++) {
+            min = row == 0 || column[row] < min ? column[row] : min;
+            max = row == 0 || column[row] > max ? column[row] : max;
+        }
+        printf("  %-16s %12g to %g\n", featureFile_columnName(&file, c), min, max);
+    }
+    recordingFile_unmap(data, size);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 3 && strcmp(argv[1], "info") == 0) {
+        return info(argv[2]);
+    }
+    FeatureExtractorConfig_t config = {
+        .threads = (int)sysconf(_SC_NPROCESSORS_ONLN),
+    };
+    const char *model_path = NULL;
+    bool scaling = false;
+    int arg = 1;
+    for (; arg < argc - 2; arg++) {
+        if (strcmp(argv[arg], "--model") == 0 && arg + 1 < argc - 2) {
+            model_path = argv[++arg];
+        } else if (strcmp(argv[arg], "--window") == 0 && arg + 1 < argc - 2) {
+            config.window = (uint32_t)strtoul(argv[++arg], NULL, 10);
+        } else if (strcmp(argv[arg], "--stride") == 0 && arg + 1 < argc - 2) {
+            config.stride = (uint32_t)strtoul(argv[++arg], NULL, 10);
+        } else if (strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc - 2) {
+            config.threads = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "--scaling") == 0) {
+            scaling = true;
+        } else {
+            break;
+        }
+    }
+    if (arg != argc - 2 || (model_path == NULL) == (config.window == 0) || config.threads < 1) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    size_t size;
+    const void *data = recordingFile_map(argv[argc - 2], &size);
+    MlRecording_t recording;
+    if (data == NULL || !mlrecording_open(&recording, data, size)) {
+        printf("%s: not a valid recording file\n", argv[argc - 2]);
+        recordingFile_unmap(data, size);
+        return 1;
+    }
+    int result = 1;
+    if (model_path != NULL) {
+        config.window = modelWindow(model_path, recording.header.dimensions);
+    }
+    if (config.window == 0) {
+        printf("%s: the model doesn't take the features of the recordings\n", model_path);
+    } else {
+        result = extract(&recording, &config, scaling, argv[argc - 1]);
+    }
+    recordingFile_unmap(data, size);
+    return result;
+}
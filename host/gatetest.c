@@ -0,0 +1,175 @@
+/**
+ * @brief Test the activity gate of the filter data processor.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * Records idle and active accelerometer-like signals, and checks isIdle()
+ * only reports the window as idle when the last processed window and all
+ * the samples since stay within the threshold, with the float and int16
+ * storage, one sample or a batch at a time, and with snapshots.
+ */
+#include <math.h>
+#include <stdio.h>
+#include "mldataprocessor.h"
+#include "filterdataprocessor.h"
+#include "testcheck.h"
+
+#define WINDOW      40
+#define DIMENSIONS  3
+#define THRESHOLD   0.05f
+
+static const MlDataFilters_t filters[] = {
+    {MLDP_ML_TRAINER_FEATURES, filterMlTrainer, MLDP_FILTER_INTERLEAVED_OUTPUT, NULL},
+};
+static const float scales[DIMENSIONS] = {1000.0f, 1000.0f, 1000.0f};
+
+typedef struct {
+    const char *name;
+    int flags;
+    int batch;
+} GateConfig_t;
+
+static const GateConfig_t configs[] = {
+    {"float", MLDP_CONFIG_ACTIVITY_GATE, 1},
+    {"float batches", MLDP_CONFIG_ACTIVITY_GATE, 8},
+    {"int16", MLDP_CONFIG_ACTIVITY_GATE | MLDP_CONFIG_INT16_SAMPLES, 1},
+    {"streaming", MLDP_CONFIG_ACTIVITY_GATE | MLDP_CONFIG_STREAMING_PEAKS, 5},
+    {"snapshots", MLDP_CONFIG_ACTIVITY_GATE | MLDP_CONFIG_DOUBLE_BUFFER, 4},
+};
+
+static FilterDataProcessor_t *createProcessor(const int flags) {
+    const MlDataProcessorConfig_t config = {
+        .samples = WINDOW,
+        .dimensions = DIMENSIONS,
+        .output_length = MLDP_ML_TRAINER_FEATURES * DIMENSIONS,
+        .filter_size = 1,
+        .filters = filters,
+        .flags = flags,
+        .sample_scale = scales,
+        .activity_threshold = THRESHOLD,
+    };
+    FilterDataProcessor_t *fdp = filterDataProcessor_create();
+    if (fdp != NULL && filterDataProcessor_init(fdp, &config) != MLDP_SUCCESS) {
+        filterDataProcessor_destroy(fdp);
+        return NULL;
+    }
+    return fdp;
+}
+
+/**
+ * Record samples from a signal: lying flat with noise (within the threshold),
+ * with a spike at spike_at, and drifting by drift per sample.
+ */
+static void record(FilterDataProcessor_t *fdp, const GateConfig_t *config, int *time, const int samples,
+                   const int spike_at, const float drift) {
+    float values[8 * DIMENSIONS];
+    int queued = 0;
+    for (int i = 0; i < samples; i++, (*time)++) {
+        const float noise = ((*time * 7) % 5) * 0.004f;
+        const float spike = (*time == spike_at) ? 0.5f : 0.0f;
+        values[queued * DIMENSIONS + 0] = 0.012f + noise + spike + drift * *time;
+        values[queued * DIMENSIONS + 1] = -0.02f - noise;
+        values[queued * DIMENSIONS + 2] = -1.024f + noise;
+        if (++queued == config->batch || i == samples - 1) {
+            filterDataProcessor_recordData(fdp, values, queued * DIMENSIONS);
+            queued = 0;
+        }
+    }
+}
+
+// Process the window like an inference, with a snapshot if configured
+static bool process(FilterDataProcessor_t *fdp, const GateConfig_t *config, int *time, float *out) {
+    const bool snapshot = config->flags & MLDP_CONFIG_DOUBLE_BUFFER;
+    if (snapshot && filterDataProcessor_snapshot(fdp) != MLDP_SUCCESS) {
+        return false;
+    }
+    // Samples recorded while the snapshot is processed
+    if (snapshot) {
+        record(fdp, config, time, 3, -1, 0.0f);
+    }
+    const float *data = filterDataProcessor_getProcessedData(fdp);
+    if (snapshot) {
+        filterDataProcessor_commit(fdp);
+    }
+    if (data != NULL && out != NULL) {
+        for (int i = 0; i < MLDP_ML_TRAINER_FEATURES * DIMENSIONS; i++) {
+            out[i] = data[i];
+        }
+    }
+    return data != NULL;
+}
+
+static int testConfig(const GateConfig_t *config) {
+    FilterDataProcessor_t *fdp = createProcessor(config->flags);
+    if (fdp == NULL) {
+        printf("%s: FAIL, the processor could not be initialised\n", config->name);
+        return 1;
+    }
+    float first[MLDP_ML_TRAINER_FEATURES * DIMENSIONS], later[MLDP_ML_TRAINER_FEATURES * DIMENSIONS];
+    int failures = 0;
+    int time = 0;
+
+    // Nothing has been processed yet
+    record(fdp, config, &time, WINDOW, -1, 0.0f);
+    failures += check("not processed", !filterDataProcessor_isIdle(fdp));
+    failures += check("process idle", process(fdp, config, &time, first));
+    record(fdp, config, &time, 10, -1, 0.0f);
+    failures += check("idle", filterDataProcessor_isIdle(fdp));
+
+    // Skipping is safe, the features of an idle window barely change
+    failures += check("process idle again", process(fdp, config, &time, later));
+    for (int i = 0; i < MLDP_ML_TRAINER_FEATURES * DIMENSIONS; i++) {
+        // Peaks (feature 4) and zero crossings (feature 6) are counts
+        const int feature = i / DIMENSIONS;
+        const float tolerance = (feature == 4 || feature == 6) ? 2.0f : THRESHOLD * WINDOW;
+        failures += check("features", fabsf(first[i] - later[i]) <= tolerance);
+    }
+
+    // A spike in the new samples wakes it up
+    record(fdp, config, &time, 10, time + 5, 0.0f);
+    failures += check("spike", !filterDataProcessor_isIdle(fdp));
+    // The window with the spike is processed, it's not idle until a window
+    // without it is processed
+    failures += check("process spike", process(fdp, config, &time, NULL));
+    record(fdp, config, &time, 10, -1, 0.0f);
+    failures += check("after spike", !filterDataProcessor_isIdle(fdp));
+    record(fdp, config, &time, WINDOW, -1, 0.0f);
+    failures += check("still after spike", !filterDataProcessor_isIdle(fdp));
+    failures += check("process after spike", process(fdp, config, &time, NULL));
+    record(fdp, config, &time, 1, -1, 0.0f);
+    failures += check("idle after spike", filterDataProcessor_isIdle(fdp));
+
+    // A slow drift, each step within the threshold, is not idle either
+    record(fdp, config, &time, WINDOW, -1, 0.004f);
+    failures += check("drift", !filterDataProcessor_isIdle(fdp));
+
+    filterDataProcessor_destroy(fdp);
+    printf("%s: %s\n", config->name, failures ? "FAIL" : "PASS");
+    return failures;
+}
+
+static int testDisabled() {
+    const GateConfig_t config = {"disabled", MLDP_CONFIG_NONE, 1};
+    FilterDataProcessor_t *fdp = createProcessor(config.flags);
+    int failures = 0;
+    int time = 0;
+    record(fdp, &config, &time, WINDOW, -1, 0.0f);
+    failures += check("process", process(fdp, &config, &time, NULL));
+    record(fdp, &config, &time, 5, -1, 0.0f);
+    failures += check("never idle", !filterDataProcessor_isIdle(fdp));
+    filterDataProcessor_destroy(fdp);
+    printf("%s: %s\n", config.name, failures ? "FAIL" : "PASS");
+    return failures;
+}
+
+int main() {
+    int failures = 0;
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+        failures += testConfig(&configs[c]);
+    }
+    failures += testDisabled();
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
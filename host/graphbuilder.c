@@ -0,0 +1,449 @@
+/**
+ * @brief Build layer graph models in memory.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ */
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "graphbuilder.h"
+#include "mlkernels.h"
+#include "mlrunner.h"
+
+// Offset of the actions in the ml_model_header_t
+#define MODEL_HEADER_ACTIONS_OFFSET 20
+
+/*****************************************************************************/
+/* Private API                                                               */
+/*****************************************************************************/
+/**
+ * @return The index of the weights copy in the builder, or 0 for none.
+ * Index 0 is never used by real weights, as the first one is reserved.
+ */
+static uint32_t addWeights(GraphBuilder_t *builder, const float *values, const uint32_t len) {
+    if (values == NULL || len == 0) {
+        return 0;
+    }
+    float *weights = (float *)realloc(builder->weights, (builder->weights_len + len) * sizeof(float));
+    if (weights == NULL) {
+        builder->error = 1;
+        return 0;
+    }
+    const uint32_t index = builder->weights_len;
+    memcpy(&weights[index], values, len * sizeof(float));
+    builder->weights = weights;
+    builder->weights_len += len;
+    return index;
+}
+
+static mlgraph_layer_t *addLayer(
+    GraphBuilder_t *builder, const mlgraph_layer_type_t type, const uint32_t out_length, const uint32_t out_channels
+) {
+    if (builder->num_layers >= GRAPH_BUILDER_MAX_LAYERS || out_length == 0 || out_channels == 0) {
+        builder->error = 1;
+        return NULL;
+    }
+    const uint8_t out_buffer = type == MLGRAPH_LAYER_ACTIVATION ? builder->buffer : !builder->buffer;
+    mlgraph_layer_t *layer = &builder->layers[builder->num_layers];
+    memset(layer, 0, sizeof(*layer));
+    layer->type = type;
+    layer->in_length = builder->length;
+    layer->in_channels = builder->channels;
+    layer->out_length = out_length;
+    layer->out_channels = out_channels;
+    builder->layer_buffer[builder->num_layers++] = out_buffer;
+
+    builder->length = out_length;
+    builder->channels = out_channels;
+    builder->buffer = out_buffer;
+    if (out_length * out_channels > builder->max_elements) {
+        builder->max_elements = out_length * out_channels;
+    }
+    return layer;
+}
+
+static uint32_t windowedLength(const uint32_t in_length, const uint32_t size, const uint32_t stride, const uint32_t padding) {
+    // The same padding is applied after the input
+    if (stride == 0 || in_length + 2 * padding < size) {
+        return 0;
+    }
+    return (in_length + 2 * padding - size) / stride + 1;
+}
+
+static void addPool(
+    GraphBuilder_t *builder, const mlgraph_layer_type_t type,
+    const uint32_t pool_size, const uint32_t stride, const uint32_t padding
+) {
+    mlgraph_layer_t *layer = addLayer(
+        builder, type, windowedLength(builder->length, pool_size, stride, padding), builder->channels);
+    if (layer != NULL) {
+        layer->kernel_size = pool_size;
+        layer->stride = stride;
+        layer->padding = padding;
+    }
+}
+
+typedef struct ModelInfo_s {
+    uint16_t samples_period;
+    uint16_t samples_length;
+    uint8_t sample_dimensions;
+    const char **labels;
+    uint8_t num_labels;
+} ModelInfo_t;
+
+static uint32_t weightsLen(const mlgraph_layer_t *layer) {
+    switch (layer->type) {
+        case MLGRAPH_LAYER_DENSE:
+            return layer->out_channels * layer->in_channels;
+        case MLGRAPH_LAYER_CONV1D:
+            return layer->out_channels * layer->kernel_size * layer->in_channels;
+        default:
+            return 0;
+    }
+}
+
+static inline size_t align4(const size_t value) {
+    return (value + 3) & ~(size_t)3;
+}
+
+/**
+ * @brief Symmetric quantization of the weights, so the zero point is 0.
+ */
+static float weightsScale(const float *weights, const uint32_t len) {
+    float max = 0.0f;
+    for (uint32_t i = 0; i < len; i++) {
+        max = fmaxf(max, fabsf(weights[i]));
+    }
+    return max > 0.0f ? max / 127.0f : 1.0f;
+}
+
+/**
+ * @brief Quantization covering the range [min, max], which always includes
+ * 0 so that it's exactly representable (it's the conv1d padding).
+ */
+static void rangeQuantization(float min, float max, float *scale, int32_t *zero_point) {
+    min = fminf(min, 0.0f);
+    max = fmaxf(max, 0.0f);
+    if (max - min < 1e-6f) {
+        max = min + 1e-6f;
+    }
+    *scale = (max - min) / 255.0f;
+    *zero_point = mlk_saturate(-128.0f - min / *scale, INT8_MIN, INT8_MAX);
+}
+
+/**
+ * @brief Write the ml_model_header_t, the graph header, the layers and then
+ * the weights and bias of each layer, as float or quantized to int8.
+ */
+static void *emitModel(
+    const GraphBuilder_t *builder, const mlgraph_layer_t *layers, const uint8_t *buffers,
+    const uint32_t num_layers, const uint32_t data_type, const ModelInfo_t *info, size_t *size
+) {
+    const bool int8 = data_type == MLGRAPH_TYPE_INT8;
+    const size_t element_size = int8 ? sizeof(int8_t) : sizeof(float);
+
+    // The ml_model_header_t, with each action padded to 4 bytes
+    size_t header_size = MODEL_HEADER_ACTIONS_OFFSET;
+    for (int i = 0; i < info->num_labels; i++) {
+        header_size += align4(ml_action_size_without_label + strlen(info->labels[i]) + 1);
+    }
+    const size_t graph_header_size = sizeof(mlgraph_header_t);
+    const size_t weights_start = graph_header_size + num_layers * sizeof(mlgraph_layer_t);
+    size_t object_size = weights_start;
+    for (uint32_t i = 0; i < num_layers; i++) {
+        object_size += align4(weightsLen(&layers[i]) * element_size);
+        object_size += layers[i].bias_offset ? layers[i].out_channels * sizeof(int32_t) : 0;
+    }
+    *size = header_size + object_size;
+    uint8_t *model = (uint8_t *)calloc(1, *size);
+    if (model == NULL) {
+        return NULL;
+    }
+
+    const uint32_t magic = MODEL_HEADER_MAGIC0;
+    const uint16_t header_size16 = (uint16_t)header_size;
+    memcpy(&model[0], &magic, 4);
+    memcpy(&model[4], &header_size16, 2);
+    memcpy(&model[6], &info->samples_period, 2);
+    memcpy(&model[8], &info->samples_length, 2);
+    model[10] = info->sample_dimensions;
+    model[11 + ML_MODEL_FORMAT_INDEX] = ML_MODEL_FORMAT_GRAPH;
+    model[19] = info->num_labels;
+    size_t offset = MODEL_HEADER_ACTIONS_OFFSET;
+    for (int i = 0; i < info->num_labels; i++) {
+        const float threshold = 0.5f;
+        const size_t label_length = strlen(info->labels[i]) + 1;
+        memcpy(&model[offset], &threshold, 4);
+        model[offset + 4] = (uint8_t)label_length;
+        memcpy(&model[offset + ml_action_size_without_label], info->labels[i], label_length);
+        offset += align4(ml_action_size_without_label + label_length);
+    }
+
+    // The arena is split in two halves of the largest tensor
+    const uint32_t half_bytes = align4(builder->max_elements * element_size);
+    uint8_t *graph = &model[header_size];
+    const mlgraph_header_t graph_header = {
+        .magic0 = MLGRAPH_MAGIC0,
+        .header_size = graph_header_size,
+        .object_size = object_size,
+        .arena_bytes = 2 * half_bytes,
+        .input_offset = 0,
+        .input_length = builder->input_elements,
+        .output_offset = buffers[num_layers - 1] * half_bytes,
+        .output_length = builder->length * builder->channels,
+        .num_layers = num_layers,
+        .data_type = data_type,
+    };
+    memcpy(graph, &graph_header, sizeof(graph_header));
+
+    uint8_t in_buffer = 0;
+    size_t weights_offset = weights_start;
+    for (uint32_t i = 0; i < num_layers; i++) {
+        mlgraph_layer_t layer = layers[i];
+        layer.input_offset = in_buffer * half_bytes;
+        layer.output_offset = buffers[i] * half_bytes;
+        in_buffer = buffers[i];
+
+        const uint32_t len = weightsLen(&layer);
+        if (len != 0) {
+            const float *weights = &builder->weights[layers[i].weights_offset];
+            if (int8) {
+                layer.weights_scale = weightsScale(weights, len);
+                for (uint32_t w = 0; w < len; w++) {
+                    graph[weights_offset + w] = (uint8_t)mlk_saturate(
+                        weights[w] / layer.weights_scale, INT8_MIN, INT8_MAX);
+                }
+            } else {
+                memcpy(&graph[weights_offset], weights, len * sizeof(float));
+            }
+            layer.weights_offset = weights_offset;
+            weights_offset += align4(len * element_size);
+        }
+        if (layer.bias_offset != 0) {
+            const float *bias = &builder->weights[layers[i].bias_offset];
+            for (uint32_t b = 0; b < layer.out_channels; b++) {
+                if (int8) {
+                    const int32_t value = mlk_saturate(
+                        bias[b] / (layer.input_scale * layer.weights_scale), INT32_MIN, INT32_MAX);
+                    memcpy(&graph[weights_offset + b * 4], &value, 4);
+                } else {
+                    memcpy(&graph[weights_offset + b * 4], &bias[b], 4);
+                }
+            }
+            layer.bias_offset = weights_offset;
+            weights_offset += layer.out_channels * sizeof(int32_t);
+        }
+        memcpy(&graph[graph_header_size + i * sizeof(mlgraph_layer_t)], &layer, sizeof(layer));
+    }
+
+    return model;
+}
+
+/**
+ * @brief Copy the layers, moving any activation other than ReLU fused in a
+ * dense or conv1d layer to an in-place activation layer.
+ *
+ * @return The number of layers.
+ */
+static uint32_t splitActivations(const GraphBuilder_t *builder, mlgraph_layer_t *layers, uint8_t *buffers) {
+    uint32_t len = 0;
+    for (uint32_t i = 0; i < builder->num_layers; i++) {
+        layers[len] = builder->layers[i];
+        buffers[len] = builder->layer_buffer[i];
+        const mlgraph_layer_t *layer = &layers[len++];
+        if (layer->type == MLGRAPH_LAYER_ACTIVATION || layer->activation <= MLGRAPH_ACTIVATION_RELU) {
+            continue;
+        }
+        mlgraph_layer_t *activation = &layers[len];
+        memset(activation, 0, sizeof(*activation));
+        activation->type = MLGRAPH_LAYER_ACTIVATION;
+        activation->activation = layer->activation;
+        activation->in_length = activation->out_length = layer->out_length;
+        activation->in_channels = activation->out_channels = layer->out_channels;
+        layers[len - 1].activation = MLGRAPH_ACTIVATION_NONE;
+        buffers[len] = buffers[len - 1];
+        len++;
+    }
+    return len;
+}
+
+/**
+ * @brief Run the float model on the calibration inputs, and set the
+ * quantization of each layer from the range of its input and output.
+ */
+static bool calibrate(
+    const GraphBuilder_t *builder, mlgraph_layer_t *layers, const uint8_t *buffers,
+    const uint32_t num_layers, const ModelInfo_t *info
+) {
+    size_t size;
+    uint8_t *model = (uint8_t *)emitModel(builder, layers, buffers, num_layers, MLGRAPH_TYPE_FLOAT32, info, &size);
+    if (model == NULL || builder->calibration_len == 0) {
+        free(model);
+        return false;
+    }
+    const mlgraph_header_t *graph = (const mlgraph_header_t *)&model[((const ml_model_header_t *)model)->header_size];
+    // The layers are run one by one, so check the model as ml_setModel() would
+    if (!mlgraph_is_valid_model(graph)) {
+        free(model);
+        return false;
+    }
+    uint8_t *arena = (uint8_t *)malloc(graph->arena_bytes);
+    float min[2 * GRAPH_BUILDER_MAX_LAYERS + 1], max[2 * GRAPH_BUILDER_MAX_LAYERS + 1];
+    for (uint32_t i = 0; i <= num_layers; i++) {
+        min[i] = INFINITY;
+        max[i] = -INFINITY;
+    }
+    bool success = arena != NULL;
+    for (uint32_t c = 0; success && c < builder->calibration_len; c++) {
+        // Range 0 is the input, and range i + 1 the output of layer i
+        const float *input = &builder->calibration[c * builder->input_elements];
+        memcpy(arena + graph->input_offset, input, builder->input_elements * sizeof(float));
+        for (uint32_t e = 0; e < builder->input_elements; e++) {
+            min[0] = fminf(min[0], input[e]);
+            max[0] = fmaxf(max[0], input[e]);
+        }
+        for (uint32_t i = 0; success && i < num_layers; i++) {
+            success = mlgraph_invoke_layer(graph, arena, i) == 0;
+            const mlgraph_layer_t *layer = mlgraph_layer(graph, i);
+            const float *output = (const float *)(arena + layer->output_offset);
+            for (uint32_t e = 0; e < layer->out_length * layer->out_channels; e++) {
+                min[i + 1] = fminf(min[i + 1], output[e]);
+                max[i + 1] = fmaxf(max[i + 1], output[e]);
+            }
+        }
+    }
+    free(arena);
+    free(model);
+    if (!success) {
+        return false;
+    }
+
+    float scale;
+    int32_t zero_point;
+    rangeQuantization(min[0], max[0], &scale, &zero_point);
+    for (uint32_t i = 0; i < num_layers; i++) {
+        mlgraph_layer_t *layer = &layers[i];
+        layer->input_scale = scale;
+        layer->input_zero_point = zero_point;
+        if (layer->type == MLGRAPH_LAYER_ACTIVATION && layer->activation == MLGRAPH_ACTIVATION_TANH) {
+            scale = 1.0f / 128.0f;
+            zero_point = 0;
+        } else if (layer->type == MLGRAPH_LAYER_ACTIVATION && layer->activation >= MLGRAPH_ACTIVATION_SIGMOID) {
+            // Sigmoid and softmax outputs are in [0, 1]
+            scale = 1.0f / 256.0f;
+            zero_point = -128;
+        } else if (layer->type == MLGRAPH_LAYER_DENSE || layer->type == MLGRAPH_LAYER_CONV1D ||
+                layer->type == MLGRAPH_LAYER_ACTIVATION) {
+            rangeQuantization(min[i + 1], max[i + 1], &scale, &zero_point);
+        }
+        // Pooling layers keep the input quantization
+        layer->output_scale = scale;
+        layer->output_zero_point = zero_point;
+    }
+    return true;
+}
+
+/*****************************************************************************/
+/* Public API                                                                */
+/*****************************************************************************/
+void graphBuilder_init(GraphBuilder_t *builder, const uint32_t length, const uint32_t channels) {
+    memset(builder, 0, sizeof(*builder));
+    builder->length = length;
+    builder->channels = channels;
+    builder->input_elements = length * channels;
+    builder->max_elements = length * channels;
+    // Reserve the first weight, so that an index of 0 means no weights
+    const float reserved = 0.0f;
+    addWeights(builder, &reserved, 1);
+}
+
+void graphBuilder_dense(
+    GraphBuilder_t *builder, const uint32_t out_channels,
+    const float *weights, const float *bias, const mlgraph_activation_t activation
+) {
+    const uint32_t in_channels = builder->channels;
+    mlgraph_layer_t *layer = addLayer(builder, MLGRAPH_LAYER_DENSE, builder->length, out_channels);
+    if (layer != NULL) {
+        layer->activation = activation;
+        layer->weights_offset = addWeights(builder, weights, out_channels * in_channels);
+        layer->bias_offset = addWeights(builder, bias, out_channels);
+    }
+}
+
+void graphBuilder_conv1d(
+    GraphBuilder_t *builder, const uint32_t out_channels, const uint32_t kernel_size,
+    const uint32_t stride, const uint32_t padding,
+    const float *weights, const float *bias, const mlgraph_activation_t activation
+) {
+    const uint32_t in_channels = builder->channels;
+    mlgraph_layer_t *layer = addLayer(
+        builder, MLGRAPH_LAYER_CONV1D, windowedLength(builder->length, kernel_size, stride, padding), out_channels);
+    if (layer != NULL) {
+        layer->activation = activation;
+        layer->kernel_size = kernel_size;
+        layer->stride = stride;
+        layer->padding = padding;
+        layer->weights_offset = addWeights(builder, weights, out_channels * kernel_size * in_channels);
+        layer->bias_offset = addWeights(builder, bias, out_channels);
+    }
+}
+
+void graphBuilder_maxPool1d(
+    GraphBuilder_t *builder, const uint32_t pool_size, const uint32_t stride, const uint32_t padding
+) {
+    addPool(builder, MLGRAPH_LAYER_MAX_POOL1D, pool_size, stride, padding);
+}
+
+void graphBuilder_avgPool1d(
+    GraphBuilder_t *builder, const uint32_t pool_size, const uint32_t stride, const uint32_t padding
+) {
+    addPool(builder, MLGRAPH_LAYER_AVG_POOL1D, pool_size, stride, padding);
+}
+
+void graphBuilder_globalAvgPool1d(GraphBuilder_t *builder) {
+    addLayer(builder, MLGRAPH_LAYER_GLOBAL_AVG_POOL1D, 1, builder->channels);
+}
+
+void graphBuilder_activation(GraphBuilder_t *builder, const mlgraph_activation_t activation) {
+    mlgraph_layer_t *layer = addLayer(builder, MLGRAPH_LAYER_ACTIVATION, builder->length, builder->channels);
+    if (layer != NULL) {
+        layer->activation = activation;
+    }
+}
+
+void graphBuilder_quantize(GraphBuilder_t *builder, const float *inputs, const uint32_t len) {
+    builder->data_type = MLGRAPH_TYPE_INT8;
+    builder->calibration = inputs;
+    builder->calibration_len = len;
+}
+
+void *graphBuilder_build(
+    GraphBuilder_t *builder, const uint16_t samples_period, const uint16_t samples_length,
+    const uint8_t sample_dimensions, const char **labels, const uint8_t num_labels, size_t *size
+) {
+    if (builder->error || builder->num_layers == 0 || builder->length * builder->channels != num_labels) {
+        return NULL;
+    }
+    ModelInfo_t info = {samples_period, samples_length, sample_dimensions, labels, num_labels};
+    if (builder->data_type != MLGRAPH_TYPE_INT8) {
+        return emitModel(builder, builder->layers, builder->layer_buffer, builder->num_layers,
+                         MLGRAPH_TYPE_FLOAT32, &info, size);
+    }
+
+    mlgraph_layer_t layers[2 * GRAPH_BUILDER_MAX_LAYERS];
+    uint8_t buffers[2 * GRAPH_BUILDER_MAX_LAYERS];
+    const uint32_t num_layers = splitActivations(builder, layers, buffers);
+    if (!calibrate(builder, layers, buffers, num_layers, &info)) {
+        return NULL;
+    }
+    return emitModel(builder, layers, buffers, num_layers, MLGRAPH_TYPE_INT8, &info, size);
+}
+
+void graphBuilder_free(GraphBuilder_t *builder) {
+    free(builder->weights);
+    builder->weights = NULL;
+    builder->weights_len = 0;
+}
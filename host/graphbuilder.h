@@ -0,0 +1,112 @@
+/**
+ * @brief Build layer graph models in memory, for the host tests and
+ * benchmark.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * @details
+ * Layers are added in order, each one taking the output of the previous
+ * layer as its input. The tensors alternate between two halves of the arena,
+ * except for activation layers, which run in place.
+ *
+ * Int8 models are created from the same float weights, with the tensors
+ * quantized for the range seen when running the float model on calibration
+ * inputs.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mlgraph.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GRAPH_BUILDER_MAX_LAYERS    16
+
+typedef struct GraphBuilder_s {
+    mlgraph_layer_t layers[GRAPH_BUILDER_MAX_LAYERS];
+    // Which half of the arena the output of each layer is in
+    uint8_t layer_buffer[GRAPH_BUILDER_MAX_LAYERS];
+    uint32_t num_layers;
+    float *weights;
+    uint32_t weights_len;
+    // Shape and arena half of the tensor the next layer takes as input
+    uint32_t length;
+    uint32_t channels;
+    uint8_t buffer;
+    uint32_t input_elements;
+    uint32_t max_elements;
+    // Set by graphBuilder_quantize()
+    uint32_t data_type;
+    const float *calibration;
+    uint32_t calibration_len;
+    // Set when a layer can't be added, graphBuilder_build() then fails
+    int error;
+} GraphBuilder_t;
+
+/**
+ * @brief Start a graph with an input of [length][channels] elements.
+ */
+void graphBuilder_init(GraphBuilder_t *builder, const uint32_t length, const uint32_t channels);
+
+/**
+ * @brief Add layers, the weights and bias are copied, bias can be NULL.
+ * The weights layouts are described in mlgraph.h.
+ */
+void graphBuilder_dense(
+    GraphBuilder_t *builder, const uint32_t out_channels,
+    const float *weights, const float *bias, const mlgraph_activation_t activation
+);
+void graphBuilder_conv1d(
+    GraphBuilder_t *builder, const uint32_t out_channels, const uint32_t kernel_size,
+    const uint32_t stride, const uint32_t padding,
+    const float *weights, const float *bias, const mlgraph_activation_t activation
+);
+void graphBuilder_maxPool1d(
+    GraphBuilder_t *builder, const uint32_t pool_size, const uint32_t stride, const uint32_t padding
+);
+void graphBuilder_avgPool1d(
+    GraphBuilder_t *builder, const uint32_t pool_size, const uint32_t stride, const uint32_t padding
+);
+void graphBuilder_globalAvgPool1d(GraphBuilder_t *builder);
+void graphBuilder_activation(GraphBuilder_t *builder, const mlgraph_activation_t activation);
+
+/**
+ * @brief Make graphBuilder_build() create an int8 model.
+ *
+ * Sigmoid, tanh and softmax activations fused in dense and conv1d layers
+ * are moved to their own activation layers, as the int8 kernels only fuse
+ * ReLU.
+ *
+ * @param inputs Calibration inputs, each of the graph input size, they
+ *               must remain valid until the model is built.
+ * @param len Number of calibration inputs.
+ */
+void graphBuilder_quantize(GraphBuilder_t *builder, const float *inputs, const uint32_t len);
+
+/**
+ * @brief Create the full model, an ml_model_header_t with one action per
+ * output channel followed by the graph.
+ *
+ * @param labels The action labels, the last layer must have as many
+ *               output elements.
+ * @param size Set to the size of the model in bytes.
+ * @return The model, to be freed by the caller, or NULL on error.
+ */
+void *graphBuilder_build(
+    GraphBuilder_t *builder, const uint16_t samples_period, const uint16_t samples_length,
+    const uint8_t sample_dimensions, const char **labels, const uint8_t num_labels, size_t *size
+);
+
+/**
+ * @brief Release the weights, the builder can't be used after this.
+ */
+void graphBuilder_free(GraphBuilder_t *builder);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,464 @@
+/**
+ * @brief Test the layer graph models and kernels.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * Builds graph models with random weights, runs them through mlrunner and
+ * compares the outputs with a straightforward implementation of each layer.
+ * Also checks invalid graphs are rejected, and that graph and ML4F models
+ * can be added together.
+ * The same models are quantized to int8 and compared with a looser tolerance.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mlrunner.h"
+#include "ml4f.h"
+#include "mlgraph.h"
+#include "examplemodels.h"
+#include "graphbuilder.h"
+#include "mlkernels.h"
+
+#define MAX_TENSOR      1024
+#define TOLERANCE       1e-5f
+#define INT8_TOLERANCE  0.03f
+#define CALIBRATION_LEN 32
+
+static const char *labels[] = {"one", "two", "three", "four", "five"};
+#define NUM_LABELS      5
+
+static uint32_t seed = 42;
+
+static float randomFloat() {
+    seed = seed * 1664525u + 1013904223u;
+    return (float)(seed >> 8) / (float)(1 << 24) - 0.5f;
+}
+
+static void randomFill(float *data, const int len) {
+    for (int i = 0; i < len; i++) {
+        data[i] = randomFloat();
+    }
+}
+
+/*****************************************************************************/
+/* Reference layers, with explicit zero padding                              */
+/*****************************************************************************/
+typedef struct {
+    float data[MAX_TENSOR];
+    int length;
+    int channels;
+} Tensor_t;
+
+static void refActivation(Tensor_t *t, const mlgraph_activation_t activation) {
+    for (int p = 0; p < t->length; p++) {
+        float *x = &t->data[p * t->channels];
+        float sum = 0.0f;
+        for (int c = 0; c < t->channels; c++) {
+            switch (activation) {
+                case MLGRAPH_ACTIVATION_RELU: x[c] = x[c] > 0.0f ? x[c] : 0.0f; break;
+                case MLGRAPH_ACTIVATION_SIGMOID: x[c] = 1.0f / (1.0f + expf(-x[c])); break;
+                case MLGRAPH_ACTIVATION_TANH: x[c] = tanhf(x[c]); break;
+                case MLGRAPH_ACTIVATION_SOFTMAX: x[c] = expf(x[c]); sum += x[c]; break;
+                default: break;
+            }
+        }
+        if (activation == MLGRAPH_ACTIVATION_SOFTMAX) {
+            for (int c = 0; c < t->channels; c++) {
+                x[c] /= sum;
+            }
+        }
+    }
+}
+
+static float padded(const Tensor_t *t, const int position, const int channel) {
+    if (position < 0 || position >= t->length) {
+        return 0.0f;
+    }
+    return t->data[position * t->channels + channel];
+}
+
+static void refConv1d(
+    const Tensor_t *in, Tensor_t *out, const int out_channels, const int kernel_size,
+    const int stride, const int padding, const float *weights, const float *bias
+) {
+    out->length = (in->length + 2 * padding - kernel_size) / stride + 1;
+    out->channels = out_channels;
+    for (int p = 0; p < out->length; p++) {
+        for (int o = 0; o < out_channels; o++) {
+            float sum = bias ? bias[o] : 0.0f;
+            for (int k = 0; k < kernel_size; k++) {
+                for (int c = 0; c < in->channels; c++) {
+                    sum += weights[(o * kernel_size + k) * in->channels + c] *
+                           padded(in, p * stride - padding + k, c);
+                }
+            }
+            out->data[p * out_channels + o] = sum;
+        }
+    }
+}
+
+static void refPool1d(
+    const Tensor_t *in, Tensor_t *out, const int pool_size, const int stride, const int padding, const bool max
+) {
+    out->length = (in->length + 2 * padding - pool_size) / stride + 1;
+    out->channels = in->channels;
+    for (int p = 0; p < out->length; p++) {
+        for (int c = 0; c < in->channels; c++) {
+            float result = max ? -INFINITY : 0.0f;
+            int count = 0;
+            for (int k = 0; k < pool_size; k++) {
+                const int position = p * stride - padding + k;
+                if (position < 0 || position >= in->length) {
+                    continue;
+                }
+                const float x = in->data[position * in->channels + c];
+                result = max ? fmaxf(result, x) : result + x;
+                count++;
+            }
+            out->data[p * in->channels + c] = max ? result : result / count;
+        }
+    }
+}
+
+/*****************************************************************************/
+/* Tests                                                                     */
+/*****************************************************************************/
+static int compare(const char *name, const float *actual, const float *expected, const int len, const float tolerance) {
+    float max_diff = 0.0f;
+    for (int i = 0; i < len; i++) {
+        max_diff = fmaxf(max_diff, fabsf(actual[i] - expected[i]));
+    }
+    printf("%s: max difference %g\n", name, max_diff);
+    if (!(max_diff <= tolerance)) {
+        printf("%s: FAIL\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * conv1d -> max pool -> strided conv1d -> avg pool -> global avg pool ->
+ * dense -> softmax, with sizes that leave remainders in the kernels.
+ */
+static void *buildConvModel(Tensor_t *input, Tensor_t *expected, const bool int8) {
+    static float w1[7 * 3 * 3], b1[7], w2[6 * 3 * 7], b2[6], w3[NUM_LABELS * 6], b3[NUM_LABELS];
+    static float calibration[CALIBRATION_LEN * 23 * 3];
+    static bool initialised = false;
+    if (!initialised) {
+        randomFill(w1, 7 * 3 * 3);
+        randomFill(b1, 7);
+        randomFill(w2, 6 * 3 * 7);
+        randomFill(b2, 6);
+        randomFill(w3, NUM_LABELS * 6);
+        randomFill(b3, NUM_LABELS);
+        randomFill(calibration, CALIBRATION_LEN * 23 * 3);
+        initialised = true;
+    }
+
+    // The test input is one of the calibration inputs
+    input->length = 23;
+    input->channels = 3;
+    memcpy(input->data, calibration, sizeof(float) * input->length * input->channels);
+
+    GraphBuilder_t builder;
+    graphBuilder_init(&builder, input->length, input->channels);
+    graphBuilder_conv1d(&builder, 7, 3, 1, 1, w1, b1, MLGRAPH_ACTIVATION_RELU);
+    graphBuilder_maxPool1d(&builder, 2, 2, 0);
+    graphBuilder_conv1d(&builder, 6, 3, 2, 1, w2, b2, MLGRAPH_ACTIVATION_TANH);
+    graphBuilder_avgPool1d(&builder, 3, 1, 1);
+    graphBuilder_globalAvgPool1d(&builder);
+    graphBuilder_dense(&builder, NUM_LABELS, w3, b3, MLGRAPH_ACTIVATION_NONE);
+    graphBuilder_activation(&builder, MLGRAPH_ACTIVATION_SOFTMAX);
+    if (int8) {
+        graphBuilder_quantize(&builder, calibration, CALIBRATION_LEN);
+    }
+    size_t size;
+    void *model = graphBuilder_build(&builder, 25, input->length, input->channels, labels, NUM_LABELS, &size);
+    graphBuilder_free(&builder);
+
+    static Tensor_t a, b;
+    refConv1d(input, &a, 7, 3, 1, 1, w1, b1);
+    refActivation(&a, MLGRAPH_ACTIVATION_RELU);
+    refPool1d(&a, &b, 2, 2, 0, true);
+    refConv1d(&b, &a, 6, 3, 2, 1, w2, b2);
+    refActivation(&a, MLGRAPH_ACTIVATION_TANH);
+    refPool1d(&a, &b, 3, 1, 1, false);
+    refPool1d(&b, &a, b.length, b.length, 0, false);
+    refConv1d(&a, expected, NUM_LABELS, 1, 1, 0, w3, b3);
+    refActivation(expected, MLGRAPH_ACTIVATION_SOFTMAX);
+    return model;
+}
+
+/**
+ * Dense layers applied to every position of the input, like the ml-trainer
+ * models, with a sigmoid output and no bias on the last layer.
+ */
+static void *buildDenseModel(Tensor_t *input, Tensor_t *expected, const bool int8) {
+    static float w1[9 * 24], b1[9], w2[NUM_LABELS * 9];
+    static float calibration[CALIBRATION_LEN * 24];
+    static bool initialised = false;
+    if (!initialised) {
+        randomFill(w1, 9 * 24);
+        randomFill(b1, 9);
+        randomFill(w2, NUM_LABELS * 9);
+        randomFill(calibration, CALIBRATION_LEN * 24);
+        initialised = true;
+    }
+
+    input->length = 1;
+    input->channels = 24;
+    memcpy(input->data, calibration, sizeof(float) * input->length * input->channels);
+
+    GraphBuilder_t builder;
+    graphBuilder_init(&builder, input->length, input->channels);
+    graphBuilder_dense(&builder, 9, w1, b1, MLGRAPH_ACTIVATION_RELU);
+    graphBuilder_dense(&builder, NUM_LABELS, w2, NULL, MLGRAPH_ACTIVATION_SIGMOID);
+    if (int8) {
+        graphBuilder_quantize(&builder, calibration, CALIBRATION_LEN);
+    }
+    size_t size;
+    void *model = graphBuilder_build(&builder, 20, 80, 3, labels, NUM_LABELS, &size);
+    graphBuilder_free(&builder);
+
+    static Tensor_t a;
+    refConv1d(input, &a, 9, 1, 1, 0, w1, b1);
+    refActivation(&a, MLGRAPH_ACTIVATION_RELU);
+    refConv1d(&a, expected, NUM_LABELS, 1, 1, 0, w2, NULL);
+    refActivation(expected, MLGRAPH_ACTIVATION_SIGMOID);
+    return model;
+}
+
+static int testModel(
+    const char *name, void *model, const Tensor_t *input, const Tensor_t *expected, const float tolerance
+) {
+    float output[NUM_LABELS];
+    if (model == NULL || !ml_setModel(model)) {
+        printf("%s: FAIL, invalid model\n", name);
+        return 1;
+    }
+    if (ml_getInputLength() != input->length * input->channels || ml_getOutputLength() != NUM_LABELS) {
+        printf("%s: FAIL, wrong input or output length\n", name);
+        return 1;
+    }
+    if (!ml_runModel(input->data, input->length * input->channels, output, NUM_LABELS)) {
+        printf("%s: FAIL, the model didn't run\n", name);
+        return 1;
+    }
+    int failures = compare(name, output, expected->data, NUM_LABELS, tolerance);
+    if (ml4f_argmax(output, NUM_LABELS) != ml4f_argmax(expected->data, NUM_LABELS)) {
+        printf("%s: FAIL, wrong prediction\n", name);
+        failures++;
+    }
+
+    // The actions come from the mlrunner header as with ML4F models
+    ml_actions_t *actions = ml_allocateActions();
+    if (actions == NULL || !ml_getActions(actions) || strcmp(actions->action[2].label, "three") != 0) {
+        printf("%s: FAIL, wrong actions\n", name);
+        failures++;
+    }
+    free(actions);
+
+    // Or in caller provided memory, without the heap
+    size_t buffer[32], predictions_buffer[8];
+    ml_actions_t *static_actions = ml_initActions(buffer, ml_getActionsSize());
+    if (static_actions == NULL || !ml_getActions(static_actions) ||
+            strcmp(static_actions->action[2].label, "three") != 0 ||
+            ml_initActions(buffer, ml_getActionsSize() - 1) != NULL ||
+            ml_initActions((uint8_t *)buffer + 1, sizeof(buffer) - 1) != NULL) {
+        printf("%s: FAIL, wrong actions in a caller buffer\n", name);
+        failures++;
+    }
+    ml_predictions_t *static_predictions = ml_initPredictions(predictions_buffer, sizeof(predictions_buffer));
+    if (static_predictions == NULL || static_predictions->len != NUM_LABELS ||
+            !ml_predict(input->data, input->length * input->channels, static_actions, static_predictions) ||
+            static_predictions->index != ml_calcPrediction(static_actions, static_predictions->prediction, NUM_LABELS)) {
+        printf("%s: FAIL, wrong predictions in a caller buffer\n", name);
+        failures++;
+    }
+    ml_removeModels();
+    return failures;
+}
+
+static int testInvalidModels(const void *model, const size_t size) {
+    const ml_model_header_t *header = (const ml_model_header_t *)model;
+    uint8_t *copy = (uint8_t *)malloc(size);
+    memcpy(copy, model, size);
+    mlgraph_header_t *graph = (mlgraph_header_t *)(copy + header->header_size);
+    mlgraph_layer_t *layer = (mlgraph_layer_t *)((uint8_t *)graph + graph->header_size);
+    int failures = 0;
+
+    struct {
+        const char *name;
+        size_t offset;
+        uint32_t value;
+        int width;
+    } corruptions[] = {
+        {"unknown model format", 11 + ML_MODEL_FORMAT_INDEX, 7, 1},
+        {"graph magic", header->header_size + offsetof(mlgraph_header_t, magic0), 0, 4},
+        {"layers past the object", header->header_size + offsetof(mlgraph_header_t, num_layers), 1000, 4},
+        {"output past the arena", header->header_size + offsetof(mlgraph_header_t, output_offset), 1 << 20, 4},
+        {"unknown layer", (uint8_t *)&layer[0].type - copy, 99, 4},
+        {"unknown activation", (uint8_t *)&layer[0].activation - copy, 99, 4},
+        {"weights past the object", (uint8_t *)&layer[0].weights_offset - copy, 1 << 20, 4},
+        {"misaligned weights", (uint8_t *)&layer[0].weights_offset - copy, layer[0].weights_offset + 2, 4},
+        {"overlapping tensors", (uint8_t *)&layer[0].output_offset - copy, 4, 4},
+        {"window past the input", (uint8_t *)&layer[0].out_length - copy, 100, 4},
+        {"zero stride", (uint8_t *)&layer[0].stride - copy, 0, 4},
+    };
+    for (size_t i = 0; i < sizeof(corruptions) / sizeof(corruptions[0]); i++) {
+        memcpy(copy, model, size);
+        memcpy(copy + corruptions[i].offset, &corruptions[i].value, corruptions[i].width);
+        if (ml_getModelArenaSize(copy) >= 0 || ml_setModel(copy)) {
+            printf("Invalid model, %s: FAIL, the model was accepted\n", corruptions[i].name);
+            failures++;
+        }
+    }
+    memcpy(copy, model, size);
+    if (ml_getModelArenaSize(copy) <= 0) {
+        printf("Invalid model, unchanged copy: FAIL, the model was rejected\n");
+        failures++;
+    }
+    free(copy);
+    return failures;
+}
+
+// Graph and ML4F models share the arena and can be selected in any order
+static int testMixedRegistry(void *graph_model, const Tensor_t *input, const Tensor_t *expected) {
+    int failures = 0;
+    ml_removeModels();
+    const int ml4f_index = ml_addModel(example_models[0].model);
+    const int graph_index = ml_addModel(graph_model);
+    if (ml4f_index < 0 || graph_index < 0) {
+        printf("Mixed registry: FAIL, the models weren't added\n");
+        ml_removeModels();
+        return 1;
+    }
+    for (int round = 0; round < 2; round++) {
+        if (!ml_selectModel(ml4f_index) || !ml_invokeModel()) {
+            printf("Mixed registry: FAIL, the ML4F model didn't run\n");
+            failures++;
+        }
+        float output[NUM_LABELS];
+        if (!ml_selectModel(graph_index) ||
+                !ml_runModel(input->data, input->length * input->channels, output, NUM_LABELS)) {
+            printf("Mixed registry: FAIL, the graph model didn't run\n");
+            failures++;
+            continue;
+        }
+        failures += compare("Mixed registry", output, expected->data, NUM_LABELS, TOLERANCE);
+    }
+    ml_removeModels();
+    return failures;
+}
+
+static size_t modelSize(const void *model) {
+    const ml_model_header_t *header = (const ml_model_header_t *)model;
+    return header->header_size + ((const mlgraph_header_t *)((const uint8_t *)model + header->header_size))->object_size;
+}
+
+// The int8 model runs from the same float API, with a quarter of the arena
+static int testInt8Model(const char *name, void *model, void *float_model, const Tensor_t *input, const Tensor_t *expected) {
+    int failures = testModel(name, model, input, expected, INT8_TOLERANCE);
+    if (model == NULL || float_model == NULL) {
+        return failures + 1;
+    }
+    const int arena = ml_getModelArenaSize(model), float_arena = ml_getModelArenaSize(float_model);
+    printf("%s: arena %d bytes (float %d), model %zu bytes (float %zu)\n",
+           name, arena, float_arena, modelSize(model), modelSize(float_model));
+    if (arena <= 0 || arena > float_arena / 4 + 8 || modelSize(model) >= modelSize(float_model)) {
+        printf("%s: FAIL, the int8 model isn't smaller\n", name);
+        failures++;
+    }
+
+    ml_tensor_info_t in_info, out_info;
+    if (!ml_setModel(model) || !ml_getInputInfo(&in_info) || !ml_getOutputInfo(&out_info) ||
+            in_info.type != ML_TENSOR_INT8 || out_info.type != ML_TENSOR_INT8 ||
+            ml_getInputBuffer() != NULL || ml_getOutputBuffer() != NULL || ml_getInputTensor() == NULL) {
+        printf("%s: FAIL, wrong tensor types\n", name);
+        failures++;
+    }
+    ml_removeModels();
+    return failures;
+}
+
+// ML4F models can have quantized inputs and outputs, with a valid scale
+static int testMl4fQuantizedHeader() {
+    const ExampleModel_t *example = &example_models[0];
+    uint8_t *copy = (uint8_t *)malloc(example->size);
+    memcpy(copy, example->model, example->size);
+    ml4f_header_t *ml4f_model = (ml4f_header_t *)(copy + ((const ml_model_header_t *)copy)->header_size);
+    int failures = 0;
+
+    ml4f_model->input_type = ML4F_TYPE_UINT8;
+    if (ml_getModelArenaSize(copy) >= 0) {
+        printf("ML4F quantized header: FAIL, accepted without a scale\n");
+        failures++;
+    }
+    ml4f_model->input_scale = 0.5f;
+    ml4f_model->input_zero_point = 10;
+    ml_tensor_info_t info;
+    if (!ml_setModel(copy) || !ml_getInputInfo(&info) || info.type != ML_TENSOR_UINT8 ||
+            info.scale != 0.5f || info.zero_point != 10) {
+        printf("ML4F quantized header: FAIL, wrong input type\n");
+        failures++;
+    }
+    ml_removeModels();
+    free(copy);
+    return failures;
+}
+
+static int testQuantization() {
+    const float input[] = {-1.0f, -0.26f, 0.0f, 0.24f, 0.26f, 200.0f};
+    int8_t q8[6];
+    uint8_t qu8[6];
+    float output[6];
+    int failures = 0;
+
+    mlk_quantizeInt8(input, q8, 6, 0.5f, 3);
+    mlk_quantizeUint8(input, qu8, 6, 0.5f, 3);
+    const int8_t expected8[] = {1, 2, 3, 3, 4, 127};
+    const uint8_t expectedu8[] = {1, 2, 3, 3, 4, 255};
+    if (memcmp(q8, expected8, sizeof(q8)) != 0 || memcmp(qu8, expectedu8, sizeof(qu8)) != 0) {
+        printf("Quantization: FAIL, wrong quantized values\n");
+        failures++;
+    }
+    mlk_dequantizeInt8(q8, output, 6, 0.5f, 3);
+    if (output[0] != -1.0f || output[2] != 0.0f || output[5] != 62.0f) {
+        printf("Quantization: FAIL, wrong dequantized values\n");
+        failures++;
+    }
+    return failures;
+}
+
+int main() {
+    static Tensor_t conv_input, conv_expected, dense_input, dense_expected;
+    int failures = 0;
+
+    void *conv_model = buildConvModel(&conv_input, &conv_expected, false);
+    void *dense_model = buildDenseModel(&dense_input, &dense_expected, false);
+    failures += testModel("Conv model", conv_model, &conv_input, &conv_expected, TOLERANCE);
+    failures += testModel("Dense model", dense_model, &dense_input, &dense_expected, TOLERANCE);
+    if (conv_model != NULL) {
+        const ml_model_header_t *header = (const ml_model_header_t *)conv_model;
+        const mlgraph_header_t *graph = (const mlgraph_header_t *)((uint8_t *)conv_model + header->header_size);
+        failures += testInvalidModels(conv_model, header->header_size + graph->object_size);
+    }
+    failures += testMixedRegistry(dense_model, &dense_input, &dense_expected);
+
+    void *conv_int8_model = buildConvModel(&conv_input, &conv_expected, true);
+    void *dense_int8_model = buildDenseModel(&dense_input, &dense_expected, true);
+    failures += testInt8Model("Conv int8 model", conv_int8_model, conv_model, &conv_input, &conv_expected);
+    failures += testInt8Model("Dense int8 model", dense_int8_model, dense_model, &dense_input, &dense_expected);
+    failures += testMl4fQuantizedHeader();
+    failures += testQuantization();
+
+    free(conv_model);
+    free(dense_model);
+    free(conv_int8_model);
+    free(dense_int8_model);
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,311 @@
+/**
+ * @brief Test recording batches of samples.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * Records the same int16 accelerometer-like signal in two data processors,
+ * one sample at a time and in batches of different sizes converted with
+ * mldp_convertInt16(), and checks the processed data is bit-identical,
+ * including while a snapshot is active and when it is overrun.
+ *
+ * Then records the same signal with MLDP_CONFIG_INT16_SAMPLES, as float and
+ * as int16 samples, and checks the processed data is also bit-identical to
+ * the float storage, with less memory, and that out of range values
+ * saturate.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "mldataprocessor.h"
+#include "filterdataprocessor.h"
+#include "testcheck.h"
+
+#define WINDOW          40
+#define MAX_DIMENSIONS  4
+#define MAX_BATCH       (WINDOW * 3)
+#define MAX_OUTPUT      (MLDP_ML_TRAINER_FEATURES * MAX_DIMENSIONS)
+
+typedef struct {
+    const char *name;
+    const MlDataFilters_t *filters;
+    int filter_size;
+    int dimensions;
+    int flags;
+} IngestConfig_t;
+
+static const MlDataFilters_t fused_filters[] = {
+    {MLDP_ML_TRAINER_FEATURES, filterMlTrainer, MLDP_FILTER_INTERLEAVED_OUTPUT, NULL},
+};
+static const MlDataFilters_t separate_filters[] = {
+    {1, filterMax, MLDP_FILTER_NONE, NULL},
+    {1, filterMean, MLDP_FILTER_NONE, NULL},
+    {1, filterMin, MLDP_FILTER_NONE, NULL},
+    {1, filterStdDev, MLDP_FILTER_NONE, NULL},
+    {1, filterPeaks, MLDP_FILTER_NONE, NULL},
+    {1, filterTotalAcc, MLDP_FILTER_NONE, NULL},
+    {1, filterZcr, MLDP_FILTER_NONE, NULL},
+    {1, filterRms, MLDP_FILTER_NONE, NULL},
+};
+
+static const float scales[MAX_DIMENSIONS] = {1000.0f, 1000.0f, 1000.0f, 1000.0f};
+
+static const IngestConfig_t configs[] = {
+    {"fused", fused_filters, 1, 3, MLDP_CONFIG_DOUBLE_BUFFER},
+    {"fused 2D", fused_filters, 1, 2, MLDP_CONFIG_DOUBLE_BUFFER},
+    {"fused 4D", fused_filters, 1, 4, MLDP_CONFIG_NONE},
+    {"fused+streaming", fused_filters, 1, 3, MLDP_CONFIG_DOUBLE_BUFFER | MLDP_CONFIG_STREAMING_PEAKS},
+    {"filters+incremental", separate_filters, 8, 3,
+        MLDP_CONFIG_DOUBLE_BUFFER | MLDP_CONFIG_INCREMENTAL_STATS | MLDP_CONFIG_INCREMENTAL_MIN_MAX},
+};
+
+// Batch sizes used in turn, including larger than the ring buffer
+static const int batch_sizes[] = {1, 4, 7, 2, 13, WINDOW + 5, 1, 3, MAX_BATCH};
+
+static uint32_t seed = 7;
+
+static int16_t nextValue(const int i) {
+    seed = seed * 1664525u + 1013904223u;
+    const int noise = (int)(seed >> 22) - 512;
+    return (int16_t)(((i / 9) % 2 ? 900 : -700) + noise);
+}
+
+static FilterDataProcessor_t *createProcessor(const IngestConfig_t *config, const int extra_flags, size_t *arena_size) {
+    int features = 0;
+    for (int i = 0; i < config->filter_size; i++) {
+        features += config->filters[i].out_size;
+    }
+    const MlDataProcessorConfig_t mldp_config = {
+        .samples = WINDOW,
+        .dimensions = config->dimensions,
+        .output_length = features * config->dimensions,
+        .filter_size = config->filter_size,
+        .filters = config->filters,
+        .flags = config->flags | extra_flags,
+        .sample_scale = scales,
+    };
+    if (arena_size != NULL) {
+        *arena_size = filterDataProcessor_getArenaSize(&mldp_config);
+    }
+    FilterDataProcessor_t *fdp = filterDataProcessor_create();
+    if (fdp != NULL && filterDataProcessor_init(fdp, &mldp_config) != MLDP_SUCCESS) {
+        filterDataProcessor_destroy(fdp);
+        return NULL;
+    }
+    return fdp;
+}
+
+static int compareOutput(const char *name, FilterDataProcessor_t *single, FilterDataProcessor_t *batched) {
+    if (filterDataProcessor_isDataReady(single) != filterDataProcessor_isDataReady(batched)) {
+        printf("%s: FAIL, data ready doesn't match\n", name);
+        return 1;
+    }
+    if (!filterDataProcessor_isDataReady(single)) {
+        return 0;
+    }
+    const size_t len = filterDataProcessor_getProcessedDataSize(single);
+    float expected[MAX_OUTPUT];
+    const float *out = filterDataProcessor_getProcessedData(single);
+    if (out != NULL) {
+        memcpy(expected, out, len * sizeof(float));
+    }
+    const float *actual = filterDataProcessor_getProcessedData(batched);
+    if ((out == NULL) != (actual == NULL) || (out != NULL && memcmp(expected, actual, len * sizeof(float)) != 0)) {
+        printf("%s: FAIL, processed data doesn't match\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+static int testConfig(const IngestConfig_t *config) {
+    FilterDataProcessor_t *single = createProcessor(config, MLDP_CONFIG_NONE, NULL);
+    FilterDataProcessor_t *batched = createProcessor(config, MLDP_CONFIG_NONE, NULL);
+    if (single == NULL || batched == NULL) {
+        printf("%s: FAIL, the processors could not be initialised\n", config->name);
+        filterDataProcessor_destroy(single);
+        filterDataProcessor_destroy(batched);
+        return 1;
+    }
+    const int dims = config->dimensions;
+    const bool snapshots = (config->flags & MLDP_CONFIG_DOUBLE_BUFFER) != 0;
+    int16_t raw[MAX_BATCH * MAX_DIMENSIONS];
+    float converted[MAX_BATCH * MAX_DIMENSIONS];
+    int failures = 0;
+    int sample = 0;
+    for (int round = 0; round < 40 && failures == 0; round++) {
+        const int batch = batch_sizes[round % (sizeof(batch_sizes) / sizeof(batch_sizes[0]))];
+        for (int i = 0; i < batch * dims; i++) {
+            raw[i] = nextValue(sample + i / dims);
+        }
+        sample += batch;
+
+        // One sample at a time, converted like the accelerometer samples
+        for (int s = 0; s < batch; s++) {
+            float values[MAX_DIMENSIONS];
+            for (int d = 0; d < dims; d++) {
+                values[d] = raw[s * dims + d] / 1000.0f;
+            }
+            filterDataProcessor_recordData(single, values, dims);
+        }
+        mldp_convertInt16(raw, converted, batch * dims, 1000.0f);
+        if (filterDataProcessor_recordData(batched, converted, batch * dims) != MLDP_SUCCESS) {
+            printf("%s: FAIL, batch of %d not recorded\n", config->name, batch);
+            failures++;
+        }
+        failures += compareOutput(config->name, single, batched);
+
+        // Alternate between taking a snapshot and committing it, so that
+        // some batches are recorded while it is active, and some overrun it
+        if (snapshots && filterDataProcessor_isDataReady(single)) {
+            if (round % 3 == 0) {
+                const MldpReturn_t a = filterDataProcessor_snapshot(single);
+                const MldpReturn_t b = filterDataProcessor_snapshot(batched);
+                failures += (a != b);
+            } else if (round % 3 == 2) {
+                filterDataProcessor_commit(single);
+                filterDataProcessor_commit(batched);
+            }
+        }
+    }
+    if (filterDataProcessor_recordData(batched, converted, dims + 1) != MLDP_ERROR_CONFIG) {
+        printf("%s: FAIL, partial sample recorded\n", config->name);
+        failures++;
+    }
+
+    filterDataProcessor_destroy(single);
+    filterDataProcessor_destroy(batched);
+    printf("%s: %s\n", config->name, failures ? "FAIL" : "PASS");
+    return failures;
+}
+
+/**
+ * Record the signal in a float processor, and in int16 processors as float
+ * and int16 samples, and check they all produce the same output.
+ */
+static int testInt16Config(const IngestConfig_t *config) {
+    size_t float_size = 0, int16_size = 0;
+    FilterDataProcessor_t *reference = createProcessor(config, MLDP_CONFIG_NONE, &float_size);
+    FilterDataProcessor_t *from_float = createProcessor(config, MLDP_CONFIG_INT16_SAMPLES, &int16_size);
+    FilterDataProcessor_t *from_int16 = createProcessor(config, MLDP_CONFIG_INT16_SAMPLES, NULL);
+    FilterDataProcessor_t *float_from_int16 = createProcessor(config, MLDP_CONFIG_NONE, NULL);
+    int failures = 0;
+    if (reference == NULL || from_float == NULL || from_int16 == NULL || float_from_int16 == NULL) {
+        printf("int16 %s: FAIL, the processors could not be initialised\n", config->name);
+        failures++;
+    }
+    const int dims = config->dimensions;
+    int16_t raw[MAX_BATCH * MAX_DIMENSIONS];
+    float converted[MAX_BATCH * MAX_DIMENSIONS];
+    int sample = 0;
+    for (int round = 0; round < 40 && failures == 0; round++) {
+        const int batch = batch_sizes[round % (sizeof(batch_sizes) / sizeof(batch_sizes[0]))];
+        for (int i = 0; i < batch * dims; i++) {
+            raw[i] = nextValue(sample + i / dims);
+        }
+        sample += batch;
+
+        mldp_convertInt16(raw, converted, batch * dims, 1000.0f);
+        filterDataProcessor_recordData(reference, converted, batch * dims);
+        filterDataProcessor_recordData(from_float, converted, batch * dims);
+        filterDataProcessor_recordDataInt16(from_int16, raw, batch * dims);
+        filterDataProcessor_recordDataInt16(float_from_int16, raw, batch * dims);
+        failures += compareOutput("int16 from float", reference, from_float);
+        failures += compareOutput("int16 from int16", reference, from_int16);
+        failures += compareOutput("float from int16", reference, float_from_int16);
+
+        if ((config->flags & MLDP_CONFIG_DOUBLE_BUFFER) && filterDataProcessor_isDataReady(reference)) {
+            FilterDataProcessor_t *processors[4] = {reference, from_float, from_int16, float_from_int16};
+            for (int p = 0; p < 4; p++) {
+                if (round % 3 == 0) {
+                    failures += filterDataProcessor_snapshot(processors[p]) != MLDP_SUCCESS;
+                } else if (round % 3 == 2) {
+                    filterDataProcessor_commit(processors[p]);
+                }
+            }
+        }
+    }
+    failures += check("int16 arena", int16_size < float_size);
+
+    filterDataProcessor_destroy(reference);
+    filterDataProcessor_destroy(from_float);
+    filterDataProcessor_destroy(from_int16);
+    filterDataProcessor_destroy(float_from_int16);
+    printf("int16 %s (%u bytes, float %u bytes): %s\n", config->name,
+           (unsigned)int16_size, (unsigned)float_size, failures ? "FAIL" : "PASS");
+    return failures;
+}
+
+static int testInt16Rounding() {
+    static const MlDataFilters_t pass_through[] = {
+        {WINDOW, filterPassThrough, MLDP_FILTER_NONE, NULL},
+    };
+    const IngestConfig_t config = {"pass through", pass_through, 1, 1, MLDP_CONFIG_NONE};
+    FilterDataProcessor_t *fdp = createProcessor(&config, MLDP_CONFIG_INT16_SAMPLES, NULL);
+    const float samples[4] = {40.0f, -40.0f, 0.0004f, -0.0016f};
+    const float expected[4] = {32767 / 1000.0f, -32768 / 1000.0f, 0.0f, -2 / 1000.0f};
+    int failures = 0;
+    for (int i = 0; i < WINDOW / 4 && fdp != NULL; i++) {
+        filterDataProcessor_recordData(fdp, samples, 4);
+    }
+    const float *out = (fdp != NULL) ? filterDataProcessor_getProcessedData(fdp) : NULL;
+    failures += check("rounding", out != NULL && memcmp(&out[WINDOW - 4], expected, sizeof(expected)) == 0);
+    filterDataProcessor_destroy(fdp);
+
+    // The scales must be positive
+    const float bad_scales[1] = {0.0f};
+    const MlDataProcessorConfig_t bad_config = {
+        .samples = WINDOW, .dimensions = 1, .output_length = WINDOW, .filter_size = 1,
+        .filters = pass_through, .flags = MLDP_CONFIG_INT16_SAMPLES, .sample_scale = bad_scales,
+    };
+    failures += check("invalid scale", filterDataProcessor_getArenaSize(&bad_config) == 0);
+
+    printf("int16 rounding: %s\n", failures ? "FAIL" : "PASS");
+    return failures;
+}
+
+// The incremental modes only apply to the separate filters
+static int testFusedFlags() {
+    const IngestConfig_t fused = {"fused", fused_filters, 1, 3, MLDP_CONFIG_INCREMENTAL_STATS};
+    const IngestConfig_t separate = {"filters", separate_filters, 8, 3, MLDP_CONFIG_INCREMENTAL_STATS};
+    size_t fused_size = 1, separate_size = 0;
+    FilterDataProcessor_t *fdp = createProcessor(&fused, MLDP_CONFIG_NONE, &fused_size);
+    int failures = check("incremental stats with the fused filter", fdp == NULL && fused_size == 0);
+    filterDataProcessor_destroy(fdp);
+    const IngestConfig_t fused_min_max = {"fused", fused_filters, 1, 3, MLDP_CONFIG_INCREMENTAL_MIN_MAX};
+    fdp = createProcessor(&fused_min_max, MLDP_CONFIG_NONE, &fused_size);
+    failures += check("incremental min/max with the fused filter", fdp == NULL && fused_size == 0);
+    filterDataProcessor_destroy(fdp);
+    fdp = createProcessor(&separate, MLDP_CONFIG_NONE, &separate_size);
+    failures += check("incremental stats with separate filters", fdp != NULL && separate_size > 0);
+    filterDataProcessor_destroy(fdp);
+    printf("Fused filter flags: %s\n", failures ? "FAIL" : "PASS");
+    return failures;
+}
+
+static int testConvert() {
+    const int16_t raw[7] = {0, 1000, -1000, 32767, -32768, 1, 123};
+    float out[7];
+    mldp_convertInt16(raw, out, 7, 1000.0f);
+    int failures = 0;
+    for (int i = 0; i < 7; i++) {
+        if (out[i] != raw[i] / 1000.0f) {
+            failures++;
+        }
+    }
+    printf("Convert int16: %s\n", failures ? "FAIL" : "PASS");
+    return failures;
+}
+
+int main() {
+    int failures = testConvert();
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+        failures += testConfig(&configs[c]);
+    }
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+        failures += testInt16Config(&configs[c]);
+    }
+    failures += testInt16Rounding();
+    failures += testFusedFlags();
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
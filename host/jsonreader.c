@@ -0,0 +1,259 @@
+/**
+ * @brief Streaming JSON tokenizer, reading a file a few kilobytes at a time
+ * so that large files don't need to fit in memory.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "jsonreader.h"
+
+// What the next token can be, stored in the reader state
+typedef enum {
+    STATE_VALUE,
+    STATE_FIRST_VALUE,      // A value or the end of the array
+    STATE_FIRST_KEY,        // A key or the end of the object, other keys
+                            // are read after the comma in STATE_NEXT
+    STATE_COLON,
+    STATE_NEXT,             // A comma or the end of the container
+    STATE_END,              // After the top level value
+} State_t;
+
+/*****************************************************************************/
+/* Private API                                                               */
+/*****************************************************************************/
+static int peekChar(JsonReader_t *reader) {
+    if (reader->buffer_pos == reader->buffer_len) {
+        reader->buffer_len = fread(reader->buffer, 1, JSON_BUFFER_SIZE, reader->file);
+        reader->buffer_pos = 0;
+        if (reader->buffer_len == 0) {
+            return EOF;
+        }
+    }
+    return (unsigned char)reader->buffer[reader->buffer_pos];
+}
+
+static int nextChar(JsonReader_t *reader) {
+    const int c = peekChar(reader);
+    if (c != EOF) {
+        reader->buffer_pos++;
+        reader->offset++;
+    }
+    return c;
+}
+
+static int skipWhitespace(JsonReader_t *reader) {
+    int c = peekChar(reader);
+    while (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        nextChar(reader);
+        c = peekChar(reader);
+    }
+    return c;
+}
+
+static JsonToken_t fail(JsonReader_t *reader) {
+    reader->failed = true;
+    return JSON_ERROR;
+}
+
+static JsonToken_t valueRead(JsonReader_t *reader, const JsonToken_t token) {
+    reader->state = reader->depth == 0 ? STATE_END : STATE_NEXT;
+    return token;
+}
+
+static JsonToken_t openContainer(JsonReader_t *reader, const bool is_object) {
+    if (reader->depth == JSON_MAX_DEPTH) {
+        return fail(reader);
+    }
+    nextChar(reader);
+    reader->is_object[reader->depth++] = is_object;
+    reader->state = is_object ? STATE_FIRST_KEY : STATE_FIRST_VALUE;
+    return is_object ? JSON_OBJECT_START : JSON_ARRAY_START;
+}
+
+static JsonToken_t closeContainer(JsonReader_t *reader, const int c) {
+    const bool is_object = c == '}';
+    if (reader->depth == 0 || reader->is_object[reader->depth - 1] != is_object) {
+        return fail(reader);
+    }
+    nextChar(reader);
+    reader->depth--;
+    return valueRead(reader, is_object ? JSON_OBJECT_END : JSON_ARRAY_END);
+}
+
+static int hexValue(const int c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool readString(JsonReader_t *reader) {
+    size_t len = 0;
+    nextChar(reader);  // Opening quote
+    while (true) {
+        int c = nextChar(reader);
+        if (c == EOF || (c >= 0 && c < 0x20)) {
+            return false;
+        }
+        if (c == '"') {
+            break;
+        }
+        if (c == '\\') {
+            c = nextChar(reader);
+            switch (c) {
+                case '"': case '\\': case '/': break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'u': {
+                    int code = 0;
+                    for (int i = 0; i < 4; i++) {
+                        const int digit = hexValue(nextChar(reader));
+                        if (digit < 0) {
+                            return false;
+                        }
+                        code = code * 16 + digit;
+                    }
+                    c = code < 0x80 ? code : '?';
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        if (len < JSON_MAX_STRING - 1) {
+            reader->string[len++] = (char)c;
+        }
+    }
+    reader->string[len] = '\0';
+    return true;
+}
+
+static bool readNumber(JsonReader_t *reader) {
+    char text[64];
+    size_t len = 0;
+    int c = peekChar(reader);
+    while (c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E' || (c >= '0' && c <= '9')) {
+        if (len == sizeof(text) - 1) {
+            return false;
+        }
+        text[len++] = (char)nextChar(reader);
+        c = peekChar(reader);
+    }
+    text[len] = '\0';
+    char *end;
+    reader->number = strtod(text, &end);
+    return len > 0 && *end == '\0';
+}
+
+static bool readLiteral(JsonReader_t *reader, const char *literal) {
+    for (const char *p = literal; *p; p++) {
+        if (nextChar(reader) != *p) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static JsonToken_t readValue(JsonReader_t *reader, const int c) {
+    switch (c) {
+        case '{':
+            return openContainer(reader, true);
+        case '[':
+            return openContainer(reader, false);
+        case '"':
+            return readString(reader) ? valueRead(reader, JSON_STRING) : fail(reader);
+        case 't':
+            return readLiteral(reader, "true") ? valueRead(reader, JSON_TRUE) : fail(reader);
+        case 'f':
+            return readLiteral(reader, "false") ? valueRead(reader, JSON_FALSE) : fail(reader);
+        case 'n':
+            return readLiteral(reader, "null") ? valueRead(reader, JSON_NULL) : fail(reader);
+        default:
+            if (c == '-' || (c >= '0' && c <= '9')) {
+                return readNumber(reader) ? valueRead(reader, JSON_NUMBER) : fail(reader);
+            }
+            return fail(reader);
+    }
+}
+
+/*****************************************************************************/
+/* Public API                                                                */
+/*****************************************************************************/
+void jsonReader_init(JsonReader_t *reader, FILE *file) {
+    memset(reader, 0, sizeof(*reader));
+    reader->file = file;
+}
+
+JsonToken_t jsonReader_next(JsonReader_t *reader) {
+    if (reader->failed) {
+        return JSON_ERROR;
+    }
+    int c = skipWhitespace(reader);
+    switch ((State_t)reader->state) {
+        case STATE_END:
+            return c == EOF ? JSON_END : fail(reader);
+        case STATE_COLON:
+            if (c != ':') {
+                return fail(reader);
+            }
+            nextChar(reader);
+            reader->state = STATE_VALUE;
+            return readValue(reader, skipWhitespace(reader));
+        case STATE_NEXT:
+            if (c == '}' || c == ']') {
+                return closeContainer(reader, c);
+            }
+            if (c != ',') {
+                return fail(reader);
+            }
+            nextChar(reader);
+            c = skipWhitespace(reader);
+            if (reader->is_object[reader->depth - 1]) {
+                break;
+            }
+            return readValue(reader, c);
+        case STATE_FIRST_VALUE:
+            return c == ']' ? closeContainer(reader, c) : readValue(reader, c);
+        case STATE_VALUE:
+            return readValue(reader, c);
+        case STATE_FIRST_KEY:
+            if (c == '}') {
+                return closeContainer(reader, c);
+            }
+            break;
+    }
+    // A key is expected
+    if (c != '"' || !readString(reader)) {
+        return fail(reader);
+    }
+    reader->state = STATE_COLON;
+    return JSON_KEY;
+}
+
+bool jsonReader_skip(JsonReader_t *reader, const JsonToken_t first) {
+    if (first == JSON_ERROR) {
+        return false;
+    }
+    if (first != JSON_OBJECT_START && first != JSON_ARRAY_START) {
+        return true;
+    }
+    // Until the end of the container opened by the first token
+    const int depth = reader->depth;
+    while (reader->depth >= depth) {
+        const JsonToken_t token = jsonReader_next(reader);
+        if (token == JSON_ERROR || token == JSON_END) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int jsonReader_depth(const JsonReader_t *reader) {
+    return reader->depth;
+}
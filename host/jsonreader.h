@@ -0,0 +1,84 @@
+/**
+ * @brief Streaming JSON tokenizer, reading a file a few kilobytes at a time
+ * so that large files don't need to fit in memory.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * @details
+ * jsonReader_next() returns the tokens one by one. Object member names are
+ * returned as JSON_KEY tokens, followed by the tokens of their value.
+ * Strings are unescaped (\uXXXX only for ASCII characters) and truncated to
+ * JSON_MAX_STRING - 1 characters.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JSON_MAX_STRING 256
+#define JSON_MAX_DEPTH 32
+#define JSON_BUFFER_SIZE 4096
+
+typedef enum {
+    JSON_ERROR = -1,
+    JSON_END = 0,           // End of the file, after the top level value
+    JSON_OBJECT_START,
+    JSON_OBJECT_END,
+    JSON_ARRAY_START,
+    JSON_ARRAY_END,
+    JSON_KEY,               // Member name in string
+    JSON_STRING,            // Value in string
+    JSON_NUMBER,            // Value in number
+    JSON_TRUE,
+    JSON_FALSE,
+    JSON_NULL,
+} JsonToken_t;
+
+typedef struct {
+    FILE *file;
+    char buffer[JSON_BUFFER_SIZE];
+    size_t buffer_len;
+    size_t buffer_pos;
+    // Open containers, true for objects, and what the next token can be
+    bool is_object[JSON_MAX_DEPTH];
+    int depth;
+    int state;
+    bool failed;
+    // Value of the last JSON_KEY, JSON_STRING or JSON_NUMBER token
+    char string[JSON_MAX_STRING];
+    double number;
+    // Bytes read, to report the position of errors
+    size_t offset;
+} JsonReader_t;
+
+void jsonReader_init(JsonReader_t *reader, FILE *file);
+
+/**
+ * @return The next token. JSON_ERROR is returned for any syntax error, and
+ *         then for all the following calls.
+ */
+JsonToken_t jsonReader_next(JsonReader_t *reader);
+
+/**
+ * @brief Skip the rest of a value, after its first token has been read,
+ * e.g. skip an object after reading its JSON_OBJECT_START.
+ *
+ * @return False if there's a syntax error.
+ */
+bool jsonReader_skip(JsonReader_t *reader, const JsonToken_t first);
+
+/**
+ * @return The current depth, 1 inside the top level object or array.
+ */
+int jsonReader_depth(const JsonReader_t *reader);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,28 @@
+/**
+ * @brief Host additions to the ML4F API, for the ml4f_invoke()
+ * implementation that runs the model code in the Thumb emulator.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+
+#include "ml4f.h"
+#include "thumbemulator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Get the instructions and memory accesses executed by the last
+ * ml4f_invoke() call, including a failed one.
+ *
+ * @return Statistics of the last invoke, all zero before the first one.
+ */
+const ThumbEmuStats_t *ml4f_last_invoke_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,56 @@
+/**
+ * @brief Host version of ml4f_invoke().
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * ML4F models are compiled to Thumb machine code, which cannot be executed
+ * natively on the host, so the model function is run in the Thumb emulator.
+ * The model and arena are mapped in place into the emulated address space,
+ * together with a stack for the model function.
+ */
+#include <stdio.h>
+#include "ml4f.h"
+#include "ml4f_host.h"
+#include "thumbemulator.h"
+
+// Emulated addresses, like the device flash and RAM
+#define ML4F_HOST_MODEL_ADDRESS         0x00010000u
+#define ML4F_HOST_ARENA_ADDRESS         0x20000000u
+#define ML4F_HOST_STACK_ADDRESS         0x30000000u
+#define ML4F_HOST_STACK_SIZE            (16 * 1024)
+
+// Stops a model stuck in a loop instead of hanging the host
+#define ML4F_HOST_MAX_INSTRUCTIONS      (1ull << 32)
+
+static ThumbEmuStats_t last_stats;
+
+const ThumbEmuStats_t *ml4f_last_invoke_stats(void) {
+    return &last_stats;
+}
+
+int ml4f_invoke(const ml4f_header_t *model, uint8_t *arena) {
+    if (!ml4f_is_valid_header(model))
+        return -1;
+
+    uint32_t stack[ML4F_HOST_STACK_SIZE / sizeof(uint32_t)];
+    ThumbEmu_t emu;
+    thumbEmu_init(&emu);
+    if (thumbEmu_addRegion(&emu, ML4F_HOST_MODEL_ADDRESS, (void *)model, model->object_size, false) != THUMB_EMU_SUCCESS ||
+            thumbEmu_addRegion(&emu, ML4F_HOST_ARENA_ADDRESS, arena, model->arena_bytes, true) != THUMB_EMU_SUCCESS ||
+            thumbEmu_addRegion(&emu, ML4F_HOST_STACK_ADDRESS, stack, sizeof(stack), true) != THUMB_EMU_SUCCESS) {
+        return -1;
+    }
+
+    const ThumbEmuReturn_t result = thumbEmu_call(
+        &emu, ML4F_HOST_MODEL_ADDRESS + model->header_size, ML4F_HOST_MODEL_ADDRESS,
+        ML4F_HOST_ARENA_ADDRESS, ML4F_HOST_STACK_ADDRESS + sizeof(stack), ML4F_HOST_MAX_INSTRUCTIONS);
+    last_stats = emu.stats;
+    if (result != THUMB_EMU_SUCCESS) {
+        fprintf(stderr, "ml4f_invoke: emulator error %d at 0x%08x, instruction 0x%08x, address 0x%08x\n",
+                result, emu.fault_pc, emu.fault_instruction, emu.fault_address);
+        return -1;
+    }
+    return 0;
+}
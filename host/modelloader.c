@@ -0,0 +1,97 @@
+/**
+ * @brief Load a model blob, with its ml_model_header_t, from a file.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ */
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "modelloader.h"
+
+static char *readFile(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    char *data = NULL;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        const long len = ftell(file);
+        // Extra byte to NUL terminate text, and the rest for the alignment
+        data = len >= 0 ? (char *)malloc(((size_t)len + 4) & ~(size_t)3) : NULL;
+        if (data != NULL) {
+            rewind(file);
+            if (fread(data, 1, (size_t)len, file) == (size_t)len) {
+                data[len] = '\0';
+                *size = (size_t)len;
+            } else {
+                free(data);
+                data = NULL;
+            }
+        }
+    }
+    fclose(file);
+    return data;
+}
+
+static int hexValue(const char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Decode the hex literal in place, the output is never longer than the input
+static uint8_t *decodeHexLiteral(char *text, size_t *size) {
+    char *start = strstr(text, "hex`");
+    if (start == NULL) {
+        return NULL;
+    }
+    start += 4;
+    uint8_t *out = (uint8_t *)text;
+    size_t len = 0;
+    int high = -1;
+    for (const char *c = start; *c != '`'; c++) {
+        if (*c == '\0') {
+            return NULL;
+        }
+        if (isspace((unsigned char)*c)) {
+            continue;
+        }
+        const int value = hexValue(*c);
+        if (value < 0) {
+            return NULL;
+        }
+        if (high < 0) {
+            high = value;
+        } else {
+            out[len++] = (uint8_t)(high << 4 | value);
+            high = -1;
+        }
+    }
+    if (high >= 0 || len == 0) {
+        return NULL;
+    }
+    *size = len;
+    return out;
+}
+
+void *modelLoader_load(const char *path, size_t *size) {
+    size_t file_size = 0;
+    char *data = readFile(path, &file_size);
+    if (data == NULL) {
+        return NULL;
+    }
+    const size_t path_len = strlen(path);
+    if (path_len > 3 && strcmp(path + path_len - 3, ".ts") == 0) {
+        if (decodeHexLiteral(data, &file_size) == NULL) {
+            free(data);
+            return NULL;
+        }
+    }
+    *size = file_size;
+    return data;
+}
@@ -0,0 +1,29 @@
+/**
+ * @brief Load a model blob, with its ml_model_header_t, from a file.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Load a model from a MakeCode autogenerated.ts file, reading the
+ * hex`...` literal returned by getModelBlob(), or from a raw binary file.
+ *
+ * @param path Path to the .ts file, any other extension is read as binary.
+ * @param size Output of the model size in bytes.
+ * @return A 4-byte aligned buffer to free() by the caller, or NULL if the
+ *         file can't be read or doesn't contain a model.
+ */
+void *modelLoader_load(const char *path, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,149 @@
+/**
+ * @brief Test the single producer, single consumer sample queue.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * Checks the queue order, wrap around, and the dropped samples and high
+ * water mark when it's full. Then runs a producer and a consumer in two
+ * threads, and checks every sample is either received in order, with its
+ * values intact, or counted as dropped.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "mlqueue.h"
+#include "testcheck.h"
+
+#define THREAD_SAMPLES 200000
+
+static MlSample_t makeSample(const uint32_t i) {
+    const MlSample_t sample = {
+        i, {(int16_t)i, (int16_t)(i >> 16), (int16_t)~i},
+    };
+    return sample;
+}
+
+static int isSample(const MlSample_t *sample, const uint32_t i) {
+    const MlSample_t expected = makeSample(i);
+    return sample->time_us == expected.time_us && sample->value[0] == expected.value[0] &&
+           sample->value[1] == expected.value[1] && sample->value[2] == expected.value[2];
+}
+
+static int testSingleThread() {
+    static MlSampleQueue_t queue;
+    MlSample_t out[MLQUEUE_CAPACITY];
+    int failures = 0;
+
+    mlqueue_init(&queue);
+    failures += check("empty", mlqueue_len(&queue) == 0 && mlqueue_pop(&queue, out, 4) == 0);
+
+    // Push and pop in uneven amounts, so that the positions wrap around
+    uint32_t pushed = 0, popped = 0;
+    for (int round = 0; round < 100; round++) {
+        for (int i = 0; i < round % 7 + 1; i++) {
+            const MlSample_t sample = makeSample(pushed);
+            failures += check("push", mlqueue_push(&queue, &sample));
+            pushed++;
+        }
+        const size_t len = mlqueue_pop(&queue, out, round % 9 + 1);
+        for (size_t i = 0; i < len; i++) {
+            failures += check("order", isSample(&out[i], popped++));
+        }
+        failures += check("len", mlqueue_len(&queue) == pushed - popped);
+    }
+    popped += mlqueue_pop(&queue, out, MLQUEUE_CAPACITY);
+    failures += check("drained", popped == pushed && mlqueue_len(&queue) == 0);
+
+    // When full the new samples are dropped, the queued ones are kept
+    uint32_t dropped = 0;
+    for (uint32_t i = 0; i < MLQUEUE_CAPACITY + 3; i++) {
+        const MlSample_t sample = makeSample(i);
+        const bool queued = mlqueue_push(&queue, &sample);
+        failures += check("full", queued == (i < MLQUEUE_CAPACITY));
+        dropped += !queued;
+    }
+    failures += check("dropped", dropped == 3 && queue.high_water == MLQUEUE_CAPACITY);
+    const size_t len = mlqueue_pop(&queue, out, MLQUEUE_CAPACITY);
+    failures += check("kept", len == MLQUEUE_CAPACITY && isSample(&out[0], 0) &&
+                      isSample(&out[MLQUEUE_CAPACITY - 1], MLQUEUE_CAPACITY - 1));
+
+    mlqueue_init(&queue);
+    failures += check("init", queue.high_water == 0 && mlqueue_len(&queue) == 0);
+
+    printf("Single thread: %s\n", failures ? "FAIL" : "PASS");
+    return failures;
+}
+
+typedef struct {
+    MlSampleQueue_t queue;
+    uint32_t accepted;
+    int finished;
+} ThreadTest_t;
+
+static void *producer(void *context) {
+    ThreadTest_t *test = (ThreadTest_t *)context;
+    for (uint32_t i = 0; i < THREAD_SAMPLES; i++) {
+        const MlSample_t sample = makeSample(i);
+        // Wait for space most of the time, so that the consumer keeps up
+        // and most samples go through, but not always, to drop some
+        while (i % 64 != 0 && mlqueue_len(&test->queue) >= MLQUEUE_CAPACITY) {
+            sched_yield();
+        }
+        test->accepted += mlqueue_push(&test->queue, &sample);
+    }
+    __atomic_store_n(&test->finished, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static int testThreads() {
+    static ThreadTest_t test;
+    MlSample_t out[8];
+    int failures = 0;
+
+    mlqueue_init(&test.queue);
+    test.accepted = 0;
+    test.finished = 0;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, producer, &test) != 0) {
+        printf("Threads: FAIL, the thread could not be created\n");
+        return 1;
+    }
+    // The samples received must be increasing, the gaps are dropped samples
+    uint32_t received = 0;
+    int64_t last = -1;
+    while (true) {
+        // Checked before popping, so that the last samples are not missed
+        const int done = __atomic_load_n(&test.finished, __ATOMIC_ACQUIRE);
+        const size_t len = mlqueue_pop(&test.queue, out, 1 + received % 8);
+        for (size_t i = 0; i < len && failures < 5; i++) {
+            failures += check("increasing", (int64_t)out[i].time_us > last);
+            failures += check("values", isSample(&out[i], out[i].time_us));
+            last = out[i].time_us;
+        }
+        received += len;
+        if (len == 0) {
+            if (done) {
+                break;
+            }
+            sched_yield();
+        }
+    }
+    pthread_join(thread, NULL);
+
+    // Every sample the queue took must be received, the others were dropped
+    failures += check("all accounted", received == test.accepted);
+    printf("Threads: %s (%u received, %u dropped, high water %u)\n", failures ? "FAIL" : "PASS",
+           (unsigned)received, (unsigned)(THREAD_SAMPLES - test.accepted), (unsigned)test.queue.high_water);
+    return failures;
+}
+
+int main() {
+    int failures = 0;
+    failures += testSingleThread();
+    failures += testThreads();
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,264 @@
+/**
+ * @brief Write mlrecording.h recording files, and map them into memory to
+ * read them with mlrecording_open().
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ */
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "recordingfile.h"
+
+#define ALIGN4(size) (((size) + 3) & ~(size_t)3)
+
+static size_t sampleSize(const RecordingWriter_t *writer) {
+    return writer->header.sample_type == MLRECORDING_INT16 ? sizeof(int16_t) : sizeof(float);
+}
+
+// Double the capacity until it fits len elements, the failure is sticky
+static bool reserve(RecordingWriter_t *writer, void **buffer, size_t *capacity, const size_t len,
+                    const size_t element_size) {
+    if (len <= *capacity) {
+        return true;
+    }
+    size_t new_capacity = *capacity ? *capacity : 64;
+    while (new_capacity < len) {
+        new_capacity *= 2;
+    }
+    void *new_buffer = realloc(*buffer, new_capacity * element_size);
+    if (new_buffer == NULL) {
+        writer->failed = true;
+        return false;
+    }
+    *buffer = new_buffer;
+    *capacity = new_capacity;
+    return true;
+}
+
+// The index and the expected outputs grow together
+static bool reserveRecordings(RecordingWriter_t *writer, const size_t len) {
+    if (len <= writer->recordings_capacity) {
+        return true;
+    }
+    size_t capacity = writer->recordings_capacity ? writer->recordings_capacity : 64;
+    while (capacity < len) {
+        capacity *= 2;
+    }
+    MlRecordingEntry_t *index = (MlRecordingEntry_t *)realloc(writer->index, capacity * sizeof(*index));
+    if (index == NULL) {
+        return false;
+    }
+    writer->index = index;
+    if (writer->header.features > 0) {
+        float *features = (float *)realloc(writer->features, capacity * writer->header.features * sizeof(float));
+        if (features == NULL) {
+            return false;
+        }
+        writer->features = features;
+    }
+    if (writer->header.outputs > 0) {
+        float *outputs = (float *)realloc(writer->outputs, capacity * writer->header.outputs * sizeof(float));
+        if (outputs == NULL) {
+            return false;
+        }
+        writer->outputs = outputs;
+    }
+    writer->recordings_capacity = capacity;
+    return true;
+}
+
+static int16_t toInt16(const float value, const float scale) {
+    const float scaled = value * scale;
+    if (!(scaled > INT16_MIN)) {
+        return INT16_MIN;
+    }
+    if (scaled > INT16_MAX) {
+        return INT16_MAX;
+    }
+    return (int16_t)lrintf(scaled);
+}
+
+void recordingWriter_init(
+    RecordingWriter_t *writer, const mlrecording_sample_type_t sample_type, const int dimensions,
+    const float sample_scale, const uint32_t period_ms, const uint32_t features, const uint32_t outputs
+) {
+    memset(writer, 0, sizeof(*writer));
+    writer->header.magic = MLRECORDING_MAGIC;
+    writer->header.version = MLRECORDING_VERSION;
+    writer->header.header_size = sizeof(MlRecordingHeader_t);
+    writer->header.sample_type = (uint8_t)sample_type;
+    writer->header.dimensions = (uint8_t)dimensions;
+    writer->header.period_ms = period_ms;
+    writer->header.features = features;
+    writer->header.outputs = outputs;
+    writer->header.sample_scale = sample_type == MLRECORDING_INT16 ? sample_scale : 1.0f;
+    writer->failed = dimensions < 1 || dimensions > MLRECORDING_MAX_DIMENSIONS;
+}
+
+int recordingWriter_label(RecordingWriter_t *writer, const char *name) {
+    for (uint32_t i = 0; i < writer->header.labels; i++) {
+        if (strncmp(writer->labels[i], name, MLRECORDING_LABEL_SIZE - 1) == 0) {
+            return (int)i;
+        }
+    }
+    if (writer->header.labels == UINT16_MAX ||
+            !reserve(writer, (void **)&writer->labels, &writer->labels_capacity, writer->header.labels + 1,
+                     MLRECORDING_LABEL_SIZE)) {
+        return -1;
+    }
+    char *label = writer->labels[writer->header.labels];
+    memset(label, 0, MLRECORDING_LABEL_SIZE);
+    strncpy(label, name, MLRECORDING_LABEL_SIZE - 1);
+    return writer->header.labels++;
+}
+
+bool recordingWriter_add(
+    RecordingWriter_t *writer, const int label, const float *const *planes, const uint32_t samples,
+    const float *features, const float *outputs
+) {
+    MlRecordingHeader_t *header = &writer->header;
+    if (writer->failed || label >= (int)header->labels || (features == NULL) != (header->features == 0) ||
+            (outputs == NULL) != (header->outputs == 0)) {
+        writer->failed = true;
+        return false;
+    }
+    const size_t total_samples = (size_t)header->total_samples + samples;
+    if (total_samples > UINT32_MAX ||
+            !reserve(writer, (void **)&writer->samples, &writer->samples_capacity,
+                     total_samples * header->dimensions, sampleSize(writer)) ||
+            !reserveRecordings(writer, header->recordings + 1)) {
+        writer->failed = true;
+        return false;
+    }
+
+    const size_t first_value = (size_t)header->total_samples * header->dimensions;
+    for (int d = 0; d < header->dimensions; d++) {
+        const size_t offset = first_value + (size_t)d * samples;
+        if (header->sample_type == MLRECORDING_INT16) {
+            int16_t *plane = (int16_t *)writer->samples + offset;
+            for (uint32_t i = 0; i < samples; i++) {
+                plane[i] = toInt16(planes[d][i], header->sample_scale);
+            }
+        } else {
+            memcpy((float *)writer->samples + offset, planes[d], samples * sizeof(float));
+        }
+    }
+    if (features != NULL) {
+        memcpy(writer->features + (size_t)header->recordings * header->features, features,
+               header->features * sizeof(float));
+    }
+    if (outputs != NULL) {
+        memcpy(writer->outputs + (size_t)header->recordings * header->outputs, outputs,
+               header->outputs * sizeof(float));
+    }
+    MlRecordingEntry_t *entry = &writer->index[header->recordings];
+    entry->first_sample = header->total_samples;
+    entry->samples = samples;
+    entry->label = label < 0 ? MLRECORDING_NO_LABEL : (uint32_t)label;
+    header->recordings++;
+    header->total_samples = (uint32_t)total_samples;
+    return true;
+}
+
+void *recordingWriter_build(const RecordingWriter_t *writer, size_t *size) {
+    if (writer->failed) {
+        return NULL;
+    }
+    MlRecordingHeader_t header = writer->header;
+    const size_t labels_size = (size_t)header.labels * MLRECORDING_LABEL_SIZE;
+    const size_t index_size = (size_t)header.recordings * sizeof(MlRecordingEntry_t);
+    const size_t samples_size = (size_t)header.total_samples * header.dimensions * sampleSize(writer);
+    const size_t features_size = (size_t)header.recordings * header.features * sizeof(float);
+    const size_t outputs_size = (size_t)header.recordings * header.outputs * sizeof(float);
+
+    header.labels_offset = sizeof(MlRecordingHeader_t);
+    header.index_offset = header.labels_offset + labels_size;
+    header.samples_offset = header.index_offset + index_size;
+    header.features_offset = ALIGN4(header.samples_offset + samples_size);
+    header.outputs_offset = header.features_offset + features_size;
+    const size_t file_size = header.outputs_offset + outputs_size;
+    if (file_size > UINT32_MAX) {
+        return NULL;
+    }
+    header.file_size = (uint32_t)file_size;
+
+    uint8_t *data = (uint8_t *)calloc(1, ALIGN4(file_size));
+    if (data == NULL) {
+        return NULL;
+    }
+    memcpy(data, &header, sizeof(header));
+    if (labels_size > 0) {
+        memcpy(data + header.labels_offset, writer->labels, labels_size);
+    }
+    if (index_size > 0) {
+        memcpy(data + header.index_offset, writer->index, index_size);
+    }
+    if (samples_size > 0) {
+        memcpy(data + header.samples_offset, writer->samples, samples_size);
+    }
+    if (features_size > 0) {
+        memcpy(data + header.features_offset, writer->features, features_size);
+    }
+    if (outputs_size > 0) {
+        memcpy(data + header.outputs_offset, writer->outputs, outputs_size);
+    }
+    *size = file_size;
+    return data;
+}
+
+bool recordingWriter_save(const RecordingWriter_t *writer, const char *path) {
+    size_t size;
+    void *data = recordingWriter_build(writer, &size);
+    if (data == NULL) {
+        return false;
+    }
+    FILE *file = fopen(path, "wb");
+    bool success = file != NULL && fwrite(data, 1, size, file) == size;
+    if (file != NULL) {
+        success = (fclose(file) == 0) && success;
+    }
+    free(data);
+    return success;
+}
+
+void recordingWriter_free(RecordingWriter_t *writer) {
+    free(writer->labels);
+    free(writer->index);
+    free(writer->samples);
+    free(writer->features);
+    free(writer->outputs);
+    memset(writer, 0, sizeof(*writer));
+    writer->failed = true;
+}
+
+const void *recordingFile_map(const char *path, size_t *size) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping stays valid after closing the file
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    *size = (size_t)st.st_size;
+    return data;
+}
+
+void recordingFile_unmap(const void *data, const size_t size) {
+    if (data != NULL) {
+        munmap((void *)data, size);
+    }
+}
@@ -0,0 +1,101 @@
+/**
+ * @brief Write mlrecording.h recording files, and map them into memory to
+ * read them with mlrecording_open().
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mlrecording.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    MlRecordingHeader_t header;
+    char (*labels)[MLRECORDING_LABEL_SIZE];
+    MlRecordingEntry_t *index;
+    uint8_t *samples;
+    float *features;
+    float *outputs;
+    // Allocated number of labels, recordings and samples
+    size_t labels_capacity;
+    size_t recordings_capacity;
+    size_t samples_capacity;
+    bool failed;
+} RecordingWriter_t;
+
+/**
+ * @brief Start a recording file, the recordings are kept in memory until
+ * recordingWriter_build() or recordingWriter_save().
+ *
+ * @param sample_scale The MLRECORDING_INT16 samples are stored multiplied
+ *                     by it, ignored for MLRECORDING_FLOAT32.
+ * @param features Expected filter outputs per recording, or 0.
+ * @param outputs Expected model outputs per recording, or 0.
+ */
+void recordingWriter_init(
+    RecordingWriter_t *writer, const mlrecording_sample_type_t sample_type, const int dimensions,
+    const float sample_scale, const uint32_t period_ms, const uint32_t features, const uint32_t outputs);
+
+/**
+ * @brief Get the index of a label, adding it if it's new.
+ *
+ * @return The label index, or -1 if it can't be added. Names longer than
+ *         MLRECORDING_LABEL_SIZE - 1 are truncated.
+ */
+int recordingWriter_label(RecordingWriter_t *writer, const char *name);
+
+/**
+ * @brief Add a recording.
+ *
+ * @param label Index from recordingWriter_label(), or -1 if not labelled.
+ * @param planes One array of samples values per dimension.
+ * @param features The expected filter output, or NULL if there's none.
+ * @param outputs The expected model output, or NULL if there's none.
+ * @return False if the recording could not be added, then the file can't
+ *         be built either.
+ */
+bool recordingWriter_add(
+    RecordingWriter_t *writer, const int label, const float *const *planes, const uint32_t samples,
+    const float *features, const float *outputs);
+
+/**
+ * @brief Build the file in memory.
+ *
+ * @param size Output of the file size.
+ * @return A 4-byte aligned buffer to free() by the caller, or NULL if a
+ *         recording could not be added or there's not enough memory.
+ */
+void *recordingWriter_build(const RecordingWriter_t *writer, size_t *size);
+
+/**
+ * @brief Build the file and write it to path.
+ */
+bool recordingWriter_save(const RecordingWriter_t *writer, const char *path);
+
+/**
+ * @brief Free the recordings added, the writer can't be used after.
+ */
+void recordingWriter_free(RecordingWriter_t *writer);
+
+/**
+ * @brief Map a file into memory, read-only, without reading it.
+ *
+ * @param size Output of the file size.
+ * @return The mapped file, to release with recordingFile_unmap(), or NULL
+ *         if it can't be mapped.
+ */
+const void *recordingFile_map(const char *path, size_t *size);
+
+void recordingFile_unmap(const void *data, const size_t size);
+
+#ifdef __cplusplus
+}
+#endif
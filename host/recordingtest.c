@@ -0,0 +1,325 @@
+/**
+ * @brief Test the recording files, from recordingfile.c to mlrecording.c,
+ * and the ML-Trainer JSON reader.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * Writes recordings of different lengths, in float and int16, and checks they
+ * are read back the same, from memory and from a mapped file. Checks invalid
+ * files are rejected, and converts an ML-Trainer export.
+ *
+ * Usage: recordingtest <ML-Trainer export.json>
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mldataprocessor.h"
+#include "mlrecording.h"
+#include "recordingfile.h"
+#include "trainerjson.h"
+#include "testcheck.h"
+
+#define TEST_FILE "recordingtest.mlrec"
+
+static float testSample(const int r, const int d, const int i) {
+    return (float)(r * 100 + d * 10 + i) / 64.0f - 1.0f;
+}
+
+static void *buildTestFile(const mlrecording_sample_type_t type, size_t *size) {
+    static float planes[3][3][40];
+    RecordingWriter_t writer;
+    recordingWriter_init(&writer, type, 3, 1000.0f, 20, 2, 1);
+    const int walk = recordingWriter_label(&writer, "walk");
+    const int jump = recordingWriter_label(&writer, "jump");
+    const int lengths[3] = {40, 7, 33};
+    const int labels[3] = {jump, -1, walk};
+    for (int r = 0; r < 3; r++) {
+        for (int d = 0; d < 3; d++) {
+            for (int i = 0; i < lengths[r]; i++) {
+                planes[r][d][i] = testSample(r, d, i);
+            }
+        }
+        const float *recording_planes[3] = {planes[r][0], planes[r][1], planes[r][2]};
+        const float features[2] = {(float)r, -(float)r};
+        const float output = r * 0.5f;
+        recordingWriter_add(&writer, labels[r], recording_planes, lengths[r], features, &output);
+    }
+    void *data = recordingWriter_build(&writer, size);
+    recordingWriter_free(&writer);
+    return data;
+}
+
+static int checkRecording(const MlRecording_t *recording, const mlrecording_sample_type_t type) {
+    int failures = 0;
+    const MlRecordingHeader_t *header = &recording->header;
+    failures += check("header", header->recordings == 3 && header->labels == 2 && header->dimensions == 3 &&
+                      header->total_samples == 80 && header->period_ms == 20 && header->sample_type == type);
+    failures += check("labels", strcmp(mlrecording_labelName(recording, 0), "walk") == 0 &&
+                      strcmp(mlrecording_labelName(recording, 1), "jump") == 0 &&
+                      mlrecording_labelName(recording, 2) == NULL);
+    const MlRecordingEntry_t *entry = mlrecording_entry(recording, 1);
+    failures += check("entry", entry != NULL && entry->first_sample == 40 && entry->samples == 7 &&
+                      entry->label == MLRECORDING_NO_LABEL && mlrecording_entry(recording, 0)->label == 1 &&
+                      mlrecording_entry(recording, 3) == NULL);
+
+    // Read in chunks that don't divide the recordings
+    const float tolerance = type == MLRECORDING_INT16 ? 0.00051f : 0.0f;
+    const int lengths[3] = {40, 7, 33};
+    for (int r = 0; r < 3; r++) {
+        int read = 0;
+        float samples[6 * 3];
+        size_t len;
+        while ((len = mlrecording_readSamples(recording, r, read, 6, samples)) > 0) {
+            for (size_t i = 0; i < len; i++) {
+                for (int d = 0; d < 3; d++) {
+                    failures += check("sample", fabsf(samples[i * 3 + d] - testSample(r, d, read + i)) <= tolerance);
+                }
+            }
+            read += len;
+        }
+        failures += check("samples read", read == lengths[r]);
+        failures += check("features", mlrecording_features(recording, r)[1] == -(float)r &&
+                          mlrecording_outputs(recording, r)[0] == r * 0.5f);
+    }
+
+    int16_t raw[3];
+    const size_t raw_len = mlrecording_readSamplesInt16(recording, 2, 32, 4, raw);
+    if (type == MLRECORDING_INT16) {
+        failures += check("int16", raw_len == 1 && raw[1] == (int16_t)lrintf(testSample(2, 1, 32) * 1000.0f));
+    } else {
+        failures += check("int16 of float file", raw_len == 0);
+    }
+    failures += check("read out of range", mlrecording_readSamples(recording, 3, 0, 1, (float *)raw) == 0 &&
+                      mlrecording_features(recording, 3) == NULL);
+    return failures;
+}
+
+static int testRoundTrip() {
+    int failures = 0;
+    const mlrecording_sample_type_t types[2] = {MLRECORDING_FLOAT32, MLRECORDING_INT16};
+    for (int t = 0; t < 2; t++) {
+        size_t size;
+        void *data = buildTestFile(types[t], &size);
+        MlRecording_t recording;
+        if (check("build", data != NULL) || check("open", mlrecording_open(&recording, data, size))) {
+            free(data);
+            return failures + 1;
+        }
+        failures += check("file size", mlrecording_fileSize(data) == size);
+        failures += checkRecording(&recording, types[t]);
+
+        // The same from a mapped file
+        FILE *file = fopen(TEST_FILE, "wb");
+        failures += check("write", file != NULL && fwrite(data, 1, size, file) == size && fclose(file) == 0);
+        size_t mapped_size;
+        const void *mapped = recordingFile_map(TEST_FILE, &mapped_size);
+        failures += check("map", mapped != NULL && mapped_size == size && memcmp(mapped, data, size) == 0);
+        if (mapped != NULL && mlrecording_open(&recording, mapped, mapped_size)) {
+            failures += checkRecording(&recording, types[t]);
+        }
+        recordingFile_unmap(mapped, mapped_size);
+        remove(TEST_FILE);
+        free(data);
+    }
+
+    // Values out of the int16 range saturate
+    RecordingWriter_t writer;
+    recordingWriter_init(&writer, MLRECORDING_INT16, 1, 1000.0f, 0, 0, 0);
+    const float values[3] = {40.0f, -40.0f, -0.0004f};
+    const float *planes[1] = {values};
+    failures += check("add", recordingWriter_add(&writer, -1, planes, 3, NULL, NULL));
+    size_t size;
+    void *data = recordingWriter_build(&writer, &size);
+    MlRecording_t recording;
+    int16_t raw[3];
+    failures += check("saturated", data != NULL && mlrecording_open(&recording, data, size) &&
+                      mlrecording_readSamplesInt16(&recording, 0, 0, 3, raw) == 3 &&
+                      raw[0] == INT16_MAX && raw[1] == INT16_MIN && raw[2] == 0);
+    free(data);
+
+    // A recording that doesn't match the file fails the whole file
+    failures += check("missing features", !recordingWriter_add(&writer, -1, planes, 3, values, NULL));
+    data = recordingWriter_build(&writer, &size);
+    failures += check("failed writer", data == NULL);
+    free(data);
+    recordingWriter_free(&writer);
+
+    printf("Round trip: %s\n", failures ? "FAIL" : "PASS");
+    return failures;
+}
+
+// Every int16 value must be read as the same float the data processor gets
+static int testInt16Conversion() {
+    static float values[UINT16_MAX + 1], read[UINT16_MAX + 1], converted[UINT16_MAX + 1];
+    static int16_t raw[UINT16_MAX + 1];
+    for (int i = 0; i <= UINT16_MAX; i++) {
+        values[i] = (INT16_MIN + i) / 1000.0f;
+    }
+    RecordingWriter_t writer;
+    recordingWriter_init(&writer, MLRECORDING_INT16, 1, 1000.0f, 0, 0, 0);
+    const float *planes[1] = {values};
+    recordingWriter_add(&writer, -1, planes, UINT16_MAX + 1, NULL, NULL);
+    size_t size;
+    void *data = recordingWriter_build(&writer, &size);
+    recordingWriter_free(&writer);
+    MlRecording_t recording;
+    int failures = check("open", data != NULL && mlrecording_open(&recording, data, size) &&
+                         mlrecording_readSamplesInt16(&recording, 0, 0, UINT16_MAX + 1, raw) == UINT16_MAX + 1 &&
+                         mlrecording_readSamples(&recording, 0, 0, UINT16_MAX + 1, read) == UINT16_MAX + 1);
+    if (failures == 0) {
+        failures += check("all int16 values", raw[0] == INT16_MIN && raw[UINT16_MAX] == INT16_MAX);
+        mldp_convertInt16(raw, converted, UINT16_MAX + 1, 1000.0f);
+        failures += check("same floats as mldp_convertInt16", memcmp(read, converted, sizeof(read)) == 0);
+    }
+    free(data);
+    printf("Int16 conversion: %s\n", failures ? "FAIL" : "PASS");
+    return failures;
+}
+
+static int testInvalidFiles() {
+    int failures = 0;
+    size_t size;
+    uint32_t *data = (uint32_t *)buildTestFile(MLRECORDING_FLOAT32, &size);
+    MlRecording_t recording;
+    MlRecordingHeader_t header;
+    memcpy(&header, data, sizeof(header));
+
+    failures += check("truncated", !mlrecording_open(&recording, data, size - 1));
+    failures += check("misaligned", !mlrecording_open(&recording, (uint8_t *)data + 2, size - 2));
+
+    data[0] ^= 1;
+    failures += check("magic", !mlrecording_open(&recording, data, size) && mlrecording_fileSize(data) == 0);
+    data[0] ^= 1;
+
+    // An index entry past the samples
+    MlRecordingEntry_t *index = (MlRecordingEntry_t *)((uint8_t *)data + header.index_offset);
+    index[2].samples++;
+    failures += check("index", !mlrecording_open(&recording, data, size));
+    index[2].samples--;
+    index[2].label = 2;
+    failures += check("label", !mlrecording_open(&recording, data, size));
+    index[2].label = 0;
+
+    // A section past the end of the file, the sections are only checked
+    // to be within the file, they could overlap
+    MlRecordingHeader_t *file_header = (MlRecordingHeader_t *)data;
+    file_header->total_samples += 1000;
+    failures += check("section", !mlrecording_open(&recording, data, size));
+    file_header->total_samples -= 1000;
+
+    char *label = (char *)data + header.labels_offset;
+    memset(label, 'a', MLRECORDING_LABEL_SIZE);
+    failures += check("label termination", !mlrecording_open(&recording, data, size));
+    label[MLRECORDING_LABEL_SIZE - 1] = '\0';
+    failures += check("valid", mlrecording_open(&recording, data, size));
+    free(data);
+
+    printf("Invalid files: %s\n", failures ? "FAIL" : "PASS");
+    return failures;
+}
+
+typedef struct {
+    RecordingWriter_t writer;
+    uint32_t recordings;
+    uint32_t max_action;
+} TrainerTest_t;
+
+static bool addRecording(const TrainerRecording_t *recording, void *context) {
+    TrainerTest_t *test = (TrainerTest_t *)context;
+    test->recordings++;
+    test->max_action = recording->action_index;
+    const int label = recordingWriter_label(&test->writer, recording->action);
+    return recordingWriter_add(&test->writer, label, recording->samples, recording->len, NULL, NULL);
+}
+
+static bool readJson(const char *json, TrainerTest_t *test) {
+    FILE *file = fmemopen((void *)json, strlen(json), "rb");
+    recordingWriter_init(&test->writer, MLRECORDING_FLOAT32, 3, 1.0f, 0, 0, 0);
+    test->recordings = 0;
+    const bool success = file != NULL && trainerJson_read(file, addRecording, test, NULL, 0);
+    if (file != NULL) {
+        fclose(file);
+    }
+    return success;
+}
+
+static int testTrainerJson(const char *path) {
+    static TrainerTest_t test;
+    int failures = 0;
+
+    // Other members are ignored, wherever they are
+    const char *valid =
+        "[{\"ID\": 1, \"name\": \"A \\\"b\\\" \\u0043\", \"icon\": {\"x\": [true, null]},\n"
+        "  \"recordings\": [{\"data\": {\"z\": [3, 4e-1], \"x\": [-1.5, 2], \"y\": [0, 0]}, \"ID\": [1, {}]}]},\n"
+        " {\"name\": \"empty\", \"recordings\": []}]";
+    failures += check("valid JSON", readJson(valid, &test) && test.recordings == 1 && test.max_action == 0);
+    size_t size;
+    void *data = recordingWriter_build(&test.writer, &size);
+    MlRecording_t recording;
+    float samples[6];
+    if (!check("open JSON", data != NULL && mlrecording_open(&recording, data, size))) {
+        failures += check("JSON label", strcmp(mlrecording_labelName(&recording, 0), "A \"b\" C") == 0);
+        failures += check("JSON samples", mlrecording_readSamples(&recording, 0, 0, 2, samples) == 2 &&
+                          samples[0] == -1.5f && samples[2] == 3.0f && samples[5] == 0.4f);
+    }
+    free(data);
+    recordingWriter_free(&test.writer);
+
+    const char *invalid[] = {
+        "[{\"name\": \"a\", \"recordings\": [{\"data\": {\"x\": [1], \"y\": [1, 2], \"z\": [1]}}]}]",
+        "[{\"name\": \"a\", \"recordings\": [{\"data\": {\"x\": [1], \"y\": [1], \"z\": [1]}}]",
+        "[{\"name\": \"a\", \"recordings\": [{\"data\": {\"x\": [\"1\"], \"y\": [1], \"z\": [1]}}]}]",
+        "[{\"name\": \"a\" \"recordings\": []}]",
+        "[{\"name\": \"a\", \"recordings\": []},]",
+        "{\"name\": \"a\"}",
+        "[] []",
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        if (check("invalid JSON", !readJson(invalid[i], &test))) {
+            printf("  %s\n", invalid[i]);
+            failures++;
+        }
+        recordingWriter_free(&test.writer);
+    }
+
+    // The ML-Trainer export, with recordings of different lengths
+    FILE *file = fopen(path, "rb");
+    recordingWriter_init(&test.writer, MLRECORDING_INT16, 3, 1000.0f, 0, 0, 0);
+    test.recordings = 0;
+    char error[128] = "";
+    failures += check("export", file != NULL && trainerJson_read(file, addRecording, &test, error, sizeof(error)));
+    if (file != NULL) {
+        fclose(file);
+    }
+    data = recordingWriter_build(&test.writer, &size);
+    if (!check("open export", data != NULL && mlrecording_open(&recording, data, size))) {
+        int16_t raw[3];
+        failures += check("export recordings", recording.header.recordings == 57 && recording.header.labels == 5);
+        failures += check("export label", strcmp(mlrecording_labelName(&recording, 0), "Not a spell") == 0 &&
+                          mlrecording_entry(&recording, 56)->label == 4);
+        failures += check("export samples", mlrecording_entry(&recording, 0)->samples == 44 &&
+                          mlrecording_readSamplesInt16(&recording, 0, 0, 1, raw) == 1 && raw[0] == -984);
+    }
+    free(data);
+    recordingWriter_free(&test.writer);
+
+    printf("ML-Trainer JSON: %s %s\n", failures ? "FAIL" : "PASS", error);
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        printf("Usage: %s <ML-Trainer export.json>\n", argv[0]);
+        return 1;
+    }
+    int failures = 0;
+    failures += testRoundTrip();
+    failures += testInt16Conversion();
+    failures += testInvalidFiles();
+    failures += testTrainerJson(argv[1]);
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
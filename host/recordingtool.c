@@ -0,0 +1,124 @@
+/**
+ * @brief Convert ML-Trainer data exports to recording files, and print the
+ * contents of recording files.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * The ML-Trainer samples are in g, the --int16 files store them in milli-g.
+ *
+ * Usage: mlrunner_recording convert [--int16] [--period <ms>] <export.json> <output.mlrec>
+ *        mlrunner_recording info <recording.mlrec>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mlrecording.h"
+#include "recordingfile.h"
+#include "trainerjson.h"
+
+static void printUsage(const char *name) {
+    printf("Usage: %s convert [--int16] [--period <ms>] <export.json> <output.mlrec>\n", name);
+    printf("       %s info <recording.mlrec>\n", name);
+}
+
+static bool addRecording(const TrainerRecording_t *recording, void *context) {
+    RecordingWriter_t *writer = (RecordingWriter_t *)context;
+    const int label = recordingWriter_label(writer, recording->action);
+    return label >= 0 && recordingWriter_add(writer, label, recording->samples, recording->len, NULL, NULL);
+}
+
+static int convert(const char *input, const char *output, const bool int16, const uint32_t period_ms) {
+    FILE *file = fopen(input, "rb");
+    if (file == NULL) {
+        printf("Can't open %s\n", input);
+        return 1;
+    }
+    RecordingWriter_t writer;
+    recordingWriter_init(&writer, int16 ? MLRECORDING_INT16 : MLRECORDING_FLOAT32, TRAINER_JSON_DIMENSIONS,
+                         1000.0f, period_ms, 0, 0);
+    char error[128];
+    const bool read = trainerJson_read(file, addRecording, &writer, error, sizeof(error));
+    fclose(file);
+    if (!read) {
+        printf("%s: %s\n", input, error);
+        recordingWriter_free(&writer);
+        return 1;
+    }
+    const MlRecordingHeader_t header = writer.header;
+    const bool saved = recordingWriter_save(&writer, output);
+    recordingWriter_free(&writer);
+    if (!saved) {
+        printf("Can't write %s\n", output);
+        return 1;
+    }
+    printf("%s: %u recordings, %u labels, %u samples\n", output, (unsigned)header.recordings,
+           (unsigned)header.labels, (unsigned)header.total_samples);
+    return 0;
+}
+
+static int info(const char *path) {
+    size_t size;
+    const void *data = recordingFile_map(path, &size);
+    MlRecording_t recording;
+    if (data == NULL || !mlrecording_open(&recording, data, size)) {
+        printf("%s: not a valid recording file\n", path);
+        recordingFile_unmap(data, size);
+        return 1;
+    }
+    const MlRecordingHeader_t *header = &recording.header;
+    printf("%s: version %u, %u bytes\n", path, header->version, (unsigned)header->file_size);
+    printf("  %u recordings, %u samples of %u dimensions, %s",
+           (unsigned)header->recordings, (unsigned)header->total_samples, header->dimensions,
+           header->sample_type == MLRECORDING_INT16 ? "int16" : "float32");
+    if (header->sample_type == MLRECORDING_INT16) {
+        printf(" scaled by %g", header->sample_scale);
+    }
+    printf(", period %u ms\n", (unsigned)header->period_ms);
+    printf("  expected outputs: %u features, %u model outputs\n", (unsigned)header->features,
+           (unsigned)header->outputs);
+    // Recordings and samples of each label, the last row is unlabelled
+    for (uint32_t label = 0; label <= header->labels; label++) {
+        uint32_t recordings = 0, min = UINT32_MAX, max = 0;
+        for (uint32_t i = 0; i < header->recordings; i++) {
+            const MlRecordingEntry_t *entry = mlrecording_entry(&recording, i);
+            if (entry->label == label || (label == header->labels && entry->label == MLRECORDING_NO_LABEL)) {
+                recordings++;
+                min = entry->samples < min ? entry->samples : min;
+                max = entry->samples > max ? entry->samples : max;
+            }
+        }
+        if (recordings > 0) {
+            const char *name = mlrecording_labelName(&recording, label);
+            printf("  %-32s %6u recordings, %u to %u samples\n", name ? name : "(no label)",
+                   (unsigned)recordings, (unsigned)min, (unsigned)max);
+        }
+    }
+    recordingFile_unmap(data, size);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 3 && strcmp(argv[1], "info") == 0) {
+        return info(argv[2]);
+    }
+    if (argc < 4 || strcmp(argv[1], "convert") != 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    bool int16 = false;
+    uint32_t period_ms = 0;
+    int arg = 2;
+    for (; arg < argc - 2; arg++) {
+        if (strcmp(argv[arg], "--int16") == 0) {
+            int16 = true;
+        } else if (strcmp(argv[arg], "--period") == 0 && arg + 1 < argc - 2) {
+            period_ms = (uint32_t)strtoul(argv[++arg], NULL, 10);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    return convert(argv[argc - 2], argv[argc - 1], int16, period_ms);
+}
@@ -0,0 +1,418 @@
+/**
+ * @brief Replay the modeltest recordings through the data processor and the
+ * model, and score them against the expected output.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * The host version of modeltest/modeltest.cpp: the samples of each recording
+ * are recorded with mlDataProcessor.recordData(), as on the device, and the
+ * processed data is compared with the expected filter output, then the model
+ * output with the expected model output.
+ * The model is also run on the expected filter output, to check the model on
+ * its own against a tighter tolerance.
+ * This is repeated for each data processor configuration (the one used by
+ * the extension, and the reference filters), reporting the maximum absolute
+ * and relative error of each feature and the time per recording, so that a
+ * change to the filters can be checked against the recordings.
+ *
+ * The recordings are the testdata.h header found in the include path, or a
+ * recording file (mlrecording.h), which is mapped into memory and read in
+ * place. The recording files without the expected outputs are only timed.
+ * --export writes the testdata.h recordings to a recording file.
+ *
+ * A filter output fails when its error is larger than the relative filter
+ * tolerance, ignoring the differences below the 0.00001 resolution of the
+ * modeltest output. The model outputs from the expected filter output fail
+ * when they differ by more than the model tolerance, and the ones from the
+ * processed data by more than the end-to-end tolerance, or when the
+ * prediction is different.
+ * The exit code is 1 if any of the recordings fail.
+ *
+ * Usage: replaytest <autogenerated.ts> <filter tolerance> <model tolerance> <end-to-end tolerance>
+ *                   [recording.mlrec]
+ *        replaytest --export <recording.mlrec>
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mldataprocessor.h"
+#include "mlrecording.h"
+#include "mlrunner.h"
+#include "ml4f.h"
+#include "modelloader.h"
+#include "recordingfile.h"
+#include "testdata.h"
+
+#define REPLAY_DIMENSIONS   3
+#define REPLAY_FEATURES     (MLDP_ML_TRAINER_FEATURES * REPLAY_DIMENSIONS)
+#define REPLAY_MAX_OUTPUTS  16
+// Samples read from the recording per recordData() call
+#define REPLAY_CHUNK        16
+// Resolution of the values printed by modeltest.cpp, smaller differences
+// are not errors
+#define REPLAY_RESOLUTION   0.00001f
+// Index of the Total Acceleration in feature_names
+#define REPLAY_TOTAL_ACC    5
+
+#define ARRAY_LEN(array) ((int)(sizeof(array) / sizeof((array)[0])))
+
+typedef struct {
+    const char *name;
+    const MlDataFilters_t *filters;
+    int filter_size;
+    int flags;
+} ReplayPipeline_t;
+
+typedef struct {
+    float max_abs[REPLAY_FEATURES];
+    float max_rel[REPLAY_FEATURES];
+    float max_model_diff;
+    double record_us;
+    double max_record_us;
+    double model_us;
+    int failures;
+} ReplayReport_t;
+
+// In the output order of filterMlTrainer() and of the ML-Trainer filters
+static const char *feature_names[MLDP_ML_TRAINER_FEATURES] = {
+    "max", "mean", "min", "stddev", "peaks", "totalAcc", "zcr", "rms",
+};
+
+static const MlDataFilters_t ml_trainer_filters[] = {
+    {1, filterMax, MLDP_FILTER_NONE, NULL},
+    {1, filterMean, MLDP_FILTER_NONE, NULL},
+    {1, filterMin, MLDP_FILTER_NONE, NULL},
+    {1, filterStdDev, MLDP_FILTER_NONE, NULL},
+    {1, filterPeaks, MLDP_FILTER_NONE, NULL},
+    {1, filterTotalAcc, MLDP_FILTER_NONE, NULL},
+    {1, filterZcr, MLDP_FILTER_NONE, NULL},
+    {1, filterRms, MLDP_FILTER_NONE, NULL},
+};
+
+static const MlDataFilters_t ml_trainer_fused_filters[] = {
+    {MLDP_ML_TRAINER_FEATURES, filterMlTrainer, MLDP_FILTER_INTERLEAVED_OUTPUT, NULL},
+};
+
+// The first one is the configuration used by testextension.cpp
+static const ReplayPipeline_t pipelines[] = {
+    {"extension", ml_trainer_fused_filters, 1,
+        MLDP_CONFIG_STREAMING_PEAKS | MLDP_CONFIG_INT16_SAMPLES},
+    {"fused", ml_trainer_fused_filters, 1, MLDP_CONFIG_NONE},
+    {"filters", ml_trainer_filters, ARRAY_LEN(ml_trainer_filters), MLDP_CONFIG_NONE},
+    {"filters+incremental", ml_trainer_filters, ARRAY_LEN(ml_trainer_filters),
+        MLDP_CONFIG_INCREMENTAL_STATS | MLDP_CONFIG_INCREMENTAL_MIN_MAX | MLDP_CONFIG_STREAMING_PEAKS},
+};
+
+// The recordings are in g, stored in milli-g by the int16 configuration
+#define REPLAY_SAMPLE_SCALE 1000.0f
+static const float sample_scale[REPLAY_DIMENSIONS] = {
+    REPLAY_SAMPLE_SCALE, REPLAY_SAMPLE_SCALE, REPLAY_SAMPLE_SCALE,
+};
+
+static double nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+/**
+ * Build a recording file in memory with the testdata.h recordings, and their
+ * expected filter and model output.
+ */
+static void *buildTestData(size_t *size) {
+    RecordingWriter_t writer;
+    recordingWriter_init(&writer, MLRECORDING_FLOAT32, REPLAY_DIMENSIONS, 1.0f, 0,
+                         ML_TEST_FILTER_OUTPUT_SIZE, ML_TEST_MODEL_OUTPUT_SIZE);
+    for (int r = 0; r < ML_TEST_RECORDINGS; r++) {
+        const float *planes[REPLAY_DIMENSIONS] = {test_data_x[r], test_data_y[r], test_data_z[r]};
+        recordingWriter_add(&writer, -1, planes, ML_TEST_RECORDING_SIZE, test_filter_output[r], test_model_output[r]);
+    }
+    void *data = recordingWriter_build(&writer, size);
+    recordingWriter_free(&writer);
+    return data;
+}
+
+/**
+ * The expected Total Acceleration comes from ML-Trainer, which adds the first
+ * sample without taking its absolute value, unlike filterTotalAcc(). The
+ * expected value is corrected for it, so that the rest of the sum is still
+ * checked.
+ */
+static void expectedFilterOutput(
+    const MlRecording_t *recording, const uint32_t r, const uint32_t window_start, float *expected
+) {
+    float first[REPLAY_DIMENSIONS];
+    mlrecording_readSamples(recording, r, window_start, 1, first);
+    memcpy(expected, mlrecording_features(recording, r), REPLAY_FEATURES * sizeof(float));
+    for (int d = 0; d < REPLAY_DIMENSIONS; d++) {
+        expected[REPLAY_TOTAL_ACC * REPLAY_DIMENSIONS + d] += fabsf(first[d]) - first[d];
+    }
+}
+
+static int scoreFilterOutput(const float *output, const float *expected, const float tolerance, ReplayReport_t *report) {
+    int failures = 0;
+    for (int i = 0; i < REPLAY_FEATURES; i++) {
+        const float diff = fabsf(output[i] - expected[i]);
+        const float rel = diff / fmaxf(fabsf(expected[i]), REPLAY_RESOLUTION);
+        report->max_abs[i] = fmaxf(report->max_abs[i], diff);
+        report->max_rel[i] = fmaxf(report->max_rel[i], rel);
+        if (diff > REPLAY_RESOLUTION && rel > tolerance) {
+            failures++;
+        }
+    }
+    return failures;
+}
+
+// The int16 files are recorded as they are when the processor has the same
+// scale, as the extension does with the accelerometer samples
+static bool recordSamples(const MlRecording_t *recording, const uint32_t r, const bool int16) {
+    const MlRecordingEntry_t *entry = mlrecording_entry(recording, r);
+    for (uint32_t first = 0; first < entry->samples; first += REPLAY_CHUNK) {
+        MldpReturn_t result;
+        if (int16) {
+            int16_t samples[REPLAY_CHUNK * REPLAY_DIMENSIONS];
+            const size_t len = mlrecording_readSamplesInt16(recording, r, first, REPLAY_CHUNK, samples);
+            result = mlDataProcessor.recordDataInt16(samples, len * REPLAY_DIMENSIONS);
+        } else {
+            float samples[REPLAY_CHUNK * REPLAY_DIMENSIONS];
+            const size_t len = mlrecording_readSamples(recording, r, first, REPLAY_CHUNK, samples);
+            result = mlDataProcessor.recordData(samples, len * REPLAY_DIMENSIONS);
+        }
+        if (result != MLDP_SUCCESS) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int replayRecording(
+    const MlRecording_t *recording, const uint32_t r, const bool int16, const float filter_tolerance,
+    const float end_tolerance, ReplayReport_t *report
+) {
+    const uint32_t samples = mlrecording_entry(recording, r)->samples;
+    const uint32_t window = (uint32_t)ml_getSamplesLength();
+    const int out_len = ml_getOutputLength();
+    if (samples < window) {
+        printf("Recording %u: FAIL, %u samples for a window of %u\n", (unsigned)r, (unsigned)samples, (unsigned)window);
+        return 1;
+    }
+
+    const double start = nowUs();
+    if (!recordSamples(recording, r, int16)) {
+        printf("Recording %u: FAIL, the samples could not be recorded\n", (unsigned)r);
+        return 1;
+    }
+    const float *output = mlDataProcessor.getProcessedData();
+    const double processed = nowUs();
+    if (output == NULL) {
+        printf("Recording %u: FAIL, no processed data\n", (unsigned)r);
+        return 1;
+    }
+
+    float prediction[REPLAY_MAX_OUTPUTS];
+    if (!ml_runModel(output, REPLAY_FEATURES, prediction, out_len)) {
+        printf("Recording %u: FAIL, the model didn't run\n", (unsigned)r);
+        return 1;
+    }
+    const double end = nowUs();
+    report->record_us += processed - start;
+    report->max_record_us = fmax(report->max_record_us, processed - start);
+    report->model_us += end - processed;
+
+    int filter_failures = 0;
+    if (mlrecording_features(recording, r) != NULL) {
+        float expected[REPLAY_FEATURES];
+        expectedFilterOutput(recording, r, samples - window, expected);
+        filter_failures = scoreFilterOutput(output, expected, filter_tolerance, report);
+    }
+    const float *expected_outputs = mlrecording_outputs(recording, r);
+    if (expected_outputs == NULL) {
+        return filter_failures > 0;
+    }
+    float model_diff = 0.0f;
+    for (int i = 0; i < out_len; i++) {
+        model_diff = fmaxf(model_diff, fabsf(prediction[i] - expected_outputs[i]));
+    }
+    report->max_model_diff = fmaxf(report->max_model_diff, model_diff);
+    const int argmax = ml4f_argmax(prediction, out_len);
+    const int expected_argmax = ml4f_argmax(expected_outputs, out_len);
+
+    if (filter_failures > 0 || model_diff > end_tolerance || argmax != expected_argmax) {
+        printf("Recording %u: FAIL, %d filter outputs out of tolerance, model difference %g, prediction %d (expected %d)\n",
+               (unsigned)r, filter_failures, model_diff, argmax, expected_argmax);
+        return 1;
+    }
+    return 0;
+}
+
+static void printReport(const ReplayPipeline_t *pipeline, const MlRecording_t *recording, const ReplayReport_t *report) {
+    const uint32_t recordings = recording->header.recordings;
+    printf("%s: %d of %u recordings failed\n", pipeline->name, report->failures, (unsigned)recordings);
+    if (recording->header.features > 0) {
+        printf("  %-10s %12s %12s %12s %12s %12s %12s\n", "feature",
+               "x abs", "x rel", "y abs", "y rel", "z abs", "z rel");
+        for (int f = 0; f < MLDP_ML_TRAINER_FEATURES; f++) {
+            printf("  %-10s", feature_names[f]);
+            for (int d = 0; d < REPLAY_DIMENSIONS; d++) {
+                const int i = f * REPLAY_DIMENSIONS + d;
+                printf(" %12.3g %12.3g", report->max_abs[i], report->max_rel[i]);
+            }
+            printf("\n");
+        }
+    }
+    if (recording->header.outputs > 0) {
+        printf("  end-to-end model max difference %g\n", report->max_model_diff);
+    }
+    printf("  per recording: %.2f us recording and processing (max %.2f us), %.2f us model (emulated)\n",
+           report->record_us / recordings, report->max_record_us, report->model_us / recordings);
+}
+
+static int replayPipeline(
+    const ReplayPipeline_t *pipeline, const MlRecording_t *recording, const float filter_tolerance,
+    const float end_tolerance
+) {
+    const MlDataProcessorConfig_t config = {
+        .samples = ml_getSamplesLength(),
+        .dimensions = REPLAY_DIMENSIONS,
+        .output_length = REPLAY_FEATURES,
+        .filter_size = pipeline->filter_size,
+        .filters = pipeline->filters,
+        .flags = pipeline->flags,
+        .sample_scale = sample_scale,
+    };
+    if (mlDataProcessor.init(&config) != MLDP_SUCCESS) {
+        printf("%s: FAIL, the data processor could not be initialised\n", pipeline->name);
+        return 1;
+    }
+    const bool int16 = recording->header.sample_type == MLRECORDING_INT16 &&
+                       recording->header.sample_scale == REPLAY_SAMPLE_SCALE &&
+                       (pipeline->flags & MLDP_CONFIG_INT16_SAMPLES);
+    // As in modeltest.cpp, the recordings are recorded one after the other
+    // without resetting the processor, the last samples of each one fill the
+    // whole window
+    ReplayReport_t report = {0};
+    for (uint32_t r = 0; r < recording->header.recordings; r++) {
+        report.failures += replayRecording(recording, r, int16, filter_tolerance, end_tolerance, &report);
+    }
+    mlDataProcessor.deinit();
+    printReport(pipeline, recording, &report);
+    return report.failures;
+}
+
+/**
+ * Run the model on the expected filter output, which includes the ML-Trainer
+ * Total Acceleration, so that the model outputs can be compared without the
+ * differences of the data processor.
+ */
+static int checkModel(const MlRecording_t *recording, const float model_tolerance) {
+    const int out_len = ml_getOutputLength();
+    int failures = 0;
+    float max_diff = 0.0f;
+    for (uint32_t r = 0; r < recording->header.recordings; r++) {
+        const float *features = mlrecording_features(recording, r);
+        const float *expected_outputs = mlrecording_outputs(recording, r);
+        float prediction[REPLAY_MAX_OUTPUTS];
+        if (!ml_runModel(features, REPLAY_FEATURES, prediction, out_len)) {
+            printf("Recording %u: FAIL, the model didn't run on the expected features\n", (unsigned)r);
+            failures++;
+            continue;
+        }
+        float diff = 0.0f;
+        for (int i = 0; i < out_len; i++) {
+            diff = fmaxf(diff, fabsf(prediction[i] - expected_outputs[i]));
+        }
+        max_diff = fmaxf(max_diff, diff);
+        const int argmax = ml4f_argmax(prediction, out_len);
+        if (diff > model_tolerance || argmax != ml4f_argmax(expected_outputs, out_len)) {
+            printf("Recording %u: FAIL, model difference %g from the expected features, prediction %d\n",
+                   (unsigned)r, diff, argmax);
+            failures++;
+        }
+    }
+    printf("model: %d of %u recordings failed, max difference %g from the expected features\n", failures,
+           (unsigned)recording->header.recordings, max_diff);
+    return failures;
+}
+
+static int replay(const char *model_path, const float filter_tolerance, const float model_tolerance,
+                  const float end_tolerance, const MlRecording_t *recording) {
+    size_t size;
+    void *model = modelLoader_load(model_path, &size);
+    if (model == NULL || !ml_setModel(model)) {
+        printf("%s: FAIL, can't load the model\n", model_path);
+        free(model);
+        return 1;
+    }
+    const MlRecordingHeader_t *header = &recording->header;
+    if (ml_getSampleDimensions() != REPLAY_DIMENSIONS || header->dimensions != REPLAY_DIMENSIONS ||
+            ml_getInputLength() != REPLAY_FEATURES || ml_getOutputLength() > REPLAY_MAX_OUTPUTS ||
+            (header->features != 0 && header->features != REPLAY_FEATURES) ||
+            (header->outputs != 0 && header->outputs != (uint32_t)ml_getOutputLength())) {
+        printf("%s: FAIL, the model doesn't match the recordings\n", model_path);
+        ml_removeModels();
+        free(model);
+        return 1;
+    }
+
+    int failures = 0;
+    if (header->features > 0 && header->outputs > 0) {
+        failures += checkModel(recording, model_tolerance);
+    }
+    for (int p = 0; p < ARRAY_LEN(pipelines); p++) {
+        failures += replayPipeline(&pipelines[p], recording, filter_tolerance, end_tolerance);
+    }
+    printf("Filter tolerance %g, model tolerance %g, end-to-end tolerance %g\n", filter_tolerance,
+           model_tolerance, end_tolerance);
+
+    ml_removeModels();
+    free(model);
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 3 && strcmp(argv[1], "--export") == 0) {
+        size_t size;
+        void *data = buildTestData(&size);
+        FILE *file = data != NULL ? fopen(argv[2], "wb") : NULL;
+        const bool written = file != NULL && fwrite(data, 1, size, file) == size;
+        const bool closed = file != NULL && fclose(file) == 0;
+        free(data);
+        printf("%s: %s\n", argv[2], written && closed ? "exported" : "FAIL, can't write the file");
+        return written && closed ? 0 : 1;
+    }
+    if (argc != 5 && argc != 6) {
+        printf("Usage: %s <autogenerated.ts> <filter tolerance> <model tolerance> <end-to-end tolerance> "
+               "[recording.mlrec]\n", argv[0]);
+        printf("       %s --export <recording.mlrec>\n", argv[0]);
+        return 1;
+    }
+
+    // The recordings are mapped from the file, or built from testdata.h
+    size_t size = 0;
+    const void *mapped = NULL;
+    void *built = NULL;
+    if (argc == 6) {
+        mapped = recordingFile_map(argv[5], &size);
+    } else {
+        built = buildTestData(&size);
+    }
+    MlRecording_t recording;
+    const void *data = argc == 6 ? mapped : built;
+    int failures;
+    if (data == NULL || !mlrecording_open(&recording, data, size)) {
+        printf("%s: FAIL, can't read the recordings\n", argc == 6 ? argv[5] : "testdata.h");
+        failures = 1;
+    } else {
+        failures = replay(argv[1], strtof(argv[2], NULL), strtof(argv[3], NULL), strtof(argv[4], NULL),
+                          &recording);
+    }
+    recordingFile_unmap(mapped, size);
+    free(built);
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,370 @@
+/**
+ * @brief Replay an ML-Trainer data export through the data processor and
+ * the model as a continuous session, as fast as the host can run it.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * The recordings of the export are streamed one after the other, in file
+ * order, into a data processor with the configuration of testextension.cpp,
+ * converted to int16 milli-g as the accelerometer samples are. The model runs
+ * every ML_INFERENCE_PERIOD_MS worth of samples (or --inference-period) once
+ * the window is full, and its output goes through ml_calcPrediction() with
+ * the model action thresholds, or the ones set with --threshold, so that a
+ * threshold change can be checked against a long session without the
+ * device.
+ *
+ * The timeline of predictions (the session time, the action and recording of
+ * the newest sample, the predicted action and the model output) is written
+ * as CSV to --timeline, and a summary of the actions predicted during each
+ * action of the export, and the throughput, is printed at the end.
+ * Only the recording being replayed is kept in memory.
+ *
+ * Usage: mlrunner_replay [options] <autogenerated.ts> <export.json>
+ *   --inference-period <ms>   Time between inferences, 250 ms by default
+ *   --threshold [label=]<t>   Threshold of an action, or of all of them
+ *   --activity <mg>           Enable the activity gate with this threshold
+ *   --timeline <file.csv>     Write the predictions, - for stdout
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "filterdataprocessor.h"
+#include "jsonreader.h"
+#include "mldataprocessor.h"
+#include "mlrunner.h"
+#include "modelloader.h"
+#include "trainerjson.h"
+
+// Same default as testextension.cpp
+#ifndef ML_INFERENCE_PERIOD_MS
+#define ML_INFERENCE_PERIOD_MS 250
+#endif
+
+#define REPLAY_DIMENSIONS   TRAINER_JSON_DIMENSIONS
+#define REPLAY_MAX_ACTIONS  16
+// Actions of the export summarised, the rest are added to the last one
+#define REPLAY_MAX_SESSION_ACTIONS 32
+// The accelerometer samples are int16 milli-g, the export is in g
+#define REPLAY_SAMPLE_SCALE 1000.0f
+#define REPLAY_MAX_THRESHOLDS 16
+// Samples converted per recordDataInt16() call
+#define REPLAY_CHUNK        16
+
+typedef struct {
+    const char *label;      // NULL for all the actions
+    float threshold;
+} ReplayThreshold_t;
+
+typedef struct {
+    FilterDataProcessor_t *fdp;
+    ml_actions_t *actions;
+    ml_predictions_t *predictions;
+    FILE *timeline;
+    int stride;                 // Samples between inferences
+    int samples_since_inference;
+    int last_index;             // Prediction repeated by the gated inferences
+    uint64_t samples;
+    uint32_t inferences;
+    uint32_t gated;
+    // Predictions during each action of the export, the last column is no
+    // action (below the thresholds)
+    char session_actions[REPLAY_MAX_SESSION_ACTIONS][JSON_MAX_STRING];
+    uint32_t session_action_count;
+    uint32_t counts[REPLAY_MAX_SESSION_ACTIONS][REPLAY_MAX_ACTIONS + 1];
+    char error[64];
+} SessionReplay_t;
+
+// The data processor configuration of testextension.cpp
+static const MlDataFilters_t ml_trainer_fused_filters[] = {
+    {MLDP_ML_TRAINER_FEATURES, filterMlTrainer, MLDP_FILTER_INTERLEAVED_OUTPUT, NULL},
+};
+static const float sample_scale[REPLAY_DIMENSIONS] = {
+    REPLAY_SAMPLE_SCALE, REPLAY_SAMPLE_SCALE, REPLAY_SAMPLE_SCALE,
+};
+
+static double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void printUsage(const char *name) {
+    printf("Usage: %s [options] <autogenerated.ts> <export.json>\n", name);
+    printf("  --inference-period <ms>   Time between inferences, %d ms by default\n", ML_INFERENCE_PERIOD_MS);
+    printf("  --threshold [label=]<t>   Threshold of an action, or of all of them\n");
+    printf("  --activity <mg>           Enable the activity gate with this threshold\n");
+    printf("  --timeline <file.csv>     Write the predictions, - for stdout\n");
+}
+
+static int16_t toInt16(const float sample) {
+    const float value = roundf(sample * REPLAY_SAMPLE_SCALE);
+    return (int16_t)fmaxf(fminf(value, (float)INT16_MAX), (float)INT16_MIN);
+}
+
+static uint32_t sessionAction(SessionReplay_t *replay, const char *action) {
+    for (uint32_t i = 0; i < replay->session_action_count; i++) {
+        if (strcmp(replay->session_actions[i], action) == 0) {
+            return i;
+        }
+    }
+    if (replay->session_action_count == REPLAY_MAX_SESSION_ACTIONS) {
+        return REPLAY_MAX_SESSION_ACTIONS - 1;
+    }
+    memcpy(replay->session_actions[replay->session_action_count], action, JSON_MAX_STRING);
+    return replay->session_action_count++;
+}
+
+static void writeTimeline(const SessionReplay_t *replay, const TrainerRecording_t *recording) {
+    const int index = replay->predictions->index;
+    fprintf(replay->timeline, "%llu,\"%s\",%u,%d,\"%s\"",
+            (unsigned long long)(replay->samples * ml_getSamplesPeriod()), recording->action,
+            (unsigned)recording->recording_index, index, index >= 0 ? replay->actions->action[index].label : "");
+    for (size_t i = 0; i < replay->predictions->len; i++) {
+        fprintf(replay->timeline, ",%.5f", replay->predictions->prediction[i]);
+    }
+    fprintf(replay->timeline, "\n");
+}
+
+// As testextension.cpp does after every mlSampleCountsPerInference samples
+static bool infer(SessionReplay_t *replay, const TrainerRecording_t *recording) {
+    if (filterDataProcessor_isIdle(replay->fdp)) {
+        replay->gated++;
+        replay->predictions->index = replay->last_index;
+    } else {
+        const float *input = filterDataProcessor_getProcessedData(replay->fdp);
+        const bool success = input != NULL && ml_runModel(input, ml_getInputLength(),
+            replay->predictions->prediction, replay->predictions->len);
+        if (!success) {
+            snprintf(replay->error, sizeof(replay->error), "the model didn't run");
+            return false;
+        }
+        replay->predictions->index = ml_calcPrediction(
+            replay->actions, replay->predictions->prediction, replay->predictions->len);
+        replay->last_index = replay->predictions->index;
+    }
+    replay->inferences++;
+    const int index = replay->predictions->index;
+    const uint32_t action = sessionAction(replay, recording->action);
+    replay->counts[action][index >= 0 ? (size_t)index : replay->actions->len]++;
+    if (replay->timeline != NULL) {
+        writeTimeline(replay, recording);
+    }
+    return true;
+}
+
+static bool replayRecording(const TrainerRecording_t *recording, void *context) {
+    SessionReplay_t *replay = (SessionReplay_t *)context;
+    uint32_t sample = 0;
+    while (sample < recording->len) {
+        // Up to the next inference, so that it runs on the same samples as
+        // on the device, one sample at a time if it is waiting for the
+        // window to be filled
+        const int until_inference = replay->stride - replay->samples_since_inference;
+        uint32_t len = until_inference > 0 ? (uint32_t)until_inference : 1;
+        len = len < recording->len - sample ? len : recording->len - sample;
+        len = len < REPLAY_CHUNK ? len : REPLAY_CHUNK;
+        int16_t samples[REPLAY_CHUNK * REPLAY_DIMENSIONS];
+        int16_t *chunk = samples;
+        for (uint32_t i = 0; i < len; i++) {
+            for (int d = 0; d < REPLAY_DIMENSIONS; d++) {
+                *chunk++ = toInt16(recording->samples[d][sample + i]);
+            }
+        }
+        if (filterDataProcessor_recordDataInt16(replay->fdp, samples, (int)len * REPLAY_DIMENSIONS) != MLDP_SUCCESS) {
+            snprintf(replay->error, sizeof(replay->error), "the samples could not be recorded");
+            return false;
+        }
+        sample += len;
+        replay->samples += len;
+        replay->samples_since_inference += (int)len;
+        if (replay->samples_since_inference < replay->stride || !filterDataProcessor_isDataReady(replay->fdp)) {
+            continue;
+        }
+        replay->samples_since_inference %= replay->stride;
+        if (!infer(replay, recording)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool setThresholds(ml_actions_t *actions, const ReplayThreshold_t *thresholds, const int count) {
+    for (int t = 0; t < count; t++) {
+        bool found = false;
+        for (size_t i = 0; i < actions->len; i++) {
+            if (thresholds[t].label == NULL || strcmp(thresholds[t].label, actions->action[i].label) == 0) {
+                actions->action[i].threshold = thresholds[t].threshold;
+                found = true;
+            }
+        }
+        if (!found) {
+            printf("The model has no action '%s'\n", thresholds[t].label);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void printSummary(const SessionReplay_t *replay, const char *path, const int inference_period_ms,
+                         const double seconds) {
+    const ml_actions_t *actions = replay->actions;
+    const double session_seconds = (double)replay->samples * ml_getSamplesPeriod() / 1000.0;
+    printf("%s: %llu samples (%.1f s at %d ms), %u inferences every %d samples (%d ms), %u gated\n", path,
+           (unsigned long long)replay->samples, session_seconds, ml_getSamplesPeriod(),
+           (unsigned)replay->inferences, replay->stride, inference_period_ms, (unsigned)replay->gated);
+    printf("  %-24s", "thresholds");
+    for (size_t i = 0; i < actions->len; i++) {
+        printf(" %12.2f", actions->action[i].threshold);
+    }
+    printf("\n  %-24s", "action \\ prediction");
+    for (size_t i = 0; i < actions->len; i++) {
+        printf(" %12.12s", actions->action[i].label);
+    }
+    printf(" %12s\n", "(none)");
+    for (uint32_t a = 0; a < replay->session_action_count; a++) {
+        printf("  %-24.24s", replay->session_actions[a]);
+        for (size_t i = 0; i <= actions->len; i++) {
+            printf(" %12u", (unsigned)replay->counts[a][i]);
+        }
+        printf("\n");
+    }
+    printf("  %.3f s, %.0f samples/s, %.0f inferences/s, %.0fx real time\n", seconds,
+           (double)replay->samples / seconds, replay->inferences / seconds, session_seconds / seconds);
+}
+
+static int replaySession(const char *model_path, const char *json_path, const int inference_period_ms,
+                         const ReplayThreshold_t *thresholds, const int threshold_count, const int activity_mg,
+                         FILE *timeline) {
+    size_t size;
+    void *model = modelLoader_load(model_path, &size);
+    if (model == NULL || !ml_setModel(model)) {
+        printf("%s: can't load the model\n", model_path);
+        free(model);
+        return 1;
+    }
+    FILE *json = fopen(json_path, "rb");
+    SessionReplay_t *replay = (SessionReplay_t *)calloc(1, sizeof(SessionReplay_t));
+    int result = 1;
+    if (json == NULL || replay == NULL) {
+        printf("Can't open %s\n", json_path);
+        goto cleanup;
+    }
+    if (ml_getSampleDimensions() != REPLAY_DIMENSIONS || ml_getOutputLength() > REPLAY_MAX_ACTIONS ||
+            ml_getSamplesPeriod() <= 0) {
+        printf("%s: the model doesn't use the accelerometer samples\n", model_path);
+        goto cleanup;
+    }
+    replay->actions = ml_allocateActions();
+    replay->predictions = ml_allocatePredictions();
+    replay->fdp = filterDataProcessor_create();
+    if (replay->actions == NULL || replay->predictions == NULL || replay->fdp == NULL ||
+            !ml_getActions(replay->actions) || !setThresholds(replay->actions, thresholds, threshold_count)) {
+        printf("%s: can't get the model actions\n", model_path);
+        goto cleanup;
+    }
+    const MlDataProcessorConfig_t config = {
+        .samples = ml_getSamplesLength(),
+        .dimensions = REPLAY_DIMENSIONS,
+        .output_length = ml_getInputLength(),
+        .filter_size = 1,
+        .filters = ml_trainer_fused_filters,
+        .flags = MLDP_CONFIG_STREAMING_PEAKS | MLDP_CONFIG_INT16_SAMPLES |
+                 (activity_mg > 0 ? MLDP_CONFIG_ACTIVITY_GATE : MLDP_CONFIG_NONE),
+        .sample_scale = sample_scale,
+        .activity_threshold = activity_mg / 1000.0f,
+    };
+    if (filterDataProcessor_init(replay->fdp, &config) != MLDP_SUCCESS) {
+        printf("%s: the data processor can't produce the model input\n", model_path);
+        goto cleanup;
+    }
+    replay->stride = inference_period_ms / ml_getSamplesPeriod();
+    replay->stride = replay->stride > 0 ? replay->stride : 1;
+    replay->last_index = -1;
+    replay->timeline = timeline;
+    if (timeline != NULL) {
+        fprintf(timeline, "time_ms,action,recording,prediction,label");
+        for (size_t i = 0; i < replay->actions->len; i++) {
+            fprintf(timeline, ",\"%s\"", replay->actions->action[i].label);
+        }
+        fprintf(timeline, "\n");
+    }
+
+    char error[128];
+    const double start = nowSeconds();
+    if (!trainerJson_read(json, replayRecording, replay, error, sizeof(error))) {
+        printf("%s: %s%s%s\n", json_path, error, replay->error[0] ? ", " : "", replay->error);
+        goto cleanup;
+    }
+    printSummary(replay, json_path, inference_period_ms, nowSeconds() - start);
+    result = 0;
+
+cleanup:
+    if (json != NULL) {
+        fclose(json);
+    }
+    if (replay != NULL) {
+        filterDataProcessor_destroy(replay->fdp);
+        free(replay->actions);
+        free(replay->predictions);
+        free(replay);
+    }
+    ml_removeModels();
+    free(model);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    int inference_period_ms = ML_INFERENCE_PERIOD_MS;
+    int activity_mg = 0;
+    const char *timeline_path = NULL;
+    ReplayThreshold_t thresholds[REPLAY_MAX_THRESHOLDS];
+    int threshold_count = 0;
+    int arg = 1;
+    for (; arg < argc - 2; arg++) {
+        if (strcmp(argv[arg], "--inference-period") == 0 && arg + 1 < argc - 2) {
+            inference_period_ms = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "--activity") == 0 && arg + 1 < argc - 2) {
+            activity_mg = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "--timeline") == 0 && arg + 1 < argc - 2) {
+            timeline_path = argv[++arg];
+        } else if (strcmp(argv[arg], "--threshold") == 0 && arg + 1 < argc - 2 &&
+                   threshold_count < REPLAY_MAX_THRESHOLDS) {
+            // The label can contain '=', the value is after the last one
+            char *value = argv[++arg];
+            char *equals = strrchr(value, '=');
+            thresholds[threshold_count].label = NULL;
+            if (equals != NULL) {
+                *equals = '\0';
+                thresholds[threshold_count].label = value;
+                value = equals + 1;
+            }
+            thresholds[threshold_count++].threshold = strtof(value, NULL);
+        } else {
+            break;
+        }
+    }
+    if (arg != argc - 2 || inference_period_ms <= 0 || activity_mg < 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    FILE *timeline = NULL;
+    if (timeline_path != NULL) {
+        timeline = strcmp(timeline_path, "-") == 0 ? stdout : fopen(timeline_path, "w");
+        if (timeline == NULL) {
+            printf("Can't write %s\n", timeline_path);
+            return 1;
+        }
+    }
+    const int result = replaySession(argv[argc - 2], argv[argc - 1], inference_period_ms, thresholds,
+                                     threshold_count, activity_mg, timeline);
+    if (timeline != NULL && timeline != stdout && fclose(timeline) != 0) {
+        printf("Can't write %s\n", timeline_path);
+        return 1;
+    }
+    return result;
+}
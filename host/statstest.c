@@ -0,0 +1,189 @@
+/**
+ * @brief Test the latency histograms.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * Records known durations to check the percentiles are within the bucket
+ * error, and runs a graph model with a fake clock to check every stage of
+ * ml_predict() is recorded.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mlrunner.h"
+#include "mlstats.h"
+#include "graphbuilder.h"
+#include "testcheck.h"
+
+static uint32_t fake_ticks = 0;
+
+// Each read of the clock advances it, so every measured stage takes 1 tick
+static uint32_t fakeClock(void) {
+    return fake_ticks++;
+}
+
+// A percentile can be above the real value by up to the bucket width
+static int checkPercentile(const mlstats_stage_t stage, const float percentile, const uint32_t exact) {
+    const uint32_t value = mlstats_percentile(stage, percentile);
+    if (value < exact || value > exact + exact / 4) {
+        printf("FAIL: p%.0f is %u, expected %u to %u\n", percentile, (unsigned)value, (unsigned)exact,
+               (unsigned)(exact + exact / 4));
+        return 1;
+    }
+    return 0;
+}
+
+static int testPercentiles() {
+    int failures = 0;
+    mlstats_setClock(fakeClock, 1);
+    mlstats_reset();
+
+    // Shuffled, the order doesn't matter
+    for (uint32_t i = 0; i < 1000; i++) {
+        mlstats_record(MLSTATS_INVOKE, (i * 7919) % 1000 + 1);
+    }
+    failures += check("count", mlstats_count(MLSTATS_INVOKE) == 1000);
+    failures += check("max", mlstats_max(MLSTATS_INVOKE) == 1000);
+    failures += checkPercentile(MLSTATS_INVOKE, 50.0f, 500);
+    failures += checkPercentile(MLSTATS_INVOKE, 95.0f, 950);
+    failures += checkPercentile(MLSTATS_INVOKE, 99.0f, 990);
+    failures += check("p100 is the max", mlstats_percentile(MLSTATS_INVOKE, 100.0f) == 1000);
+    failures += check("p0 is the min", mlstats_percentile(MLSTATS_INVOKE, 0.0f) == 1);
+
+    // Small values have a bucket each
+    for (uint32_t i = 0; i < 4; i++) {
+        mlstats_record(MLSTATS_ARGMAX, i);
+    }
+    failures += check("small p50", mlstats_percentile(MLSTATS_ARGMAX, 50.0f) == 1);
+    failures += check("small p75", mlstats_percentile(MLSTATS_ARGMAX, 75.0f) == 2);
+
+    // A single outlier sets the tail, and durations over the last bucket are
+    // reported as the max
+    for (uint32_t i = 0; i < 99; i++) {
+        mlstats_record(MLSTATS_COPY_IN, 100);
+    }
+    mlstats_record(MLSTATS_COPY_IN, 100000000);
+    failures += checkPercentile(MLSTATS_COPY_IN, 50.0f, 100);
+    failures += checkPercentile(MLSTATS_COPY_IN, 99.0f, 100);
+    failures += check("outlier p100", mlstats_percentile(MLSTATS_COPY_IN, 100.0f) == 100000000);
+
+    // Host durations are in nanoseconds, tens of milliseconds still have
+    // their own buckets
+    for (uint32_t i = 0; i < 99; i++) {
+        mlstats_record(MLSTATS_SAMPLE_CAPTURE, 50000000);
+    }
+    mlstats_record(MLSTATS_SAMPLE_CAPTURE, 2000000000);
+    failures += checkPercentile(MLSTATS_SAMPLE_CAPTURE, 50.0f, 50000000);
+    failures += check("host p100", mlstats_percentile(MLSTATS_SAMPLE_CAPTURE, 100.0f) == 2000000000);
+
+    // Other stages are not affected, and invalid ones are ignored
+    mlstats_record(MLSTATS_STAGES_LEN, 10);
+    failures += check("empty stage", mlstats_count(MLSTATS_COPY_OUT) == 0 &&
+                      mlstats_percentile(MLSTATS_COPY_OUT, 50.0f) == 0);
+    failures += check("invalid stage", mlstats_count(MLSTATS_STAGES_LEN) == 0 &&
+                      mlstats_stageName(MLSTATS_STAGES_LEN) == NULL);
+
+    mlstats_increment(MLSTATS_INFERENCES_SKIPPED);
+    mlstats_increment(MLSTATS_INFERENCES_SKIPPED);
+    failures += check("counter", mlstats_counter(MLSTATS_INFERENCES_SKIPPED) == 2 &&
+                      mlstats_counter(MLSTATS_RECORD_ERRORS) == 0);
+
+    mlstats_reset();
+    failures += check("reset", mlstats_count(MLSTATS_INVOKE) == 0 && mlstats_max(MLSTATS_INVOKE) == 0 &&
+                      mlstats_counter(MLSTATS_INFERENCES_SKIPPED) == 0);
+
+    // Nothing is recorded without a clock
+    mlstats_setClock(NULL, 0);
+    mlstats_record(MLSTATS_INVOKE, 10);
+    failures += check("no clock", mlstats_count(MLSTATS_INVOKE) == 0 && mlstats_now() == 0);
+
+    printf("Percentiles: %s\n", failures ? "FAIL" : "PASS");
+    return failures;
+}
+
+static int testPredictStages() {
+    static const char *labels[] = {"a", "b"};
+    static const float weights[6] = {0.1f, -0.2f, 0.3f, 0.4f, 0.5f, -0.6f};
+    int failures = 0;
+
+    size_t size;
+    GraphBuilder_t builder;
+    graphBuilder_init(&builder, 1, 3);
+    graphBuilder_dense(&builder, 2, weights, NULL, MLGRAPH_ACTIVATION_SOFTMAX);
+    void *model = graphBuilder_build(&builder, 25, 1, 3, labels, 2, &size);
+    graphBuilder_free(&builder);
+    ml_actions_t *actions = NULL;
+    ml_predictions_t *predictions = NULL;
+    if (model == NULL || !ml_setModel(model) ||
+            (actions = ml_allocateActions()) == NULL || !ml_getActions(actions) ||
+            (predictions = ml_allocatePredictions()) == NULL) {
+        printf("Predict stages: FAIL, model not set\n");
+        failures++;
+    } else {
+        mlstats_setClock(fakeClock, 1);
+        mlstats_reset();
+        const float input[3] = {1.0f, 2.0f, 3.0f};
+        for (int i = 0; i < 3; i++) {
+            failures += check("predict", ml_predict(input, 3, actions, predictions));
+        }
+        const mlstats_stage_t stages[] = {MLSTATS_COPY_IN, MLSTATS_INVOKE, MLSTATS_COPY_OUT, MLSTATS_ARGMAX};
+        for (size_t s = 0; s < sizeof(stages) / sizeof(stages[0]); s++) {
+            if (mlstats_count(stages[s]) != 3 || mlstats_max(stages[s]) != 1) {
+                printf("FAIL: stage %s recorded %u times\n",
+                       mlstats_stageName(stages[s]), (unsigned)mlstats_count(stages[s]));
+                failures++;
+            }
+        }
+        failures += check("feature stage not recorded", mlstats_count(MLSTATS_FEATURE_EXTRACTION) == 0);
+        printf("Predict stages: %s\n", failures ? "FAIL" : "PASS");
+    }
+    free(actions);
+    free(predictions);
+    ml_removeModels();
+    free(model);
+    return failures;
+}
+
+typedef struct {
+    char text[2048];
+    int lines;
+} DumpOutput_t;
+
+static void printToBuffer(const char *line, void *context) {
+    DumpOutput_t *output = (DumpOutput_t *)context;
+    strncat(output->text, line, sizeof(output->text) - strlen(output->text) - 1);
+    output->lines++;
+}
+
+static int testDump() {
+    int failures = 0;
+    DumpOutput_t output = {{0}, 0};
+    // 64 ticks per microsecond, like the micro:bit cycle counter
+    mlstats_setClock(fakeClock, 64);
+    mlstats_reset();
+    mlstats_record(MLSTATS_INVOKE, 6400);
+    mlstats_increment(MLSTATS_SAMPLE_DRIFT);
+    mlstats_dump(printToBuffer, &output);
+
+    failures += check("dump lines", output.lines == 1 + MLSTATS_STAGES_LEN + MLSTATS_COUNTERS_LEN);
+    failures += check("dump invoke", strstr(output.text, "invoke") != NULL &&
+                      strstr(output.text, "100.0") != NULL);
+    failures += check("dump counter", strstr(output.text, "sample_drift         1") != NULL);
+    failures += check("micros", mlstats_ticksToMicros(32) == 0.5f);
+    if (failures) {
+        printf("%s", output.text);
+    }
+    printf("Dump: %s\n", failures ? "FAIL" : "PASS");
+    return failures;
+}
+
+int main() {
+    int failures = 0;
+    failures += testPercentiles();
+    failures += testPredictStages();
+    failures += testDump();
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+/**
+ * @brief Decode the binary telemetry frames sent by mltelemetry.c.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ */
+#include <string.h>
+#include "telemetrydecoder.h"
+
+static uint32_t getU32(const uint8_t *data) {
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static uint16_t getU16(const uint8_t *data) {
+    return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+static void emitText(TelemetryDecoder_t *decoder, const size_t len) {
+    if (decoder->on_text != NULL && len > 0) {
+        decoder->on_text(decoder->buffer, len, decoder->context);
+    }
+    decoder->buffer_len -= len;
+    memmove(decoder->buffer, decoder->buffer + len, decoder->buffer_len);
+}
+
+/**
+ * Take the frames and text from the start of the buffer, until it only has
+ * the start of a frame that needs more bytes.
+ */
+static void decodeBuffer(TelemetryDecoder_t *decoder) {
+    while (decoder->buffer_len > 0) {
+        const uint8_t *buffer = decoder->buffer;
+        // Everything up to the next possible frame start is text
+        size_t text = 0;
+        while (text < decoder->buffer_len && buffer[text] != MLTELEMETRY_SYNC0) {
+            text++;
+        }
+        if (text > 0) {
+            emitText(decoder, text);
+            continue;
+        }
+        if (decoder->buffer_len < 2) {
+            return;
+        }
+        if (buffer[1] != MLTELEMETRY_SYNC1) {
+            emitText(decoder, 1);
+            continue;
+        }
+        if (decoder->buffer_len < MLTELEMETRY_HEADER_SIZE) {
+            return;
+        }
+        const size_t payload_len = buffer[4];
+        const size_t frame_len = MLTELEMETRY_HEADER_SIZE + payload_len + MLTELEMETRY_CRC_SIZE;
+        if (decoder->buffer_len < frame_len) {
+            return;
+        }
+        const uint16_t crc = mltelemetry_crc16(0xFFFF, &buffer[2], 3 + payload_len);
+        if (crc != getU16(&buffer[MLTELEMETRY_HEADER_SIZE + payload_len])) {
+            // Not a frame, or a corrupted one, the sync bytes were text
+            decoder->crc_errors++;
+            emitText(decoder, 1);
+            continue;
+        }
+
+        TelemetryFrame_t frame;
+        frame.type = buffer[2];
+        frame.seq = buffer[3];
+        frame.len = (uint8_t)payload_len;
+        memcpy(frame.payload, &buffer[MLTELEMETRY_HEADER_SIZE], payload_len);
+        if (decoder->has_seq) {
+            decoder->lost_frames += (uint8_t)(frame.seq - decoder->last_seq - 1);
+        }
+        decoder->has_seq = true;
+        decoder->last_seq = frame.seq;
+        decoder->frames++;
+        decoder->buffer_len -= frame_len;
+        memmove(decoder->buffer, decoder->buffer + frame_len, decoder->buffer_len);
+        if (decoder->on_frame != NULL) {
+            decoder->on_frame(&frame, decoder->context);
+        }
+    }
+}
+
+void telemetryDecoder_init(
+    TelemetryDecoder_t *decoder, TelemetryFrameCallback_t on_frame, TelemetryTextCallback_t on_text, void *context
+) {
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->on_frame = on_frame;
+    decoder->on_text = on_text;
+    decoder->context = context;
+}
+
+void telemetryDecoder_push(TelemetryDecoder_t *decoder, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        const size_t space = sizeof(decoder->buffer) - decoder->buffer_len;
+        const size_t copy = len < space ? len : space;
+        memcpy(decoder->buffer + decoder->buffer_len, data, copy);
+        decoder->buffer_len += copy;
+        data += copy;
+        len -= copy;
+        decodeBuffer(decoder);
+    }
+}
+
+void telemetryDecoder_flush(TelemetryDecoder_t *decoder) {
+    emitText(decoder, decoder->buffer_len);
+}
+
+bool telemetry_parsePrediction(const TelemetryFrame_t *frame, TelemetryPrediction_t *out) {
+    if (frame->type != MLTELEMETRY_PREDICTION || frame->len < 6) {
+        return false;
+    }
+    const uint8_t len = frame->payload[5];
+    if (frame->len != 6 + len * 2) {
+        return false;
+    }
+    out->time_ms = getU32(frame->payload);
+    out->index = (int8_t)frame->payload[4];
+    out->len = len;
+    for (int i = 0; i < len; i++) {
+        out->prediction[i] = (float)getU16(&frame->payload[6 + i * 2]) / 65535.0f;
+    }
+    return true;
+}
+
+bool telemetry_parseValues(const TelemetryFrame_t *frame, TelemetryValues_t *out) {
+    if ((frame->type != MLTELEMETRY_TIMINGS && frame->type != MLTELEMETRY_COUNTERS) || frame->len < 5) {
+        return false;
+    }
+    const uint8_t len = frame->payload[4];
+    if (frame->len != 5 + len * 4) {
+        return false;
+    }
+    out->time_ms = getU32(frame->payload);
+    out->len = len;
+    for (int i = 0; i < len; i++) {
+        out->value[i] = getU32(&frame->payload[5 + i * 4]);
+    }
+    return true;
+}
+
+bool telemetry_parseSamples(const TelemetryFrame_t *frame, TelemetrySamples_t *out) {
+    if (frame->type != MLTELEMETRY_SAMPLES || frame->len < 6) {
+        return false;
+    }
+    const int values = frame->payload[4] * frame->payload[5];
+    if (frame->len != 6 + values * 2) {
+        return false;
+    }
+    out->time_ms = getU32(frame->payload);
+    out->dimensions = frame->payload[4];
+    out->count = frame->payload[5];
+    for (int i = 0; i < values; i++) {
+        out->sample[i] = (int16_t)getU16(&frame->payload[6 + i * 2]);
+    }
+    return true;
+}
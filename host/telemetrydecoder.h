@@ -0,0 +1,98 @@
+/**
+ * @brief Decode the binary telemetry frames sent by mltelemetry.c.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * @details
+ * The decoder takes the serial stream in chunks of any size, finds the
+ * frames by their sync bytes and CRC, and passes any other bytes (e.g. the
+ * printf output) to a text callback, so the two can be mixed.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mltelemetry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct TelemetryFrame_s {
+    uint8_t type;                       // mltelemetry_frame_type_t
+    uint8_t seq;
+    uint8_t len;
+    uint8_t payload[MLTELEMETRY_MAX_PAYLOAD];
+} TelemetryFrame_t;
+
+typedef void (*TelemetryFrameCallback_t)(const TelemetryFrame_t *frame, void *context);
+// Called with the bytes that are not part of a frame, can be NULL
+typedef void (*TelemetryTextCallback_t)(const uint8_t *text, size_t len, void *context);
+
+typedef struct TelemetryDecoder_s {
+    uint8_t buffer[MLTELEMETRY_MAX_FRAME];
+    size_t buffer_len;
+    TelemetryFrameCallback_t on_frame;
+    TelemetryTextCallback_t on_text;
+    void *context;
+    // Statistics of the stream so far
+    uint32_t frames;
+    uint32_t crc_errors;
+    uint32_t lost_frames;               // From the gaps in the sequence numbers
+    bool has_seq;
+    uint8_t last_seq;
+} TelemetryDecoder_t;
+
+typedef struct TelemetryPrediction_s {
+    uint32_t time_ms;
+    int index;
+    uint8_t len;
+    float prediction[MLTELEMETRY_MAX_PAYLOAD / 2];
+} TelemetryPrediction_t;
+
+// The payload of MLTELEMETRY_TIMINGS and MLTELEMETRY_COUNTERS frames
+typedef struct TelemetryValues_s {
+    uint32_t time_ms;
+    uint8_t len;
+    uint32_t value[MLTELEMETRY_MAX_PAYLOAD / 4];
+} TelemetryValues_t;
+
+typedef struct TelemetrySamples_s {
+    uint32_t time_ms;
+    uint8_t dimensions;
+    uint8_t count;
+    int16_t sample[MLTELEMETRY_MAX_PAYLOAD / 2];
+} TelemetrySamples_t;
+
+void telemetryDecoder_init(
+    TelemetryDecoder_t *decoder, TelemetryFrameCallback_t on_frame, TelemetryTextCallback_t on_text, void *context);
+
+/**
+ * @brief Decode the next bytes of the stream, calling the callbacks for the
+ * frames and text found. An incomplete frame at the end is kept until the
+ * next call.
+ */
+void telemetryDecoder_push(TelemetryDecoder_t *decoder, const uint8_t *data, size_t len);
+
+/**
+ * @brief Pass the bytes kept from an incomplete frame as text, at the end
+ * of the stream.
+ */
+void telemetryDecoder_flush(TelemetryDecoder_t *decoder);
+
+/**
+ * @brief Parse the payload of a frame of the matching type.
+ *
+ * @return True if the frame is of that type and the payload is complete,
+ *         False otherwise.
+ */
+bool telemetry_parsePrediction(const TelemetryFrame_t *frame, TelemetryPrediction_t *out);
+bool telemetry_parseValues(const TelemetryFrame_t *frame, TelemetryValues_t *out);
+bool telemetry_parseSamples(const TelemetryFrame_t *frame, TelemetrySamples_t *out);
+
+#ifdef __cplusplus
+}
+#endif
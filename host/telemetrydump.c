@@ -0,0 +1,127 @@
+/**
+ * @brief Print the telemetry frames from a micro:bit serial stream.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * Reads the serial output saved to a file, or a serial port device already
+ * configured (e.g. with `stty -F /dev/ttyACM0 115200 raw`), or stdin, and
+ * prints one line per frame. The text between the frames is printed as is.
+ * At the end, the number of frames, CRC errors and lost frames are printed
+ * to stderr.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "mlstats.h"
+#include "telemetrydecoder.h"
+
+static void printValues(const char *kind, const TelemetryValues_t *values) {
+    const bool timings = strcmp(kind, "timings") == 0;
+    printf("[%10u ms] %s", (unsigned)values->time_ms, kind);
+    for (int i = 0; i < values->len; i++) {
+        const char *name;
+        if (timings) {
+            name = mlstats_stageName((mlstats_stage_t)i);
+        } else {
+            name = (i == MLSTATS_COUNTERS_LEN) ? "telemetry_dropped" : mlstats_counterName((mlstats_counter_t)i);
+        }
+        if (timings) {
+            printf(" %s=%.1fus", name != NULL ? name : "?", values->value[i] / 1000.0);
+        } else {
+            printf(" %s=%u", name != NULL ? name : "?", (unsigned)values->value[i]);
+        }
+    }
+    printf("\n");
+}
+
+static void printFrame(const TelemetryFrame_t *frame, void *context) {
+    (void)context;
+    static TelemetryPrediction_t prediction;
+    static TelemetryValues_t values;
+    static TelemetrySamples_t samples;
+    switch (frame->type) {
+        case MLTELEMETRY_PREDICTION:
+            if (telemetry_parsePrediction(frame, &prediction)) {
+                printf("[%10u ms] prediction %d", (unsigned)prediction.time_ms, prediction.index);
+                for (int i = 0; i < prediction.len; i++) {
+                    printf(" %.3f", prediction.prediction[i]);
+                }
+                printf("\n");
+                return;
+            }
+            break;
+        case MLTELEMETRY_TIMINGS:
+            if (telemetry_parseValues(frame, &values)) {
+                printValues("timings", &values);
+                return;
+            }
+            break;
+        case MLTELEMETRY_COUNTERS:
+            if (telemetry_parseValues(frame, &values)) {
+                printValues("counters", &values);
+                return;
+            }
+            break;
+        case MLTELEMETRY_SAMPLES:
+            if (telemetry_parseSamples(frame, &samples)) {
+                for (int s = 0; s < samples.count; s++) {
+                    printf("[%10u ms] sample", (unsigned)samples.time_ms);
+                    for (int d = 0; d < samples.dimensions; d++) {
+                        printf(" %.3f", samples.sample[s * samples.dimensions + d] / 1000.0);
+                    }
+                    printf("\n");
+                }
+                return;
+            }
+            break;
+        case MLTELEMETRY_TEXT:
+            printf("%.*s\n", (int)frame->len, (const char *)frame->payload);
+            return;
+        default:
+            break;
+    }
+    printf("Unknown frame type %u with %u bytes\n", (unsigned)frame->type, (unsigned)frame->len);
+}
+
+static void printText(const uint8_t *text, size_t len, void *context) {
+    (void)context;
+    fwrite(text, 1, len, stdout);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 2 || (argc == 2 && strcmp(argv[1], "--help") == 0)) {
+        printf("Usage: %s [FILE]\n", argv[0]);
+        printf("  FILE   The serial output or port to read, stdin if not given\n");
+        return argc == 2 ? 0 : 1;
+    }
+    FILE *input = stdin;
+    if (argc == 2) {
+        input = fopen(argv[1], "rb");
+        if (input == NULL) {
+            fprintf(stderr, "Failed to open %s\n", argv[1]);
+            return 1;
+        }
+    }
+
+    TelemetryDecoder_t decoder;
+    telemetryDecoder_init(&decoder, printFrame, printText, NULL);
+    // read() instead of fread(), to print the frames from a serial port as
+    // they arrive, without waiting for a full buffer
+    uint8_t buffer[256];
+    ssize_t len;
+    while ((len = read(fileno(input), buffer, sizeof(buffer))) > 0) {
+        telemetryDecoder_push(&decoder, buffer, (size_t)len);
+        fflush(stdout);
+    }
+    telemetryDecoder_flush(&decoder);
+    if (input != stdin) {
+        fclose(input);
+    }
+
+    fprintf(stderr, "%u frames, %u CRC errors, %u lost frames\n",
+            (unsigned)decoder.frames, (unsigned)decoder.crc_errors, (unsigned)decoder.lost_frames);
+    return 0;
+}
@@ -0,0 +1,211 @@
+/**
+ * @brief Test the telemetry frames, from mltelemetry.c to the decoder.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * Queues frames, sends them through a simulated serial stream mixed with
+ * text, and checks the decoder gets the same values back. Also checks the
+ * frames dropped when the transmit buffer is full are counted by the decoder,
+ * and that corrupted frames are skipped.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "mlstats.h"
+#include "mltelemetry.h"
+#include "telemetrydecoder.h"
+#include "testcheck.h"
+
+#define STREAM_SIZE 8192
+
+typedef struct {
+    uint8_t data[STREAM_SIZE];
+    size_t len;
+} Stream_t;
+
+typedef struct {
+    TelemetryFrame_t frames[64];
+    int frames_len;
+    char text[256];
+    size_t text_len;
+} Received_t;
+
+static void streamWrite(Stream_t *stream, const void *data, const size_t len) {
+    memcpy(stream->data + stream->len, data, len);
+    stream->len += len;
+}
+
+// Take up to max bytes from the transmit buffer, as a serial port would
+static void drain(Stream_t *stream, size_t max) {
+    const uint8_t *data;
+    size_t len;
+    while (max > 0 && (len = mltelemetry_peek(&data)) > 0) {
+        if (len > max) {
+            len = max;
+        }
+        streamWrite(stream, data, len);
+        mltelemetry_consume(len);
+        max -= len;
+    }
+}
+
+static void onFrame(const TelemetryFrame_t *frame, void *context) {
+    Received_t *received = (Received_t *)context;
+    if (received->frames_len < 64) {
+        received->frames[received->frames_len++] = *frame;
+    }
+}
+
+static void onText(const uint8_t *text, size_t len, void *context) {
+    Received_t *received = (Received_t *)context;
+    if (received->text_len + len < sizeof(received->text)) {
+        memcpy(received->text + received->text_len, text, len);
+        received->text_len += len;
+    }
+}
+
+static void decode(const Stream_t *stream, const size_t chunk, TelemetryDecoder_t *decoder, Received_t *received) {
+    memset(received, 0, sizeof(*received));
+    telemetryDecoder_init(decoder, onFrame, onText, received);
+    for (size_t i = 0; i < stream->len; i += chunk) {
+        const size_t len = (stream->len - i) < chunk ? stream->len - i : chunk;
+        telemetryDecoder_push(decoder, stream->data + i, len);
+    }
+    telemetryDecoder_flush(decoder);
+}
+
+static int testRoundTrip() {
+    static Stream_t stream;
+    static Received_t received;
+    static TelemetryPrediction_t prediction;
+    static TelemetryValues_t values;
+    static TelemetrySamples_t samples;
+    int failures = 0;
+
+    mltelemetry_reset();
+    mlstats_reset();
+    mlstats_setClock(NULL, 1);
+    mlstats_increment(MLSTATS_SAMPLE_DRIFT);
+    const float predictions[4] = {0.1f, 0.0f, 0.85f, 1.0f};
+    const int16_t accelerometer[6] = {-1000, 20, 1500, 32767, -32768, 0};
+
+    // Text before, between (with sync bytes in it) and after the frames
+    stream.len = 0;
+    streamWrite(&stream, "Model loaded\n", 13);
+    mltelemetry_sendPrediction(1234, 2, predictions, 4);
+    mltelemetry_sendTimings(1235);
+    drain(&stream, SIZE_MAX);
+    const uint8_t noise[] = {'x', MLTELEMETRY_SYNC0, MLTELEMETRY_SYNC1, 3, 'y', '\n'};
+    streamWrite(&stream, noise, sizeof(noise));
+    mltelemetry_sendCounters(1236);
+    mltelemetry_sendSamples(1237, accelerometer, 3, 2);
+    mltelemetry_sendText("hello");
+    drain(&stream, SIZE_MAX);
+    streamWrite(&stream, "end", 3);
+
+    // The result can't depend on how the stream is split
+    const size_t chunks[] = {1, 7, STREAM_SIZE};
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        TelemetryDecoder_t decoder;
+        decode(&stream, chunks[c], &decoder, &received);
+        if (check("frame count", received.frames_len == 5 && decoder.frames == 5 && decoder.lost_frames == 0)) {
+            printf("  with chunks of %u bytes: %d frames\n", (unsigned)chunks[c], received.frames_len);
+            return failures + 1;
+        }
+        const size_t text_len = 13 + sizeof(noise) + 3;
+        failures += check("text", received.text_len == text_len &&
+                          memcmp(received.text, "Model loaded\nx", 14) == 0 &&
+                          memcmp(received.text + received.text_len - 3, "end", 3) == 0);
+    }
+
+    failures += check("prediction", telemetry_parsePrediction(&received.frames[0], &prediction) &&
+                      prediction.time_ms == 1234 && prediction.index == 2 && prediction.len == 4);
+    for (int i = 0; i < 4; i++) {
+        failures += check("prediction value", fabsf(prediction.prediction[i] - predictions[i]) < 1e-4f);
+    }
+    failures += check("timings", telemetry_parseValues(&received.frames[1], &values) &&
+                      values.time_ms == 1235 && values.len == MLSTATS_STAGES_LEN);
+    failures += check("counters", telemetry_parseValues(&received.frames[2], &values) &&
+                      values.time_ms == 1236 && values.len == MLSTATS_COUNTERS_LEN + 1 &&
+                      values.value[MLSTATS_SAMPLE_DRIFT] == 1 && values.value[MLSTATS_COUNTERS_LEN] == 0);
+    failures += check("samples", telemetry_parseSamples(&received.frames[3], &samples) &&
+                      samples.time_ms == 1237 && samples.dimensions == 3 && samples.count == 2 &&
+                      memcmp(samples.sample, accelerometer, sizeof(accelerometer)) == 0);
+    failures += check("text frame", received.frames[4].type == MLTELEMETRY_TEXT &&
+                      received.frames[4].len == 5 && memcmp(received.frames[4].payload, "hello", 5) == 0);
+    failures += check("wrong type", !telemetry_parseSamples(&received.frames[0], &samples));
+
+    printf("Round trip: %s\n", failures ? "FAIL" : "PASS");
+    return failures;
+}
+
+static int testDroppedFrames() {
+    static Stream_t stream;
+    static Received_t received;
+    int failures = 0;
+    const float predictions[5] = {0.2f, 0.2f, 0.2f, 0.2f, 0.2f};
+
+    // Fill the buffer, the frames that don't fit are dropped whole
+    mltelemetry_reset();
+    stream.len = 0;
+    int sent = 0;
+    for (int i = 0; i < 40; i++) {
+        sent += mltelemetry_sendPrediction(i, 0, predictions, 5);
+    }
+    failures += check("buffer full", sent < 40 && mltelemetry_dropped() == (uint32_t)(40 - sent) &&
+                      mltelemetry_pending() <= MLTELEMETRY_BUFFER_SIZE);
+    // After draining part of it, more frames fit and the sequence continues
+    drain(&stream, 100);
+    const int sent_after = mltelemetry_sendPrediction(40, 0, predictions, 5);
+    failures += check("space after drain", sent_after == 1);
+    drain(&stream, SIZE_MAX);
+    failures += check("empty", mltelemetry_pending() == 0 && mltelemetry_peek(NULL) == 0);
+
+    TelemetryDecoder_t decoder;
+    decode(&stream, STREAM_SIZE, &decoder, &received);
+    failures += check("frames received", decoder.frames == (uint32_t)(sent + 1));
+    failures += check("lost frames", decoder.lost_frames == mltelemetry_dropped());
+    failures += check("too long", !mltelemetry_sendPrediction(0, 0, predictions, 200));
+
+    printf("Dropped frames: %s\n", failures ? "FAIL" : "PASS");
+    return failures;
+}
+
+static int testWrapAndCorruption() {
+    static Stream_t stream;
+    static Received_t received;
+    int failures = 0;
+    const int16_t values[30] = {0};
+
+    // Frames of 73 bytes, sent in small pieces, so that they wrap around the
+    // end of the buffer several times
+    mltelemetry_reset();
+    stream.len = 0;
+    for (int i = 0; i < 50; i++) {
+        failures += check("send", mltelemetry_sendSamples(i, values, 3, 10));
+        drain(&stream, 73);
+    }
+    drain(&stream, SIZE_MAX);
+    // Corrupt one byte in the payload of the 10th frame
+    stream.data[9 * 73 + 20] ^= 0x40;
+
+    TelemetryDecoder_t decoder;
+    decode(&stream, 64, &decoder, &received);
+    failures += check("frames", decoder.frames == 49 && decoder.crc_errors >= 1);
+    // The corrupted frame is missing from the sequence
+    failures += check("lost", decoder.lost_frames == 1);
+
+    printf("Wrap and corruption: %s\n", failures ? "FAIL" : "PASS");
+    return failures;
+}
+
+int main() {
+    int failures = 0;
+    failures += testRoundTrip();
+    failures += testDroppedFrames();
+    failures += testWrapAndCorruption();
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,23 @@
+/**
+ * @brief The check shared by the host tests.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+
+#include <stdio.h>
+
+/**
+ * @brief Print the name of a failed check.
+ *
+ * @return 1 if the condition is false, to add to the failures, 0 otherwise.
+ */
+static inline int check(const char *name, const int condition) {
+    if (!condition) {
+        printf("FAIL: %s\n", name);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,1235 @@
+/**
+ * @brief Emulator for the Thumb-2 and single precision VFP instructions
+ * used by the ML4F models, so that they can run on a host computer.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * @details
+ * The instruction encodings and pseudocode references are from the ARMv7-M
+ * Architecture Reference Manual (ARM DDI 0403).
+ */
+#include <math.h>
+#include <string.h>
+#include "thumbemulator.h"
+
+// Every VFP operation has to round to single precision like the FPU does,
+// so the compiler must not fuse the multiply and add of VMLA and friends
+#pragma GCC optimize ("fp-contract=off")
+
+#define BIT(value, n)           (((value) >> (n)) & 1u)
+#define BITS(value, hi, lo)     (((value) >> (lo)) & ((1u << ((hi) - (lo) + 1)) - 1u))
+
+#define REG_SP                  13
+#define REG_LR                  14
+#define REG_PC                  15
+
+typedef enum {
+    SHIFT_LSL = 0,
+    SHIFT_LSR = 1,
+    SHIFT_ASR = 2,
+    SHIFT_ROR = 3,
+    SHIFT_RRX = 4,
+} ShiftType_t;
+
+// Data processing opcodes shared by the 32-bit encodings
+typedef enum {
+    DP_AND = 0,
+    DP_BIC = 1,
+    DP_ORR = 2,
+    DP_ORN = 3,
+    DP_EOR = 4,
+    DP_ADD = 8,
+    DP_ADC = 10,
+    DP_SBC = 11,
+    DP_SUB = 13,
+    DP_RSB = 14,
+} DataOp_t;
+
+/*****************************************************************************/
+/* Helpers                                                                   */
+/*****************************************************************************/
+static inline float toFloat(const uint32_t bits) {
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static inline uint32_t toBits(const float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+static inline uint32_t signExtend(const uint32_t value, const int bits) {
+    const uint32_t sign = 1u << (bits - 1);
+    return (value ^ sign) - sign;
+}
+
+static inline uint32_t ror(const uint32_t value, const int amount) {
+    const int n = amount & 31;
+    return n == 0 ? value : (value >> n) | (value << (32 - n));
+}
+
+static ThumbEmuReturn_t fault(ThumbEmu_t *emu, const ThumbEmuReturn_t error) {
+    emu->fault_pc = emu->r[REG_PC] - 4;
+    return error;
+}
+
+static bool conditionPassed(const ThumbEmu_t *emu, const uint32_t cond) {
+    bool result;
+    switch (cond >> 1) {
+        case 0: result = emu->z; break;
+        case 1: result = emu->c; break;
+        case 2: result = emu->n; break;
+        case 3: result = emu->v; break;
+        case 4: result = emu->c && !emu->z; break;
+        case 5: result = emu->n == emu->v; break;
+        case 6: result = emu->n == emu->v && !emu->z; break;
+        default: return true;
+    }
+    return (cond & 1) ? !result : result;
+}
+
+static inline void setNZ(ThumbEmu_t *emu, const uint32_t result) {
+    emu->n = BIT(result, 31);
+    emu->z = result == 0;
+}
+
+static uint32_t addWithCarry(ThumbEmu_t *emu, const uint32_t x, const uint32_t y, const bool carry_in, const bool set_flags) {
+    const uint64_t sum = (uint64_t)x + y + carry_in;
+    const uint32_t result = (uint32_t)sum;
+    if (set_flags) {
+        setNZ(emu, result);
+        emu->c = sum >> 32;
+        emu->v = BIT((x ^ result) & (y ^ result), 31);
+    }
+    return result;
+}
+
+// Shift_C() from the reference manual, amount can be any register value
+static uint32_t shiftC(const uint32_t value, const ShiftType_t type, const uint32_t amount, const bool carry_in, bool *carry_out) {
+    *carry_out = carry_in;
+    if (type == SHIFT_RRX) {
+        *carry_out = value & 1;
+        return ((uint32_t)carry_in << 31) | (value >> 1);
+    }
+    if (amount == 0) {
+        return value;
+    }
+    switch (type) {
+        case SHIFT_LSL:
+            if (amount > 32) { *carry_out = false; return 0; }
+            *carry_out = BIT(value, 32 - amount);
+            return amount == 32 ? 0 : value << amount;
+        case SHIFT_LSR:
+            if (amount > 32) { *carry_out = false; return 0; }
+            *carry_out = BIT(value, amount - 1);
+            return amount == 32 ? 0 : value >> amount;
+        case SHIFT_ASR:
+            if (amount >= 32) { *carry_out = BIT(value, 31); return BIT(value, 31) ? 0xFFFFFFFFu : 0; }
+            *carry_out = BIT(value, amount - 1);
+            return (uint32_t)((int32_t)value >> amount);
+        default: {
+            const uint32_t result = ror(value, amount);
+            *carry_out = BIT(result, 31);
+            return result;
+        }
+    }
+}
+
+// DecodeImmShift(), an immediate of 0 means 32 for LSR and ASR
+static void decodeImmShift(const uint32_t type, const uint32_t imm5, ShiftType_t *shift_type, uint32_t *amount) {
+    *shift_type = (ShiftType_t)type;
+    *amount = imm5;
+    if ((type == SHIFT_LSR || type == SHIFT_ASR) && imm5 == 0) {
+        *amount = 32;
+    } else if (type == SHIFT_ROR && imm5 == 0) {
+        *shift_type = SHIFT_RRX;
+        *amount = 1;
+    }
+}
+
+// ThumbExpandImm_C()
+static uint32_t thumbExpandImm(const uint32_t imm12, const bool carry_in, bool *carry_out) {
+    const uint32_t imm8 = imm12 & 0xFF;
+    *carry_out = carry_in;
+    if (BITS(imm12, 11, 10) == 0) {
+        switch (BITS(imm12, 9, 8)) {
+            case 0: return imm8;
+            case 1: return (imm8 << 16) | imm8;
+            case 2: return (imm8 << 24) | (imm8 << 8);
+            default: return (imm8 << 24) | (imm8 << 16) | (imm8 << 8) | imm8;
+        }
+    }
+    const uint32_t result = ror(0x80 | (imm12 & 0x7F), BITS(imm12, 11, 7));
+    *carry_out = BIT(result, 31);
+    return result;
+}
+
+/*****************************************************************************/
+/* Memory                                                                    */
+/*****************************************************************************/
+static uint8_t* translate(ThumbEmu_t *emu, const uint32_t address, const uint32_t size, const bool write) {
+    const ThumbEmuRegion_t *region = &emu->regions[emu->last_region];
+    if (address - region->address < region->size && region->size - (address - region->address) >= size) {
+        return (write && !region->writable) ? NULL : region->data + (address - region->address);
+    }
+    for (int i = 0; i < emu->regions_len; i++) {
+        region = &emu->regions[i];
+        if (address - region->address < region->size && region->size - (address - region->address) >= size) {
+            emu->last_region = i;
+            return (write && !region->writable) ? NULL : region->data + (address - region->address);
+        }
+    }
+    return NULL;
+}
+
+static bool load(ThumbEmu_t *emu, const uint32_t address, const uint32_t size, uint32_t *value) {
+    const uint8_t *data = translate(emu, address, size, false);
+    if (data == NULL) {
+        emu->fault_address = address;
+        return false;
+    }
+    switch (size) {
+        case 1: *value = data[0]; break;
+        case 2: { uint16_t v; memcpy(&v, data, 2); *value = v; break; }
+        default: memcpy(value, data, 4); break;
+    }
+    emu->stats.loads++;
+    emu->stats.load_bytes += size;
+    return true;
+}
+
+static bool store(ThumbEmu_t *emu, const uint32_t address, const uint32_t size, const uint32_t value) {
+    uint8_t *data = translate(emu, address, size, true);
+    if (data == NULL) {
+        emu->fault_address = address;
+        return false;
+    }
+    switch (size) {
+        case 1: data[0] = (uint8_t)value; break;
+        case 2: { const uint16_t v = (uint16_t)value; memcpy(data, &v, 2); break; }
+        default: memcpy(data, &value, 4); break;
+    }
+    emu->stats.stores++;
+    emu->stats.store_bytes += size;
+    return true;
+}
+
+/*****************************************************************************/
+/* Branches and register writes                                              */
+/*****************************************************************************/
+static inline void branchWritePC(ThumbEmu_t *emu, const uint32_t address) {
+    emu->next_pc = address & ~1u;
+}
+
+// BXWritePC(), the M profile only has the Thumb state
+static ThumbEmuReturn_t bxWritePC(ThumbEmu_t *emu, const uint32_t address) {
+    if ((address & 1) == 0) {
+        emu->fault_address = address;
+        return fault(emu, THUMB_EMU_ERROR_STATE);
+    }
+    emu->next_pc = address & ~1u;
+    return THUMB_EMU_SUCCESS;
+}
+
+static inline void writeReg(ThumbEmu_t *emu, const uint32_t d, const uint32_t value) {
+    if (d == REG_PC) {
+        branchWritePC(emu, value);
+    } else {
+        emu->r[d] = value;
+    }
+}
+
+static ThumbEmuReturn_t loadMultiple(ThumbEmu_t *emu, const uint32_t rn, const uint32_t list, const bool decrement, const bool writeback) {
+    const uint32_t count = __builtin_popcount(list);
+    uint32_t address = decrement ? emu->r[rn] - 4 * count : emu->r[rn];
+    const uint32_t final = decrement ? emu->r[rn] - 4 * count : emu->r[rn] + 4 * count;
+    uint32_t pc_value = 0;
+    for (uint32_t i = 0; i < 16; i++) {
+        if (!BIT(list, i)) continue;
+        uint32_t value;
+        if (!load(emu, address, 4, &value)) {
+            return fault(emu, THUMB_EMU_ERROR_MEMORY);
+        }
+        if (i == REG_PC) {
+            pc_value = value;
+        } else {
+            emu->r[i] = value;
+        }
+        address += 4;
+    }
+    if (writeback && !BIT(list, rn)) {
+        emu->r[rn] = final;
+    }
+    if (BIT(list, REG_PC)) {
+        return bxWritePC(emu, pc_value);
+    }
+    return THUMB_EMU_SUCCESS;
+}
+
+static ThumbEmuReturn_t storeMultiple(ThumbEmu_t *emu, const uint32_t rn, const uint32_t list, const bool decrement, const bool writeback) {
+    const uint32_t count = __builtin_popcount(list);
+    uint32_t address = decrement ? emu->r[rn] - 4 * count : emu->r[rn];
+    const uint32_t final = decrement ? emu->r[rn] - 4 * count : emu->r[rn] + 4 * count;
+    for (uint32_t i = 0; i < 16; i++) {
+        if (!BIT(list, i)) continue;
+        if (!store(emu, address, 4, emu->r[i])) {
+            return fault(emu, THUMB_EMU_ERROR_MEMORY);
+        }
+        address += 4;
+    }
+    if (writeback) {
+        emu->r[rn] = final;
+    }
+    return THUMB_EMU_SUCCESS;
+}
+
+static ThumbEmuReturn_t loadStore(
+    ThumbEmu_t *emu, const bool is_load, const uint32_t size, const bool is_signed,
+    const uint32_t rt, const uint32_t address
+) {
+    if (!is_load) {
+        return store(emu, address, size, emu->r[rt]) ? THUMB_EMU_SUCCESS : fault(emu, THUMB_EMU_ERROR_MEMORY);
+    }
+    uint32_t value;
+    if (!load(emu, address, size, &value)) {
+        return fault(emu, THUMB_EMU_ERROR_MEMORY);
+    }
+    if (is_signed) {
+        value = signExtend(value, size * 8);
+    }
+    if (rt == REG_PC) {
+        return bxWritePC(emu, value);
+    }
+    emu->r[rt] = value;
+    return THUMB_EMU_SUCCESS;
+}
+
+/*****************************************************************************/
+/* 32-bit data processing, shared by the register and immediate encodings    */
+/*****************************************************************************/
+static ThumbEmuReturn_t dataProcessing(
+    ThumbEmu_t *emu, const uint32_t op, const bool set_flags, const uint32_t rn, const uint32_t rd,
+    const uint32_t operand, const bool shifter_carry
+) {
+    // Rn == 15 turns ORR/ORN into MOV/MVN
+    const uint32_t n = (rn == REG_PC && (op == DP_ORR || op == DP_ORN)) ? 0 : emu->r[rn];
+    uint32_t result;
+    bool logical = true;
+    switch (op) {
+        case DP_AND: result = n & operand; break;
+        case DP_BIC: result = n & ~operand; break;
+        case DP_ORR: result = n | operand; break;
+        case DP_ORN: result = n | ~operand; break;
+        case DP_EOR: result = n ^ operand; break;
+        case DP_ADD: result = addWithCarry(emu, n, operand, false, set_flags); logical = false; break;
+        case DP_ADC: result = addWithCarry(emu, n, operand, emu->c, set_flags); logical = false; break;
+        case DP_SBC: result = addWithCarry(emu, n, ~operand, emu->c, set_flags); logical = false; break;
+        case DP_SUB: result = addWithCarry(emu, n, ~operand, true, set_flags); logical = false; break;
+        case DP_RSB: result = addWithCarry(emu, ~n, operand, true, set_flags); logical = false; break;
+        default: return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+    }
+    if (set_flags && logical) {
+        setNZ(emu, result);
+        emu->c = shifter_carry;
+    }
+    // TST, TEQ, CMN and CMP are the flag setting versions with Rd == 15
+    if (!(rd == REG_PC && set_flags)) {
+        writeReg(emu, rd, result);
+    }
+    return THUMB_EMU_SUCCESS;
+}
+
+/*****************************************************************************/
+/* VFP                                                                       */
+/*****************************************************************************/
+static inline float getS(const ThumbEmu_t *emu, const uint32_t n) {
+    return toFloat(emu->s[n]);
+}
+
+static inline void setS(ThumbEmu_t *emu, const uint32_t d, const float value) {
+    emu->s[d] = toBits(value);
+}
+
+// VFPExpandImm() for single precision
+static uint32_t vfpExpandImm(const uint32_t imm8) {
+    const uint32_t b = BIT(imm8, 6);
+    return (BIT(imm8, 7) << 31) | ((b ^ 1) << 30) | ((b ? 0x1Fu : 0) << 25) | (BITS(imm8, 5, 0) << 19);
+}
+
+static void vfpCompare(ThumbEmu_t *emu, const float a, const float b) {
+    uint32_t nzcv;
+    if (isnan(a) || isnan(b)) {
+        nzcv = 0x3;
+    } else if (a == b) {
+        nzcv = 0x6;
+    } else if (a < b) {
+        nzcv = 0x8;
+    } else {
+        nzcv = 0x2;
+    }
+    emu->fpscr = (emu->fpscr & 0x0FFFFFFFu) | (nzcv << 28);
+}
+
+// FPToFixed() with 0 fraction bits, saturating like the FPU
+static uint32_t floatToInt(const float value, const bool is_signed, const bool round_to_zero) {
+    if (isnan(value)) {
+        return 0;
+    }
+    const double rounded = round_to_zero ? trunc((double)value) : nearbyint((double)value);
+    if (is_signed) {
+        if (rounded >= 2147483647.0) return 0x7FFFFFFFu;
+        if (rounded <= -2147483648.0) return 0x80000000u;
+        return (uint32_t)(int32_t)rounded;
+    }
+    if (rounded >= 4294967295.0) return 0xFFFFFFFFu;
+    if (rounded <= 0.0) return 0;
+    return (uint32_t)rounded;
+}
+
+static ThumbEmuReturn_t vfpLoadStore(ThumbEmu_t *emu, const uint32_t hw1, const uint32_t hw2) {
+    const bool p = BIT(hw1, 8), u = BIT(hw1, 7), w = BIT(hw1, 5), l = BIT(hw1, 4);
+    const uint32_t rn = BITS(hw1, 3, 0);
+    const bool is_double = BIT(hw2, 8);
+    const uint32_t imm8 = BITS(hw2, 7, 0);
+    // Double registers D0-D15 overlap pairs of single registers
+    const uint32_t d = is_double
+        ? (BIT(hw1, 6) << 4 | BITS(hw2, 15, 12)) * 2
+        : BITS(hw2, 15, 12) << 1 | BIT(hw1, 6);
+
+    if (p && !w) {
+        // VLDR and VSTR, with PC relative addressing for literals
+        const uint32_t base = rn == REG_PC ? (emu->r[REG_PC] & ~3u) : emu->r[rn];
+        const uint32_t address = u ? base + imm8 * 4 : base - imm8 * 4;
+        const uint32_t words = is_double ? 2 : 1;
+        for (uint32_t i = 0; i < words; i++) {
+            if (l ? !load(emu, address + 4 * i, 4, &emu->s[d + i])
+                  : !store(emu, address + 4 * i, 4, emu->s[d + i])) {
+                return fault(emu, THUMB_EMU_ERROR_MEMORY);
+            }
+        }
+        return THUMB_EMU_SUCCESS;
+    }
+    if (p == u) {
+        return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+    }
+
+    // VLDM and VSTM (including VPUSH and VPOP), imm8 is the number of words
+    if (d + imm8 > 32 || imm8 == 0) {
+        return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+    }
+    uint32_t address = u ? emu->r[rn] : emu->r[rn] - imm8 * 4;
+    const uint32_t final = u ? emu->r[rn] + imm8 * 4 : emu->r[rn] - imm8 * 4;
+    for (uint32_t i = 0; i < imm8; i++) {
+        if (l ? !load(emu, address, 4, &emu->s[d + i]) : !store(emu, address, 4, emu->s[d + i])) {
+            return fault(emu, THUMB_EMU_ERROR_MEMORY);
+        }
+        address += 4;
+    }
+    if (w) {
+        emu->r[rn] = final;
+    }
+    return THUMB_EMU_SUCCESS;
+}
+
+static ThumbEmuReturn_t vfpDataProcessing(ThumbEmu_t *emu, const uint32_t hw1, const uint32_t hw2) {
+    if (BIT(hw2, 8)) {
+        // Double precision isn't available on the Cortex-M4
+        return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+    }
+    const uint32_t opc1 = BIT(hw1, 7) << 2 | BITS(hw1, 5, 4);
+    const uint32_t d = BITS(hw2, 15, 12) << 1 | BIT(hw1, 6);
+    const uint32_t n = BITS(hw1, 3, 0) << 1 | BIT(hw2, 7);
+    const uint32_t m = BITS(hw2, 3, 0) << 1 | BIT(hw2, 5);
+    const bool op = BIT(hw2, 6);
+
+    switch (opc1) {
+        case 0: {
+            // VMLA, VMLS
+            const float product = getS(emu, n) * getS(emu, m);
+            setS(emu, d, getS(emu, d) + (op ? -product : product));
+            return THUMB_EMU_SUCCESS;
+        }
+        case 1: {
+            // VNMLS, VNMLA
+            const float product = getS(emu, n) * getS(emu, m);
+            setS(emu, d, -getS(emu, d) + (op ? -product : product));
+            return THUMB_EMU_SUCCESS;
+        }
+        case 2: {
+            // VMUL, VNMUL
+            const float product = getS(emu, n) * getS(emu, m);
+            setS(emu, d, op ? -product : product);
+            return THUMB_EMU_SUCCESS;
+        }
+        case 3:
+            // VADD, VSUB
+            setS(emu, d, op ? getS(emu, n) - getS(emu, m) : getS(emu, n) + getS(emu, m));
+            return THUMB_EMU_SUCCESS;
+        case 4:
+            if (op) break;
+            setS(emu, d, getS(emu, n) / getS(emu, m));
+            return THUMB_EMU_SUCCESS;
+        case 5:
+            // VFNMS, VFNMA
+            setS(emu, d, fmaf(op ? -getS(emu, n) : getS(emu, n), getS(emu, m), -getS(emu, d)));
+            return THUMB_EMU_SUCCESS;
+        case 6:
+            // VFMA, VFMS
+            setS(emu, d, fmaf(op ? -getS(emu, n) : getS(emu, n), getS(emu, m), getS(emu, d)));
+            return THUMB_EMU_SUCCESS;
+        default:
+            break;
+    }
+    if (opc1 != 7) {
+        return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+    }
+
+    // Other VFP data processing instructions, opc2 is in the Vn field
+    const uint32_t opc2 = BITS(hw1, 3, 0);
+    const uint32_t opc3 = BITS(hw2, 7, 6);
+    if ((opc3 & 1) == 0) {
+        // VMOV (immediate)
+        emu->s[d] = vfpExpandImm(BITS(hw1, 3, 0) << 4 | BITS(hw2, 3, 0));
+        return THUMB_EMU_SUCCESS;
+    }
+    switch (opc2) {
+        case 0:
+            // VMOV (register), VABS
+            emu->s[d] = opc3 == 1 ? emu->s[m] : emu->s[m] & 0x7FFFFFFFu;
+            return THUMB_EMU_SUCCESS;
+        case 1:
+            // VNEG, VSQRT
+            if (opc3 == 1) {
+                emu->s[d] = emu->s[m] ^ 0x80000000u;
+            } else {
+                setS(emu, d, sqrtf(getS(emu, m)));
+            }
+            return THUMB_EMU_SUCCESS;
+        case 4:
+            // VCMP, VCMPE
+            vfpCompare(emu, getS(emu, d), getS(emu, m));
+            return THUMB_EMU_SUCCESS;
+        case 5:
+            // VCMP, VCMPE with zero
+            vfpCompare(emu, getS(emu, d), 0.0f);
+            return THUMB_EMU_SUCCESS;
+        case 8:
+            // VCVT from a signed or unsigned integer
+            setS(emu, d, BIT(hw2, 7) ? (float)(int32_t)emu->s[m] : (float)emu->s[m]);
+            return THUMB_EMU_SUCCESS;
+        case 12:
+        case 13:
+            // VCVT and VCVTR to an unsigned or signed integer
+            emu->s[d] = floatToInt(getS(emu, m), opc2 == 13, BIT(hw2, 7));
+            return THUMB_EMU_SUCCESS;
+        default:
+            return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+    }
+}
+
+static ThumbEmuReturn_t vfpInstruction(ThumbEmu_t *emu, const uint32_t hw1, const uint32_t hw2) {
+    if (BITS(hw2, 11, 9) != 5) {
+        // Only coprocessors 10 and 11 (the FPU) exist
+        return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+    }
+    emu->stats.fp_instructions++;
+
+    if ((hw1 & 0xFFE0) == 0xEC40) {
+        // VMOV between two core registers and two single registers
+        if (BIT(hw2, 8) || BITS(hw2, 7, 6) != 0 || !BIT(hw2, 4)) {
+            return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+        }
+        const uint32_t rt = BITS(hw2, 15, 12), rt2 = BITS(hw1, 3, 0);
+        const uint32_t m = BITS(hw2, 3, 0) << 1 | BIT(hw2, 5);
+        if (m == 31) {
+            return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+        }
+        if (BIT(hw1, 4)) {
+            emu->r[rt] = emu->s[m];
+            emu->r[rt2] = emu->s[m + 1];
+        } else {
+            emu->s[m] = emu->r[rt];
+            emu->s[m + 1] = emu->r[rt2];
+        }
+        return THUMB_EMU_SUCCESS;
+    }
+    if ((hw1 & 0xFE00) == 0xEC00) {
+        return vfpLoadStore(emu, hw1, hw2);
+    }
+    if ((hw1 & 0xFF00) == 0xEE00 && !BIT(hw2, 4)) {
+        return vfpDataProcessing(emu, hw1, hw2);
+    }
+    if ((hw1 & 0xFF00) == 0xEE00 && BITS(hw2, 6, 5) == 0 && BITS(hw2, 3, 0) == 0 && !BIT(hw2, 8)) {
+        const uint32_t rt = BITS(hw2, 15, 12);
+        const uint32_t a = BITS(hw1, 7, 5);
+        if (a == 0) {
+            // VMOV between a core register and a single register
+            const uint32_t n = BITS(hw1, 3, 0) << 1 | BIT(hw2, 7);
+            if (BIT(hw1, 4)) {
+                writeReg(emu, rt, emu->s[n]);
+            } else {
+                emu->s[n] = emu->r[rt];
+            }
+            return THUMB_EMU_SUCCESS;
+        }
+        if (a == 7 && BITS(hw1, 3, 0) == 1) {
+            if (!BIT(hw1, 4)) {
+                // VMSR
+                emu->fpscr = emu->r[rt];
+            } else if (rt == REG_PC) {
+                // VMRS APSR_nzcv, FPSCR
+                emu->n = BIT(emu->fpscr, 31);
+                emu->z = BIT(emu->fpscr, 30);
+                emu->c = BIT(emu->fpscr, 29);
+                emu->v = BIT(emu->fpscr, 28);
+            } else {
+                emu->r[rt] = emu->fpscr;
+            }
+            return THUMB_EMU_SUCCESS;
+        }
+    }
+    return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+}
+
+/*****************************************************************************/
+/* 16-bit instructions                                                       */
+/*****************************************************************************/
+static ThumbEmuReturn_t execute16(ThumbEmu_t *emu, const uint32_t hw, const bool in_it) {
+    const bool set_flags = !in_it;
+
+    switch (hw >> 11) {
+        case 0x00: case 0x01: case 0x02: {
+            // LSL, LSR, ASR (immediate), LSL #0 is MOVS
+            const uint32_t rd = BITS(hw, 2, 0), rm = BITS(hw, 5, 3);
+            ShiftType_t type;
+            uint32_t amount;
+            decodeImmShift(hw >> 11, BITS(hw, 10, 6), &type, &amount);
+            bool carry;
+            const uint32_t result = shiftC(emu->r[rm], type, amount, emu->c, &carry);
+            emu->r[rd] = result;
+            if (set_flags) {
+                setNZ(emu, result);
+                emu->c = carry;
+            }
+            return THUMB_EMU_SUCCESS;
+        }
+        case 0x03: {
+            // ADD, SUB with a register or a 3-bit immediate
+            const uint32_t rd = BITS(hw, 2, 0), rn = BITS(hw, 5, 3);
+            const uint32_t operand = BIT(hw, 10) ? BITS(hw, 8, 6) : emu->r[BITS(hw, 8, 6)];
+            emu->r[rd] = BIT(hw, 9)
+                ? addWithCarry(emu, emu->r[rn], ~operand, true, set_flags)
+                : addWithCarry(emu, emu->r[rn], operand, false, set_flags);
+            return THUMB_EMU_SUCCESS;
+        }
+        case 0x04: {
+            // MOV (immediate)
+            const uint32_t rd = BITS(hw, 10, 8);
+            emu->r[rd] = hw & 0xFF;
+            if (set_flags) {
+                setNZ(emu, emu->r[rd]);
+            }
+            return THUMB_EMU_SUCCESS;
+        }
+        case 0x05:
+            // CMP (immediate)
+            addWithCarry(emu, emu->r[BITS(hw, 10, 8)], ~(hw & 0xFFu), true, true);
+            return THUMB_EMU_SUCCESS;
+        case 0x06: {
+            // ADD (immediate, 8-bit)
+            const uint32_t rdn = BITS(hw, 10, 8);
+            emu->r[rdn] = addWithCarry(emu, emu->r[rdn], hw & 0xFF, false, set_flags);
+            return THUMB_EMU_SUCCESS;
+        }
+        case 0x07: {
+            // SUB (immediate, 8-bit)
+            const uint32_t rdn = BITS(hw, 10, 8);
+            emu->r[rdn] = addWithCarry(emu, emu->r[rdn], ~(hw & 0xFFu), true, set_flags);
+            return THUMB_EMU_SUCCESS;
+        }
+        case 0x08: {
+            if (BIT(hw, 10) == 0) {
+                // Data processing (register)
+                const uint32_t rdn = BITS(hw, 2, 0), rm = BITS(hw, 5, 3);
+                const uint32_t a = emu->r[rdn], b = emu->r[rm];
+                uint32_t result = 0;
+                bool carry = emu->c, write = true, logical = true;
+                switch (BITS(hw, 9, 6)) {
+                    case 0x0: result = a & b; break;
+                    case 0x1: result = a ^ b; break;
+                    case 0x2: result = shiftC(a, SHIFT_LSL, b & 0xFF, emu->c, &carry); break;
+                    case 0x3: result = shiftC(a, SHIFT_LSR, b & 0xFF, emu->c, &carry); break;
+                    case 0x4: result = shiftC(a, SHIFT_ASR, b & 0xFF, emu->c, &carry); break;
+                    case 0x5: result = addWithCarry(emu, a, b, emu->c, set_flags); logical = false; break;
+                    case 0x6: result = addWithCarry(emu, a, ~b, emu->c, set_flags); logical = false; break;
+                    case 0x7: result = shiftC(a, SHIFT_ROR, b & 0xFF, emu->c, &carry); break;
+                    case 0x8: result = a & b; write = false; break;
+                    case 0x9: result = addWithCarry(emu, ~b, 0, true, set_flags); logical = false; break;
+                    case 0xA: addWithCarry(emu, a, ~b, true, true); return THUMB_EMU_SUCCESS;
+                    case 0xB: addWithCarry(emu, a, b, false, true); return THUMB_EMU_SUCCESS;
+                    case 0xC: result = a | b; break;
+                    case 0xD: result = a * b; break;
+                    case 0xE: result = a & ~b; break;
+                    default: result = ~b; break;
+                }
+                // TST always sets the flags
+                if (logical && (set_flags || !write)) {
+                    setNZ(emu, result);
+                    emu->c = carry;
+                }
+                if (write) {
+                    emu->r[rdn] = result;
+                }
+                return THUMB_EMU_SUCCESS;
+            }
+            // Special data instructions and branch and exchange
+            const uint32_t rm = BITS(hw, 6, 3);
+            const uint32_t rdn = BIT(hw, 7) << 3 | BITS(hw, 2, 0);
+            switch (BITS(hw, 9, 8)) {
+                case 0:
+                    writeReg(emu, rdn, emu->r[rdn] + emu->r[rm]);
+                    return THUMB_EMU_SUCCESS;
+                case 1:
+                    addWithCarry(emu, emu->r[rdn], ~emu->r[rm], true, true);
+                    return THUMB_EMU_SUCCESS;
+                case 2:
+                    writeReg(emu, rdn, emu->r[rm]);
+                    return THUMB_EMU_SUCCESS;
+                default: {
+                    const uint32_t target = emu->r[rm];
+                    if (BIT(hw, 7)) {
+                        // BLX
+                        emu->r[REG_LR] = (emu->r[REG_PC] - 2) | 1;
+                    }
+                    return bxWritePC(emu, target);
+                }
+            }
+        }
+        case 0x09:
+            // LDR (literal)
+            return loadStore(emu, true, 4, false, BITS(hw, 10, 8), (emu->r[REG_PC] & ~3u) + (hw & 0xFF) * 4);
+        case 0x0A: case 0x0B: {
+            // Load and store with a register offset
+            static const uint8_t sizes[8] = {4, 2, 1, 1, 4, 2, 1, 2};
+            const uint32_t op = BITS(hw, 11, 9);
+            const uint32_t address = emu->r[BITS(hw, 5, 3)] + emu->r[BITS(hw, 8, 6)];
+            return loadStore(emu, op != 0 && op != 1 && op != 2, sizes[op], op == 3 || op == 7, BITS(hw, 2, 0), address);
+        }
+        case 0x0C: case 0x0D:
+            // STR, LDR (immediate)
+            return loadStore(emu, BIT(hw, 11), 4, false, BITS(hw, 2, 0), emu->r[BITS(hw, 5, 3)] + BITS(hw, 10, 6) * 4);
+        case 0x0E: case 0x0F:
+            // STRB, LDRB (immediate)
+            return loadStore(emu, BIT(hw, 11), 1, false, BITS(hw, 2, 0), emu->r[BITS(hw, 5, 3)] + BITS(hw, 10, 6));
+        case 0x10: case 0x11:
+            // STRH, LDRH (immediate)
+            return loadStore(emu, BIT(hw, 11), 2, false, BITS(hw, 2, 0), emu->r[BITS(hw, 5, 3)] + BITS(hw, 10, 6) * 2);
+        case 0x12: case 0x13:
+            // STR, LDR (SP relative)
+            return loadStore(emu, BIT(hw, 11), 4, false, BITS(hw, 10, 8), emu->r[REG_SP] + (hw & 0xFF) * 4);
+        case 0x14:
+            // ADR
+            emu->r[BITS(hw, 10, 8)] = (emu->r[REG_PC] & ~3u) + (hw & 0xFF) * 4;
+            return THUMB_EMU_SUCCESS;
+        case 0x15:
+            // ADD (SP plus immediate)
+            emu->r[BITS(hw, 10, 8)] = emu->r[REG_SP] + (hw & 0xFF) * 4;
+            return THUMB_EMU_SUCCESS;
+        case 0x16: case 0x17: {
+            // Miscellaneous 16-bit instructions
+            if ((hw & 0xFF00) == 0xB000) {
+                // ADD, SUB (SP plus immediate)
+                const uint32_t imm = BITS(hw, 6, 0) * 4;
+                emu->r[REG_SP] += BIT(hw, 7) ? -imm : imm;
+                return THUMB_EMU_SUCCESS;
+            }
+            if ((hw & 0xF500) == 0xB100) {
+                // CBZ, CBNZ
+                const uint32_t offset = BIT(hw, 9) << 6 | BITS(hw, 7, 3) << 1;
+                if ((emu->r[BITS(hw, 2, 0)] == 0) != BIT(hw, 11)) {
+                    branchWritePC(emu, emu->r[REG_PC] + offset);
+                }
+                return THUMB_EMU_SUCCESS;
+            }
+            if ((hw & 0xFF00) == 0xB200) {
+                // SXTH, SXTB, UXTH, UXTB
+                const uint32_t value = emu->r[BITS(hw, 5, 3)];
+                uint32_t result;
+                switch (BITS(hw, 7, 6)) {
+                    case 0: result = signExtend(value & 0xFFFF, 16); break;
+                    case 1: result = signExtend(value & 0xFF, 8); break;
+                    case 2: result = value & 0xFFFF; break;
+                    default: result = value & 0xFF; break;
+                }
+                emu->r[BITS(hw, 2, 0)] = result;
+                return THUMB_EMU_SUCCESS;
+            }
+            if ((hw & 0xFE00) == 0xB400) {
+                // PUSH
+                return storeMultiple(emu, REG_SP, (hw & 0xFF) | BIT(hw, 8) << REG_LR, true, true);
+            }
+            if ((hw & 0xFE00) == 0xBC00) {
+                // POP
+                return loadMultiple(emu, REG_SP, (hw & 0xFF) | BIT(hw, 8) << REG_PC, false, true);
+            }
+            if ((hw & 0xFF00) == 0xBA00 && BITS(hw, 7, 6) != 2) {
+                // REV, REV16, REVSH
+                const uint32_t value = emu->r[BITS(hw, 5, 3)];
+                uint32_t result;
+                switch (BITS(hw, 7, 6)) {
+                    case 0: result = __builtin_bswap32(value); break;
+                    case 1: result = (value & 0xFF00FF00u) >> 8 | (value & 0x00FF00FFu) << 8; break;
+                    default: result = signExtend(__builtin_bswap16((uint16_t)value), 16); break;
+                }
+                emu->r[BITS(hw, 2, 0)] = result;
+                return THUMB_EMU_SUCCESS;
+            }
+            if ((hw & 0xFF00) == 0xBF00) {
+                // IT, or a hint like NOP when the mask is 0
+                if ((hw & 0xF) != 0) {
+                    emu->it_state = hw & 0xFF;
+                }
+                return THUMB_EMU_SUCCESS;
+            }
+            return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+        }
+        case 0x18:
+            // STM
+            return storeMultiple(emu, BITS(hw, 10, 8), hw & 0xFF, false, true);
+        case 0x19:
+            // LDM
+            return loadMultiple(emu, BITS(hw, 10, 8), hw & 0xFF, false, true);
+        case 0x1A: case 0x1B: {
+            // B<c>, UDF and SVC are not supported
+            const uint32_t cond = BITS(hw, 11, 8);
+            if (cond >= 14) {
+                return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+            }
+            if (conditionPassed(emu, cond)) {
+                branchWritePC(emu, emu->r[REG_PC] + signExtend((hw & 0xFF) << 1, 9));
+            }
+            return THUMB_EMU_SUCCESS;
+        }
+        case 0x1C:
+            // B
+            branchWritePC(emu, emu->r[REG_PC] + signExtend((hw & 0x7FF) << 1, 12));
+            return THUMB_EMU_SUCCESS;
+        default:
+            return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+    }
+}
+
+/*****************************************************************************/
+/* 32-bit instructions                                                       */
+/*****************************************************************************/
+static ThumbEmuReturn_t executeLoadStoreSingle(ThumbEmu_t *emu, const uint32_t hw1, const uint32_t hw2) {
+    const bool is_signed = BIT(hw1, 8);
+    const bool is_load = BIT(hw1, 4);
+    const uint32_t size = 1u << BITS(hw1, 6, 5);
+    const uint32_t rn = BITS(hw1, 3, 0), rt = BITS(hw2, 15, 12);
+    if (size == 8 || (is_signed && !is_load)) {
+        return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+    }
+    // Byte and halfword loads to PC are the PLD hints
+    if (is_load && rt == REG_PC && size != 4) {
+        return THUMB_EMU_SUCCESS;
+    }
+
+    if (rn == REG_PC) {
+        if (!is_load) {
+            return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+        }
+        const uint32_t base = emu->r[REG_PC] & ~3u, imm12 = BITS(hw2, 11, 0);
+        return loadStore(emu, true, size, is_signed, rt, BIT(hw1, 7) ? base + imm12 : base - imm12);
+    }
+    if (BIT(hw1, 7)) {
+        // 12-bit positive immediate offset
+        return loadStore(emu, is_load, size, is_signed, rt, emu->r[rn] + BITS(hw2, 11, 0));
+    }
+    if (BIT(hw2, 11)) {
+        // 8-bit immediate, with pre or post indexing and writeback
+        const bool p = BIT(hw2, 10), u = BIT(hw2, 9), w = BIT(hw2, 8);
+        const uint32_t imm8 = BITS(hw2, 7, 0);
+        const uint32_t offset_address = u ? emu->r[rn] + imm8 : emu->r[rn] - imm8;
+        const ThumbEmuReturn_t result = loadStore(emu, is_load, size, is_signed, rt, p ? offset_address : emu->r[rn]);
+        if (result == THUMB_EMU_SUCCESS && w) {
+            emu->r[rn] = offset_address;
+        }
+        return result;
+    }
+    if (BITS(hw2, 11, 6) == 0) {
+        // Register offset, shifted left by up to 3
+        const uint32_t address = emu->r[rn] + (emu->r[BITS(hw2, 3, 0)] << BITS(hw2, 5, 4));
+        return loadStore(emu, is_load, size, is_signed, rt, address);
+    }
+    return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+}
+
+static ThumbEmuReturn_t executeDataRegister(ThumbEmu_t *emu, const uint32_t hw1, const uint32_t hw2) {
+    const uint32_t op1 = BITS(hw1, 7, 4), op2 = BITS(hw2, 7, 4);
+    const uint32_t rn = BITS(hw1, 3, 0), rd = BITS(hw2, 11, 8), rm = BITS(hw2, 3, 0);
+    const bool set_flags = BIT(hw1, 4);
+
+    if (BITS(hw2, 15, 12) != 0xF) {
+        return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+    }
+    if ((op1 & 0x8) == 0 && op2 == 0) {
+        // LSL, LSR, ASR, ROR (register)
+        bool carry;
+        const uint32_t result = shiftC(emu->r[rn], (ShiftType_t)BITS(hw1, 6, 5), emu->r[rm] & 0xFF, emu->c, &carry);
+        emu->r[rd] = result;
+        if (set_flags) {
+            setNZ(emu, result);
+            emu->c = carry;
+        }
+        return THUMB_EMU_SUCCESS;
+    }
+    if ((op1 & 0x8) == 0 && (op2 & 0x8)) {
+        // SXTH, UXTH, SXTB, UXTB, and the add versions when Rn != 15
+        const uint32_t rotated = ror(emu->r[rm], BITS(hw2, 5, 4) * 8);
+        uint32_t value;
+        switch (op1) {
+            case 0: value = signExtend(rotated & 0xFFFF, 16); break;
+            case 1: value = rotated & 0xFFFF; break;
+            case 4: value = signExtend(rotated & 0xFF, 8); break;
+            case 5: value = rotated & 0xFF; break;
+            default: return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+        }
+        emu->r[rd] = rn == REG_PC ? value : emu->r[rn] + value;
+        return THUMB_EMU_SUCCESS;
+    }
+    if ((op1 & 0xC) == 0x8 && (op2 & 0xC) == 0x8) {
+        const uint32_t value = emu->r[rm];
+        switch ((op1 & 3) << 2 | (op2 & 3)) {
+            case 0x4: emu->r[rd] = __builtin_bswap32(value); break;
+            case 0x5: emu->r[rd] = (value & 0xFF00FF00u) >> 8 | (value & 0x00FF00FFu) << 8; break;
+            case 0x6: {
+                uint32_t result = 0;
+                for (int i = 0; i < 32; i++) {
+                    result |= BIT(value, i) << (31 - i);
+                }
+                emu->r[rd] = result;
+                break;
+            }
+            case 0x7: emu->r[rd] = signExtend(__builtin_bswap16((uint16_t)value), 16); break;
+            case 0xC: emu->r[rd] = value == 0 ? 32 : (uint32_t)__builtin_clz(value); break;
+            default: return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+        }
+        return THUMB_EMU_SUCCESS;
+    }
+    return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+}
+
+static ThumbEmuReturn_t executeMultiply(ThumbEmu_t *emu, const uint32_t hw1, const uint32_t hw2) {
+    const uint32_t op1 = BITS(hw1, 6, 4), op2 = BITS(hw2, 7, 4);
+    const uint32_t rn = BITS(hw1, 3, 0), ra = BITS(hw2, 15, 12), rd = BITS(hw2, 11, 8), rm = BITS(hw2, 3, 0);
+    const uint32_t a = emu->r[rn], b = emu->r[rm];
+
+    if (BIT(hw1, 7) == 0) {
+        if (op1 != 0 || op2 > 1) {
+            return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+        }
+        // MUL, MLA, MLS
+        const uint32_t product = a * b;
+        if (op2 == 1) {
+            emu->r[rd] = emu->r[ra] - product;
+        } else {
+            emu->r[rd] = ra == REG_PC ? product : emu->r[ra] + product;
+        }
+        return THUMB_EMU_SUCCESS;
+    }
+
+    // Long multiply and divide, Ra is RdLo
+    const uint32_t rd_lo = ra, rd_hi = rd;
+    uint64_t result;
+    switch (op1 << 4 | op2) {
+        case 0x00:
+            result = (uint64_t)((int64_t)(int32_t)a * (int32_t)b);
+            break;
+        case 0x1F:
+            // SDIV, division by 0 gives 0 when DIV_0_TRP is clear
+            if (b == 0) emu->r[rd] = 0;
+            else if (a == 0x80000000u && b == 0xFFFFFFFFu) emu->r[rd] = a;
+            else emu->r[rd] = (uint32_t)((int32_t)a / (int32_t)b);
+            return THUMB_EMU_SUCCESS;
+        case 0x20:
+            result = (uint64_t)a * b;
+            break;
+        case 0x3F:
+            emu->r[rd] = b == 0 ? 0 : a / b;
+            return THUMB_EMU_SUCCESS;
+        case 0x40:
+            result = (uint64_t)((int64_t)(int32_t)a * (int32_t)b) + ((uint64_t)emu->r[rd_hi] << 32 | emu->r[rd_lo]);
+            break;
+        case 0x60:
+            result = (uint64_t)a * b + ((uint64_t)emu->r[rd_hi] << 32 | emu->r[rd_lo]);
+            break;
+        default:
+            return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+    }
+    emu->r[rd_lo] = (uint32_t)result;
+    emu->r[rd_hi] = (uint32_t)(result >> 32);
+    return THUMB_EMU_SUCCESS;
+}
+
+static ThumbEmuReturn_t executePlainImmediate(ThumbEmu_t *emu, const uint32_t hw1, const uint32_t hw2) {
+    const uint32_t op = BITS(hw1, 8, 4);
+    const uint32_t rn = BITS(hw1, 3, 0), rd = BITS(hw2, 11, 8);
+    const uint32_t imm12 = BIT(hw1, 10) << 11 | BITS(hw2, 14, 12) << 8 | BITS(hw2, 7, 0);
+    const uint32_t imm16 = BITS(hw1, 3, 0) << 12 | imm12;
+    const uint32_t lsb = BITS(hw2, 14, 12) << 2 | BITS(hw2, 7, 6);
+    const uint32_t width = BITS(hw2, 4, 0) + 1;
+
+    switch (op) {
+        case 0x00:
+            // ADDW, ADR
+            emu->r[rd] = (rn == REG_PC ? emu->r[REG_PC] & ~3u : emu->r[rn]) + imm12;
+            return THUMB_EMU_SUCCESS;
+        case 0x0A:
+            // SUBW, ADR
+            emu->r[rd] = (rn == REG_PC ? emu->r[REG_PC] & ~3u : emu->r[rn]) - imm12;
+            return THUMB_EMU_SUCCESS;
+        case 0x04:
+            // MOVW
+            emu->r[rd] = imm16;
+            return THUMB_EMU_SUCCESS;
+        case 0x0C:
+            // MOVT
+            emu->r[rd] = (emu->r[rd] & 0xFFFF) | imm16 << 16;
+            return THUMB_EMU_SUCCESS;
+        case 0x14:
+        case 0x1C: {
+            // SBFX, UBFX
+            if (lsb + width > 32) {
+                return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+            }
+            const uint32_t field = width == 32 ? emu->r[rn] : (emu->r[rn] >> lsb) & ((1u << width) - 1);
+            emu->r[rd] = op == 0x14 ? signExtend(field, width) : field;
+            return THUMB_EMU_SUCCESS;
+        }
+        case 0x16: {
+            // BFI, BFC when Rn == 15, the msb is in the width field
+            const uint32_t msb = BITS(hw2, 4, 0);
+            if (msb < lsb) {
+                return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+            }
+            const uint32_t mask = (msb - lsb == 31 ? 0xFFFFFFFFu : ((1u << (msb - lsb + 1)) - 1)) << lsb;
+            const uint32_t value = rn == REG_PC ? 0 : emu->r[rn] << lsb;
+            emu->r[rd] = (emu->r[rd] & ~mask) | (value & mask);
+            return THUMB_EMU_SUCCESS;
+        }
+        default:
+            return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+    }
+}
+
+static ThumbEmuReturn_t executeBranchMisc(ThumbEmu_t *emu, const uint32_t hw1, const uint32_t hw2) {
+    const uint32_t s = BIT(hw1, 10), j1 = BIT(hw2, 13), j2 = BIT(hw2, 11);
+
+    if (BIT(hw2, 12) == 0 && BIT(hw2, 14) == 0) {
+        const uint32_t cond = BITS(hw1, 9, 6);
+        if ((cond & 0xE) != 0xE) {
+            // B<c>.W
+            const uint32_t imm = s << 20 | j2 << 19 | j1 << 18 | BITS(hw1, 5, 0) << 12 | BITS(hw2, 10, 0) << 1;
+            if (conditionPassed(emu, cond)) {
+                branchWritePC(emu, emu->r[REG_PC] + signExtend(imm, 21));
+            }
+            return THUMB_EMU_SUCCESS;
+        }
+        // NOP and the other hints, and the memory barriers
+        if (hw1 == 0xF3AF && BITS(hw2, 10, 8) == 0) {
+            return THUMB_EMU_SUCCESS;
+        }
+        if (hw1 == 0xF3BF && BITS(hw2, 15, 8) == 0x8F) {
+            return THUMB_EMU_SUCCESS;
+        }
+        return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+    }
+    if (BIT(hw2, 12) == 0) {
+        // BLX (immediate) switches to the Arm state
+        return fault(emu, THUMB_EMU_ERROR_STATE);
+    }
+
+    // B.W and BL
+    const uint32_t i1 = !(j1 ^ s), i2 = !(j2 ^ s);
+    const uint32_t imm = s << 24 | i1 << 23 | i2 << 22 | BITS(hw1, 9, 0) << 12 | BITS(hw2, 10, 0) << 1;
+    if (BIT(hw2, 14)) {
+        emu->r[REG_LR] = emu->next_pc | 1;
+    }
+    branchWritePC(emu, emu->r[REG_PC] + signExtend(imm, 25));
+    return THUMB_EMU_SUCCESS;
+}
+
+static ThumbEmuReturn_t execute32(ThumbEmu_t *emu, const uint32_t hw1, const uint32_t hw2) {
+    if ((hw1 & 0xFE40) == 0xE800) {
+        // LDM, STM, with PUSH.W and POP.W
+        const uint32_t op = BITS(hw1, 8, 7);
+        if (op != 1 && op != 2) {
+            return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+        }
+        const bool decrement = op == 2, writeback = BIT(hw1, 5);
+        return BIT(hw1, 4)
+            ? loadMultiple(emu, BITS(hw1, 3, 0), hw2, decrement, writeback)
+            : storeMultiple(emu, BITS(hw1, 3, 0), hw2, decrement, writeback);
+    }
+    if ((hw1 & 0xFE40) == 0xE840) {
+        const uint32_t rn = BITS(hw1, 3, 0);
+        if ((hw1 & 0xFFF0) == 0xE8D0 && (hw2 & 0xFFE0) == 0xF000) {
+            // TBB, TBH
+            const bool half = BIT(hw2, 4);
+            const uint32_t base = emu->r[rn], index = emu->r[BITS(hw2, 3, 0)];
+            uint32_t offset;
+            if (!load(emu, half ? base + index * 2 : base + index, half ? 2 : 1, &offset)) {
+                return fault(emu, THUMB_EMU_ERROR_MEMORY);
+            }
+            branchWritePC(emu, emu->r[REG_PC] + offset * 2);
+            return THUMB_EMU_SUCCESS;
+        }
+        const bool p = BIT(hw1, 8), u = BIT(hw1, 7), w = BIT(hw1, 5), l = BIT(hw1, 4);
+        if (!p && !w) {
+            // Exclusive loads and stores
+            return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+        }
+        // LDRD, STRD
+        const uint32_t rt = BITS(hw2, 15, 12), rt2 = BITS(hw2, 11, 8);
+        const uint32_t imm = BITS(hw2, 7, 0) * 4;
+        const uint32_t base = rn == REG_PC ? emu->r[REG_PC] & ~3u : emu->r[rn];
+        const uint32_t offset_address = u ? base + imm : base - imm;
+        const uint32_t address = p ? offset_address : base;
+        ThumbEmuReturn_t result = loadStore(emu, l, 4, false, rt, address);
+        if (result == THUMB_EMU_SUCCESS) {
+            result = loadStore(emu, l, 4, false, rt2, address + 4);
+        }
+        if (result == THUMB_EMU_SUCCESS && w) {
+            emu->r[rn] = offset_address;
+        }
+        return result;
+    }
+    if ((hw1 & 0xFE00) == 0xEA00) {
+        // Data processing (shifted register)
+        ShiftType_t type;
+        uint32_t amount;
+        decodeImmShift(BITS(hw2, 5, 4), BITS(hw2, 14, 12) << 2 | BITS(hw2, 7, 6), &type, &amount);
+        bool carry;
+        const uint32_t operand = shiftC(emu->r[BITS(hw2, 3, 0)], type, amount, emu->c, &carry);
+        return dataProcessing(emu, BITS(hw1, 8, 5), BIT(hw1, 4), BITS(hw1, 3, 0), BITS(hw2, 11, 8), operand, carry);
+    }
+    if ((hw1 & 0xEC00) == 0xEC00 && (hw1 & 0xF000) == 0xE000) {
+        return vfpInstruction(emu, hw1, hw2);
+    }
+    if ((hw1 & 0xF800) == 0xF000 && BIT(hw2, 15) == 0) {
+        if (BIT(hw1, 9) == 0) {
+            // Data processing (modified immediate)
+            const uint32_t imm12 = BIT(hw1, 10) << 11 | BITS(hw2, 14, 12) << 8 | BITS(hw2, 7, 0);
+            bool carry;
+            const uint32_t operand = thumbExpandImm(imm12, emu->c, &carry);
+            return dataProcessing(emu, BITS(hw1, 8, 5), BIT(hw1, 4), BITS(hw1, 3, 0), BITS(hw2, 11, 8), operand, carry);
+        }
+        return executePlainImmediate(emu, hw1, hw2);
+    }
+    if ((hw1 & 0xF800) == 0xF000) {
+        return executeBranchMisc(emu, hw1, hw2);
+    }
+    if ((hw1 & 0xFE00) == 0xF800) {
+        return executeLoadStoreSingle(emu, hw1, hw2);
+    }
+    if ((hw1 & 0xFF00) == 0xFA00) {
+        return executeDataRegister(emu, hw1, hw2);
+    }
+    if ((hw1 & 0xFF00) == 0xFB00) {
+        return executeMultiply(emu, hw1, hw2);
+    }
+    return fault(emu, THUMB_EMU_ERROR_UNDEFINED);
+}
+
+/*****************************************************************************/
+/* Public API                                                                */
+/*****************************************************************************/
+void thumbEmu_init(ThumbEmu_t *emu) {
+    memset(emu, 0, sizeof(ThumbEmu_t));
+}
+
+ThumbEmuReturn_t thumbEmu_addRegion(
+    ThumbEmu_t *emu, const uint32_t address, void *data, const uint32_t size, const bool writable
+) {
+    if (emu->regions_len >= THUMB_EMU_MAX_REGIONS || data == NULL || size == 0 ||
+            (uint64_t)address + size > 0x100000000ull) {
+        return THUMB_EMU_ERROR_CONFIG;
+    }
+    emu->regions[emu->regions_len++] = (ThumbEmuRegion_t){
+        .address = address,
+        .size = size,
+        .data = (uint8_t *)data,
+        .writable = writable,
+    };
+    return THUMB_EMU_SUCCESS;
+}
+
+ThumbEmuReturn_t thumbEmu_call(
+    ThumbEmu_t *emu, const uint32_t function, const uint32_t arg0, const uint32_t arg1,
+    const uint32_t stack_top, const uint64_t max_instructions
+) {
+    if (emu->regions_len == 0) {
+        return THUMB_EMU_ERROR_CONFIG;
+    }
+    emu->r[0] = arg0;
+    emu->r[1] = arg1;
+    emu->r[REG_SP] = stack_top;
+    emu->r[REG_LR] = THUMB_EMU_RETURN_ADDRESS | 1;
+    emu->r[REG_PC] = function & ~1u;
+    emu->it_state = 0;
+    emu->last_region = 0;
+
+    const uint64_t limit = max_instructions ? emu->stats.instructions + max_instructions : UINT64_MAX;
+    while (emu->r[REG_PC] != THUMB_EMU_RETURN_ADDRESS) {
+        if (emu->stats.instructions >= limit) {
+            emu->fault_pc = emu->r[REG_PC];
+            return THUMB_EMU_ERROR_LIMIT;
+        }
+        const uint32_t pc = emu->r[REG_PC];
+        const uint8_t *code = translate(emu, pc, 2, false);
+        if (code == NULL) {
+            emu->fault_pc = pc;
+            emu->fault_address = pc;
+            return THUMB_EMU_ERROR_MEMORY;
+        }
+        const uint32_t hw1 = code[0] | code[1] << 8;
+        const bool wide = (hw1 >> 11) >= 0x1D;
+        uint32_t hw2 = 0;
+        if (wide) {
+            code = translate(emu, pc + 2, 2, false);
+            if (code == NULL) {
+                emu->fault_pc = pc;
+                emu->fault_address = pc + 2;
+                return THUMB_EMU_ERROR_MEMORY;
+            }
+            hw2 = code[0] | code[1] << 8;
+        }
+        emu->fault_instruction = wide ? hw1 << 16 | hw2 : hw1;
+        emu->stats.instructions++;
+
+        // Reads of the PC give the address of the instruction plus 4
+        emu->next_pc = pc + (wide ? 4 : 2);
+        emu->r[REG_PC] = pc + 4;
+
+        bool execute = true;
+        const bool in_it = (emu->it_state & 0xF) != 0;
+        if (in_it) {
+            execute = conditionPassed(emu, emu->it_state >> 4);
+            // ITAdvance()
+            emu->it_state = (emu->it_state & 0x7) == 0 ? 0 : (emu->it_state & 0xE0) | ((emu->it_state << 1) & 0x1F);
+        }
+        if (execute) {
+            const ThumbEmuReturn_t result = wide ? execute32(emu, hw1, hw2) : execute16(emu, hw1, in_it);
+            if (result != THUMB_EMU_SUCCESS) {
+                return result;
+            }
+        }
+        emu->r[REG_PC] = emu->next_pc;
+    }
+    return THUMB_EMU_SUCCESS;
+}
@@ -0,0 +1,120 @@
+/**
+ * @brief Emulator for the Thumb-2 and single precision VFP instructions
+ * used by the ML4F models, so that they can run on a host computer.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * @details
+ * Implements the ARMv7-M Thumb instruction set without the system
+ * instructions, plus the FPv4-SP single precision floating point extension
+ * of the Cortex-M4. The emulated 32-bit address space is made of host memory
+ * regions, so the model and arena buffers are used in place.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define THUMB_EMU_MAX_REGIONS       4
+
+// Branching to this address (with the Thumb bit) returns from the call
+#define THUMB_EMU_RETURN_ADDRESS    0xFFFFFFF0u
+
+typedef enum ThumbEmuReturn_e {
+    THUMB_EMU_SUCCESS = 0,
+    THUMB_EMU_ERROR_UNDEFINED = -1,
+    THUMB_EMU_ERROR_MEMORY = -2,
+    THUMB_EMU_ERROR_LIMIT = -3,
+    THUMB_EMU_ERROR_STATE = -4,
+    THUMB_EMU_ERROR_CONFIG = -5,
+} ThumbEmuReturn_t;
+
+typedef struct ThumbEmuRegion_s {
+    uint32_t address;
+    uint32_t size;
+    uint8_t *data;
+    bool writable;
+} ThumbEmuRegion_t;
+
+// Memory accesses are counted per register transferred, so a PUSH of
+// 4 registers is 4 stores of 4 bytes
+typedef struct ThumbEmuStats_s {
+    uint64_t instructions;
+    uint64_t fp_instructions;
+    uint64_t loads;
+    uint64_t stores;
+    uint64_t load_bytes;
+    uint64_t store_bytes;
+} ThumbEmuStats_t;
+
+typedef struct ThumbEmu_s {
+    uint32_t r[16];
+    uint32_t s[32];
+    uint32_t fpscr;
+    bool n, z, c, v;
+    uint8_t it_state;
+    uint32_t next_pc;
+    ThumbEmuRegion_t regions[THUMB_EMU_MAX_REGIONS];
+    int regions_len;
+    int last_region;
+    ThumbEmuStats_t stats;
+    // Details of the last error
+    uint32_t fault_pc;
+    uint32_t fault_instruction;
+    uint32_t fault_address;
+} ThumbEmu_t;
+
+/**
+ * @brief Reset the emulator registers, regions and statistics.
+ *
+ * @param emu The emulator instance.
+ */
+void thumbEmu_init(ThumbEmu_t *emu);
+
+/**
+ * @brief Map a host buffer into the emulated address space.
+ *
+ * @param emu The emulator instance.
+ * @param address The emulated address of the first byte.
+ * @param data The host buffer.
+ * @param size The size of the buffer in bytes.
+ * @param writable False to fault on stores to this region.
+ * @return THUMB_EMU_SUCCESS, or THUMB_EMU_ERROR_CONFIG if there are too
+ *         many regions or the region wraps around the address space.
+ */
+ThumbEmuReturn_t thumbEmu_addRegion(
+    ThumbEmu_t *emu, const uint32_t address, void *data, const uint32_t size, const bool writable
+);
+
+/**
+ * @brief Call a Thumb function following the AAPCS, with two arguments,
+ * until it returns.
+ *
+ * The statistics are accumulated over calls, until thumbEmu_init() is called
+ * or they are cleared by the caller.
+ *
+ * @param emu The emulator instance.
+ * @param function The emulated address of the function, without the Thumb bit.
+ * @param arg0 Value for R0.
+ * @param arg1 Value for R1.
+ * @param stack_top The emulated address of the initial stack pointer.
+ * @param max_instructions Stop with THUMB_EMU_ERROR_LIMIT after this many
+ *        instructions, or 0 for no limit.
+ * @return THUMB_EMU_SUCCESS when the function returns, or the error that
+ *         stopped it, with the fault_* fields set.
+ */
+ThumbEmuReturn_t thumbEmu_call(
+    ThumbEmu_t *emu, const uint32_t function, const uint32_t arg0, const uint32_t arg1,
+    const uint32_t stack_top, const uint64_t max_instructions
+);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,205 @@
+/**
+ * @brief Read the recordings of an ML-Trainer data export, the JSON file
+ * with the recordings of each action, one at a time.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "jsonreader.h"
+#include "trainerjson.h"
+
+typedef struct {
+    JsonReader_t json;
+    TrainerRecordingCallback_t callback;
+    void *context;
+    char action[JSON_MAX_STRING];
+    uint32_t action_index;
+    uint32_t recording_index;
+    float *samples[TRAINER_JSON_DIMENSIONS];
+    uint32_t len[TRAINER_JSON_DIMENSIONS];
+    uint32_t capacity[TRAINER_JSON_DIMENSIONS];
+    const char *error;
+} Parser_t;
+
+static bool failed(Parser_t *parser, const char *error) {
+    if (parser->error == NULL) {
+        parser->error = error;
+    }
+    return false;
+}
+
+static bool expectToken(Parser_t *parser, const JsonToken_t expected) {
+    const JsonToken_t token = jsonReader_next(&parser->json);
+    return token == expected || failed(parser, token == JSON_ERROR ? "invalid JSON" : "unexpected value");
+}
+
+static bool addSample(Parser_t *parser, const int d, const float value) {
+    if (parser->len[d] == parser->capacity[d]) {
+        const uint32_t capacity = parser->capacity[d] ? parser->capacity[d] * 2 : 256;
+        float *samples = (float *)realloc(parser->samples[d], capacity * sizeof(float));
+        if (samples == NULL) {
+            return failed(parser, "out of memory");
+        }
+        parser->samples[d] = samples;
+        parser->capacity[d] = capacity;
+    }
+    parser->samples[d][parser->len[d]++] = value;
+    return true;
+}
+
+// The samples of one dimension, after its "x", "y" or "z" key
+static bool readSamples(Parser_t *parser, const int d) {
+    if (!expectToken(parser, JSON_ARRAY_START)) {
+        return false;
+    }
+    while (true) {
+        const JsonToken_t token = jsonReader_next(&parser->json);
+        if (token == JSON_ARRAY_END) {
+            return true;
+        }
+        if (token != JSON_NUMBER) {
+            return failed(parser, "the samples must be numbers");
+        }
+        if (!addSample(parser, d, (float)parser->json.number)) {
+            return false;
+        }
+    }
+}
+
+// After the JSON_OBJECT_START of "data"
+static bool readData(Parser_t *parser) {
+    while (true) {
+        const JsonToken_t token = jsonReader_next(&parser->json);
+        if (token == JSON_OBJECT_END) {
+            return true;
+        }
+        if (token != JSON_KEY) {
+            return failed(parser, "invalid JSON");
+        }
+        const char *key = parser->json.string;
+        if (key[0] >= 'x' && key[0] <= 'z' && key[1] == '\0') {
+            if (!readSamples(parser, key[0] - 'x')) {
+                return false;
+            }
+        } else if (!jsonReader_skip(&parser->json, jsonReader_next(&parser->json))) {
+            return failed(parser, "invalid JSON");
+        }
+    }
+}
+
+// After the JSON_OBJECT_START of a recording
+static bool readRecording(Parser_t *parser) {
+    memset(parser->len, 0, sizeof(parser->len));
+    while (true) {
+        const JsonToken_t token = jsonReader_next(&parser->json);
+        if (token == JSON_OBJECT_END) {
+            break;
+        }
+        if (token != JSON_KEY) {
+            return failed(parser, "invalid JSON");
+        }
+        if (strcmp(parser->json.string, "data") == 0) {
+            if (!expectToken(parser, JSON_OBJECT_START) || !readData(parser)) {
+                return false;
+            }
+        } else if (!jsonReader_skip(&parser->json, jsonReader_next(&parser->json))) {
+            return failed(parser, "invalid JSON");
+        }
+    }
+
+    TrainerRecording_t recording = {
+        .action = parser->action,
+        .action_index = parser->action_index,
+        .recording_index = parser->recording_index++,
+        .len = parser->len[0],
+    };
+    for (int d = 0; d < TRAINER_JSON_DIMENSIONS; d++) {
+        if (parser->len[d] != recording.len) {
+            return failed(parser, "the x, y and z samples of a recording must have the same length");
+        }
+        recording.samples[d] = parser->samples[d];
+    }
+    if (recording.len == 0) {
+        return failed(parser, "a recording has no samples");
+    }
+    return parser->callback(&recording, parser->context) || failed(parser, "stopped");
+}
+
+// After the JSON_OBJECT_START of an action, its name must be before its
+// recordings, as ML-Trainer writes them
+static bool readAction(Parser_t *parser) {
+    parser->action[0] = '\0';
+    while (true) {
+        const JsonToken_t token = jsonReader_next(&parser->json);
+        if (token == JSON_OBJECT_END) {
+            parser->action_index++;
+            return true;
+        }
+        if (token != JSON_KEY) {
+            return failed(parser, "invalid JSON");
+        }
+        if (strcmp(parser->json.string, "name") == 0) {
+            if (!expectToken(parser, JSON_STRING)) {
+                return false;
+            }
+            memcpy(parser->action, parser->json.string, sizeof(parser->action));
+        } else if (strcmp(parser->json.string, "recordings") == 0) {
+            if (!expectToken(parser, JSON_ARRAY_START)) {
+                return false;
+            }
+            JsonToken_t item;
+            while ((item = jsonReader_next(&parser->json)) == JSON_OBJECT_START) {
+                if (!readRecording(parser)) {
+                    return false;
+                }
+            }
+            if (item != JSON_ARRAY_END) {
+                return failed(parser, "the recordings must be objects");
+            }
+        } else if (!jsonReader_skip(&parser->json, jsonReader_next(&parser->json))) {
+            return failed(parser, "invalid JSON");
+        }
+    }
+}
+
+static bool readFile(Parser_t *parser) {
+    if (!expectToken(parser, JSON_ARRAY_START)) {
+        return false;
+    }
+    JsonToken_t token;
+    while ((token = jsonReader_next(&parser->json)) == JSON_OBJECT_START) {
+        if (!readAction(parser)) {
+            return false;
+        }
+    }
+    if (token != JSON_ARRAY_END) {
+        return failed(parser, "the actions must be objects");
+    }
+    return expectToken(parser, JSON_END);
+}
+
+bool trainerJson_read(FILE *file, TrainerRecordingCallback_t callback, void *context, char *error, size_t error_len) {
+    Parser_t *parser = (Parser_t *)calloc(1, sizeof(Parser_t));
+    if (parser == NULL) {
+        if (error != NULL) {
+            snprintf(error, error_len, "out of memory");
+        }
+        return false;
+    }
+    jsonReader_init(&parser->json, file);
+    parser->callback = callback;
+    parser->context = context;
+
+    const bool success = readFile(parser);
+    if (!success && error != NULL) {
+        snprintf(error, error_len, "%s, at byte %zu", parser->error, parser->json.offset);
+    }
+    for (int d = 0; d < TRAINER_JSON_DIMENSIONS; d++) {
+        free(parser->samples[d]);
+    }
+    free(parser);
+    return success;
+}
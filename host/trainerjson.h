@@ -0,0 +1,50 @@
+/**
+ * @brief Read the recordings of an ML-Trainer data export, the JSON file
+ * with the recordings of each action, one at a time.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * @details
+ * The file is an array of actions, each one with its "name" and its
+ * "recordings", and each recording has the accelerometer samples in g in
+ * the "x", "y" and "z" arrays of its "data". Other members are ignored.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRAINER_JSON_DIMENSIONS 3
+
+typedef struct {
+    const char *action;         // Name of the action, the label
+    uint32_t action_index;      // Position of the action in the file
+    uint32_t recording_index;   // Position of the recording in the file
+    const float *samples[TRAINER_JSON_DIMENSIONS];  // x, y and z
+    uint32_t len;
+} TrainerRecording_t;
+
+/**
+ * @return False to stop reading the file.
+ */
+typedef bool (*TrainerRecordingCallback_t)(const TrainerRecording_t *recording, void *context);
+
+/**
+ * @brief Read the recordings of a file, calling the callback for each one.
+ * Only one recording is kept in memory at a time.
+ *
+ * @return False if the file is not a valid export, or the callback stopped
+ *         the reading, with the error in error, if not NULL.
+ */
+bool trainerJson_read(FILE *file, TrainerRecordingCallback_t callback, void *context, char *error, size_t error_len);
+
+#ifdef __cplusplus
+}
+#endif
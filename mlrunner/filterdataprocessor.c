@@ -5,169 +5,1092 @@
  * Copyright 2024 Micro:bit Educational Foundation.
  * SPDX-License-Identifier: MIT
  *
- * TODO: Could be double buffered so that an interruptible model could be
- * run while the data is still being collected. Currently the model run
- * is quick enough where this is not necessary.
+ * When configured with MLDP_CONFIG_DOUBLE_BUFFER the ring buffers have space
+ * for two windows, so that a window can be frozen with snapshot() and
+ * processed while new samples are still being recorded, until commit().
+ *
+ * With MLDP_CONFIG_INT16_SAMPLES the ring buffers keep the samples as int16
+ * values in the units of sample_scale, and a window is converted back to
+ * float into the temporary buffer when the first filter that reads it runs,
+ * so the incremental filters stay constant time. The running
+ * statistics, peak detector and min/max queues see the values as they are
+ * read back, so all the outputs match the float storage of the same values.
+ *
+ * With MLDP_CONFIG_ACTIVITY_GATE every recorded sample extends or restarts
+ * a run of samples that stay within a band of the threshold, in constant
+ * time, and processing a window remembers if it was inside the current run,
+ * so isIdle() only needs to check the run hasn't changed since.
+ *
+ * Each FilterDataProcessor_t instance keeps its own state, so several can run
+ * side by side, the mlDataProcessor interface uses a default instance.
+ * All the buffers of an instance are placed in a single memory block, either
+ * allocated by init() or provided to initArena().
  */
+#include <math.h>
+#include <stdint.h>
 #include <string.h>
 #include "mldataprocessor.h"
+#include "filterdataprocessor.h"
 
+// Running statistics for the samples currently in the window of a dimension
+typedef struct {
+    float sum;
+    float sum_squares;
+    float sum_abs;
+    // The variance is calculated from samples shifted by a value close to the
+    // mean, to avoid the cancellation error from sum_squares/n - mean^2
+    float shift;
+    float sum_shifted_squares;
+    int zero_crossings;
+} WindowStats_t;
 
-static float **input_samples = NULL;
-static float *temp_buffer = NULL;
-static int sample_dimensions = 0;
-static int sample_length = 0;
-static int sample_index = 0;
-static bool buffer_filled = false;
-static float *output_data = NULL;
-static int output_length = 0;
-static MlDataFilters_t *filters = NULL;
-static int filter_size = 0;
-static bool initialised = false;
+// Peak detector running through all the samples recorded for a dimension,
+// with its output stored for each position in the ring buffer
+typedef struct {
+    MldpPeakDetector_t detector;
+    float *filtered;
+    int8_t *signal;
+    // Number of peaks detected up to each position, wraps around
+    uint16_t *peak_count;
+} StreamingPeaks_t;
 
+// Ring buffer positions of the samples that can still become the window
+// maximum (or minimum), from the oldest, with space for a full window
+typedef struct {
+    int *indexes;
+    int front;
+    int size;
+} MonotonicQueue_t;
 
-static MldpReturn_t filterDataProcessor_init(const MlDataProcessorConfig_t* config);
-static void filterDataProcessor_deinit();
-static MldpReturn_t filterDataProcessor_recordData(const float *samples, const int elements);
-static bool filterDataProcessor_isDataReady();
-static float* filterDataProcessor_getProcessedData();
+typedef struct {
+    float max;
+    float min;
+} WindowMinMax_t;
 
+// Consecutive samples with all dimensions inside a band of the threshold
+typedef struct {
+    float threshold;
+    float *min;                 // Per dimension, of the current run
+    float *max;
+    int run_samples;            // Length of the current run, saturated
+    uint32_t run;               // Increased when a sample starts a new run
+    // The run the last processed window was fully inside of, if any
+    bool processed_idle;
+    uint32_t processed_run;
+} ActivityGate_t;
 
-MldpReturn_t filterDataProcessor_init(const MlDataProcessorConfig_t* config) {
+
+// All the state of a data processor instance, so that several can be used
+struct FilterDataProcessor_s {
+    float **input_samples;
+    // Ring buffers used instead of input_samples with MLDP_CONFIG_INT16_SAMPLES
+    int16_t **int16_samples;
+    // Units of the int16 samples in 1.0, per dimension
+    float *sample_scale;
+    float *temp_buffer;
+    float *interleave_buffer;
+    int sample_dimensions;
+    int sample_length;
+    int buffer_length;
+    int sample_index;
+    int samples_since_resync;
+    bool buffer_filled;
+    float *output_data;
+    int output_length;
+    MlDataFilters_t *filters;
+    MldpWindowFilter_t *window_filters;
+    int filter_size;
+    WindowStats_t *window_stats;
+    bool snapshot_active;
+    bool snapshot_overrun;
+    int snapshot_start;
+    int snapshot_free;
+    WindowStats_t *snapshot_stats;
+    StreamingPeaks_t *streaming_peaks;
+    MonotonicQueue_t *max_queues;
+    MonotonicQueue_t *min_queues;
+    WindowMinMax_t *snapshot_min_max;
+    ActivityGate_t *activity_gate;
+    // Memory block containing all the buffers above
+    uint8_t *arena;
+    bool arena_owned;
+    bool initialised;
+};
+
+
+static bool isConfigValid(const MlDataProcessorConfig_t* config) {
     if (config->samples <= 0 || config->dimensions <= 0 || config->output_length <= 0) {
-        filterDataProcessor_deinit();
-        return MLDP_ERROR_CONFIG;
+        return false;
     }
 
     // The output size will depend on output size per filter and number of dimensions
     int total_output = 0;
     for (int i = 0; i < config->filter_size; i++) {
+        if (config->filters[i].filter == NULL && config->filters[i].window_filter == NULL) {
+            return false;
+        }
+        // The running statistics and min/max queues only replace single
+        // output filters, they would be kept up to date for nothing with the
+        // fused filters
+        if ((config->filters[i].flags & MLDP_FILTER_INTERLEAVED_OUTPUT) &&
+                (config->flags & (MLDP_CONFIG_INCREMENTAL_STATS | MLDP_CONFIG_INCREMENTAL_MIN_MAX))) {
+            return false;
+        }
         total_output += config->filters[i].out_size * config->dimensions;
     }
-    if (config->output_length != total_output) {
-        filterDataProcessor_deinit();
-        return MLDP_ERROR_CONFIG;
+    if ((config->flags & MLDP_CONFIG_ACTIVITY_GATE) && !(config->activity_threshold >= 0.0f)) {
+        return false;
+    }
+    if (config->sample_scale != NULL) {
+        for (int i = 0; i < config->dimensions; i++) {
+            if (!(config->sample_scale[i] > 0.0f) || isinf(config->sample_scale[i])) {
+                return false;
+            }
+        }
     }
+    return config->output_length == total_output;
+}
 
-    if (initialised) {
-        filterDataProcessor_deinit();
+/**
+ * Reserve space for a buffer in the arena.
+ *
+ * @param arena The arena to place the buffer in, or NULL to only calculate
+ *              the arena size.
+ * @param offset Current end of the used arena space, it is updated with the
+ *               size of the new buffer.
+ * @return A pointer to the buffer, or NULL if there is no arena.
+ */
+static void* arenaReserve(uint8_t *arena, size_t *offset, const size_t size) {
+    const size_t start = (*offset + MLDP_ARENA_ALIGNMENT - 1) & ~(size_t)(MLDP_ARENA_ALIGNMENT - 1);
+    *offset = start + size;
+    return (arena != NULL) ? &arena[start] : NULL;
+}
+
+/**
+ * Place all the buffers needed for a configuration in the arena.
+ * Calculating the arena size and setting the buffers uses the same function,
+ * so that the size is always exact.
+ *
+ * @param fdp The instance to set the buffers, only used if there is an arena.
+ * @param arena The zeroed arena, or NULL to only calculate the arena size.
+ * @return The size of the arena in bytes.
+ */
+static size_t arenaLayout(FilterDataProcessor_t *fdp, const MlDataProcessorConfig_t* config, uint8_t *arena) {
+    const int dimensions = config->dimensions;
+    // Space for a second window when double buffered
+    const int buffer_length = (config->flags & MLDP_CONFIG_DOUBLE_BUFFER) ? config->samples * 2 : config->samples;
+
+    // Filters read the ring buffer directly when they have a window version,
+    // otherwise a temporary buffer is needed to copy the window in order.
+    // Filters with interleaved output need a buffer to write a dimension
+    // output, and the streaming peak detector is only needed if a filter
+    // counts peaks.
+    bool linear_filters = false;
+    bool peak_filters = false;
+    int interleave_size = 0;
+    for (int i = 0; i < config->filter_size; i++) {
+        MldpWindowFilter_t window_filter = config->filters[i].window_filter;
+        if (window_filter == NULL) {
+            window_filter = mldp_getWindowFilter(config->filters[i].filter);
+        }
+        if (window_filter == NULL) {
+            linear_filters = true;
+        }
+        if (window_filter == filterPeaksWindow || window_filter == filterMlTrainerWindow) {
+            peak_filters = true;
+        }
+        if ((config->filters[i].flags & MLDP_FILTER_INTERLEAVED_OUTPUT) &&
+                config->filters[i].out_size > interleave_size) {
+            interleave_size = config->filters[i].out_size;
+        }
     }
+    const bool incremental_stats = config->flags & MLDP_CONFIG_INCREMENTAL_STATS;
+    const bool streaming_peaks = (config->flags & MLDP_CONFIG_STREAMING_PEAKS) && peak_filters &&
+            config->samples >= MLDP_PEAKS_LAG + 2;
+    const bool min_max = config->flags & MLDP_CONFIG_INCREMENTAL_MIN_MAX;
+    const bool snapshot = config->flags & MLDP_CONFIG_DOUBLE_BUFFER;
+    const bool int16_storage = config->flags & MLDP_CONFIG_INT16_SAMPLES;
+    const bool activity_gate = config->flags & MLDP_CONFIG_ACTIVITY_GATE;
 
-    filters = (MlDataFilters_t*)malloc(config->filter_size * sizeof(MlDataFilters_t));
-    output_data = (float*)malloc(config->output_length * sizeof(float));
-    input_samples = (float**)calloc(config->dimensions, sizeof(float*));
-    if (filters == NULL || output_data == NULL || input_samples == NULL) {
-        filterDataProcessor_deinit();
-        return MLDP_ERROR_ALLOC;
+    size_t size = 0;
+    MlDataFilters_t *filters = (MlDataFilters_t*)arenaReserve(arena, &size, config->filter_size * sizeof(MlDataFilters_t));
+    MldpWindowFilter_t *window_filters = (MldpWindowFilter_t*)arenaReserve(arena, &size, config->filter_size * sizeof(MldpWindowFilter_t));
+    float *output_data = (float*)arenaReserve(arena, &size, config->output_length * sizeof(float));
+    float *sample_scale = (float*)arenaReserve(arena, &size, dimensions * sizeof(float));
+    float **input_samples = NULL;
+    float *samples = NULL;
+    int16_t **int16_ptrs = NULL;
+    int16_t *int16_samples = NULL;
+    if (int16_storage) {
+        int16_ptrs = (int16_t**)arenaReserve(arena, &size, dimensions * sizeof(int16_t*));
+        int16_samples = (int16_t*)arenaReserve(arena, &size, dimensions * buffer_length * sizeof(int16_t));
+    } else {
+        input_samples = (float**)arenaReserve(arena, &size, dimensions * sizeof(float*));
+        samples = (float*)arenaReserve(arena, &size, dimensions * buffer_length * sizeof(float));
+    }
+    // The int16 windows are converted into the temporary buffer
+    float *temp_buffer = NULL;
+    if (linear_filters || int16_storage) {
+        temp_buffer = (float*)arenaReserve(arena, &size, config->samples * sizeof(float));
+    }
+    float *interleave_buffer = NULL;
+    if (interleave_size > 0) {
+        interleave_buffer = (float*)arenaReserve(arena, &size, interleave_size * sizeof(float));
+    }
+    WindowStats_t *window_stats = NULL, *snapshot_stats = NULL;
+    if (incremental_stats) {
+        window_stats = (WindowStats_t*)arenaReserve(arena, &size, dimensions * sizeof(WindowStats_t));
+        if (snapshot) {
+            snapshot_stats = (WindowStats_t*)arenaReserve(arena, &size, dimensions * sizeof(WindowStats_t));
+        }
+    }
+    StreamingPeaks_t *peaks = NULL;
+    float *peaks_filtered = NULL;
+    int8_t *peaks_signal = NULL;
+    uint16_t *peaks_count = NULL;
+    if (streaming_peaks) {
+        peaks = (StreamingPeaks_t*)arenaReserve(arena, &size, dimensions * sizeof(StreamingPeaks_t));
+        peaks_filtered = (float*)arenaReserve(arena, &size, dimensions * buffer_length * sizeof(float));
+        peaks_signal = (int8_t*)arenaReserve(arena, &size, dimensions * buffer_length * sizeof(int8_t));
+        peaks_count = (uint16_t*)arenaReserve(arena, &size, dimensions * buffer_length * sizeof(uint16_t));
+    }
+    MonotonicQueue_t *max_queues = NULL, *min_queues = NULL;
+    int *queue_indexes = NULL;
+    WindowMinMax_t *snapshot_min_max = NULL;
+    if (min_max) {
+        max_queues = (MonotonicQueue_t*)arenaReserve(arena, &size, dimensions * sizeof(MonotonicQueue_t));
+        min_queues = (MonotonicQueue_t*)arenaReserve(arena, &size, dimensions * sizeof(MonotonicQueue_t));
+        queue_indexes = (int*)arenaReserve(arena, &size, 2 * dimensions * config->samples * sizeof(int));
+        if (snapshot) {
+            snapshot_min_max = (WindowMinMax_t*)arenaReserve(arena, &size, dimensions * sizeof(WindowMinMax_t));
+        }
+    }
+    ActivityGate_t *gate = NULL;
+    float *gate_min_max = NULL;
+    if (activity_gate) {
+        gate = (ActivityGate_t*)arenaReserve(arena, &size, sizeof(ActivityGate_t));
+        gate_min_max = (float*)arenaReserve(arena, &size, 2 * dimensions * sizeof(float));
+    }
+
+    if (arena == NULL) {
+        return size;
     }
 
-    // Allocate for each sample dimension, and the temporary buffer
-    sample_dimensions = config->dimensions;
-    for (int i = 0; i < sample_dimensions; i++) {
-        input_samples[i] = (float*)malloc(config->samples * sizeof(float));
-        if (input_samples[i] == NULL) {
-            filterDataProcessor_deinit();
-            return MLDP_ERROR_ALLOC;
+    for (int i = 0; i < config->filter_size; i++) {
+        window_filters[i] = config->filters[i].window_filter;
+        if (window_filters[i] == NULL) {
+            window_filters[i] = mldp_getWindowFilter(config->filters[i].filter);
         }
     }
-    temp_buffer = (float*)malloc(config->samples * sizeof(float));
-    if (temp_buffer == NULL) {
-        filterDataProcessor_deinit();
+    for (int i = 0; i < dimensions; i++) {
+        if (int16_storage) {
+            int16_ptrs[i] = &int16_samples[i * buffer_length];
+        } else {
+            input_samples[i] = &samples[i * buffer_length];
+        }
+        sample_scale[i] = (config->sample_scale != NULL) ? config->sample_scale[i] : 1.0f;
+    }
+    if (peaks != NULL) {
+        for (int i = 0; i < dimensions; i++) {
+            mldp_peakDetectorReset(&peaks[i].detector);
+            peaks[i].filtered = &peaks_filtered[i * buffer_length];
+            peaks[i].signal = &peaks_signal[i * buffer_length];
+            peaks[i].peak_count = &peaks_count[i * buffer_length];
+        }
+    }
+    if (max_queues != NULL) {
+        for (int i = 0; i < dimensions; i++) {
+            max_queues[i].indexes = &queue_indexes[(2 * i) * config->samples];
+            min_queues[i].indexes = &queue_indexes[(2 * i + 1) * config->samples];
+        }
+    }
+    fdp->filters = filters;
+    fdp->window_filters = window_filters;
+    fdp->output_data = output_data;
+    fdp->input_samples = input_samples;
+    fdp->int16_samples = int16_ptrs;
+    fdp->sample_scale = sample_scale;
+    fdp->temp_buffer = temp_buffer;
+    fdp->interleave_buffer = interleave_buffer;
+    fdp->window_stats = window_stats;
+    fdp->snapshot_stats = snapshot_stats;
+    fdp->streaming_peaks = peaks;
+    fdp->max_queues = max_queues;
+    fdp->min_queues = min_queues;
+    fdp->snapshot_min_max = snapshot_min_max;
+    if (gate != NULL) {
+        gate->threshold = config->activity_threshold;
+        gate->min = gate_min_max;
+        gate->max = &gate_min_max[dimensions];
+    }
+    fdp->activity_gate = gate;
+    fdp->buffer_length = buffer_length;
+
+    return size;
+}
+
+size_t filterDataProcessor_getArenaSize(const MlDataProcessorConfig_t* config) {
+    if (!isConfigValid(config)) return 0;
+
+    return arenaLayout(NULL, config, NULL);
+}
+
+MldpReturn_t filterDataProcessor_initArena(
+    FilterDataProcessor_t *fdp, const MlDataProcessorConfig_t* config, void *arena, const size_t arena_size
+) {
+    if (fdp->initialised) {
+        filterDataProcessor_deinit(fdp);
+    }
+    if (!isConfigValid(config)) {
+        return MLDP_ERROR_CONFIG;
+    }
+    if (arena == NULL || ((uintptr_t)arena % MLDP_ARENA_ALIGNMENT) != 0 ||
+            arena_size < arenaLayout(NULL, config, NULL)) {
         return MLDP_ERROR_ALLOC;
     }
 
+    memset(arena, 0, arena_size);
+    arenaLayout(fdp, config, (uint8_t*)arena);
+    fdp->arena = (uint8_t*)arena;
+    fdp->arena_owned = false;
+
     // Copy the filter pointers
-    memcpy(filters, config->filters, config->filter_size * sizeof(MlDataFilters_t));
+    memcpy(fdp->filters, config->filters, config->filter_size * sizeof(MlDataFilters_t));
+
+    fdp->filter_size = config->filter_size;
+    fdp->output_length = config->output_length;
+    fdp->sample_dimensions = config->dimensions;
+    fdp->sample_length = config->samples;
+    fdp->sample_index = 0;
+    fdp->samples_since_resync = 0;
+    fdp->buffer_filled = false;
+    fdp->snapshot_active = false;
+
+    fdp->initialised = true;
+    return MLDP_SUCCESS;
+}
+
+MldpReturn_t filterDataProcessor_init(FilterDataProcessor_t *fdp, const MlDataProcessorConfig_t* config) {
+    if (fdp->initialised) {
+        filterDataProcessor_deinit(fdp);
+    }
+    if (!isConfigValid(config)) {
+        return MLDP_ERROR_CONFIG;
+    }
 
-    filter_size = config->filter_size;
-    output_length = config->output_length;
-    sample_length = config->samples;
-    sample_index = 0;
+    // All the buffers are placed in a single allocation
+    const size_t arena_size = arenaLayout(NULL, config, NULL);
+    void *arena = malloc(arena_size);
+    if (arena == NULL) {
+        return MLDP_ERROR_ALLOC;
+    }
+    MldpReturn_t result = filterDataProcessor_initArena(fdp, config, arena, arena_size);
+    if (result != MLDP_SUCCESS) {
+        free(arena);
+        return result;
+    }
+    fdp->arena_owned = true;
 
-    initialised = true;
     return MLDP_SUCCESS;
 }
 
-void filterDataProcessor_deinit() {
-    initialised = false;
-    for (int i = 0; i < sample_dimensions; i++) {
-        free(input_samples[i]);
+void filterDataProcessor_deinit(FilterDataProcessor_t *fdp) {
+    if (fdp->arena_owned) {
+        free(fdp->arena);
     }
-    free(input_samples);
-    free(temp_buffer);
-    free(output_data);
-    free(filters);
-    input_samples = NULL;
-    output_data = NULL;
-    filters = NULL;
-    filter_size = 0;
-    output_length = 0;
-    sample_dimensions = 0;
-    sample_length = 0;
-    sample_index = 0;
+    memset(fdp, 0, sizeof(FilterDataProcessor_t));
 }
 
-MldpReturn_t filterDataProcessor_recordData(const float* samples, const int elements) {
-    if (!initialised) return MLDP_ERROR_NOINIT;
-    // Only record data if the number of elements is a multiple of the sample dimensions
-    if (elements % sample_dimensions != 0) return MLDP_ERROR_CONFIG;
+// Wrap an index from [-buffer_length, 2 * buffer_length) into the ring buffer
+static inline int ringIndex(const FilterDataProcessor_t *fdp, const int index) {
+    if (index < 0) return index + fdp->buffer_length;
+    if (index >= fdp->buffer_length) return index - fdp->buffer_length;
+    return index;
+}
+
+// Index of the oldest sample in the current window
+static inline int windowStart(const FilterDataProcessor_t *fdp) {
+    return ringIndex(fdp, fdp->sample_index - fdp->sample_length);
+}
+
+static inline MlDataWindow_t getWindow(const FilterDataProcessor_t *fdp, const int dimension, const int start) {
+    const int head_size = (start + fdp->sample_length <= fdp->buffer_length) ? fdp->sample_length : fdp->buffer_length - start;
+    const MlDataWindow_t window = {
+        .head = &fdp->input_samples[dimension][start],
+        .head_size = head_size,
+        .tail = fdp->input_samples[dimension],
+        .tail_size = fdp->sample_length - head_size,
+    };
+    return window;
+}
+
+// Value of a recorded sample, from either the float or the int16 ring buffer
+static inline float sampleAt(const FilterDataProcessor_t *fdp, const int dimension, const int index) {
+    if (fdp->int16_samples != NULL) {
+        return (float)fdp->int16_samples[dimension][index] / fdp->sample_scale[dimension];
+    }
+    return fdp->input_samples[dimension][index];
+}
+
+// Round a value to the int16 units of a dimension, saturating
+static inline int16_t toInt16(const FilterDataProcessor_t *fdp, const int dimension, const float value) {
+    const float scaled = value * fdp->sample_scale[dimension];
+    if (scaled >= 32767.0f) return INT16_MAX;
+    if (scaled <= -32768.0f) return INT16_MIN;
+    return (int16_t)lrintf(scaled);
+}
+
+/**
+ * Convert the int16 window of a dimension to float, in order, into the
+ * temporary buffer, and get it as a window with a single span.
+ */
+static MlDataWindow_t convertWindow(const FilterDataProcessor_t *fdp, const int dimension, const int start) {
+    const int16_t *samples = fdp->int16_samples[dimension];
+    const float scale = fdp->sample_scale[dimension];
+    const int head_size = (start + fdp->sample_length <= fdp->buffer_length) ? fdp->sample_length : fdp->buffer_length - start;
+    for (int i = 0; i < head_size; i++) {
+        fdp->temp_buffer[i] = (float)samples[start + i] / scale;
+    }
+    for (int i = head_size; i < fdp->sample_length; i++) {
+        fdp->temp_buffer[i] = (float)samples[i - head_size] / scale;
+    }
+    const MlDataWindow_t window = {
+        .head = fdp->temp_buffer,
+        .head_size = fdp->sample_length,
+        .tail = fdp->temp_buffer,
+        .tail_size = 0,
+    };
+    return window;
+}
+
+static inline bool isZeroCrossing(const float previous, const float next) {
+    return (previous < 0) != (next < 0);
+}
+
+/**
+ * Update the running statistics of a dimension with a new sample, before it
+ * is stored at fdp->sample_index.
+ */
+static void updateWindowStats(FilterDataProcessor_t *fdp, const int dimension, const float sample) {
+    WindowStats_t *stats = &fdp->window_stats[dimension];
+
+    if (fdp->sample_index > 0 || fdp->buffer_filled) {
+        if (isZeroCrossing(sampleAt(fdp, dimension, ringIndex(fdp, fdp->sample_index - 1)), sample)) {
+            stats->zero_crossings++;
+        }
+    }
+    if (fdp->buffer_filled) {
+        // The oldest sample is about to leave the window
+        const int oldest_index = windowStart(fdp);
+        const float oldest = sampleAt(fdp, dimension, oldest_index);
+        if (isZeroCrossing(oldest, sampleAt(fdp, dimension, ringIndex(fdp, oldest_index + 1)))) {
+            stats->zero_crossings--;
+        }
+        const float oldest_shifted = oldest - stats->shift;
+        stats->sum -= oldest;
+        stats->sum_squares -= oldest * oldest;
+        stats->sum_abs -= fabsf(oldest);
+        stats->sum_shifted_squares -= oldest_shifted * oldest_shifted;
+    }
+    const float sample_shifted = sample - stats->shift;
+    stats->sum += sample;
+    stats->sum_squares += sample * sample;
+    stats->sum_abs += fabsf(sample);
+    stats->sum_shifted_squares += sample_shifted * sample_shifted;
+}
+
+/**
+ * Recalculate the float sums of a dimension from scratch, so that rounding
+ * errors don't accumulate.
+ * This is called every time a full window of samples has been recorded, so
+ * the cost is amortised to O(1) per sample. The sums are accumulated from the
+ * oldest sample, in the same order as the filter functions.
+ */
+static void resyncWindowStats(FilterDataProcessor_t *fdp, const int dimension) {
+    WindowStats_t *stats = &fdp->window_stats[dimension];
+    const int start = windowStart(fdp);
+
+    float sum = 0, sum_squares = 0, sum_abs = 0;
+    for (int i = 0; i < fdp->sample_length; i++) {
+        const float value = sampleAt(fdp, dimension, ringIndex(fdp, start + i));
+        sum += value;
+        sum_squares += value * value;
+        sum_abs += fabsf(value);
+    }
+    stats->sum = sum;
+    stats->sum_squares = sum_squares;
+    stats->sum_abs = sum_abs;
+
+    // Shift by the current mean for the following window updates
+    stats->shift = sum / (float)fdp->sample_length;
+    float sum_shifted_squares = 0;
+    for (int i = 0; i < fdp->sample_length; i++) {
+        const float f = sampleAt(fdp, dimension, ringIndex(fdp, start + i)) - stats->shift;
+        sum_shifted_squares += f * f;
+    }
+    stats->sum_shifted_squares = sum_shifted_squares;
+}
+
+/**
+ * Add a new sample to a monotonic queue, before it is stored at fdp->sample_index.
+ * Samples are removed from the back while they are smaller (or larger for
+ * the minimum) than the new sample, as they will leave the window first.
+ * Equal samples are kept, so that the front is the oldest, like filterMax
+ * and filterMin return.
+ */
+static void updateMonotonicQueue(FilterDataProcessor_t *fdp, MonotonicQueue_t *queue, const int dimension, const float sample, const bool is_max) {
+    // The oldest sample is about to leave the window
+    if (fdp->buffer_filled && queue->size > 0 && queue->indexes[queue->front] == windowStart(fdp)) {
+        queue->front = (queue->front + 1) % fdp->sample_length;
+        queue->size--;
+    }
+    while (queue->size > 0) {
+        const float back = sampleAt(fdp, dimension, queue->indexes[(queue->front + queue->size - 1) % fdp->sample_length]);
+        if (is_max ? (back >= sample) : (back <= sample)) {
+            break;
+        }
+        queue->size--;
+    }
+    queue->indexes[(queue->front + queue->size) % fdp->sample_length] = fdp->sample_index;
+    queue->size++;
+}
+
+static inline WindowMinMax_t windowMinMax(const FilterDataProcessor_t *fdp, const int dimension) {
+    const WindowMinMax_t min_max = {
+        .max = sampleAt(fdp, dimension, fdp->max_queues[dimension].indexes[fdp->max_queues[dimension].front]),
+        .min = sampleAt(fdp, dimension, fdp->min_queues[dimension].indexes[fdp->min_queues[dimension].front]),
+    };
+    return min_max;
+}
+
+/**
+ * Run the streaming peak detector with a new sample, before it is stored at
+ * fdp->sample_index.
+ */
+static void updateStreamingPeaks(FilterDataProcessor_t *fdp, const int dimension, const float sample) {
+    StreamingPeaks_t *peaks = &fdp->streaming_peaks[dimension];
+    const uint16_t previous_count = (peaks->detector.count == 0) ? 0 : peaks->peak_count[ringIndex(fdp, fdp->sample_index - 1)];
+
+    const bool new_peak = mldp_peakDetectorAdd(&peaks->detector, sample, &peaks->filtered[fdp->sample_index]);
+    peaks->signal[fdp->sample_index] = (int8_t)peaks->detector.signal;
+    peaks->peak_count[fdp->sample_index] = previous_count + (new_peak ? 1 : 0);
+}
+
+/**
+ * Count the peaks in a window, with the same result as filterPeaks().
+ *
+ * The streaming detector started before the window, so its output for the
+ * first samples in the window can be different. A new detector is run from
+ * the start of the window until its state matches the streaming one (the
+ * last filtered values and signal are the same), from there the peaks
+ * counted by the streaming detector are added. This normally happens
+ * after MLDP_PEAKS_LAG + 1 samples, in the worst case the detector runs
+ * through the whole window.
+ */
+static int streamingPeakCount(const FilterDataProcessor_t *fdp, const int dimension, const int start) {
+    const StreamingPeaks_t *peaks = &fdp->streaming_peaks[dimension];
+    const int end = ringIndex(fdp, start + fdp->sample_length - 1);
+
+    MldpPeakDetector_t detector;
+    mldp_peakDetectorReset(&detector);
+    int count = 0;
+    int matching = 0;
+    for (int i = 0; i < fdp->sample_length; i++) {
+        const int index = ringIndex(fdp, start + i);
+        float filtered;
+        if (mldp_peakDetectorAdd(&detector, sampleAt(fdp, dimension, index), &filtered)) {
+            count++;
+        }
+        matching = (filtered == peaks->filtered[index]) ? matching + 1 : 0;
+        if (i >= MLDP_PEAKS_LAG && matching > MLDP_PEAKS_LAG &&
+                detector.signal == peaks->signal[index]) {
+            return count + (uint16_t)(peaks->peak_count[end] - peaks->peak_count[index]);
+        }
+    }
+    return count;
+}
+
+/**
+ * Add the sample stored at index to the activity gate. If any dimension
+ * leaves the band of the current run, the sample starts a new one.
+ */
+static void updateActivityGate(FilterDataProcessor_t *fdp, const int index) {
+    ActivityGate_t *gate = fdp->activity_gate;
+    bool inside = gate->run_samples > 0;
+    for (int d_i = 0; d_i < fdp->sample_dimensions && inside; d_i++) {
+        const float value = sampleAt(fdp, d_i, index);
+        const float min = (value < gate->min[d_i]) ? value : gate->min[d_i];
+        const float max = (value > gate->max[d_i]) ? value : gate->max[d_i];
+        inside = (max - min) <= gate->threshold;
+    }
+    for (int d_i = 0; d_i < fdp->sample_dimensions; d_i++) {
+        const float value = sampleAt(fdp, d_i, index);
+        if (!inside) {
+            gate->min[d_i] = value;
+            gate->max[d_i] = value;
+        } else if (value < gate->min[d_i]) {
+            gate->min[d_i] = value;
+        } else if (value > gate->max[d_i]) {
+            gate->max[d_i] = value;
+        }
+    }
+    if (inside) {
+        // Only needs to cover the whole ring buffer
+        if (gate->run_samples <= fdp->buffer_length) {
+            gate->run_samples++;
+        }
+    } else {
+        gate->run++;
+        gate->run_samples = 1;
+    }
+}
+
+// Count the samples recorded while a snapshot is active
+static inline void consumeSnapshotSpace(FilterDataProcessor_t *fdp, const int number_of_samples) {
+    // Recording never stalls, if there is no space left outside of the
+    // snapshot window, the snapshot is overwritten and becomes invalid
+    if (fdp->snapshot_active) {
+        if (fdp->snapshot_free >= number_of_samples) {
+            fdp->snapshot_free -= number_of_samples;
+        } else {
+            fdp->snapshot_free = 0;
+            fdp->snapshot_overrun = true;
+        }
+    }
+}
+
+/**
+ * Copy a run of values of a dimension from the interleaved samples (either
+ * float or int16) to its ring buffer at fdp->sample_index, converting them
+ * to the stored type.
+ */
+static void storeRun(FilterDataProcessor_t *fdp, const int dimension, const float *samples, const int16_t *raw, const int run) {
+    const int stride = fdp->sample_dimensions;
+    const float scale = fdp->sample_scale[dimension];
+    if (fdp->int16_samples != NULL) {
+        int16_t *out = &fdp->int16_samples[dimension][fdp->sample_index];
+        if (raw != NULL) {
+            for (int i = 0; i < run; i++) {
+                out[i] = raw[i * stride];
+            }
+        } else {
+            for (int i = 0; i < run; i++) {
+                out[i] = toInt16(fdp, dimension, samples[i * stride]);
+            }
+        }
+    } else {
+        float *out = &fdp->input_samples[dimension][fdp->sample_index];
+        if (raw != NULL) {
+            for (int i = 0; i < run; i++) {
+                out[i] = (float)raw[i * stride] / scale;
+            }
+        } else {
+            for (int i = 0; i < run; i++) {
+                out[i] = samples[i * stride];
+            }
+        }
+    }
+}
+
+/**
+ * Record interleaved samples, either float or int16 (raw), when there is no
+ * state to update per sample, copying them into each dimension ring buffer
+ * in runs up to the end of the buffer, instead of one sample at a time.
+ */
+static void recordSamplesBatch(FilterDataProcessor_t *fdp, const float *samples, const int16_t *raw, const int number_of_samples) {
+    consumeSnapshotSpace(fdp, number_of_samples);
+
+    const int dimensions = fdp->sample_dimensions;
+    int recorded = 0;
+    while (recorded < number_of_samples) {
+        int run = fdp->buffer_length - fdp->sample_index;
+        if (run > number_of_samples - recorded) {
+            run = number_of_samples - recorded;
+        }
+        if (dimensions == 3 && raw == NULL && fdp->input_samples != NULL) {
+            const float *in = &samples[recorded * 3];
+            float *x = &fdp->input_samples[0][fdp->sample_index];
+            float *y = &fdp->input_samples[1][fdp->sample_index];
+            float *z = &fdp->input_samples[2][fdp->sample_index];
+            for (int i = 0; i < run; i++) {
+                x[i] = in[0];
+                y[i] = in[1];
+                z[i] = in[2];
+                in += 3;
+            }
+        } else {
+            for (int d_i = 0; d_i < dimensions; d_i++) {
+                storeRun(fdp, d_i,
+                         (raw == NULL) ? &samples[recorded * dimensions + d_i] : NULL,
+                         (raw != NULL) ? &raw[recorded * dimensions + d_i] : NULL, run);
+            }
+        }
+        if (fdp->activity_gate != NULL) {
+            for (int i = 0; i < run; i++) {
+                updateActivityGate(fdp, fdp->sample_index + i);
+            }
+        }
+        fdp->sample_index = ringIndex(fdp, fdp->sample_index + run);
+        recorded += run;
+    }
 
-    int number_of_samples = elements / sample_dimensions;
+    fdp->samples_since_resync += number_of_samples;
+    if (fdp->samples_since_resync >= fdp->sample_length) {
+        fdp->samples_since_resync %= fdp->sample_length;
+        fdp->buffer_filled = true;
+    }
+}
+
+/**
+ * Record interleaved samples, either float or int16 (raw), one at a time,
+ * updating the running statistics, peak detectors and min/max queues.
+ */
+static void recordSamples(FilterDataProcessor_t *fdp, const float *samples, const int16_t *raw, const int number_of_samples) {
     for (int s_i = 0; s_i < number_of_samples; s_i++) {
-        for (int d_i = 0; d_i < sample_dimensions; d_i++) {
-            input_samples[d_i][sample_index + s_i] = samples[s_i * sample_dimensions + d_i];
+        consumeSnapshotSpace(fdp, 1);
+        for (int d_i = 0; d_i < fdp->sample_dimensions; d_i++) {
+            const int element = s_i * fdp->sample_dimensions + d_i;
+            float sample = (raw != NULL) ? (float)raw[element] / fdp->sample_scale[d_i] : samples[element];
+            int16_t stored = 0;
+            if (fdp->int16_samples != NULL) {
+                // The state is updated with the value as it will be read back
+                stored = (raw != NULL) ? raw[element] : toInt16(fdp, d_i, sample);
+                sample = (float)stored / fdp->sample_scale[d_i];
+            }
+            if (fdp->window_stats != NULL) {
+                updateWindowStats(fdp, d_i, sample);
+            }
+            if (fdp->streaming_peaks != NULL) {
+                updateStreamingPeaks(fdp, d_i, sample);
+            }
+            if (fdp->max_queues != NULL) {
+                updateMonotonicQueue(fdp, &fdp->max_queues[d_i], d_i, sample, true);
+                updateMonotonicQueue(fdp, &fdp->min_queues[d_i], d_i, sample, false);
+            }
+            if (fdp->int16_samples != NULL) {
+                fdp->int16_samples[d_i][fdp->sample_index] = stored;
+            } else {
+                fdp->input_samples[d_i][fdp->sample_index] = sample;
+            }
         }
-        sample_index++;
-        if (sample_index >= sample_length) {
-            sample_index = 0;
-            buffer_filled = true;
+        if (fdp->activity_gate != NULL) {
+            updateActivityGate(fdp, fdp->sample_index);
+        }
+        fdp->sample_index = ringIndex(fdp, fdp->sample_index + 1);
+        fdp->samples_since_resync++;
+        if (fdp->samples_since_resync >= fdp->sample_length) {
+            fdp->samples_since_resync = 0;
+            fdp->buffer_filled = true;
+            if (fdp->window_stats != NULL) {
+                for (int d_i = 0; d_i < fdp->sample_dimensions; d_i++) {
+                    resyncWindowStats(fdp, d_i);
+                }
+            }
         }
     }
+}
+
+static MldpReturn_t recordData(FilterDataProcessor_t *fdp, const float *samples, const int16_t *raw, const int elements) {
+    if (!fdp->initialised) return MLDP_ERROR_NOINIT;
+    // Only record data if the number of elements is a multiple of the sample dimensions
+    if (elements % fdp->sample_dimensions != 0) return MLDP_ERROR_CONFIG;
 
+    const int number_of_samples = elements / fdp->sample_dimensions;
+    if (fdp->window_stats == NULL && fdp->streaming_peaks == NULL && fdp->max_queues == NULL) {
+        recordSamplesBatch(fdp, samples, raw, number_of_samples);
+    } else {
+        recordSamples(fdp, samples, raw, number_of_samples);
+    }
     return MLDP_SUCCESS;
 }
 
-bool filterDataProcessor_isDataReady() {
-    if (!initialised) return false;
+MldpReturn_t filterDataProcessor_recordData(FilterDataProcessor_t *fdp, const float* samples, const int elements) {
+    return recordData(fdp, samples, NULL, elements);
+}
+
+MldpReturn_t filterDataProcessor_recordDataInt16(FilterDataProcessor_t *fdp, const int16_t* samples, const int elements) {
+    return recordData(fdp, NULL, samples, elements);
+}
+
+bool filterDataProcessor_isDataReady(FilterDataProcessor_t *fdp) {
+    if (!fdp->initialised) return false;
+
+    return fdp->buffer_filled;
+}
+
+/**
+ * Calculate a filter output from the running window statistics or the
+ * window minimum and maximum, either can be NULL if not available.
+ *
+ * @return True if the filter output can be calculated from the statistics
+ *         and data_out has been set, false otherwise.
+ */
+static bool incrementalFilter(
+    const FilterDataProcessor_t *fdp, const MlDataFilters_t *filter,
+    const WindowStats_t *stats, const WindowMinMax_t *min_max, float *data_out
+) {
+    if (filter->out_size != 1) {
+        return false;
+    }
+    if (min_max != NULL && filter->filter == filterMax) {
+        *data_out = min_max->max;
+        return true;
+    }
+    if (min_max != NULL && filter->filter == filterMin) {
+        *data_out = min_max->min;
+        return true;
+    }
+    if (stats == NULL) {
+        return false;
+    }
+    const float n = (float)fdp->sample_length;
+
+    if (filter->filter == filterMean) {
+        *data_out = stats->sum / n;
+    } else if (filter->filter == filterStdDev) {
+        const float mean_shifted = stats->sum / n - stats->shift;
+        const float variance = stats->sum_shifted_squares / n - mean_shifted * mean_shifted;
+        *data_out = variance > 0 ? sqrtf(variance) : 0.0f;
+    } else if (filter->filter == filterRms) {
+        *data_out = sqrtf(stats->sum_squares / n);
+    } else if (filter->filter == filterTotalAcc) {
+        *data_out = stats->sum_abs;
+    } else if (filter->filter == filterZcr && fdp->sample_length >= 2) {
+        *data_out = (float)stats->zero_crossings / (float)(fdp->sample_length - 1);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+MldpReturn_t filterDataProcessor_snapshot(FilterDataProcessor_t *fdp) {
+    if (!fdp->initialised) return MLDP_ERROR_NOINIT;
+    if (fdp->buffer_length == fdp->sample_length) return MLDP_ERROR_CONFIG;
+    if (!fdp->buffer_filled) return MLDP_ERROR;
 
-    return buffer_filled;
+    // Only the window position and its statistics need to be kept, as the
+    // samples will remain in the ring buffer until the space is needed
+    fdp->snapshot_start = windowStart(fdp);
+    fdp->snapshot_free = fdp->buffer_length - fdp->sample_length;
+    fdp->snapshot_overrun = false;
+    if (fdp->snapshot_stats != NULL) {
+        memcpy(fdp->snapshot_stats, fdp->window_stats, fdp->sample_dimensions * sizeof(WindowStats_t));
+    }
+    if (fdp->snapshot_min_max != NULL) {
+        for (int i = 0; i < fdp->sample_dimensions; i++) {
+            fdp->snapshot_min_max[i] = windowMinMax(fdp, i);
+        }
+    }
+    fdp->snapshot_active = true;
+
+    return MLDP_SUCCESS;
 }
 
-float* filterDataProcessor_getProcessedData() {
-    if (!initialised) return NULL;
-    if (!buffer_filled) return NULL;
+void filterDataProcessor_commit(FilterDataProcessor_t *fdp) {
+    fdp->snapshot_active = false;
+}
 
-    // Run all filters and save their output to output_data
-    int output_i = 0;
-    for (int filter_i = 0; filter_i < filter_size; filter_i++) {
-        for (int dimension_i = 0; dimension_i < sample_dimensions; dimension_i++) {
-            const int elements_left = sample_length - sample_index;
-            memcpy(temp_buffer, &input_samples[dimension_i][sample_index], elements_left * sizeof(float));
-            memcpy(&temp_buffer[elements_left], input_samples[dimension_i], sample_index * sizeof(float));
-            MldpReturn_t filter_result = filters[filter_i].filter(
-                temp_buffer, sample_length,
-                &output_data[output_i], filters[filter_i].out_size
-            );
+/**
+ * Run all the filters through the current window (or the snapshot window) and
+ * write their output to output, which has output_length elements.
+ */
+static MldpReturn_t processData(FilterDataProcessor_t *fdp, float *output) {
+
+    // Process the frozen window if there is a snapshot, or the latest otherwise
+    const int start = fdp->snapshot_active ? fdp->snapshot_start : windowStart(fdp);
+    const WindowStats_t *stats = fdp->snapshot_active ? fdp->snapshot_stats : fdp->window_stats;
+
+    // Run all filters and save their output
+    for (int dimension_i = 0; dimension_i < fdp->sample_dimensions; dimension_i++) {
+        // The int16 window is only converted into the temporary buffer when a
+        // filter reads it, which is then ready for the filters without a
+        // window version too
+        const bool int16_window = fdp->int16_samples != NULL;
+        MlDataWindow_t window = {0};
+        if (!int16_window) {
+            window = getWindow(fdp, dimension_i, start);
+        }
+        bool temp_buffer_ready = false;
+        WindowMinMax_t min_max;
+        if (fdp->max_queues != NULL) {
+            min_max = fdp->snapshot_active ? fdp->snapshot_min_max[dimension_i] : windowMinMax(fdp, dimension_i);
+        }
+
+        // Each filter output block contains the output for all dimensions
+        int filter_output_i = 0;
+        for (int filter_i = 0; filter_i < fdp->filter_size; filter_i++) {
+            const int out_size = fdp->filters[filter_i].out_size;
+            const bool interleaved = fdp->filters[filter_i].flags & MLDP_FILTER_INTERLEAVED_OUTPUT;
+            float *data_out = interleaved ?
+                    fdp->interleave_buffer : &output[filter_output_i + dimension_i * out_size];
+            filter_output_i += out_size * fdp->sample_dimensions;
+
+            if (!interleaved && incrementalFilter(
+                    fdp, &fdp->filters[filter_i], stats ? &stats[dimension_i] : NULL,
+                    fdp->max_queues ? &min_max : NULL, data_out)) {
+                continue;
+            }
+
+            // The streaming peak count reads the ring buffer directly
+            const bool streamed_peaks = fdp->streaming_peaks != NULL &&
+                    fdp->window_filters[filter_i] == filterPeaksWindow && out_size == 1;
+            if (int16_window && !temp_buffer_ready && !streamed_peaks) {
+                window = convertWindow(fdp, dimension_i, start);
+                temp_buffer_ready = true;
+            }
+
+            MldpReturn_t filter_result;
+            if (streamed_peaks) {
+                *data_out = streamingPeakCount(fdp, dimension_i, start);
+                filter_result = MLDP_SUCCESS;
+            } else if (fdp->streaming_peaks != NULL && fdp->window_filters[filter_i] == filterMlTrainerWindow) {
+                filter_result = filterMlTrainerWindowPeaks(
+                        &window, streamingPeakCount(fdp, dimension_i, start), data_out, out_size);
+            } else if (fdp->window_filters[filter_i] != NULL) {
+                filter_result = fdp->window_filters[filter_i](&window, data_out, out_size);
+            } else {
+                // Filters without a window version need a contiguous copy of the window
+                if (!temp_buffer_ready) {
+                    memcpy(fdp->temp_buffer, window.head, window.head_size * sizeof(float));
+                    memcpy(&fdp->temp_buffer[window.head_size], window.tail, window.tail_size * sizeof(float));
+                    temp_buffer_ready = true;
+                }
+                filter_result = fdp->filters[filter_i].filter(fdp->temp_buffer, fdp->sample_length, data_out, out_size);
+            }
             if (filter_result != MLDP_SUCCESS) {
-                return NULL;
+                return filter_result;
+            }
+
+            if (interleaved) {
+                // Each feature is placed next to the same feature of the other dimensions
+                const int block_start = filter_output_i - out_size * fdp->sample_dimensions;
+                for (int i = 0; i < out_size; i++) {
+                    output[block_start + i * fdp->sample_dimensions + dimension_i] = fdp->interleave_buffer[i];
+                }
             }
-            output_i += filters[filter_i].out_size;
         }
     }
-    return output_data;
+
+    // The gate can skip the next windows if this one, and the samples
+    // recorded after it, are all inside the current idle run
+    ActivityGate_t *gate = fdp->activity_gate;
+    if (gate != NULL) {
+        const int recorded_after = fdp->snapshot_active ?
+                fdp->buffer_length - fdp->sample_length - fdp->snapshot_free : 0;
+        gate->processed_idle = gate->run_samples >= fdp->sample_length + recorded_after;
+        gate->processed_run = gate->run;
+    }
+    return MLDP_SUCCESS;
+}
+
+bool filterDataProcessor_isIdle(FilterDataProcessor_t *fdp) {
+    if (!fdp->initialised || fdp->activity_gate == NULL) return false;
+
+    const ActivityGate_t *gate = fdp->activity_gate;
+    return gate->processed_idle && gate->run == gate->processed_run;
+}
+
+float* filterDataProcessor_getProcessedData(FilterDataProcessor_t *fdp) {
+    if (!fdp->initialised) return NULL;
+    if (!fdp->buffer_filled) return NULL;
+    if (fdp->snapshot_active && fdp->snapshot_overrun) return NULL;
+
+    if (processData(fdp, fdp->output_data) != MLDP_SUCCESS) {
+        return NULL;
+    }
+    return fdp->output_data;
 }
 
-size_t filterDataProcessor_getProcessedDataSize() {
-    if (!initialised) return 0;
+MldpReturn_t filterDataProcessor_writeProcessedData(FilterDataProcessor_t *fdp, float *data_out, const size_t out_len) {
+    if (!fdp->initialised) return MLDP_ERROR_NOINIT;
+    if (data_out == NULL || out_len != (size_t)fdp->output_length) return MLDP_ERROR_CONFIG;
+    if (!fdp->buffer_filled) return MLDP_ERROR;
+    if (fdp->snapshot_active && fdp->snapshot_overrun) return MLDP_ERROR;
+
+    return processData(fdp, data_out);
+}
+
+size_t filterDataProcessor_getProcessedDataSize(FilterDataProcessor_t *fdp) {
+    if (!fdp->initialised) return 0;
+
+    return fdp->output_length;
+}
+
+FilterDataProcessor_t* filterDataProcessor_create() {
+    return (FilterDataProcessor_t*)calloc(1, sizeof(FilterDataProcessor_t));
+}
+
+void filterDataProcessor_destroy(FilterDataProcessor_t *fdp) {
+    if (fdp == NULL) return;
+    filterDataProcessor_deinit(fdp);
+    free(fdp);
+}
+
+/*****************************************************************************/
+/* Default instance, used through the mlDataProcessor interface              */
+/*****************************************************************************/
+static FilterDataProcessor_t default_processor;
+
+static MldpReturn_t defaultProcessor_init(const MlDataProcessorConfig_t* config) {
+    return filterDataProcessor_init(&default_processor, config);
+}
+
+static MldpReturn_t defaultProcessor_initArena(const MlDataProcessorConfig_t* config, void *arena, const size_t arena_size) {
+    return filterDataProcessor_initArena(&default_processor, config, arena, arena_size);
+}
+
+static void defaultProcessor_deinit() {
+    filterDataProcessor_deinit(&default_processor);
+}
+
+static MldpReturn_t defaultProcessor_recordData(const float* samples, const int elements) {
+    return filterDataProcessor_recordData(&default_processor, samples, elements);
+}
+
+static MldpReturn_t defaultProcessor_recordDataInt16(const int16_t* samples, const int elements) {
+    return filterDataProcessor_recordDataInt16(&default_processor, samples, elements);
+}
+
+static bool defaultProcessor_isDataReady() {
+    return filterDataProcessor_isDataReady(&default_processor);
+}
+
+static float* defaultProcessor_getProcessedData() {
+    return filterDataProcessor_getProcessedData(&default_processor);
+}
+
+static MldpReturn_t defaultProcessor_writeProcessedData(float *data_out, const size_t out_len) {
+    return filterDataProcessor_writeProcessedData(&default_processor, data_out, out_len);
+}
+
+static size_t defaultProcessor_getProcessedDataSize() {
+    return filterDataProcessor_getProcessedDataSize(&default_processor);
+}
+
+static MldpReturn_t defaultProcessor_snapshot() {
+    return filterDataProcessor_snapshot(&default_processor);
+}
+
+static void defaultProcessor_commit() {
+    filterDataProcessor_commit(&default_processor);
+}
 
-    return output_length;
+static bool defaultProcessor_isIdle() {
+    return filterDataProcessor_isIdle(&default_processor);
 }
 
 MlDataProcessor_t mlDataProcessor = {
-    .init = filterDataProcessor_init,
-    .deinit = filterDataProcessor_deinit,
-    .recordData = filterDataProcessor_recordData,
-    .isDataReady = filterDataProcessor_isDataReady,
-    .getProcessedData = filterDataProcessor_getProcessedData,
-    .getProcessedDataSize = filterDataProcessor_getProcessedDataSize,
+    .init = defaultProcessor_init,
+    .deinit = defaultProcessor_deinit,
+    .recordData = defaultProcessor_recordData,
+    .isDataReady = defaultProcessor_isDataReady,
+    .getProcessedData = defaultProcessor_getProcessedData,
+    .getProcessedDataSize = defaultProcessor_getProcessedDataSize,
+    .snapshot = defaultProcessor_snapshot,
+    .commit = defaultProcessor_commit,
+    .getArenaSize = filterDataProcessor_getArenaSize,
+    .initArena = defaultProcessor_initArena,
+    .writeProcessedData = defaultProcessor_writeProcessedData,
+    .recordDataInt16 = defaultProcessor_recordDataInt16,
+    .isIdle = defaultProcessor_isIdle,
 };
@@ -0,0 +1,53 @@
+/**
+ * @brief Instances of the Data Processor that applies a collection of
+ * filters to the input data.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * The mlDataProcessor interface from mldataprocessor.h uses a default
+ * instance, these functions can be used to create more instances, e.g. to
+ * process the same samples for two models, or for two window lengths.
+ */
+#pragma once
+
+#include "mldataprocessor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Opaque handle to a data processor instance
+typedef struct FilterDataProcessor_s FilterDataProcessor_t;
+
+/**
+ * @brief Allocate a new data processor instance, it needs to be initialised
+ * with filterDataProcessor_init() before recording data.
+ *
+ * @return The new instance, or NULL if it could not be allocated.
+ */
+FilterDataProcessor_t* filterDataProcessor_create(void);
+
+// Deinitialise and free an instance created with filterDataProcessor_create()
+void filterDataProcessor_destroy(FilterDataProcessor_t *fdp);
+
+// Same as the MlDataProcessor_t functions, for a specific instance
+MldpReturn_t filterDataProcessor_init(FilterDataProcessor_t *fdp, const MlDataProcessorConfig_t *config);
+MldpReturn_t filterDataProcessor_initArena(
+    FilterDataProcessor_t *fdp, const MlDataProcessorConfig_t *config, void *arena, const size_t arena_size);
+size_t filterDataProcessor_getArenaSize(const MlDataProcessorConfig_t *config);
+void filterDataProcessor_deinit(FilterDataProcessor_t *fdp);
+MldpReturn_t filterDataProcessor_recordData(FilterDataProcessor_t *fdp, const float *samples, const int elements);
+MldpReturn_t filterDataProcessor_recordDataInt16(FilterDataProcessor_t *fdp, const int16_t *samples, const int elements);
+bool filterDataProcessor_isDataReady(FilterDataProcessor_t *fdp);
+float* filterDataProcessor_getProcessedData(FilterDataProcessor_t *fdp);
+MldpReturn_t filterDataProcessor_writeProcessedData(FilterDataProcessor_t *fdp, float *data_out, const size_t out_len);
+size_t filterDataProcessor_getProcessedDataSize(FilterDataProcessor_t *fdp);
+MldpReturn_t filterDataProcessor_snapshot(FilterDataProcessor_t *fdp);
+void filterDataProcessor_commit(FilterDataProcessor_t *fdp);
+bool filterDataProcessor_isIdle(FilterDataProcessor_t *fdp);
+
+#ifdef __cplusplus
+}
+#endif
@@ -13,11 +13,19 @@
 int ml4f_is_valid_header(const ml4f_header_t *header) {
     if (!header || header->magic0 != ML4F_MAGIC0 || header->magic1 != ML4F_MAGIC1)
         return 0;
-    if (header->input_type != ML4F_TYPE_FLOAT32 || header->output_type != ML4F_TYPE_FLOAT32)
+    if (!ml4f_type_size(header->input_type) || !ml4f_type_size(header->output_type))
+        return 0;
+    // Quantized tensors need a scale to convert them from and to float
+    if (header->input_type != ML4F_TYPE_FLOAT32 && !(header->input_scale > 0.0f))
+        return 0;
+    if (header->output_type != ML4F_TYPE_FLOAT32 && !(header->output_scale > 0.0f))
         return 0;
     return 1;
 }
 
+// The model is Thumb machine code, host builds without an Arm CPU provide
+// their own ml4f_invoke() by defining ML4F_HOST_INVOKE
+#ifndef ML4F_HOST_INVOKE
 typedef void (*model_fn_t)(const ml4f_header_t *model, uint8_t *arena);
 
 int ml4f_invoke(const ml4f_header_t *model, uint8_t *arena) {
@@ -28,6 +36,7 @@ int ml4f_invoke(const ml4f_header_t *model, uint8_t *arena) {
     fn(model, arena);
     return 0;
 }
+#endif
 
 #define EPS 0.00002f
 static int is_near(float a, float b) {
@@ -57,6 +66,14 @@ int ml4f_test(const ml4f_header_t *model, uint8_t *arena) {
 
     ml4f_invoke(model, arena);
 
+    // Quantized outputs are expected to match exactly
+    if (model->output_type != ML4F_TYPE_FLOAT32) {
+        if (memcmp(arena + model->output_offset, (const uint8_t *)model + model->test_output_offset,
+                   ml4f_shape_size(ml4f_output_shape(model), model->output_type)) != 0)
+            return -2;
+        return 1;
+    }
+
     float *actual = (float *)(arena + model->output_offset);
     const float *expected = (const float *)((const uint8_t *)model + model->test_output_offset);
     int elts = ml4f_shape_elements(ml4f_output_shape(model));
@@ -87,10 +104,20 @@ uint32_t ml4f_shape_elements(const uint32_t *shape) {
     return r;
 }
 
-uint32_t ml4f_shape_size(const uint32_t *shape, uint32_t type) {
-    if (type != ML4F_TYPE_FLOAT32)
+uint32_t ml4f_type_size(uint32_t type) {
+    switch (type) {
+    case ML4F_TYPE_FLOAT32:
+        return 4;
+    case ML4F_TYPE_INT8:
+    case ML4F_TYPE_UINT8:
+        return 1;
+    default:
         return 0;
-    return ml4f_shape_elements(shape) << 2;
+    }
+}
+
+uint32_t ml4f_shape_size(const uint32_t *shape, uint32_t type) {
+    return ml4f_shape_elements(shape) * ml4f_type_size(type);
 }
 
 int ml4f_argmax(const float *data, uint32_t size) {
@@ -111,8 +138,14 @@ int ml4f_argmax(const float *data, uint32_t size) {
 
 #include <stdlib.h>
 
+// The full invoke functions take and return float tensors
+static int is_float_model(const ml4f_header_t *model) {
+    return ml4f_is_valid_header(model) && model->input_type == ML4F_TYPE_FLOAT32 &&
+           model->output_type == ML4F_TYPE_FLOAT32;
+}
+
 int ml4f_full_invoke(const ml4f_header_t *model, const float *input, float *output) {
-    if (!ml4f_is_valid_header(model))
+    if (!is_float_model(model))
         return -1;
     uint8_t *arena = malloc(model->arena_bytes);
     memcpy(arena + model->input_offset, input,
@@ -125,7 +158,7 @@ int ml4f_full_invoke(const ml4f_header_t *model, const float *input, float *outp
 }
 
 int ml4f_full_invoke_arena(const ml4f_header_t *model, uint8_t *arena, const float *input, float *output) {
-    if (!ml4f_is_valid_header(model))
+    if (!is_float_model(model))
         return -1;
     memcpy(arena + model->input_offset, input,
            ml4f_shape_size(ml4f_input_shape(model), model->input_type));
@@ -136,7 +169,7 @@ int ml4f_full_invoke_arena(const ml4f_header_t *model, uint8_t *arena, const flo
 }
 
 int ml4f_full_invoke_argmax(const ml4f_header_t *model, const float *input) {
-    if (!ml4f_is_valid_header(model))
+    if (!is_float_model(model))
         return -1;
     uint8_t *arena = malloc(model->arena_bytes);
     memcpy(arena + model->input_offset, input,
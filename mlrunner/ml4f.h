@@ -17,6 +17,9 @@ extern "C" {
 #endif
 
 #define ML4F_TYPE_FLOAT32 1
+// Quantized tensors, real_value = scale * (quantized_value - zero_point)
+#define ML4F_TYPE_INT8 2
+#define ML4F_TYPE_UINT8 3
 
 #define ML4F_MAGIC0 0x30470f62
 #define ML4F_MAGIC1 0x46344c4d /* "ML4F" */
@@ -34,10 +37,15 @@ typedef struct ml4f_header {
     uint32_t test_output_offset;
     uint32_t arena_bytes;
     uint32_t input_offset;
-    uint32_t input_type; // always ML4F_TYPE_FLOAT32
+    uint32_t input_type; // ML4F_TYPE_*
     uint32_t output_offset;
-    uint32_t output_type; // always ML4F_TYPE_FLOAT32
-    uint32_t reserved[4];
+    uint32_t output_type; // ML4F_TYPE_*
+    // Quantization of the input and output tensors, only for the
+    // ML4F_TYPE_INT8 and ML4F_TYPE_UINT8 types (zero for float models)
+    float input_scale;
+    int32_t input_zero_point;
+    float output_scale;
+    int32_t output_zero_point;
     // Shapes are 0-terminated, and are given in elements (not bytes).
     // Input shape is followed by output shape.
     uint32_t input_shape[0];
@@ -50,6 +58,7 @@ const uint32_t *ml4f_input_shape(const ml4f_header_t *model);
 const uint32_t *ml4f_output_shape(const ml4f_header_t *model);
 uint32_t ml4f_shape_elements(const uint32_t *shape);
 uint32_t ml4f_shape_size(const uint32_t *shape, uint32_t type);
+uint32_t ml4f_type_size(uint32_t type);
 int ml4f_argmax(const float *data, uint32_t size);
 
 int ml4f_full_invoke(const ml4f_header_t *model, const float *input, float *output);
@@ -10,15 +10,71 @@
 #include <string.h>
 #include "mldataprocessor.h"
 
-MldpReturn_t filterMax(const float *data_in, const int in_size, float *data_out, const int out_size) {
-    if (in_size < 1 || out_size != 1) {
+// Disable floating point contraction (e.g. into fused multiply-add
+// instructions), as the compiler might contract the same expression
+// differently in each function, and filterMlTrainer() needs to produce the
+// exact same output as the individual filters. Clang only has the standard
+// pragma, builds with other compilers need -ffp-contract=off or equivalent
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+// Number of contiguous spans in a MlDataWindow_t
+#define WINDOW_SPANS 2
+
+static inline int windowSize(const MlDataWindow_t *window) {
+    return window->head_size + window->tail_size;
+}
+
+/**
+ * Get one of the contiguous spans from a window, the head span first.
+ *
+ * @return The number of elements in the span.
+ */
+static inline int windowSpan(const MlDataWindow_t *window, const int span, const float **data) {
+    if (span == 0) {
+        *data = window->head;
+        return window->head_size;
+    }
+    *data = window->tail;
+    return window->tail_size;
+}
+
+// Random access to a window element, slower than iterating through the spans
+static inline float windowAt(const MlDataWindow_t *window, const int i) {
+    return (i < window->head_size) ? window->head[i] : window->tail[i - window->head_size];
+}
+
+static inline bool isZeroCrossing(const float previous, const float next) {
+    return (next >= 0 && previous < 0) || (next < 0 && previous >= 0);
+}
+
+// Wrap a contiguous buffer in a window to run the window version of the filters
+static inline MlDataWindow_t linearWindow(const float *data_in, const int in_size) {
+    const MlDataWindow_t window = {
+        .head = data_in,
+        .head_size = in_size,
+        .tail = NULL,
+        .tail_size = 0,
+    };
+    return window;
+}
+
+MldpReturn_t filterMaxWindow(const MlDataWindow_t *window, float *data_out, const int out_size) {
+    if (windowSize(window) < 1 || out_size != 1) {
         return MLDP_ERROR_CONFIG;
     }
 
-    float max = data_in[0];
-    for (int i = 1; i < in_size; i++) {
-        if (data_in[i] > max) {
-            max = data_in[i];
+    float max = windowAt(window, 0);
+    for (int span = 0; span < WINDOW_SPANS; span++) {
+        const float *data;
+        const int size = windowSpan(window, span, &data);
+        for (int i = 0; i < size; i++) {
+            if (data[i] > max) {
+                max = data[i];
+            }
         }
     }
     *data_out = max;
@@ -26,15 +82,19 @@ MldpReturn_t filterMax(const float *data_in, const int in_size, float *data_out,
     return MLDP_SUCCESS;
 }
 
-MldpReturn_t filterMin(const float *data_in, const int in_size, float *data_out, const int out_size) {
-    if (in_size < 1 || out_size != 1) {
+MldpReturn_t filterMinWindow(const MlDataWindow_t *window, float *data_out, const int out_size) {
+    if (windowSize(window) < 1 || out_size != 1) {
         return MLDP_ERROR_CONFIG;
     }
 
-    float min = data_in[0];
-    for (int i = 1; i < in_size; i++) {
-        if (data_in[i] < min) {
-            min = data_in[i];
+    float min = windowAt(window, 0);
+    for (int span = 0; span < WINDOW_SPANS; span++) {
+        const float *data;
+        const int size = windowSpan(window, span, &data);
+        for (int i = 0; i < size; i++) {
+            if (data[i] < min) {
+                min = data[i];
+            }
         }
     }
     *data_out = min;
@@ -42,14 +102,19 @@ MldpReturn_t filterMin(const float *data_in, const int in_size, float *data_out,
     return MLDP_SUCCESS;
 }
 
-MldpReturn_t filterMean(const float *data_in, const int in_size, float *data_out, const int out_size) {
+MldpReturn_t filterMeanWindow(const MlDataWindow_t *window, float *data_out, const int out_size) {
+    const int in_size = windowSize(window);
     if (in_size < 1 || out_size != 1) {
         return MLDP_ERROR_CONFIG;
     }
 
     float sum = 0;
-    for (int i = 0; i < in_size; i++) {
-        sum += data_in[i];
+    for (int span = 0; span < WINDOW_SPANS; span++) {
+        const float *data;
+        const int size = windowSpan(window, span, &data);
+        for (int i = 0; i < size; i++) {
+            sum += data[i];
+        }
     }
     *data_out = sum / (float)in_size;
 
@@ -57,21 +122,26 @@ MldpReturn_t filterMean(const float *data_in, const int in_size, float *data_out
 }
 
 // Standard Deviation
-MldpReturn_t filterStdDev(const float *data_in, const int in_size, float *data_out, const int out_size) {
+MldpReturn_t filterStdDevWindow(const MlDataWindow_t *window, float *data_out, const int out_size) {
+    const int in_size = windowSize(window);
     if (in_size < 1 || out_size != 1) {
         return MLDP_ERROR_CONFIG;
     }
 
     float mean;
-    MldpReturn_t mean_result = filterMean(data_in, in_size, &mean, 1);
+    MldpReturn_t mean_result = filterMeanWindow(window, &mean, 1);
     if (mean_result != MLDP_SUCCESS) {
         return mean_result;
     }
 
     float sum_of_squares = 0;
-    for (int i = 0; i < in_size; i++) {
-        float f = data_in[i] - mean;
-        sum_of_squares += f * f;
+    for (int span = 0; span < WINDOW_SPANS; span++) {
+        const float *data;
+        const int size = windowSpan(window, span, &data);
+        for (int i = 0; i < size; i++) {
+            float f = data[i] - mean;
+            sum_of_squares += f * f;
+        }
     }
     *data_out = sqrtf(sum_of_squares / (float)in_size);
 
@@ -79,91 +149,124 @@ MldpReturn_t filterStdDev(const float *data_in, const int in_size, float *data_o
 }
 
 // This combined function is more efficient than calling filterMean and filterStdDev separately
-static inline void calcMeanAndStdDev(const float *data_in, const int in_size, float *mean, float *std_dev) {
+static inline void calcLagMeanAndStdDev(const MldpPeakDetector_t *detector, const int start, float *mean, float *std_dev) {
+    const int lag = MLDP_PEAKS_LAG;
+    const int history = MLDP_PEAKS_LAG + 1;
+
     float sum = 0;
-    for (int i = 0; i < in_size; i++) {
-        sum += data_in[i];
+    for (int i = 0; i < lag; i++) {
+        sum += detector->filtered[(start + i) % history];
     }
-    const float _mean = sum / (float)in_size;
+    const float _mean = sum / (float)lag;
 
     float sum_of_squares = 0;
-    for (int i = 0; i < in_size; i++) {
-        float f = data_in[i] - _mean;
+    for (int i = 0; i < lag; i++) {
+        float f = detector->filtered[(start + i) % history] - _mean;
         sum_of_squares += f * f;
     }
-    *std_dev = sqrtf(sum_of_squares / (float)in_size);
+    *std_dev = sqrtf(sum_of_squares / (float)lag);
     *mean = _mean;
 }
 
-// Count the number of peaks
-MldpReturn_t filterPeaks(const float *data_in, const int in_size, float *data_out, const int out_size) {
-    const int lag = 5;
+void mldp_peakDetectorReset(MldpPeakDetector_t *detector) {
+    detector->index = 0;
+    detector->count = 0;
+    detector->signal = 0;
+}
+
+bool mldp_peakDetectorAdd(MldpPeakDetector_t *detector, const float value, float *filtered) {
+    const int lag = MLDP_PEAKS_LAG;
+    const int history = MLDP_PEAKS_LAG + 1;
     const float threshold = 3.5;
     const float influence = 0.5;
 
-    if (in_size < (lag + 2) || out_size != 1) {
-        return MLDP_ERROR_CONFIG;
-    }
-
-    // Keep memory allocated between calls to avoid malloc/free overhead
-    static float *filtered_y = NULL;
-    static int alloc_size = 0;
-    if (alloc_size < in_size) {
-        free(filtered_y);
-        filtered_y = (float *)malloc(in_size * sizeof(float));
-        if (filtered_y == NULL) {
-            alloc_size = 0;
-            return MLDP_ERROR_ALLOC;
-        }
-        alloc_size = in_size;
-    }
-    memcpy(filtered_y, data_in, lag * sizeof(float));
+    bool new_peak = false;
+    float filtered_value = value;
+    // The first lag values are only used to initialise the filter
+    if (detector->count >= lag) {
+        // The filter is adjusted with the lag filtered values before the
+        // previous one, which for the first two values are the initial ones
+        const int start = (detector->count == lag) ? 0 : detector->index;
+        float mean_lag, std_dev_lag;
+        calcLagMeanAndStdDev(detector, start, &mean_lag, &std_dev_lag);
 
-    float mean_lag, std_dev_lag;
-    calcMeanAndStdDev(filtered_y, lag, &mean_lag, &std_dev_lag);
-
-    int previous_signal = 0;
-    int peaksCounter = 0;
-    for (int i = lag; i < in_size; i++) {
         int current_signal;
-        const float diff = fabsf(data_in[i] - mean_lag);
+        const float diff = fabsf(value - mean_lag);
         if (
             diff > 0.1f &&
             diff > threshold * std_dev_lag
         ) {
-            if (data_in[i] > mean_lag) {
+            if (value > mean_lag) {
                 current_signal = +1; // positive signal
-                if (previous_signal == 0) {
-                    peaksCounter++;
+                if (detector->signal == 0) {
+                    new_peak = true;
                 }
             } else {
                 current_signal = -1; // negative signal
             }
             // make influence lower
-            filtered_y[i] = influence * data_in[i] + (1.0f - influence) * filtered_y[i - 1];
+            const float previous = detector->filtered[(detector->index + history - 1) % history];
+            filtered_value = influence * value + (1.0f - influence) * previous;
         } else {
             current_signal = 0; // no signal
-            filtered_y[i] = data_in[i];
         }
-        previous_signal = current_signal;
+        detector->signal = current_signal;
+    }
+
+    detector->filtered[detector->index] = filtered_value;
+    detector->index = (detector->index + 1) % history;
+    if (detector->count <= lag) {
+        detector->count++;
+    }
+    if (filtered != NULL) {
+        *filtered = filtered_value;
+    }
+
+    return new_peak;
+}
+
+static int countPeaks(const MlDataWindow_t *window) {
+    MldpPeakDetector_t detector;
+    mldp_peakDetectorReset(&detector);
+
+    int peaksCounter = 0;
+    for (int span = 0; span < WINDOW_SPANS; span++) {
+        const float *data;
+        const int size = windowSpan(window, span, &data);
+        for (int i = 0; i < size; i++) {
+            if (mldp_peakDetectorAdd(&detector, data[i], NULL)) {
+                peaksCounter++;
+            }
+        }
+    }
+
+    return peaksCounter;
+}
 
-        // adjust the filters
-        calcMeanAndStdDev(&filtered_y[i - lag], lag, &mean_lag, &std_dev_lag);
+// Count the number of peaks
+MldpReturn_t filterPeaksWindow(const MlDataWindow_t *window, float *data_out, const int out_size) {
+    if (windowSize(window) < (MLDP_PEAKS_LAG + 2) || out_size != 1) {
+        return MLDP_ERROR_CONFIG;
     }
-    *data_out = peaksCounter;
+
+    *data_out = countPeaks(window);
 
     return MLDP_SUCCESS;
 }
 
 // Total Absolute Acceleration
-MldpReturn_t filterTotalAcc(const float *data_in, const int in_size, float *data_out, const int out_size) {
-    if (in_size < 1 || out_size != 1) {
+MldpReturn_t filterTotalAccWindow(const MlDataWindow_t *window, float *data_out, const int out_size) {
+    if (windowSize(window) < 1 || out_size != 1) {
         return MLDP_ERROR_CONFIG;
     }
 
     float total = 0;
-    for (int i = 0; i < in_size; i++) {
-        total += fabsf(data_in[i]);
+    for (int span = 0; span < WINDOW_SPANS; span++) {
+        const float *data;
+        const int size = windowSpan(window, span, &data);
+        for (int i = 0; i < size; i++) {
+            total += fabsf(data[i]);
+        }
     }
     *data_out = total;
 
@@ -171,16 +274,22 @@ MldpReturn_t filterTotalAcc(const float *data_in, const int in_size, float *data
 }
 
 // Zero Crossing Rate
-MldpReturn_t filterZcr(const float *data_in, const int in_size, float *data_out, const int out_size) {
+MldpReturn_t filterZcrWindow(const MlDataWindow_t *window, float *data_out, const int out_size) {
+    const int in_size = windowSize(window);
     if (in_size < 2 || out_size != 1) {
         return MLDP_ERROR_CONFIG;
     }
 
     int count = 0;
-    for (int i = 1; i < in_size; i++) {
-        if ((data_in[i] >= 0 && data_in[i - 1] < 0) ||
-            (data_in[i] < 0 && data_in[i - 1] >= 0)) {
-            count++;
+    float previous = windowAt(window, 0);
+    for (int span = 0; span < WINDOW_SPANS; span++) {
+        const float *data;
+        const int size = windowSpan(window, span, &data);
+        for (int i = 0; i < size; i++) {
+            if (isZeroCrossing(previous, data[i])) {
+                count++;
+            }
+            previous = data[i];
         }
     }
     *data_out = (float)count / (float)(in_size - 1);
@@ -189,26 +298,195 @@ MldpReturn_t filterZcr(const float *data_in, const int in_size, float *data_out,
 }
 
 // Root Mean Square
-MldpReturn_t filterRms(const float *data_in, const int in_size, float *data_out, const int out_size) {
+MldpReturn_t filterRmsWindow(const MlDataWindow_t *window, float *data_out, const int out_size) {
+    const int in_size = windowSize(window);
     if (in_size < 1 || out_size != 1) {
         return MLDP_ERROR_CONFIG;
     }
 
     float rms = 0;
-    for (int i = 0; i < in_size; i++) {
-        rms += data_in[i] * data_in[i];
+    for (int span = 0; span < WINDOW_SPANS; span++) {
+        const float *data;
+        const int size = windowSpan(window, span, &data);
+        for (int i = 0; i < size; i++) {
+            rms += data[i] * data[i];
+        }
     }
     *data_out = sqrtf(rms / (float)in_size);
 
     return MLDP_SUCCESS;
 }
 
-MldpReturn_t filterPassThrough(const float *data_in, const int in_size, float *data_out, const int out_size) {
-    if (in_size > out_size) {
+MldpReturn_t filterPassThroughWindow(const MlDataWindow_t *window, float *data_out, const int out_size) {
+    if (windowSize(window) > out_size) {
         return MLDP_ERROR_CONFIG;
     }
 
-    memcpy(data_out, data_in, in_size * sizeof(float));
+    memcpy(data_out, window->head, window->head_size * sizeof(float));
+    memcpy(&data_out[window->head_size], window->tail, window->tail_size * sizeof(float));
 
     return MLDP_SUCCESS;
 }
+
+MldpReturn_t filterMlTrainerWindowPeaks(const MlDataWindow_t *window, const int peaks, float *data_out, const int out_size) {
+    const int in_size = windowSize(window);
+    if (in_size < (MLDP_PEAKS_LAG + 2) || out_size != MLDP_ML_TRAINER_FEATURES) {
+        return MLDP_ERROR_CONFIG;
+    }
+
+    // Each accumulator is updated in the same order as the individual filters
+    // do, so that the results are bit-identical
+    float max = windowAt(window, 0);
+    float min = max;
+    float previous = max;
+    float sum = 0;
+    float total = 0;
+    float sum_squares = 0;
+    int zero_crossings = 0;
+    for (int span = 0; span < WINDOW_SPANS; span++) {
+        const float *data;
+        const int size = windowSpan(window, span, &data);
+        for (int i = 0; i < size; i++) {
+            const float value = data[i];
+            if (value > max) {
+                max = value;
+            }
+            if (value < min) {
+                min = value;
+            }
+            sum += value;
+            total += fabsf(value);
+            sum_squares += value * value;
+            if (isZeroCrossing(previous, value)) {
+                zero_crossings++;
+            }
+            previous = value;
+        }
+    }
+    const float mean = sum / (float)in_size;
+
+    // The Standard Deviation needs the mean before it can be calculated
+    float sum_of_squares = 0;
+    for (int span = 0; span < WINDOW_SPANS; span++) {
+        const float *data;
+        const int size = windowSpan(window, span, &data);
+        for (int i = 0; i < size; i++) {
+            float f = data[i] - mean;
+            sum_of_squares += f * f;
+        }
+    }
+
+    data_out[0] = max;
+    data_out[1] = mean;
+    data_out[2] = min;
+    data_out[3] = sqrtf(sum_of_squares / (float)in_size);
+    data_out[4] = peaks;
+    data_out[5] = total;
+    data_out[6] = (float)zero_crossings / (float)(in_size - 1);
+    data_out[7] = sqrtf(sum_squares / (float)in_size);
+
+    return MLDP_SUCCESS;
+}
+
+MldpReturn_t filterMlTrainerWindow(const MlDataWindow_t *window, float *data_out, const int out_size) {
+    if (windowSize(window) < (MLDP_PEAKS_LAG + 2)) {
+        return MLDP_ERROR_CONFIG;
+    }
+    return filterMlTrainerWindowPeaks(window, countPeaks(window), data_out, out_size);
+}
+
+/*****************************************************************************/
+/* Contiguous buffer versions of the filters                                 */
+/*****************************************************************************/
+MldpReturn_t filterMax(const float *data_in, const int in_size, float *data_out, const int out_size) {
+    const MlDataWindow_t window = linearWindow(data_in, in_size);
+    return filterMaxWindow(&window, data_out, out_size);
+}
+
+MldpReturn_t filterMin(const float *data_in, const int in_size, float *data_out, const int out_size) {
+    const MlDataWindow_t window = linearWindow(data_in, in_size);
+    return filterMinWindow(&window, data_out, out_size);
+}
+
+MldpReturn_t filterMean(const float *data_in, const int in_size, float *data_out, const int out_size) {
+    const MlDataWindow_t window = linearWindow(data_in, in_size);
+    return filterMeanWindow(&window, data_out, out_size);
+}
+
+MldpReturn_t filterStdDev(const float *data_in, const int in_size, float *data_out, const int out_size) {
+    const MlDataWindow_t window = linearWindow(data_in, in_size);
+    return filterStdDevWindow(&window, data_out, out_size);
+}
+
+MldpReturn_t filterPeaks(const float *data_in, const int in_size, float *data_out, const int out_size) {
+    const MlDataWindow_t window = linearWindow(data_in, in_size);
+    return filterPeaksWindow(&window, data_out, out_size);
+}
+
+MldpReturn_t filterTotalAcc(const float *data_in, const int in_size, float *data_out, const int out_size) {
+    const MlDataWindow_t window = linearWindow(data_in, in_size);
+    return filterTotalAccWindow(&window, data_out, out_size);
+}
+
+MldpReturn_t filterZcr(const float *data_in, const int in_size, float *data_out, const int out_size) {
+    const MlDataWindow_t window = linearWindow(data_in, in_size);
+    return filterZcrWindow(&window, data_out, out_size);
+}
+
+MldpReturn_t filterRms(const float *data_in, const int in_size, float *data_out, const int out_size) {
+    const MlDataWindow_t window = linearWindow(data_in, in_size);
+    return filterRmsWindow(&window, data_out, out_size);
+}
+
+MldpReturn_t filterPassThrough(const float *data_in, const int in_size, float *data_out, const int out_size) {
+    const MlDataWindow_t window = linearWindow(data_in, in_size);
+    return filterPassThroughWindow(&window, data_out, out_size);
+}
+
+MldpReturn_t filterMlTrainer(const float *data_in, const int in_size, float *data_out, const int out_size) {
+    const MlDataWindow_t window = linearWindow(data_in, in_size);
+    return filterMlTrainerWindow(&window, data_out, out_size);
+}
+
+MldpWindowFilter_t mldp_getWindowFilter(MldpFilter_t filter) {
+    static const struct {
+        MldpFilter_t filter;
+        MldpWindowFilter_t window_filter;
+    } window_filters[] = {
+        {filterMax, filterMaxWindow},
+        {filterMin, filterMinWindow},
+        {filterMean, filterMeanWindow},
+        {filterStdDev, filterStdDevWindow},
+        {filterPeaks, filterPeaksWindow},
+        {filterTotalAcc, filterTotalAccWindow},
+        {filterZcr, filterZcrWindow},
+        {filterRms, filterRmsWindow},
+        {filterPassThrough, filterPassThroughWindow},
+        {filterMlTrainer, filterMlTrainerWindow},
+    };
+    for (size_t i = 0; i < sizeof(window_filters) / sizeof(window_filters[0]); i++) {
+        if (window_filters[i].filter == filter) {
+            return window_filters[i].window_filter;
+        }
+    }
+    return NULL;
+}
+
+void mldp_convertInt16(const int16_t *data_in, float *data_out, const int elements, const float divisor) {
+    // Unrolled, so that the loads, conversions and divisions of the four
+    // values can be interleaved
+    int i = 0;
+    for (; i + 4 <= elements; i += 4) {
+        const float a = (float)data_in[i];
+        const float b = (float)data_in[i + 1];
+        const float c = (float)data_in[i + 2];
+        const float d = (float)data_in[i + 3];
+        data_out[i] = a / divisor;
+        data_out[i + 1] = b / divisor;
+        data_out[i + 2] = c / divisor;
+        data_out[i + 3] = d / divisor;
+    }
+    for (; i < elements; i++) {
+        data_out[i] = (float)data_in[i] / divisor;
+    }
+}
@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -25,9 +26,69 @@ typedef enum {
     MLDP_ERROR_NOINIT = -4,
 } MldpReturn_t;
 
+// Flags to enable optional processing modes, can be combined
+typedef enum {
+    MLDP_CONFIG_NONE = 0,
+    // Keep running window statistics updated as samples are recorded, so that
+    // filterMean, filterStdDev, filterRms, filterTotalAcc and filterZcr are
+    // calculated in constant time, instead of iterating through the window.
+    // Not valid with MLDP_FILTER_INTERLEAVED_OUTPUT filters (e.g. the fused
+    // filterMlTrainer), which calculate all their features in one pass
+    MLDP_CONFIG_INCREMENTAL_STATS = (1 << 0),
+    // Allocate space for two windows, so that a window can be frozen with
+    // snapshot() and processed while new samples are still being recorded
+    MLDP_CONFIG_DOUBLE_BUFFER = (1 << 1),
+    // Run the filterPeaks detector as samples are recorded, so that the peak
+    // count of the window (from filterPeaks or filterMlTrainer) is available
+    // without running the detector through the whole window
+    MLDP_CONFIG_STREAMING_PEAKS = (1 << 2),
+    // Keep the samples that can become the window maximum or minimum in
+    // monotonic queues as they are recorded, so that filterMax and filterMin
+    // are calculated in amortised constant time, with the same output.
+    // Not valid with MLDP_FILTER_INTERLEAVED_OUTPUT filters either
+    MLDP_CONFIG_INCREMENTAL_MIN_MAX = (1 << 3),
+    // Store the samples in the ring buffers as int16, in the units set by
+    // sample_scale, instead of float, halving the memory used by the window.
+    // The recorded values are rounded to those units, the window is
+    // converted back to float for the filters
+    MLDP_CONFIG_INT16_SAMPLES = (1 << 4),
+    // Track, as samples are recorded, how long every dimension has stayed
+    // within a band of activity_threshold, so that isIdle() can tell if the
+    // window processed last and all the samples since are idle, and running
+    // the filters and the model again can be skipped
+    MLDP_CONFIG_ACTIVITY_GATE = (1 << 5),
+} MldpConfigFlags_t;
+
+// Flags to describe the filter output, can be combined
+typedef enum {
+    MLDP_FILTER_NONE = 0,
+    // The filter produces out_size different features, instead of an
+    // out_size array for a single feature. The processor places each feature
+    // next to the same feature from the other dimensions, so the output has
+    // the same order as using out_size filters with an out_size of 1
+    MLDP_FILTER_INTERLEAVED_OUTPUT = (1 << 0),
+} MldpFilterFlags_t;
+
+/**
+ * A window of samples from a ring buffer, split in two contiguous spans.
+ * The oldest sample is the first element of head, and it continues until the
+ * last element of tail (which can be empty).
+ */
+typedef struct {
+    const float *head;
+    int head_size;
+    const float *tail;
+    int tail_size;
+} MlDataWindow_t;
+
+typedef MldpReturn_t (*MldpFilter_t)(const float *data_in, const int in_size, float *data_out, const int out_size);
+typedef MldpReturn_t (*MldpWindowFilter_t)(const MlDataWindow_t *window, float *data_out, const int out_size);
+
 typedef struct {
     const int out_size;
-    MldpReturn_t (*filter)(const float *data_in, const int in_size, float *data_out, const int out_size);
+    MldpFilter_t filter;
+    const int flags;                    // Optional MldpFilterFlags_t values
+    MldpWindowFilter_t window_filter;   // Optional, reads the window directly instead of a copy
 } MlDataFilters_t;
 
 typedef struct {
@@ -36,8 +97,19 @@ typedef struct {
     const int output_length;    // Expected number elements produced by the processed output, depends on filters
     const int filter_size;      // How many filters in the *filters array
     const MlDataFilters_t *filters;
+    const int flags;            // Optional MldpConfigFlags_t values
+    // Optional, one per dimension, the int16 units in 1.0 of the float
+    // samples (e.g. 1000 for accelerometer samples in milli-g), for
+    // MLDP_CONFIG_INT16_SAMPLES and recordDataInt16(). NULL for 1
+    const float *sample_scale;
+    // Optional, width of the band (in float sample units) the samples must
+    // stay within to be idle, for MLDP_CONFIG_ACTIVITY_GATE
+    const float activity_threshold;
 } MlDataProcessorConfig_t;
 
+// Alignment required for the memory provided to initArena()
+#define MLDP_ARENA_ALIGNMENT 8
+
 typedef struct {
     MldpReturn_t (*init)(const MlDataProcessorConfig_t *config);
     void (*deinit)(void);
@@ -45,6 +117,28 @@ typedef struct {
     bool (*isDataReady)(void);
     float* (*getProcessedData)(void);
     size_t (*getProcessedDataSize)(void);
+    // Optional, freeze the current window so that getProcessedData() uses it
+    // until commit() is called, while recordData() continues recording
+    MldpReturn_t (*snapshot)(void);
+    void (*commit)(void);
+    // Optional, number of bytes initArena() needs for a configuration, or 0
+    // if the configuration is invalid
+    size_t (*getArenaSize)(const MlDataProcessorConfig_t *config);
+    // Optional, same as init() but without any heap allocations, all buffers
+    // are placed in the arena provided, which must be MLDP_ARENA_ALIGNMENT
+    // aligned and remain valid until deinit()
+    MldpReturn_t (*initArena)(const MlDataProcessorConfig_t *config, void *arena, const size_t arena_size);
+    // Optional, same as getProcessedData() but the output is written to the
+    // data_out buffer provided (e.g. the model input tensor), which must
+    // have getProcessedDataSize() elements
+    MldpReturn_t (*writeProcessedData)(float *data_out, const size_t out_len);
+    // Optional, same as recordData() for raw int16 samples, each value is
+    // divided by the sample_scale of its dimension
+    MldpReturn_t (*recordDataInt16)(const int16_t *samples, const int elements);
+    // Optional, true if the last window processed and all the samples
+    // recorded since stay within the activity threshold, so the processed
+    // data (and the model output) would be practically the same
+    bool (*isIdle)(void);
 } MlDataProcessor_t;
 
 extern MlDataProcessor_t mlDataProcessor;
@@ -59,6 +153,93 @@ MldpReturn_t filterZcr(const float *data_in, const int in_size, float *data_out,
 MldpReturn_t filterRms(const float *data_in, const int in_size, float *data_out, const int out_size);
 MldpReturn_t filterPassThrough(const float *data_in, const int in_size, float *data_out, const int out_size);
 
+// Number of features produced by filterMlTrainer()
+#define MLDP_ML_TRAINER_FEATURES 8
+
+/**
+ * @brief Calculates all the ML-Trainer features in a single pass through the
+ * data (except for Standard Deviation and Peaks, which need a second pass).
+ *
+ * The output is bit-identical to running filterMax, filterMean, filterMin,
+ * filterStdDev, filterPeaks, filterTotalAcc, filterZcr and filterRms, in that
+ * order. It should be configured with out_size MLDP_ML_TRAINER_FEATURES and
+ * the MLDP_FILTER_INTERLEAVED_OUTPUT flag.
+ */
+MldpReturn_t filterMlTrainer(const float *data_in, const int in_size, float *data_out, const int out_size);
+
+// Window versions of the filters, with the same output as the filters above
+MldpReturn_t filterMaxWindow(const MlDataWindow_t *window, float *data_out, const int out_size);
+MldpReturn_t filterMinWindow(const MlDataWindow_t *window, float *data_out, const int out_size);
+MldpReturn_t filterMeanWindow(const MlDataWindow_t *window, float *data_out, const int out_size);
+MldpReturn_t filterStdDevWindow(const MlDataWindow_t *window, float *data_out, const int out_size);
+MldpReturn_t filterPeaksWindow(const MlDataWindow_t *window, float *data_out, const int out_size);
+MldpReturn_t filterTotalAccWindow(const MlDataWindow_t *window, float *data_out, const int out_size);
+MldpReturn_t filterZcrWindow(const MlDataWindow_t *window, float *data_out, const int out_size);
+MldpReturn_t filterRmsWindow(const MlDataWindow_t *window, float *data_out, const int out_size);
+MldpReturn_t filterPassThroughWindow(const MlDataWindow_t *window, float *data_out, const int out_size);
+MldpReturn_t filterMlTrainerWindow(const MlDataWindow_t *window, float *data_out, const int out_size);
+
+/**
+ * @brief Get the window version of one of the filters included in this file.
+ *
+ * Data processors use this to read their ring buffers directly when a
+ * configured filter doesn't set its window_filter.
+ *
+ * @param filter The contiguous buffer version of a filter.
+ * @return The window version of the filter, or NULL if there isn't one.
+ */
+MldpWindowFilter_t mldp_getWindowFilter(MldpFilter_t filter);
+
+/**
+ * @brief Calculates the ML-Trainer features with a peak count calculated
+ * elsewhere (e.g. by a streaming peak detector), instead of running the peak
+ * detection through the window.
+ */
+MldpReturn_t filterMlTrainerWindowPeaks(const MlDataWindow_t *window, const int peaks, float *data_out, const int out_size);
+
+/**
+ * @brief Convert raw int16 sensor samples to float, so that a batch of
+ * samples can be recorded with a single recordData() call.
+ *
+ * Each value is divided by the divisor (e.g. 1000 for the accelerometer
+ * milli-g), instead of multiplied by its inverse, so that the result is the
+ * same as converting the samples one by one.
+ */
+void mldp_convertInt16(const int16_t *data_in, float *data_out, const int elements, const float divisor);
+
+// Number of filtered values used for the peak detection mean and deviation
+#define MLDP_PEAKS_LAG 5
+
+/**
+ * State of the peak detection algorithm used by filterPeaks(), so that it can
+ * be run one value at a time.
+ * The detector compares each value against the mean and standard deviation of
+ * the previous filtered values, the first MLDP_PEAKS_LAG values are only used
+ * to initialise it.
+ */
+typedef struct {
+    // Circular buffer with the latest filtered values
+    float filtered[MLDP_PEAKS_LAG + 1];
+    // Position in filtered for the next value
+    int index;
+    // How many values have been added since the last reset, up to
+    // MLDP_PEAKS_LAG + 1
+    int count;
+    // Signal of the latest value, +1 for a positive peak, -1 for a negative
+    // peak, or 0 for no peak
+    int signal;
+} MldpPeakDetector_t;
+
+void mldp_peakDetectorReset(MldpPeakDetector_t *detector);
+
+/**
+ * @brief Add the next value to the peak detector.
+ *
+ * @param filtered Optional, set to the filtered value stored for this value.
+ * @return True if this value starts a new positive peak.
+ */
+bool mldp_peakDetectorAdd(MldpPeakDetector_t *detector, const float value, float *filtered);
+
 #ifdef __cplusplus
 }
 #endif
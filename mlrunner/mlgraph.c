@@ -0,0 +1,356 @@
+/**
+ * @brief Interpreter for serialised layer graph models.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ */
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "mlgraph.h"
+#include "mlkernels.h"
+
+/*****************************************************************************/
+/* Private API                                                               */
+/*****************************************************************************/
+/**
+ * @return True if the range of elements of element_size bytes at offset is
+ *         inside a buffer of size bytes, and aligned to the element size
+ *         (always 4 bytes for tensors).
+ */
+static inline bool is_range_valid(
+    const uint32_t offset, const uint64_t elements, const uint32_t element_size, const uint32_t size
+) {
+    return (offset & (element_size - 1)) == 0 && (uint64_t)offset + elements * element_size <= size;
+}
+
+static inline uint32_t element_size(const mlgraph_header_t *model) {
+    return model->data_type == MLGRAPH_TYPE_INT8 ? sizeof(int8_t) : sizeof(float);
+}
+
+static inline bool is_quantization_valid(const float scale, const int32_t zero_point) {
+    // Also false for NaN
+    return scale > 0.0f && scale < INFINITY && zero_point >= INT8_MIN && zero_point <= INT8_MAX;
+}
+
+static inline bool is_overlapping(const uint32_t a, const uint64_t a_size, const uint32_t b, const uint64_t b_size) {
+    return a < b + b_size && b < a + a_size;
+}
+
+static bool is_valid_header(const mlgraph_header_t *model) {
+    if (model == NULL || model->magic0 != MLGRAPH_MAGIC0) {
+        return false;
+    }
+    if (model->header_size < sizeof(mlgraph_header_t) || (model->header_size & 3) != 0 ||
+            model->num_layers == 0 || model->arena_bytes == 0) {
+        return false;
+    }
+    if (model->data_type != MLGRAPH_TYPE_FLOAT32 && model->data_type != MLGRAPH_TYPE_INT8) {
+        return false;
+    }
+    const uint64_t layers_end = model->header_size + (uint64_t)model->num_layers * sizeof(mlgraph_layer_t);
+    if (layers_end > model->object_size) {
+        return false;
+    }
+    return model->input_length != 0 && model->output_length != 0 && (model->input_offset & 3) == 0 &&
+           (model->output_offset & 3) == 0 &&
+           is_range_valid(model->input_offset, model->input_length, element_size(model), model->arena_bytes) &&
+           is_range_valid(model->output_offset, model->output_length, element_size(model), model->arena_bytes);
+}
+
+static bool is_valid_layer(const mlgraph_header_t *model, const mlgraph_layer_t *layer) {
+    if (layer->in_length == 0 || layer->in_channels == 0 || layer->out_length == 0 || layer->out_channels == 0) {
+        return false;
+    }
+    if (layer->activation > MLGRAPH_ACTIVATION_SOFTMAX) {
+        return false;
+    }
+    const uint32_t size = element_size(model);
+    const uint64_t in_elements = (uint64_t)layer->in_length * layer->in_channels;
+    const uint64_t out_elements = (uint64_t)layer->out_length * layer->out_channels;
+    if ((layer->input_offset & 3) != 0 || (layer->output_offset & 3) != 0 ||
+            !is_range_valid(layer->input_offset, in_elements, size, model->arena_bytes) ||
+            !is_range_valid(layer->output_offset, out_elements, size, model->arena_bytes)) {
+        return false;
+    }
+
+    // Windowed layers need every window to start inside the padded input
+    const bool windowed = layer->type == MLGRAPH_LAYER_CONV1D ||
+                          layer->type == MLGRAPH_LAYER_MAX_POOL1D ||
+                          layer->type == MLGRAPH_LAYER_AVG_POOL1D;
+    if (windowed && (layer->kernel_size == 0 || layer->stride == 0 ||
+            (uint64_t)(layer->out_length - 1) * layer->stride >= (uint64_t)layer->in_length + layer->padding)) {
+        return false;
+    }
+
+    uint64_t weights = 0;
+    switch (layer->type) {
+        case MLGRAPH_LAYER_DENSE:
+            if (layer->out_length != layer->in_length) {
+                return false;
+            }
+            weights = (uint64_t)layer->out_channels * layer->in_channels;
+            break;
+        case MLGRAPH_LAYER_CONV1D:
+            weights = (uint64_t)layer->out_channels * layer->kernel_size * layer->in_channels;
+            break;
+        case MLGRAPH_LAYER_MAX_POOL1D:
+        case MLGRAPH_LAYER_AVG_POOL1D:
+            if (layer->out_channels != layer->in_channels) {
+                return false;
+            }
+            break;
+        case MLGRAPH_LAYER_GLOBAL_AVG_POOL1D:
+            if (layer->out_length != 1 || layer->out_channels != layer->in_channels) {
+                return false;
+            }
+            break;
+        case MLGRAPH_LAYER_ACTIVATION:
+            if (layer->out_length != layer->in_length || layer->out_channels != layer->in_channels) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+    }
+    if (weights != 0) {
+        // The bias is float or int32, so always 4 bytes
+        if (layer->weights_offset == 0 ||
+                !is_range_valid(layer->weights_offset, weights, size, model->object_size)) {
+            return false;
+        }
+        if (layer->bias_offset != 0 &&
+                !is_range_valid(layer->bias_offset, layer->out_channels, sizeof(int32_t), model->object_size)) {
+            return false;
+        }
+    }
+
+    if (model->data_type == MLGRAPH_TYPE_INT8) {
+        if (!is_quantization_valid(layer->input_scale, layer->input_zero_point) ||
+                !is_quantization_valid(layer->output_scale, layer->output_zero_point)) {
+            return false;
+        }
+        if (weights != 0 && (!is_quantization_valid(layer->weights_scale, 0) ||
+                layer->activation > MLGRAPH_ACTIVATION_RELU)) {
+            return false;
+        }
+        // The int8 pooling kernels don't change the quantization
+        if (layer->type != MLGRAPH_LAYER_ACTIVATION && weights == 0 &&
+                (layer->activation != MLGRAPH_ACTIVATION_NONE || layer->input_scale != layer->output_scale ||
+                 layer->input_zero_point != layer->output_zero_point)) {
+            return false;
+        }
+    }
+
+    // Only an activation can run in place, and then it has to be exactly in place
+    if (layer->type == MLGRAPH_LAYER_ACTIVATION && layer->input_offset == layer->output_offset) {
+        return true;
+    }
+    return !is_overlapping(layer->input_offset, in_elements * size, layer->output_offset, out_elements * size);
+}
+
+static void run_activation(const uint32_t activation, float *data, const uint32_t length, const uint32_t channels) {
+    const size_t elements = (size_t)length * channels;
+    switch (activation) {
+        case MLGRAPH_ACTIVATION_RELU:
+            mlk_relu(data, elements);
+            break;
+        case MLGRAPH_ACTIVATION_SIGMOID:
+            mlk_sigmoid(data, elements);
+            break;
+        case MLGRAPH_ACTIVATION_TANH:
+            mlk_tanh(data, elements);
+            break;
+        case MLGRAPH_ACTIVATION_SOFTMAX:
+            for (uint32_t p = 0; p < length; p++) {
+                mlk_softmax(data + (size_t)p * channels, channels);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void run_layer(const mlgraph_header_t *model, const mlgraph_layer_t *layer, uint8_t *arena) {
+    const float *input = (const float *)(arena + layer->input_offset);
+    float *output = (float *)(arena + layer->output_offset);
+    const float *weights = (const float *)((const uint8_t *)model + layer->weights_offset);
+    const float *bias = layer->bias_offset ? (const float *)((const uint8_t *)model + layer->bias_offset) : NULL;
+
+    switch (layer->type) {
+        case MLGRAPH_LAYER_DENSE:
+            for (uint32_t p = 0; p < layer->in_length; p++) {
+                mlk_dense(input + (size_t)p * layer->in_channels, weights, bias,
+                          output + (size_t)p * layer->out_channels, layer->in_channels, layer->out_channels);
+            }
+            break;
+        case MLGRAPH_LAYER_CONV1D:
+            mlk_conv1d(input, weights, bias, output, layer->in_length, layer->in_channels,
+                       layer->out_length, layer->out_channels, layer->kernel_size, layer->stride, layer->padding);
+            break;
+        case MLGRAPH_LAYER_MAX_POOL1D:
+            mlk_maxPool1d(input, output, layer->in_length, layer->in_channels,
+                          layer->out_length, layer->kernel_size, layer->stride, layer->padding);
+            break;
+        case MLGRAPH_LAYER_AVG_POOL1D:
+            mlk_avgPool1d(input, output, layer->in_length, layer->in_channels,
+                          layer->out_length, layer->kernel_size, layer->stride, layer->padding);
+            break;
+        case MLGRAPH_LAYER_GLOBAL_AVG_POOL1D:
+            mlk_globalAvgPool1d(input, output, layer->in_length, layer->in_channels);
+            break;
+        case MLGRAPH_LAYER_ACTIVATION:
+            if (output != input) {
+                memcpy(output, input, (size_t)layer->in_length * layer->in_channels * sizeof(float));
+            }
+            break;
+        default:
+            return;
+    }
+    run_activation(layer->activation, output, layer->out_length, layer->out_channels);
+}
+
+/**
+ * @brief The int8 activations are calculated in float, from the input to the
+ * output quantization, so they can run in place.
+ */
+static void run_activation_int8(const mlgraph_layer_t *layer, const int8_t *input, int8_t *output) {
+    const size_t elements = (size_t)layer->out_length * layer->out_channels;
+    const float in_scale = layer->input_scale, out_scale = layer->output_scale;
+    const int32_t in_zero = layer->input_zero_point, out_zero = layer->output_zero_point;
+    if (layer->activation == MLGRAPH_ACTIVATION_SOFTMAX) {
+        for (uint32_t p = 0; p < layer->out_length; p++) {
+            const int8_t *in = input + (size_t)p * layer->out_channels;
+            int8_t *out = output + (size_t)p * layer->out_channels;
+            int8_t max = in[0];
+            for (uint32_t c = 1; c < layer->out_channels; c++) {
+                if (in[c] > max) {
+                    max = in[c];
+                }
+            }
+            float sum = 0.0f;
+            for (uint32_t c = 0; c < layer->out_channels; c++) {
+                sum += expf(in_scale * (float)(in[c] - max));
+            }
+            for (uint32_t c = 0; c < layer->out_channels; c++) {
+                const float value = expf(in_scale * (float)(in[c] - max)) / sum;
+                out[c] = (int8_t)mlk_saturate(value / out_scale + (float)out_zero, INT8_MIN, INT8_MAX);
+            }
+        }
+        return;
+    }
+    for (size_t i = 0; i < elements; i++) {
+        float value = in_scale * (float)(input[i] - in_zero);
+        switch (layer->activation) {
+            case MLGRAPH_ACTIVATION_RELU:
+                value = value > 0.0f ? value : 0.0f;
+                break;
+            case MLGRAPH_ACTIVATION_SIGMOID:
+                value = 1.0f / (1.0f + expf(-value));
+                break;
+            case MLGRAPH_ACTIVATION_TANH:
+                value = tanhf(value);
+                break;
+            default:
+                break;
+        }
+        output[i] = (int8_t)mlk_saturate(value / out_scale + (float)out_zero, INT8_MIN, INT8_MAX);
+    }
+}
+
+static void run_layer_int8(const mlgraph_header_t *model, const mlgraph_layer_t *layer, uint8_t *arena) {
+    const int8_t *input = (const int8_t *)(arena + layer->input_offset);
+    int8_t *output = (int8_t *)(arena + layer->output_offset);
+    const int8_t *weights = (const int8_t *)((const uint8_t *)model + layer->weights_offset);
+    const int32_t *bias = layer->bias_offset ? (const int32_t *)((const uint8_t *)model + layer->bias_offset) : NULL;
+    const mlk_int8_params_t params = {
+        .input_zero_point = layer->input_zero_point,
+        .output_zero_point = layer->output_zero_point,
+        .multiplier = layer->input_scale * layer->weights_scale / layer->output_scale,
+        .output_min = layer->activation == MLGRAPH_ACTIVATION_RELU ? layer->output_zero_point : INT8_MIN,
+        .output_max = INT8_MAX,
+    };
+
+    switch (layer->type) {
+        case MLGRAPH_LAYER_DENSE:
+            for (uint32_t p = 0; p < layer->in_length; p++) {
+                mlk_denseInt8(input + (size_t)p * layer->in_channels, weights, bias,
+                              output + (size_t)p * layer->out_channels, layer->in_channels, layer->out_channels,
+                              &params);
+            }
+            break;
+        case MLGRAPH_LAYER_CONV1D:
+            mlk_conv1dInt8(input, weights, bias, output, layer->in_length, layer->in_channels,
+                           layer->out_length, layer->out_channels, layer->kernel_size, layer->stride,
+                           layer->padding, &params);
+            break;
+        case MLGRAPH_LAYER_MAX_POOL1D:
+            mlk_maxPool1dInt8(input, output, layer->in_length, layer->in_channels,
+                              layer->out_length, layer->kernel_size, layer->stride, layer->padding);
+            break;
+        case MLGRAPH_LAYER_AVG_POOL1D:
+            mlk_avgPool1dInt8(input, output, layer->in_length, layer->in_channels,
+                              layer->out_length, layer->kernel_size, layer->stride, layer->padding);
+            break;
+        case MLGRAPH_LAYER_GLOBAL_AVG_POOL1D:
+            mlk_globalAvgPool1dInt8(input, output, layer->in_length, layer->in_channels);
+            break;
+        case MLGRAPH_LAYER_ACTIVATION:
+            run_activation_int8(layer, input, output);
+            break;
+        default:
+            break;
+    }
+}
+
+/*****************************************************************************/
+/* Public API                                                                */
+/*****************************************************************************/
+int mlgraph_is_valid_model(const mlgraph_header_t *model) {
+    if (!is_valid_header(model)) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < model->num_layers; i++) {
+        if (!is_valid_layer(model, mlgraph_layer(model, i))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+const mlgraph_layer_t *mlgraph_layer(const mlgraph_header_t *model, uint32_t index) {
+    if (model == NULL || index >= model->num_layers) {
+        return NULL;
+    }
+    const mlgraph_layer_t *layers = (const mlgraph_layer_t *)((const uint8_t *)model + model->header_size);
+    return &layers[index];
+}
+
+int mlgraph_invoke_layer(const mlgraph_header_t *model, uint8_t *arena, uint32_t index) {
+    if (model == NULL || index >= model->num_layers) {
+        return -1;
+    }
+    const mlgraph_layer_t *layer = mlgraph_layer(model, index);
+    if (model->data_type == MLGRAPH_TYPE_INT8) {
+        run_layer_int8(model, layer, arena);
+    } else {
+        run_layer(model, layer, arena);
+    }
+    return 0;
+}
+
+int mlgraph_invoke(const mlgraph_header_t *model, uint8_t *arena) {
+    if (model == NULL) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < model->num_layers; i++) {
+        if (model->data_type == MLGRAPH_TYPE_INT8) {
+            run_layer_int8(model, mlgraph_layer(model, i), arena);
+        } else {
+            run_layer(model, mlgraph_layer(model, i), arena);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,134 @@
+/**
+ * @brief Interpreter for serialised layer graph models, a portable
+ * alternative to the ML4F compiled models.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * @details
+ * A graph model is a header, followed by a list of layers run in order, and
+ * the weights the layers point to. Like ML4F, each layer reads and
+ * writes tensors at fixed offsets in the arena, so no memory is allocated.
+ * The layers are run by the kernels in mlkernels.h.
+ *
+ * In int8 models all the tensors are quantized per tensor, with
+ * real = scale * (q - zero_point), so the arena and the weights are a
+ * quarter of the float model size. The weights are symmetric (zero point 0)
+ * and the bias is int32, with a scale of input_scale * weights_scale.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MLGRAPH_MAGIC0 0x48505247 /* "GRPH" */
+
+// All values are little endian.
+// All offsets and sizes are in bytes, arena offsets are from the start of
+// the arena and the weights offsets from the start of the graph header.
+// Tensors are in "channels last" order, [length][channels].
+
+// Same values as the ML4F_TYPE_* tensor types
+typedef enum mlgraph_data_type_e {
+    MLGRAPH_TYPE_FLOAT32 = 1,
+    MLGRAPH_TYPE_INT8 = 2,
+} mlgraph_data_type_t;
+
+typedef enum mlgraph_layer_type_e {
+    MLGRAPH_LAYER_DENSE = 1,            // Applied at each position, weights [out_channels][in_channels]
+    MLGRAPH_LAYER_CONV1D = 2,           // Weights [out_channels][kernel_size][in_channels]
+    MLGRAPH_LAYER_MAX_POOL1D = 3,
+    MLGRAPH_LAYER_AVG_POOL1D = 4,
+    MLGRAPH_LAYER_GLOBAL_AVG_POOL1D = 5,
+    MLGRAPH_LAYER_ACTIVATION = 6,       // Only the activation, it can run in place, and
+                                        // in int8 models it can change the quantization
+} mlgraph_layer_type_t;
+
+typedef enum mlgraph_activation_e {
+    MLGRAPH_ACTIVATION_NONE = 0,
+    MLGRAPH_ACTIVATION_RELU = 1,
+    MLGRAPH_ACTIVATION_SIGMOID = 2,
+    MLGRAPH_ACTIVATION_TANH = 3,
+    MLGRAPH_ACTIVATION_SOFTMAX = 4,     // Over the channels of each position
+} mlgraph_activation_t;
+
+typedef struct mlgraph_header {
+    uint32_t magic0;
+    uint32_t header_size;               // The layers start at this offset
+    uint32_t object_size;               // Size of the header, layers and weights
+    uint32_t arena_bytes;
+    uint32_t input_offset;
+    uint32_t input_length;              // In elements
+    uint32_t output_offset;
+    uint32_t output_length;             // In elements
+    uint32_t num_layers;
+    uint32_t data_type;                 // mlgraph_data_type_t of all tensors and weights
+    uint32_t reserved[2];
+} mlgraph_header_t;
+
+typedef struct mlgraph_layer {
+    uint32_t type;                      // mlgraph_layer_type_t
+    uint32_t activation;                // mlgraph_activation_t, applied to the output,
+                                        // int8 dense and conv1d layers only fuse ReLU
+    uint32_t input_offset;
+    uint32_t output_offset;
+    uint32_t in_length;
+    uint32_t in_channels;
+    uint32_t out_length;
+    uint32_t out_channels;
+    uint32_t kernel_size;               // Kernel or pool size
+    uint32_t stride;
+    uint32_t padding;                   // Zero positions before the input
+    uint32_t weights_offset;            // 0 for layers without weights
+    uint32_t bias_offset;               // 0 for no bias
+    // Quantization of int8 models, ignored in float models. Pooling layers
+    // keep the input quantization for the output.
+    float input_scale;
+    int32_t input_zero_point;
+    float output_scale;
+    int32_t output_zero_point;
+    float weights_scale;
+} mlgraph_layer_t;
+
+/**
+ * @brief Check the header and every layer, so that running the model only
+ * accesses the arena and the model object.
+ *
+ * @return 1 if the model is valid, 0 otherwise.
+ */
+int mlgraph_is_valid_model(const mlgraph_header_t *model);
+
+/**
+ * @return The layer at the index, or NULL if it doesn't exist.
+ */
+const mlgraph_layer_t *mlgraph_layer(const mlgraph_header_t *model, uint32_t index);
+
+/**
+ * @brief Run a single layer, the previous layers must have run already.
+ *
+ * The model is not checked, it must have been accepted by
+ * mlgraph_is_valid_model() first, as mlrunner does when adding a model.
+ *
+ * @return 0 on success, -1 if there is no model or the index is past the
+ * last layer.
+ */
+int mlgraph_invoke_layer(const mlgraph_header_t *model, uint8_t *arena, uint32_t index);
+
+/**
+ * @brief Run all the layers, from the input to the output in the arena.
+ *
+ * As with mlgraph_invoke_layer(), the model must have been checked with
+ * mlgraph_is_valid_model() first, so that each inference only runs the
+ * kernels.
+ *
+ * @return 0 on success, -1 if there is no model.
+ */
+int mlgraph_invoke(const mlgraph_header_t *model, uint8_t *arena);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,371 @@
+/**
+ * @brief Neural network kernels for the layer graph interpreter.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ */
+#include <math.h>
+#include "mlkernels.h"
+
+/*****************************************************************************/
+/* Private API                                                               */
+/*****************************************************************************/
+/**
+ * @brief Dot product of the same n input elements with rows of weights,
+ * each row starting row_stride elements after the previous one.
+ *
+ * Four rows are calculated together, so each input element is loaded once
+ * for all of them and the four sums stay in registers.
+ */
+static void dotRows(
+    const float *input, const float *weights, const size_t row_stride, const size_t n,
+    const float *bias, float *output, const size_t rows
+) {
+    size_t r = 0;
+    for (; r + 4 <= rows; r += 4) {
+        const float *w0 = weights + r * row_stride;
+        const float *w1 = w0 + row_stride;
+        const float *w2 = w1 + row_stride;
+        const float *w3 = w2 + row_stride;
+        float sum0 = bias ? bias[r] : 0.0f;
+        float sum1 = bias ? bias[r + 1] : 0.0f;
+        float sum2 = bias ? bias[r + 2] : 0.0f;
+        float sum3 = bias ? bias[r + 3] : 0.0f;
+        for (size_t i = 0; i < n; i++) {
+            const float x = input[i];
+            sum0 += w0[i] * x;
+            sum1 += w1[i] * x;
+            sum2 += w2[i] * x;
+            sum3 += w3[i] * x;
+        }
+        output[r] = sum0;
+        output[r + 1] = sum1;
+        output[r + 2] = sum2;
+        output[r + 3] = sum3;
+    }
+    for (; r < rows; r++) {
+        const float *w = weights + r * row_stride;
+        float sum = bias ? bias[r] : 0.0f;
+        for (size_t i = 0; i < n; i++) {
+            sum += w[i] * input[i];
+        }
+        output[r] = sum;
+    }
+}
+
+/**
+ * @brief Clip a window of size elements starting at position start (which
+ * can be negative due to padding) to the input length.
+ */
+static inline void clipWindow(
+    const long start, const size_t size, const size_t in_length, size_t *first, size_t *last
+) {
+    *first = start < 0 ? (size_t)(-start) : 0;
+    *last = size;
+    if (start + (long)size > (long)in_length) {
+        *last = start >= (long)in_length ? 0 : in_length - (size_t)start;
+    }
+    if (*last < *first) {
+        *last = *first;
+    }
+}
+
+/*****************************************************************************/
+/* Public API                                                                */
+/*****************************************************************************/
+void mlk_dense(
+    const float *input, const float *weights, const float *bias, float *output,
+    const size_t in_size, const size_t out_size
+) {
+    dotRows(input, weights, in_size, in_size, bias, output, out_size);
+}
+
+void mlk_conv1d(
+    const float *input, const float *weights, const float *bias, float *output,
+    const size_t in_length, const size_t in_channels, const size_t out_length, const size_t out_channels,
+    const size_t kernel_size, const size_t stride, const size_t padding
+) {
+    // The window of each output position is contiguous in the input, and so
+    // are the weights of each output channel, so it's one dot product each
+    const size_t row_stride = kernel_size * in_channels;
+    for (size_t p = 0; p < out_length; p++) {
+        const long start = (long)(p * stride) - (long)padding;
+        size_t first, last;
+        clipWindow(start, kernel_size, in_length, &first, &last);
+        float *out = output + p * out_channels;
+        if (first == last) {
+            for (size_t c = 0; c < out_channels; c++) {
+                out[c] = bias ? bias[c] : 0.0f;
+            }
+            continue;
+        }
+        dotRows(
+            input + (start + (long)first) * (long)in_channels, weights + first * in_channels,
+            row_stride, (last - first) * in_channels, bias, out, out_channels);
+    }
+}
+
+void mlk_maxPool1d(
+    const float *input, float *output, const size_t in_length, const size_t channels,
+    const size_t out_length, const size_t pool_size, const size_t stride, const size_t padding
+) {
+    for (size_t p = 0; p < out_length; p++) {
+        const long start = (long)(p * stride) - (long)padding;
+        size_t first, last;
+        clipWindow(start, pool_size, in_length, &first, &last);
+        float *out = output + p * channels;
+        if (first == last) {
+            for (size_t c = 0; c < channels; c++) {
+                out[c] = 0.0f;
+            }
+            continue;
+        }
+        const float *in = input + (start + (long)first) * (long)channels;
+        for (size_t c = 0; c < channels; c++) {
+            out[c] = in[c];
+        }
+        for (size_t k = first + 1; k < last; k++) {
+            in += channels;
+            for (size_t c = 0; c < channels; c++) {
+                if (in[c] > out[c]) {
+                    out[c] = in[c];
+                }
+            }
+        }
+    }
+}
+
+void mlk_avgPool1d(
+    const float *input, float *output, const size_t in_length, const size_t channels,
+    const size_t out_length, const size_t pool_size, const size_t stride, const size_t padding
+) {
+    for (size_t p = 0; p < out_length; p++) {
+        const long start = (long)(p * stride) - (long)padding;
+        size_t first, last;
+        clipWindow(start, pool_size, in_length, &first, &last);
+        float *out = output + p * channels;
+        for (size_t c = 0; c < channels; c++) {
+            out[c] = 0.0f;
+        }
+        if (first == last) {
+            continue;
+        }
+        const float *in = input + (start + (long)first) * (long)channels;
+        for (size_t k = first; k < last; k++) {
+            for (size_t c = 0; c < channels; c++) {
+                out[c] += in[c];
+            }
+            in += channels;
+        }
+        const float count = (float)(last - first);
+        for (size_t c = 0; c < channels; c++) {
+            out[c] /= count;
+        }
+    }
+}
+
+void mlk_globalAvgPool1d(const float *input, float *output, const size_t in_length, const size_t channels) {
+    mlk_avgPool1d(input, output, in_length, channels, 1, in_length, in_length, 0);
+}
+
+void mlk_relu(float *data, const size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] < 0.0f) {
+            data[i] = 0.0f;
+        }
+    }
+}
+
+void mlk_sigmoid(float *data, const size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        data[i] = 1.0f / (1.0f + expf(-data[i]));
+    }
+}
+
+void mlk_tanh(float *data, const size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        data[i] = tanhf(data[i]);
+    }
+}
+
+void mlk_softmax(float *data, const size_t len) {
+    if (len == 0) {
+        return;
+    }
+    // Subtracting the max keeps expf() in range without changing the result
+    float max = data[0];
+    for (size_t i = 1; i < len; i++) {
+        if (data[i] > max) {
+            max = data[i];
+        }
+    }
+    float sum = 0.0f;
+    for (size_t i = 0; i < len; i++) {
+        data[i] = expf(data[i] - max);
+        sum += data[i];
+    }
+    for (size_t i = 0; i < len; i++) {
+        data[i] /= sum;
+    }
+}
+
+/*****************************************************************************/
+/* int8 kernels                                                              */
+/*****************************************************************************/
+static inline int8_t requantize(const int32_t acc, const mlk_int8_params_t *params) {
+    return (int8_t)mlk_saturate(
+        (float)acc * params->multiplier + (float)params->output_zero_point, params->output_min, params->output_max);
+}
+
+/**
+ * @brief The int8 version of dotRows(), subtracting the input zero point
+ * once per input element for the four rows.
+ */
+static void dotRowsInt8(
+    const int8_t *input, const int8_t *weights, const size_t row_stride, const size_t n,
+    const int32_t *bias, int8_t *output, const size_t rows, const mlk_int8_params_t *params
+) {
+    const int32_t zero_point = params->input_zero_point;
+    size_t r = 0;
+    for (; r + 4 <= rows; r += 4) {
+        const int8_t *w0 = weights + r * row_stride;
+        const int8_t *w1 = w0 + row_stride;
+        const int8_t *w2 = w1 + row_stride;
+        const int8_t *w3 = w2 + row_stride;
+        int32_t sum0 = bias ? bias[r] : 0;
+        int32_t sum1 = bias ? bias[r + 1] : 0;
+        int32_t sum2 = bias ? bias[r + 2] : 0;
+        int32_t sum3 = bias ? bias[r + 3] : 0;
+        for (size_t i = 0; i < n; i++) {
+            const int32_t x = (int32_t)input[i] - zero_point;
+            sum0 += w0[i] * x;
+            sum1 += w1[i] * x;
+            sum2 += w2[i] * x;
+            sum3 += w3[i] * x;
+        }
+        output[r] = requantize(sum0, params);
+        output[r + 1] = requantize(sum1, params);
+        output[r + 2] = requantize(sum2, params);
+        output[r + 3] = requantize(sum3, params);
+    }
+    for (; r < rows; r++) {
+        const int8_t *w = weights + r * row_stride;
+        int32_t sum = bias ? bias[r] : 0;
+        for (size_t i = 0; i < n; i++) {
+            sum += w[i] * ((int32_t)input[i] - zero_point);
+        }
+        output[r] = requantize(sum, params);
+    }
+}
+
+void mlk_denseInt8(
+    const int8_t *input, const int8_t *weights, const int32_t *bias, int8_t *output,
+    const size_t in_size, const size_t out_size, const mlk_int8_params_t *params
+) {
+    dotRowsInt8(input, weights, in_size, in_size, bias, output, out_size, params);
+}
+
+void mlk_conv1dInt8(
+    const int8_t *input, const int8_t *weights, const int32_t *bias, int8_t *output,
+    const size_t in_length, const size_t in_channels, const size_t out_length, const size_t out_channels,
+    const size_t kernel_size, const size_t stride, const size_t padding, const mlk_int8_params_t *params
+) {
+    const size_t row_stride = kernel_size * in_channels;
+    for (size_t p = 0; p < out_length; p++) {
+        const long start = (long)(p * stride) - (long)padding;
+        size_t first, last;
+        clipWindow(start, kernel_size, in_length, &first, &last);
+        int8_t *out = output + p * out_channels;
+        if (first == last) {
+            for (size_t c = 0; c < out_channels; c++) {
+                out[c] = requantize(bias ? bias[c] : 0, params);
+            }
+            continue;
+        }
+        dotRowsInt8(
+            input + (start + (long)first) * (long)in_channels, weights + first * in_channels,
+            row_stride, (last - first) * in_channels, bias, out, out_channels, params);
+    }
+}
+
+void mlk_maxPool1dInt8(
+    const int8_t *input, int8_t *output, const size_t in_length, const size_t channels,
+    const size_t out_length, const size_t pool_size, const size_t stride, const size_t padding
+) {
+    for (size_t p = 0; p < out_length; p++) {
+        const long start = (long)(p * stride) - (long)padding;
+        size_t first, last;
+        clipWindow(start, pool_size, in_length, &first, &last);
+        int8_t *out = output + p * channels;
+        if (first == last) {
+            for (size_t c = 0; c < channels; c++) {
+                out[c] = INT8_MIN;
+            }
+            continue;
+        }
+        const int8_t *in = input + (start + (long)first) * (long)channels;
+        for (size_t c = 0; c < channels; c++) {
+            out[c] = in[c];
+        }
+        for (size_t k = first + 1; k < last; k++) {
+            in += channels;
+            for (size_t c = 0; c < channels; c++) {
+                if (in[c] > out[c]) {
+                    out[c] = in[c];
+                }
+            }
+        }
+    }
+}
+
+void mlk_avgPool1dInt8(
+    const int8_t *input, int8_t *output, const size_t in_length, const size_t channels,
+    const size_t out_length, const size_t pool_size, const size_t stride, const size_t padding
+) {
+    for (size_t p = 0; p < out_length; p++) {
+        const long start = (long)(p * stride) - (long)padding;
+        size_t first, last;
+        clipWindow(start, pool_size, in_length, &first, &last);
+        int8_t *out = output + p * channels;
+        const float count = (float)(last - first);
+        const int8_t *in = input + (start + (long)first) * (long)channels;
+        for (size_t c = 0; c < channels; c++) {
+            int32_t sum = 0;
+            for (size_t k = 0; k < last - first; k++) {
+                sum += in[k * channels + c];
+            }
+            out[c] = first == last ? INT8_MIN : (int8_t)mlk_saturate((float)sum / count, INT8_MIN, INT8_MAX);
+        }
+    }
+}
+
+void mlk_globalAvgPool1dInt8(const int8_t *input, int8_t *output, const size_t in_length, const size_t channels) {
+    mlk_avgPool1dInt8(input, output, in_length, channels, 1, in_length, in_length, 0);
+}
+
+void mlk_quantizeInt8(const float *input, int8_t *output, const size_t len, const float scale, const int32_t zero_point) {
+    const float inverse_scale = 1.0f / scale;
+    for (size_t i = 0; i < len; i++) {
+        output[i] = (int8_t)mlk_saturate(input[i] * inverse_scale + (float)zero_point, INT8_MIN, INT8_MAX);
+    }
+}
+
+void mlk_quantizeUint8(const float *input, uint8_t *output, const size_t len, const float scale, const int32_t zero_point) {
+    const float inverse_scale = 1.0f / scale;
+    for (size_t i = 0; i < len; i++) {
+        output[i] = (uint8_t)mlk_saturate(input[i] * inverse_scale + (float)zero_point, 0, UINT8_MAX);
+    }
+}
+
+void mlk_dequantizeInt8(const int8_t *input, float *output, const size_t len, const float scale, const int32_t zero_point) {
+    for (size_t i = 0; i < len; i++) {
+        output[i] = scale * (float)((int32_t)input[i] - zero_point);
+    }
+}
+
+void mlk_dequantizeUint8(const uint8_t *input, float *output, const size_t len, const float scale, const int32_t zero_point) {
+    for (size_t i = 0; i < len; i++) {
+        output[i] = scale * (float)((int32_t)input[i] - zero_point);
+    }
+}
@@ -0,0 +1,152 @@
+/**
+ * @brief Neural network kernels for the layer graph interpreter.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * @details
+ * The kernels work on float tensors in "channels last" order, so element
+ * [l][c] of a tensor with C channels is at l * C + c.
+ * Every output is accumulated starting from the bias and then in input
+ * order, so the results don't depend on how a kernel is unrolled.
+ * The input and output buffers must not overlap, except for the in-place
+ * activation kernels.
+ *
+ * The int8 kernels use quantized tensors, real = scale * (q - zero_point),
+ * accumulating in int32 and converting the result to the output scale.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Fully connected layer, output[o] = bias[o] + sum(weights[o][i] * input[i]).
+ *
+ * @param input Input vector of in_size elements.
+ * @param weights Weights in [out_size][in_size] order.
+ * @param bias Bias of out_size elements, or NULL for none.
+ * @param output Output vector of out_size elements.
+ * @param in_size Number of input elements.
+ * @param out_size Number of output elements.
+ */
+void mlk_dense(
+    const float *input, const float *weights, const float *bias, float *output,
+    const size_t in_size, const size_t out_size
+);
+
+/**
+ * @brief 1D convolution, the input positions outside of the input are zero.
+ *
+ * @param input Input tensor of [in_length][in_channels] elements.
+ * @param weights Weights in [out_channels][kernel_size][in_channels] order.
+ * @param bias Bias of out_channels elements, or NULL for none.
+ * @param output Output tensor of [out_length][out_channels] elements.
+ * @param padding Number of zero positions before the input.
+ */
+void mlk_conv1d(
+    const float *input, const float *weights, const float *bias, float *output,
+    const size_t in_length, const size_t in_channels, const size_t out_length, const size_t out_channels,
+    const size_t kernel_size, const size_t stride, const size_t padding
+);
+
+/**
+ * @brief 1D max pooling, windows are clipped to the input.
+ */
+void mlk_maxPool1d(
+    const float *input, float *output, const size_t in_length, const size_t channels,
+    const size_t out_length, const size_t pool_size, const size_t stride, const size_t padding
+);
+
+/**
+ * @brief 1D average pooling, windows are clipped to the input and only the
+ * input positions are averaged.
+ */
+void mlk_avgPool1d(
+    const float *input, float *output, const size_t in_length, const size_t channels,
+    const size_t out_length, const size_t pool_size, const size_t stride, const size_t padding
+);
+
+/**
+ * @brief Average of each channel over the whole input length.
+ */
+void mlk_globalAvgPool1d(const float *input, float *output, const size_t in_length, const size_t channels);
+
+/**
+ * @brief In-place activation functions over len elements.
+ */
+void mlk_relu(float *data, const size_t len);
+void mlk_sigmoid(float *data, const size_t len);
+void mlk_tanh(float *data, const size_t len);
+void mlk_softmax(float *data, const size_t len);
+
+/**
+ * @brief Parameters of the int8 dense and convolution kernels.
+ * The weights are symmetric (zero point 0), and the bias is int32 with a
+ * scale of input_scale * weights_scale and zero point 0.
+ */
+typedef struct mlk_int8_params_s {
+    int32_t input_zero_point;
+    int32_t output_zero_point;
+    float multiplier;                   // input_scale * weights_scale / output_scale
+    int32_t output_min;                 // output_zero_point for a fused ReLU, otherwise -128
+    int32_t output_max;
+} mlk_int8_params_t;
+
+void mlk_denseInt8(
+    const int8_t *input, const int8_t *weights, const int32_t *bias, int8_t *output,
+    const size_t in_size, const size_t out_size, const mlk_int8_params_t *params
+);
+
+/**
+ * @brief The padding positions are the input zero point, so they are zero.
+ */
+void mlk_conv1dInt8(
+    const int8_t *input, const int8_t *weights, const int32_t *bias, int8_t *output,
+    const size_t in_length, const size_t in_channels, const size_t out_length, const size_t out_channels,
+    const size_t kernel_size, const size_t stride, const size_t padding, const mlk_int8_params_t *params
+);
+
+/**
+ * @brief The int8 pooling kernels keep the input scale and zero point.
+ */
+void mlk_maxPool1dInt8(
+    const int8_t *input, int8_t *output, const size_t in_length, const size_t channels,
+    const size_t out_length, const size_t pool_size, const size_t stride, const size_t padding
+);
+void mlk_avgPool1dInt8(
+    const int8_t *input, int8_t *output, const size_t in_length, const size_t channels,
+    const size_t out_length, const size_t pool_size, const size_t stride, const size_t padding
+);
+void mlk_globalAvgPool1dInt8(const int8_t *input, int8_t *output, const size_t in_length, const size_t channels);
+
+/**
+ * @brief Convert between float and quantized tensors, the quantized values
+ * are rounded to the nearest and saturated.
+ */
+void mlk_quantizeInt8(const float *input, int8_t *output, const size_t len, const float scale, const int32_t zero_point);
+void mlk_quantizeUint8(const float *input, uint8_t *output, const size_t len, const float scale, const int32_t zero_point);
+void mlk_dequantizeInt8(const int8_t *input, float *output, const size_t len, const float scale, const int32_t zero_point);
+void mlk_dequantizeUint8(const uint8_t *input, float *output, const size_t len, const float scale, const int32_t zero_point);
+
+/**
+ * @brief Round to the nearest integer and saturate to [min, max].
+ */
+static inline int32_t mlk_saturate(const float value, const int32_t min, const int32_t max) {
+    if (!(value > (float)min)) {
+        return min;
+    }
+    if (value >= (float)max) {
+        return max;
+    }
+    return (int32_t)(value + (value >= 0.0f ? 0.5f : -0.5f));
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,47 @@
+#include <string.h>
+#include "mlqueue.h"
+
+#if (MLQUEUE_CAPACITY & (MLQUEUE_CAPACITY - 1)) != 0
+#error "MLQUEUE_CAPACITY must be a power of 2"
+#endif
+
+// On the Cortex-M4 the aligned 32-bit loads and stores are atomic, these
+// add the barriers so that the samples are written before the position
+// that makes them visible to the other side
+#define LOAD_ACQUIRE(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+
+void mlqueue_init(MlSampleQueue_t *queue) {
+    memset(queue, 0, sizeof(*queue));
+}
+
+bool mlqueue_push(MlSampleQueue_t *queue, const MlSample_t *sample) {
+    const uint32_t head = queue->head;
+    const uint32_t queued = head - LOAD_ACQUIRE(&queue->tail);
+    if (queued >= MLQUEUE_CAPACITY) {
+        return false;
+    }
+    queue->samples[head & (MLQUEUE_CAPACITY - 1)] = *sample;
+    STORE_RELEASE(&queue->head, head + 1);
+    if (queued + 1 > queue->high_water) {
+        queue->high_water = queued + 1;
+    }
+    return true;
+}
+
+size_t mlqueue_pop(MlSampleQueue_t *queue, MlSample_t *out, const size_t max) {
+    const uint32_t tail = queue->tail;
+    size_t len = LOAD_ACQUIRE(&queue->head) - tail;
+    if (len > max) {
+        len = max;
+    }
+    for (size_t i = 0; i < len; i++) {
+        out[i] = queue->samples[(tail + i) & (MLQUEUE_CAPACITY - 1)];
+    }
+    STORE_RELEASE(&queue->tail, tail + (uint32_t)len);
+    return len;
+}
+
+size_t mlqueue_len(const MlSampleQueue_t *queue) {
+    return LOAD_ACQUIRE(&queue->head) - LOAD_ACQUIRE(&queue->tail);
+}
@@ -0,0 +1,81 @@
+/**
+ * @brief Lock-free single producer, single consumer queue of timestamped
+ * sensor samples, to read the samples on time independently of the model.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * @details
+ * The producer (the sample timer handler, which can run in an interrupt)
+ * only calls mlqueue_push(), and the consumer (the fiber recording the
+ * samples and running the model) only calls mlqueue_pop(). Each position is
+ * written by one side only and published with release/acquire ordering, so
+ * no locks or disabled interrupts are needed.
+ *
+ * When the consumer falls behind and the queue is full, the new samples are
+ * dropped instead of blocking the producer, and the producer counts them,
+ * e.g. in the MLSTATS_SAMPLES_DROPPED counter.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Number of samples the queue can hold, it must be a power of 2
+#ifndef MLQUEUE_CAPACITY
+#define MLQUEUE_CAPACITY 32
+#endif
+
+#define MLQUEUE_MAX_DIMENSIONS 3
+
+typedef struct MlSample_s {
+    uint32_t time_us;                       // When the sample was taken
+    int16_t value[MLQUEUE_MAX_DIMENSIONS];  // Sensor values, e.g. in milli-g
+} MlSample_t;
+
+typedef struct MlSampleQueue_s {
+    MlSample_t samples[MLQUEUE_CAPACITY];
+    // Free running positions, only masked to access the samples
+    uint32_t head;                          // Written by the producer only
+    uint32_t tail;                          // Written by the consumer only
+    // Backpressure statistic, written by the producer only
+    uint32_t high_water;                    // Most samples queued at once
+} MlSampleQueue_t;
+
+/**
+ * @brief Empty the queue and clear its statistics, while neither side is
+ * using it.
+ */
+void mlqueue_init(MlSampleQueue_t *queue);
+
+/**
+ * @brief Add a sample, producer side.
+ *
+ * @return True if the sample has been queued, False if the queue was full
+ *         and the sample has been dropped.
+ */
+bool mlqueue_push(MlSampleQueue_t *queue, const MlSample_t *sample);
+
+/**
+ * @brief Take the oldest samples, consumer side.
+ *
+ * @param out Where to copy the samples to.
+ * @param max Maximum number of samples to take.
+ * @return The number of samples taken, 0 if the queue was empty.
+ */
+size_t mlqueue_pop(MlSampleQueue_t *queue, MlSample_t *out, const size_t max);
+
+/**
+ * @return The number of samples queued, from either side.
+ */
+size_t mlqueue_len(const MlSampleQueue_t *queue);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
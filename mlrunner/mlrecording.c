@@ -0,0 +1,178 @@
+#include <string.h>
+#include "mlrecording.h"
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+#error "The recording files are read in place, only little endian is supported"
+#endif
+
+_Static_assert(sizeof(MlRecordingHeader_t) == 64, "The header layout is part of the file format");
+_Static_assert(sizeof(MlRecordingEntry_t) == 12, "The index layout is part of the file format");
+
+/*****************************************************************************/
+/* Private API                                                               */
+/*****************************************************************************/
+static inline size_t sampleSize(const MlRecording_t *recording) {
+    return recording->header.sample_type == MLRECORDING_INT16 ? sizeof(int16_t) : sizeof(float);
+}
+
+// The section must be 4 byte aligned and within the file, the sizes are
+// calculated in 64 bits so that they can't overflow
+static bool isSectionValid(const MlRecordingHeader_t *header, const uint32_t offset, const uint64_t size) {
+    return (offset % 4) == 0 && offset >= header->header_size && (uint64_t)offset + size <= header->file_size;
+}
+
+static bool isHeaderValid(const MlRecordingHeader_t *header) {
+    if (header->magic != MLRECORDING_MAGIC || header->version != MLRECORDING_VERSION ||
+            header->header_size < sizeof(MlRecordingHeader_t) || header->dimensions < 1 ||
+            header->dimensions > MLRECORDING_MAX_DIMENSIONS) {
+        return false;
+    }
+    uint64_t sample_size;
+    if (header->sample_type == MLRECORDING_FLOAT32) {
+        sample_size = sizeof(float);
+    } else if (header->sample_type == MLRECORDING_INT16) {
+        // Also rejects NaN
+        if (!(header->sample_scale > 0.0f)) {
+            return false;
+        }
+        sample_size = sizeof(int16_t);
+    } else {
+        return false;
+    }
+    return isSectionValid(header, header->labels_offset, (uint64_t)header->labels * MLRECORDING_LABEL_SIZE) &&
+           isSectionValid(header, header->index_offset, (uint64_t)header->recordings * sizeof(MlRecordingEntry_t)) &&
+           isSectionValid(header, header->samples_offset,
+                          (uint64_t)header->total_samples * header->dimensions * sample_size) &&
+           isSectionValid(header, header->features_offset,
+                          (uint64_t)header->recordings * header->features * sizeof(float)) &&
+           isSectionValid(header, header->outputs_offset,
+                          (uint64_t)header->recordings * header->outputs * sizeof(float));
+}
+
+/*****************************************************************************/
+/* Public API                                                                */
+/*****************************************************************************/
+size_t mlrecording_fileSize(const void *data) {
+    MlRecordingHeader_t header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != MLRECORDING_MAGIC || header.version != MLRECORDING_VERSION) {
+        return 0;
+    }
+    return header.file_size;
+}
+
+bool mlrecording_open(MlRecording_t *recording, const void *data, const size_t size) {
+    memset(recording, 0, sizeof(*recording));
+    if (data == NULL || ((uintptr_t)data % 4) != 0 || size < sizeof(MlRecordingHeader_t)) {
+        return false;
+    }
+    MlRecordingHeader_t header;
+    memcpy(&header, data, sizeof(header));
+    if (header.file_size > size || !isHeaderValid(&header)) {
+        return false;
+    }
+
+    // The entries are checked once here, so that reading doesn't need to
+    const uint8_t *bytes = (const uint8_t *)data;
+    const MlRecordingEntry_t *index = (const MlRecordingEntry_t *)(bytes + header.index_offset);
+    for (uint32_t i = 0; i < header.recordings; i++) {
+        if ((uint64_t)index[i].first_sample + index[i].samples > header.total_samples ||
+                (index[i].label >= header.labels && index[i].label != MLRECORDING_NO_LABEL)) {
+            return false;
+        }
+    }
+    // The label names must be null terminated
+    for (uint32_t i = 0; i < header.labels; i++) {
+        if (bytes[header.labels_offset + (i + 1) * MLRECORDING_LABEL_SIZE - 1] != '\0') {
+            return false;
+        }
+    }
+
+    recording->header = header;
+    recording->data = bytes;
+    recording->index = index;
+    return true;
+}
+
+const MlRecordingEntry_t *mlrecording_entry(const MlRecording_t *recording, const uint32_t index) {
+    if (index >= recording->header.recordings) {
+        return NULL;
+    }
+    return &recording->index[index];
+}
+
+const char *mlrecording_labelName(const MlRecording_t *recording, const uint32_t label) {
+    if (label >= recording->header.labels) {
+        return NULL;
+    }
+    return (const char *)(recording->data + recording->header.labels_offset + label * MLRECORDING_LABEL_SIZE);
+}
+
+size_t mlrecording_readSamples(
+    const MlRecording_t *recording, const uint32_t index, const uint32_t first, const size_t count, float *out
+) {
+    const MlRecordingEntry_t *entry = mlrecording_entry(recording, index);
+    if (entry == NULL || first >= entry->samples) {
+        return 0;
+    }
+    const size_t len = (entry->samples - first) < count ? entry->samples - first : count;
+    const int dimensions = recording->header.dimensions;
+    const uint8_t *samples = recording->data + recording->header.samples_offset +
+                             (size_t)entry->first_sample * dimensions * sampleSize(recording);
+
+    if (recording->header.sample_type == MLRECORDING_INT16) {
+        // Divided, not multiplied by the inverse, to get the same values as
+        // mldp_convertInt16() and the data processor
+        const float scale = recording->header.sample_scale;
+        for (int d = 0; d < dimensions; d++) {
+            const int16_t *plane = (const int16_t *)samples + (size_t)d * entry->samples + first;
+            for (size_t i = 0; i < len; i++) {
+                out[i * dimensions + d] = plane[i] / scale;
+            }
+        }
+    } else {
+        for (int d = 0; d < dimensions; d++) {
+            const float *plane = (const float *)samples + (size_t)d * entry->samples + first;
+            for (size_t i = 0; i < len; i++) {
+                out[i * dimensions + d] = plane[i];
+            }
+        }
+    }
+    return len;
+}
+
+size_t mlrecording_readSamplesInt16(
+    const MlRecording_t *recording, const uint32_t index, const uint32_t first, const size_t count, int16_t *out
+) {
+    const MlRecordingEntry_t *entry = mlrecording_entry(recording, index);
+    if (recording->header.sample_type != MLRECORDING_INT16 || entry == NULL || first >= entry->samples) {
+        return 0;
+    }
+    const size_t len = (entry->samples - first) < count ? entry->samples - first : count;
+    const int dimensions = recording->header.dimensions;
+    const int16_t *samples = (const int16_t *)(recording->data + recording->header.samples_offset) +
+                             (size_t)entry->first_sample * dimensions;
+    for (int d = 0; d < dimensions; d++) {
+        const int16_t *plane = samples + (size_t)d * entry->samples + first;
+        for (size_t i = 0; i < len; i++) {
+            out[i * dimensions + d] = plane[i];
+        }
+    }
+    return len;
+}
+
+const float *mlrecording_features(const MlRecording_t *recording, const uint32_t index) {
+    if (recording->header.features == 0 || index >= recording->header.recordings) {
+        return NULL;
+    }
+    return (const float *)(recording->data + recording->header.features_offset) +
+           (size_t)index * recording->header.features;
+}
+
+const float *mlrecording_outputs(const MlRecording_t *recording, const uint32_t index) {
+    if (recording->header.outputs == 0 || index >= recording->header.recordings) {
+        return NULL;
+    }
+    return (const float *)(recording->data + recording->header.outputs_offset) +
+           (size_t)index * recording->header.outputs;
+}
@@ -0,0 +1,153 @@
+/**
+ * @brief Binary recording files, with the sensor samples of a set of
+ * recordings and, optionally, their expected filter and model output.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * @details
+ * The file is read in place, from memory mapped flash on the device or an
+ * mmap() file on the host: mlrecording_open() only checks the header and the
+ * recording index, and the samples are converted from the file as they are
+ * read, a few at a time.
+ *
+ * File layout, all values little endian and all sections 4 byte aligned:
+ *
+ *     header       MlRecordingHeader_t
+ *     labels       labels * MLRECORDING_LABEL_SIZE bytes, null terminated
+ *     index        recordings * MlRecordingEntry_t
+ *     samples      total_samples * dimensions values of sample_type
+ *     features     recordings * features float, the expected filter output
+ *     outputs      recordings * outputs float, the expected model output
+ *
+ * The samples of each recording are planar, all the values of the first
+ * dimension, then all the values of the second one, etc. They start at
+ * first_sample * dimensions values into the samples section.
+ * MLRECORDING_INT16 samples are stored multiplied by sample_scale and
+ * rounded, e.g. the accelerometer in milli-g with a sample_scale of 1000.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MLRECORDING_MAGIC 0x43524C4D  // "MLRC"
+#define MLRECORDING_VERSION 1
+#define MLRECORDING_MAX_DIMENSIONS 8
+#define MLRECORDING_LABEL_SIZE 32
+// Label index of the recordings without a label
+#define MLRECORDING_NO_LABEL 0xFFFFFFFF
+
+typedef enum mlrecording_sample_type_e {
+    MLRECORDING_FLOAT32 = 0,
+    MLRECORDING_INT16 = 1,
+} mlrecording_sample_type_t;
+
+typedef struct MlRecordingHeader_s {
+    uint32_t magic;             // MLRECORDING_MAGIC
+    uint16_t version;           // MLRECORDING_VERSION
+    uint16_t header_size;       // sizeof(MlRecordingHeader_t)
+    uint8_t sample_type;        // mlrecording_sample_type_t
+    uint8_t dimensions;         // Values per sample, e.g. 3 for x, y, z
+    uint16_t labels;            // Number of labels, 0 if not labelled
+    uint32_t period_ms;         // Time between samples, 0 if unknown
+    uint32_t recordings;
+    uint32_t features;          // Expected filter outputs per recording, or 0
+    uint32_t outputs;           // Expected model outputs per recording, or 0
+    float sample_scale;         // MLRECORDING_INT16 value = sample * scale
+    uint32_t total_samples;     // Samples in all the recordings
+    // Byte offsets of the sections from the start of the file
+    uint32_t labels_offset;
+    uint32_t index_offset;
+    uint32_t samples_offset;
+    uint32_t features_offset;
+    uint32_t outputs_offset;
+    uint32_t file_size;
+    uint32_t reserved;
+} MlRecordingHeader_t;
+
+typedef struct MlRecordingEntry_s {
+    uint32_t first_sample;      // Samples of the recordings before this one
+    uint32_t samples;           // Number of samples in this recording
+    uint32_t label;             // Label index, or MLRECORDING_NO_LABEL
+} MlRecordingEntry_t;
+
+typedef struct MlRecording_s {
+    MlRecordingHeader_t header;
+    const uint8_t *data;
+    const MlRecordingEntry_t *index;
+} MlRecording_t;
+
+/**
+ * @brief Get the size of a recording file from its header, to open it when
+ * only its address is known (e.g. in flash).
+ *
+ * @return The file size, or 0 if data isn't a recording file.
+ */
+size_t mlrecording_fileSize(const void *data);
+
+/**
+ * @brief Check a recording file and set up the recording to read it.
+ *
+ * @param data The file, 4 byte aligned. It must remain valid while the
+ *             recording is used, nothing is copied.
+ * @param size Bytes available at data.
+ * @return False if the file is not a valid recording file, or it's larger
+ *         than size.
+ */
+bool mlrecording_open(MlRecording_t *recording, const void *data, const size_t size);
+
+/**
+ * @return The index entry of a recording, or NULL if out of range.
+ */
+const MlRecordingEntry_t *mlrecording_entry(const MlRecording_t *recording, const uint32_t index);
+
+/**
+ * @return The name of a label, or NULL if out of range.
+ */
+const char *mlrecording_labelName(const MlRecording_t *recording, const uint32_t label);
+
+/**
+ * @brief Read samples from a recording, as interleaved floats, in the same
+ * units as the original samples.
+ *
+ * @param first First sample to read.
+ * @param count Maximum number of samples to read.
+ * @param out count * dimensions floats.
+ * @return The number of samples read, less than count at the end of the
+ *         recording.
+ */
+size_t mlrecording_readSamples(
+    const MlRecording_t *recording, const uint32_t index, const uint32_t first, const size_t count, float *out);
+
+/**
+ * @brief Same as mlrecording_readSamples() for MLRECORDING_INT16 files,
+ * without converting the values, e.g. for recordDataInt16().
+ *
+ * @return The number of samples read, 0 if the file doesn't have int16
+ *         samples.
+ */
+size_t mlrecording_readSamplesInt16(
+    const MlRecording_t *recording, const uint32_t index, const uint32_t first, const size_t count, int16_t *out);
+
+/**
+ * @return The expected filter output of a recording, header.features
+ *         floats, or NULL if the file doesn't have them.
+ */
+const float *mlrecording_features(const MlRecording_t *recording, const uint32_t index);
+
+/**
+ * @return The expected model output of a recording, header.outputs floats,
+ *         or NULL if the file doesn't have them.
+ */
+const float *mlrecording_outputs(const MlRecording_t *recording, const uint32_t index);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
@@ -1,22 +1,53 @@
 
 #include <stdlib.h>
+#include <string.h>
 #include "ml4f.h"
+#include "mlgraph.h"
+#include "mlkernels.h"
 #include "mlrunner.h"
+#include "mlstats.h"
 
-// Pointer to the model in flash
+// Pointer to the selected model in flash
 static uint32_t *MODEL_ADDRESS = NULL;
-static uint8_t *model_arena = NULL;
 static size_t input_length = 0;
 static size_t output_length = 0;
 
+// Models added with ml_addModel(), only one runs at a time, so they all share
+// the same arena, sized for the model that needs the largest arena
+static const void *models[ML_MAX_MODELS];
+static int models_len = 0;
+static uint8_t *model_arena = NULL;
+static size_t model_arena_size = 0;
+static bool model_arena_owned = false;
+
 /*****************************************************************************/
 /* Private API                                                               */
 /*****************************************************************************/
 /**
- * @return True if the model header is valid, False otherwise.
+ * @brief Where the tensors of a model are in its arena, for any model format.
  */
-static bool is_model_valid(const void *model_address) {
-    ml_model_header_t *model_header = (ml_model_header_t *)model_address;
+typedef struct model_layout_s {
+    uint8_t format;
+    const void *model;          // The ML4F or graph model after the header
+    size_t arena_bytes;
+    size_t input_offset;
+    size_t input_length;
+    ml_tensor_info_t input_info;
+    size_t output_offset;
+    size_t output_length;
+    ml_tensor_info_t output_info;
+} model_layout_t;
+
+// Layout of the selected model
+static model_layout_t model_layout;
+
+/**
+ * @brief Check the model headers and get the layout of its arena.
+ *
+ * @return True if the model is valid, False otherwise.
+ */
+static bool get_model_layout(const void *model_address, model_layout_t *layout) {
+    const ml_model_header_t *model_header = (const ml_model_header_t *)model_address;
     if (model_header->magic0 != MODEL_HEADER_MAGIC0) {
         return false;
     }
@@ -29,69 +60,242 @@ static bool is_model_valid(const void *model_address) {
     ) {
         return false;
     }
-    // Also check the ML4F header magic values to ensure it's there too
-    ml4f_header_t *ml4f_model = (ml4f_header_t *)((uint32_t)model_header + model_header->header_size);
-    if (ml4f_model->magic0 != ML4F_MAGIC0 || ml4f_model->magic1 != ML4F_MAGIC1) {
+    // Also check the header of the model format to ensure it's there too
+    layout->format = model_header->reserved[ML_MODEL_FORMAT_INDEX];
+    layout->model = (const void *)((uintptr_t)model_header + model_header->header_size);
+    if (layout->format == ML_MODEL_FORMAT_ML4F) {
+        const ml4f_header_t *ml4f_model = (const ml4f_header_t *)layout->model;
+        if (!ml4f_is_valid_header(ml4f_model)) {
+            return false;
+        }
+        layout->arena_bytes = ml4f_model->arena_bytes;
+        layout->input_offset = ml4f_model->input_offset;
+        layout->input_length = ml4f_shape_elements(ml4f_input_shape(ml4f_model));
+        layout->input_info = (ml_tensor_info_t){
+            (ml_tensor_type_t)ml4f_model->input_type, ml4f_model->input_scale, ml4f_model->input_zero_point};
+        layout->output_offset = ml4f_model->output_offset;
+        layout->output_length = ml4f_shape_elements(ml4f_output_shape(ml4f_model));
+        layout->output_info = (ml_tensor_info_t){
+            (ml_tensor_type_t)ml4f_model->output_type, ml4f_model->output_scale, ml4f_model->output_zero_point};
+    } else if (layout->format == ML_MODEL_FORMAT_GRAPH) {
+        const mlgraph_header_t *graph_model = (const mlgraph_header_t *)layout->model;
+        if (!mlgraph_is_valid_model(graph_model)) {
+            return false;
+        }
+        // The quantization of the model tensors is in the first and last layers
+        const mlgraph_layer_t *first = mlgraph_layer(graph_model, 0);
+        const mlgraph_layer_t *last = mlgraph_layer(graph_model, graph_model->num_layers - 1);
+        const ml_tensor_type_t type = (ml_tensor_type_t)graph_model->data_type;
+        layout->arena_bytes = graph_model->arena_bytes;
+        layout->input_offset = graph_model->input_offset;
+        layout->input_length = graph_model->input_length;
+        layout->input_info = (ml_tensor_info_t){type, first->input_scale, first->input_zero_point};
+        layout->output_offset = graph_model->output_offset;
+        layout->output_length = graph_model->output_length;
+        layout->output_info = (ml_tensor_info_t){type, last->output_scale, last->output_zero_point};
+    } else {
         return false;
     }
-    return true;
+    return layout->arena_bytes != 0;
 }
 
 /**
- * @brief Get a pointer to the ML4F model.
- *
- * @return The ML4F model or NULL if the model is not present or invalid.
+ * @brief Release the shared model arena, if it was allocated by mlrunner.
  */
-static inline ml4f_header_t* get_ml4f_model() {
-    if (MODEL_ADDRESS == NULL) {
-        return NULL;
+static void release_model_arena() {
+    if (model_arena_owned) {
+        free(model_arena);
     }
-    ml_model_header_t *model_header = (ml_model_header_t *)MODEL_ADDRESS;
-    return (ml4f_header_t *)((uint32_t)model_header + model_header->header_size);
+    model_arena = NULL;
+    model_arena_size = 0;
+    model_arena_owned = false;
+}
+
+/**
+ * @return True if the arena can be used for a model that needs arena_size.
+ */
+static inline bool is_arena_valid(const void *arena, const size_t size, const size_t arena_size) {
+    return arena != NULL && ((uintptr_t)arena & 3) == 0 && size >= arena_size;
+}
+
+/**
+ * @return True if the buffer can hold the actions or predictions, which
+ * start with a size_t.
+ */
+static inline bool is_buffer_valid(const void *buffer, const size_t size, const size_t needed_size) {
+    return buffer != NULL && ((uintptr_t)buffer % sizeof(size_t)) == 0 && size >= needed_size;
 }
 
 /*****************************************************************************/
 /* Public API                                                                */
 /*****************************************************************************/
 bool ml_setModel(const void *model_address) {
-    // Check if the model is valid
-    if (!is_model_valid(model_address)) {
+    // Check if the model is valid before replacing the current one
+    if (ml_getModelArenaSize(model_address) < 0) {
         return false;
     }
-    MODEL_ADDRESS = (uint32_t *)model_address;
+    ml_removeModels();
 
-    // Allocate the model arena
-    int model_arena_size = ml_getArenaSize();
-    if (model_arena_size <= 0) {
-        MODEL_ADDRESS = NULL;
+    return ml_selectModel(ml_addModel(model_address));
+}
+
+bool ml_setModelArena(const void *model_address, void *arena, const size_t arena_size) {
+    const int model_arena_size = ml_getModelArenaSize(model_address);
+    if (model_arena_size < 0 || !is_arena_valid(arena, arena_size, model_arena_size)) {
         return false;
     }
-    if (model_arena != NULL) {
-        free(model_arena);
+    ml_removeModels();
+    ml_setSharedArena(arena, arena_size);
+
+    return ml_selectModel(ml_addModel(model_address));
+}
+
+int ml_addModel(const void *model_address) {
+    const int arena_size = ml_getModelArenaSize(model_address);
+    if (arena_size < 0 || models_len >= ML_MAX_MODELS) {
+        return -1;
     }
-    model_arena = malloc(model_arena_size);
-    if (model_arena == NULL) {
+    // An arena provided with ml_setSharedArena() cannot grow
+    if (model_arena != NULL && !model_arena_owned && model_arena_size < (size_t)arena_size) {
+        return -1;
+    }
+    models[models_len] = model_address;
+
+    return models_len++;
+}
+
+bool ml_selectModel(const int model) {
+    if (model < 0 || model >= models_len) {
+        return false;
+    }
+
+    // The shared arena is allocated on first use, and it is reallocated if a
+    // model with a larger arena has been added since
+    const size_t arena_size = ml_getSharedArenaSize();
+    if (model_arena == NULL || model_arena_size < arena_size) {
+        release_model_arena();
+        model_arena = malloc(arena_size);
+        if (model_arena == NULL) {
+            MODEL_ADDRESS = NULL;
+            return false;
+        }
+        model_arena_size = arena_size;
+        model_arena_owned = true;
+    }
+
+    if (!get_model_layout(models[model], &model_layout)) {
         MODEL_ADDRESS = NULL;
         return false;
     }
+    MODEL_ADDRESS = (uint32_t *)models[model];
+    input_length = model_layout.input_length;
+    output_length = model_layout.output_length;
+
+    return true;
+}
+
+void ml_removeModels() {
+    release_model_arena();
+    models_len = 0;
+    MODEL_ADDRESS = NULL;
+    input_length = 0;
+    output_length = 0;
+}
+
+int ml_getSharedArenaSize() {
+    int arena_size = 0;
+    for (int i = 0; i < models_len; i++) {
+        const int model_arena_size = ml_getModelArenaSize(models[i]);
+        if (model_arena_size > arena_size) {
+            arena_size = model_arena_size;
+        }
+    }
+    return arena_size;
+}
+
+bool ml_setSharedArena(void *arena, const size_t arena_size) {
+    if (!is_arena_valid(arena, arena_size, ml_getSharedArenaSize())) {
+        return false;
+    }
+    release_model_arena();
+    model_arena = (uint8_t *)arena;
+    model_arena_size = arena_size;
+    model_arena_owned = false;
+
+    return true;
+}
+
+int ml_getModelArenaSize(const void *model_address) {
+    model_layout_t layout;
+    if (model_address == NULL || !get_model_layout(model_address, &layout)) {
+        return -1;
+    }
+    return layout.arena_bytes;
+}
+
+float* ml_getInputBuffer() {
+    if (MODEL_ADDRESS == NULL || model_layout.input_info.type != ML_TENSOR_FLOAT32) {
+        return NULL;
+    }
+    return (float *)(model_arena + model_layout.input_offset);
+}
 
-    // Set the cached input and output lengths
-    ml_getInputLength();
-    ml_getOutputLength();
+float* ml_getOutputBuffer() {
+    if (MODEL_ADDRESS == NULL || model_layout.output_info.type != ML_TENSOR_FLOAT32) {
+        return NULL;
+    }
+    return (float *)(model_arena + model_layout.output_offset);
+}
 
+bool ml_getInputInfo(ml_tensor_info_t *info) {
+    if (MODEL_ADDRESS == NULL || info == NULL) {
+        return false;
+    }
+    *info = model_layout.input_info;
     return true;
 }
 
+bool ml_getOutputInfo(ml_tensor_info_t *info) {
+    if (MODEL_ADDRESS == NULL || info == NULL) {
+        return false;
+    }
+    *info = model_layout.output_info;
+    return true;
+}
+
+void* ml_getInputTensor() {
+    if (MODEL_ADDRESS == NULL) {
+        return NULL;
+    }
+    return model_arena + model_layout.input_offset;
+}
+
+void* ml_getOutputTensor() {
+    if (MODEL_ADDRESS == NULL) {
+        return NULL;
+    }
+    return model_arena + model_layout.output_offset;
+}
+
+bool ml_invokeModel() {
+    if (MODEL_ADDRESS == NULL) {
+        return false;
+    }
+    if (model_layout.format == ML_MODEL_FORMAT_GRAPH) {
+        return mlgraph_invoke((const mlgraph_header_t *)model_layout.model, model_arena) == 0;
+    }
+    return ml4f_invoke((const ml4f_header_t *)model_layout.model, model_arena) == 0;
+}
+
 bool ml_isModelPresent() {
     return MODEL_ADDRESS != NULL;
 }
 
 int ml_getArenaSize() {
-    ml4f_header_t *ml4f_model = get_ml4f_model();
-    if (ml4f_model == NULL) {
+    if (MODEL_ADDRESS == NULL) {
         return -1;
     }
-    return ml4f_model->arena_bytes;
+    return model_layout.arena_bytes;
 }
 
 int ml_getSamplesPeriod() {
@@ -119,44 +323,49 @@ int ml_getSampleDimensions() {
 }
 
 int ml_getInputLength() {
-    if (input_length == 0) {
-        ml4f_header_t *ml4f_model = get_ml4f_model();
-        if (ml4f_model == NULL) {
-            return -1;
-        }
-        input_length = ml4f_shape_elements(ml4f_input_shape(ml4f_model));
+    if (MODEL_ADDRESS == NULL) {
+        return -1;
     }
-
     return input_length;
 }
 
 int ml_getOutputLength() {
-    if (output_length == 0) {
-        ml4f_header_t *ml4f_model = get_ml4f_model();
-        if (ml4f_model == NULL) {
-            return -1;
-        }
-        output_length = ml4f_shape_elements(ml4f_output_shape(ml4f_model));
+    if (MODEL_ADDRESS == NULL) {
+        return -1;
     }
-
     return output_length;
 }
 
-ml_actions_t* ml_allocateActions() {
+int ml_getActionsSize() {
     const ml_model_header_t* const model_header = (ml_model_header_t*)MODEL_ADDRESS;
     if (model_header == NULL) {
-        return NULL;
+        return -1;
     }
+    return sizeof(ml_actions_t) + sizeof(ml_action_t) * model_header->number_of_actions;
+}
 
-    ml_actions_t *actions = (ml_actions_t *)malloc(
-            sizeof(ml_actions_t) + sizeof(ml_action_t) * model_header->number_of_actions);
-    if (actions == NULL) {
+ml_actions_t* ml_initActions(void *buffer, const size_t size) {
+    const int actions_size = ml_getActionsSize();
+    if (actions_size < 0 || !is_buffer_valid(buffer, size, actions_size)) {
         return NULL;
     }
-    actions->len = model_header->number_of_actions;
+    ml_actions_t *actions = (ml_actions_t *)buffer;
+    actions->len = ((ml_model_header_t*)MODEL_ADDRESS)->number_of_actions;
     return actions;
 }
 
+ml_actions_t* ml_allocateActions() {
+    const int actions_size = ml_getActionsSize();
+    if (actions_size < 0) {
+        return NULL;
+    }
+    void *buffer = malloc(actions_size);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    return ml_initActions(buffer, actions_size);
+}
+
 bool ml_getActions(ml_actions_t *actions_out) {
     const ml_model_header_t* const model_header = (ml_model_header_t*)MODEL_ADDRESS;
     if (model_header == NULL || actions_out == NULL) {
@@ -185,29 +394,46 @@ bool ml_getActions(ml_actions_t *actions_out) {
         actions_out->action[i].threshold = action->threshold;
 
         // Locate the next action in flash, which is 4 byte aligned
-        action = (ml_header_action_t *)((uint32_t)action + ml_action_size_without_label + action->label_length);
-        action = (ml_header_action_t *)(((uint32_t)action + 3) & ~3);
+        action = (ml_header_action_t *)((uintptr_t)action + ml_action_size_without_label + action->label_length);
+        action = (ml_header_action_t *)(((uintptr_t)action + 3) & ~3);
     }
 
     return true;
 }
 
-ml_predictions_t *ml_allocatePredictions() {
-    int output_size = ml_getOutputLength();
+int ml_getPredictionsSize() {
+    const int output_size = ml_getOutputLength();
     if (output_size <= 0) {
-        return NULL;
+        return -1;
     }
-    ml_predictions_t *predictions = (ml_predictions_t *)calloc(
-        1, sizeof(ml_predictions_t) + sizeof(float) * output_size);
-    if (predictions == NULL) {
+    return sizeof(ml_predictions_t) + sizeof(float) * output_size;
+}
+
+ml_predictions_t *ml_initPredictions(void *buffer, const size_t size) {
+    const int predictions_size = ml_getPredictionsSize();
+    if (predictions_size < 0 || !is_buffer_valid(buffer, size, predictions_size)) {
         return NULL;
     }
+    memset(buffer, 0, predictions_size);
+    ml_predictions_t *predictions = (ml_predictions_t *)buffer;
     predictions->index = -1;
-    predictions->len = output_size;
+    predictions->len = ml_getOutputLength();
 
     return predictions;
 }
 
+ml_predictions_t *ml_allocatePredictions() {
+    const int predictions_size = ml_getPredictionsSize();
+    if (predictions_size < 0) {
+        return NULL;
+    }
+    void *buffer = malloc(predictions_size);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    return ml_initPredictions(buffer, predictions_size);
+}
+
 bool ml_predict(const float *input, const size_t in_len, const ml_actions_t *actions, ml_predictions_t *predictions_out) {
     if (actions == NULL || actions->len != output_length ||
             predictions_out == NULL || predictions_out->len != output_length) {
@@ -218,7 +444,9 @@ bool ml_predict(const float *input, const size_t in_len, const ml_actions_t *act
     if (!success) {
         return false;
     }
+    const uint32_t start = mlstats_now();
     predictions_out->index = ml_calcPrediction(actions, (float *)&predictions_out->prediction, output_length);
+    mlstats_recordSince(MLSTATS_ARGMAX, start);
 
     return true;
 }
@@ -229,11 +457,42 @@ bool ml_runModel(const float *input, const size_t in_len, float* individual_pred
         return false;
     }
 
-    ml4f_header_t *ml4f_model = get_ml4f_model();
-    int r = ml4f_full_invoke_arena(ml4f_model, model_arena, input, individual_predictions);
-    if (r != 0) {
+    // The data is only copied in and out of the arena when needed, and
+    // quantized tensors are converted from and to float
+    void *input_tensor = ml_getInputTensor();
+    void *output_tensor = ml_getOutputTensor();
+    if (input_tensor == NULL || output_tensor == NULL) {
+        return false;
+    }
+    uint32_t start = mlstats_now();
+    const ml_tensor_info_t *in_info = &model_layout.input_info;
+    if (in_info->type == ML_TENSOR_INT8) {
+        mlk_quantizeInt8(input, (int8_t *)input_tensor, in_len, in_info->scale, in_info->zero_point);
+    } else if (in_info->type == ML_TENSOR_UINT8) {
+        mlk_quantizeUint8(input, (uint8_t *)input_tensor, in_len, in_info->scale, in_info->zero_point);
+    } else if (input != input_tensor) {
+        memcpy(input_tensor, input, in_len * sizeof(float));
+    }
+    mlstats_recordSince(MLSTATS_COPY_IN, start);
+
+    start = mlstats_now();
+    if (!ml_invokeModel()) {
         return false;
     }
+    mlstats_recordSince(MLSTATS_INVOKE, start);
+
+    start = mlstats_now();
+    const ml_tensor_info_t *out_info = &model_layout.output_info;
+    if (out_info->type == ML_TENSOR_INT8) {
+        mlk_dequantizeInt8(
+            (const int8_t *)output_tensor, individual_predictions, out_len, out_info->scale, out_info->zero_point);
+    } else if (out_info->type == ML_TENSOR_UINT8) {
+        mlk_dequantizeUint8(
+            (const uint8_t *)output_tensor, individual_predictions, out_len, out_info->scale, out_info->zero_point);
+    } else if (individual_predictions != output_tensor) {
+        memcpy(individual_predictions, output_tensor, out_len * sizeof(float));
+    }
+    mlstats_recordSince(MLSTATS_COPY_OUT, start);
 
     return true;
 }
@@ -11,6 +11,10 @@
  * This header start and end are 4-byte aligned, with padding zeros at the
  * end if needed, so that the ML4F model is placed directly after it.
  * We call the "full model" the custom header + the ML4F model.
+ *
+ * The model after the header can also be a layer graph (see mlgraph.h), run
+ * by an interpreter instead of as compiled code, the format is indicated in
+ * the header reserved bytes.
  */
 #pragma once
 
@@ -25,6 +29,19 @@ extern "C" {
 // ASCII for "MODL"
 #define MODEL_HEADER_MAGIC0 0x4D4F444C
 
+// Index in ml_model_header_t.reserved of the model format
+#define ML_MODEL_FORMAT_INDEX 0
+
+typedef enum ml_model_format_e {
+    ML_MODEL_FORMAT_ML4F = 0,           // All existing models have zeros in the reserved bytes
+    ML_MODEL_FORMAT_GRAPH = 1,
+} ml_model_format_t;
+
+// Maximum number of models that can be added with ml_addModel()
+#ifndef ML_MAX_MODELS
+#define ML_MAX_MODELS 4
+#endif
+
 /**
  * The ML header contains a series of actions, each with a threshold and label.
  * The label is of variable length, and inside the header these instances are
@@ -35,7 +52,7 @@ typedef struct __attribute__((packed)) ml_header_action_s {
     const uint8_t label_length;         // Length of the label string including the null terminator
     const char label[];                 // Null-terminated string for the label starts from this address
 } ml_header_action_t;
-const size_t ml_action_size_without_label = 5;
+static const size_t ml_action_size_without_label = 5;
 
 /**
  * The ML model header presence can be checked via the magic number.
@@ -47,11 +64,28 @@ typedef struct __attribute__((packed, aligned(4))) ml_model_header_s {
     const uint16_t samples_period;      // Period in ms between samples
     const uint16_t samples_length;      // Number of samples used per inference, not counting dimensions
     const uint8_t sample_dimensions;    // Number of dimensions per sample, e.g. 3 for accelerometer data
-    const uint8_t reserved[8];
+    const uint8_t reserved[8];          // reserved[ML_MODEL_FORMAT_INDEX] is the ml_model_format_t
     const uint8_t number_of_actions;    // Only 255 actions supported
     const ml_header_action_t actions[]; // As many actions as number_of_actions, the size of each is variable
 } ml_model_header_t;
 
+// Same values as the ML4F_TYPE_* tensor types
+typedef enum ml_tensor_type_e {
+    ML_TENSOR_FLOAT32 = 1,
+    ML_TENSOR_INT8 = 2,
+    ML_TENSOR_UINT8 = 3,
+} ml_tensor_type_t;
+
+/**
+ * Type of a model input or output tensor, quantized tensors are converted
+ * with real_value = scale * (quantized_value - zero_point).
+ */
+typedef struct ml_tensor_info_s {
+    ml_tensor_type_t type;
+    float scale;                        // Only for quantized types
+    int32_t zero_point;                 // Only for quantized types
+} ml_tensor_info_t;
+
 typedef struct ml_action_s {
     float threshold;
     const char *label;
@@ -76,11 +110,89 @@ typedef struct ml_predictions_s {
 /**
  * @brief Set the model to use for inference.
  *
+ * Any models previously added are removed, this is the same as calling
+ * ml_removeModels(), ml_addModel() and ml_selectModel().
+ *
  * @param model_address The start address of the model.
  * @return True if the model is valid and set, False otherwise.
  */
 bool ml_setModel(const void *model_address);
 
+/**
+ * @brief Set the model to use for inference, with a caller provided arena
+ * instead of allocating it.
+ *
+ * @param model_address The start address of the model.
+ * @param arena Memory for the model to run, 4-byte aligned, it must remain
+ *              valid while the model is set.
+ * @param arena_size The size of the arena, at least ml_getModelArenaSize().
+ * @return True if the model is valid and set, False otherwise.
+ */
+bool ml_setModelArena(const void *model_address, void *arena, const size_t arena_size);
+
+/**
+ * @brief Get the arena size a model needs to run, before it is set.
+ *
+ * @param model_address The start address of the model.
+ * @return The size, in bytes, of the arena required for the model.
+ *         Or -1 if the model is not valid.
+ */
+int ml_getModelArenaSize(const void *model_address);
+
+/**
+ * @brief Add a model, so that several models can be loaded and run in
+ * sequence (e.g. a simple model to detect movement and a classifier).
+ *
+ * Only one model runs at a time, so all models share the same arena, sized
+ * for the largest one. As a result, the contents of ml_getInputBuffer() and
+ * ml_getOutputBuffer() are not preserved when a different model runs.
+ *
+ * @param model_address The start address of the model.
+ * @return The model index to use with ml_selectModel().
+ *         Or -1 if the model is not valid, ML_MAX_MODELS have been added, or
+ *         it doesn't fit in the arena set with ml_setSharedArena().
+ */
+int ml_addModel(const void *model_address);
+
+/**
+ * @brief Select one of the added models, all the other functions to get the
+ * model information or run it use the selected model.
+ *
+ * The shared arena is allocated the first time a model is selected, unless
+ * one has been provided with ml_setSharedArena(). If a model with a larger
+ * arena has been added since, the arena is allocated again, so any pointers
+ * previously returned by ml_getInputBuffer(), ml_getOutputBuffer(),
+ * ml_getInputTensor() and ml_getOutputTensor() are no longer valid, and must
+ * be requested again. Adding all the models before selecting one avoids it.
+ *
+ * @param model The model index returned by ml_addModel().
+ * @return True if the model has been selected, False otherwise.
+ */
+bool ml_selectModel(const int model);
+
+/**
+ * @brief Remove all the added models and release the shared arena.
+ */
+void ml_removeModels();
+
+/**
+ * @brief Get the arena size needed to run any of the added models.
+ *
+ * @return The size, in bytes, of the largest model arena.
+ */
+int ml_getSharedArenaSize();
+
+/**
+ * @brief Provide the memory for the shared arena, instead of allocating it.
+ *
+ * @param arena Memory for the models to run, 4-byte aligned, it must remain
+ *              valid until ml_removeModels().
+ * @param arena_size The size of the arena, at least ml_getSharedArenaSize()
+ *                   for the models already added.
+ * @return True if the arena is set, False otherwise.
+ */
+bool ml_setSharedArena(void *arena, const size_t arena_size);
+
 /**
  * @brief Check if a model is present.
  *
@@ -136,15 +248,110 @@ int ml_getInputLength();
  */
 int ml_getOutputLength();
 
+/**
+ * @brief Get the model input tensor inside the arena.
+ *
+ * The input data can be written directly here and then passed to
+ * ml_runModel() or ml_predict() to avoid copying it into the arena, or the
+ * model can be run with ml_invokeModel().
+ * The contents are not preserved after the model runs, as the arena space is
+ * reused by the model layers. The pointer is valid until ml_removeModels(),
+ * or until ml_selectModel() grows the arena, see ml_selectModel().
+ *
+ * @return A pointer to ml_getInputLength() floats.
+ *         Or NULL if the model is not present or its input is quantized.
+ */
+float* ml_getInputBuffer();
+
+/**
+ * @brief Get the model output tensor inside the arena.
+ *
+ * The contents are valid after the model runs, until it runs again. As with
+ * ml_getInputBuffer(), the pointer is not valid after ml_selectModel() grows
+ * the arena.
+ *
+ * @return A pointer to ml_getOutputLength() floats.
+ *         Or NULL if the model is not present or its output is quantized.
+ */
+float* ml_getOutputBuffer();
+
+/**
+ * @brief Get the type of the model input tensor.
+ *
+ * Quantized inputs are converted from float by ml_runModel() and
+ * ml_predict(), or they can be written to ml_getInputTensor() directly.
+ *
+ * @param info Set to the input tensor type.
+ * @return True if the model is present, False otherwise.
+ */
+bool ml_getInputInfo(ml_tensor_info_t *info);
+
+/**
+ * @brief Get the type of the model output tensor.
+ *
+ * Quantized outputs are converted to float by ml_runModel() and
+ * ml_predict(), so that they can be used with ml_calcPrediction().
+ *
+ * @param info Set to the output tensor type.
+ * @return True if the model is present, False otherwise.
+ */
+bool ml_getOutputInfo(ml_tensor_info_t *info);
+
+/**
+ * @brief Get the model input tensor inside the arena, of any type.
+ *
+ * @return A pointer to ml_getInputLength() elements of the input type.
+ *         Or NULL if the model is not present.
+ */
+void* ml_getInputTensor();
+
+/**
+ * @brief Get the model output tensor inside the arena, of any type.
+ *
+ * @return A pointer to ml_getOutputLength() elements of the output type.
+ *         Or NULL if the model is not present.
+ */
+void* ml_getOutputTensor();
+
+/**
+ * @brief Run the model with the data already in ml_getInputBuffer(), the
+ * results are placed in ml_getOutputBuffer().
+ *
+ * @return True if the model is present and the model run was successful,
+ *         False otherwise.
+ */
+bool ml_invokeModel();
+
 /**
  * @brief Allocate memory for the model actions.
  *
- * The caller is responsible for freeing the memory.
+ * The caller is responsible for freeing the memory. This and
+ * ml_allocatePredictions() are the only mlrunner functions that use the heap
+ * apart from the shared arena, ml_initActions() and ml_initPredictions() use
+ * caller provided memory instead.
  *
  * @return A pointer to a ml_actions_t object to store the actions.
  */
 ml_actions_t* ml_allocateActions();
 
+/**
+ * @brief Get the memory needed for the actions of the selected model.
+ *
+ * @return The size, in bytes, for ml_initActions().
+ *         Or -1 if the model is not present.
+ */
+int ml_getActionsSize();
+
+/**
+ * @brief Same as ml_allocateActions(), but in caller provided memory.
+ *
+ * @param buffer Memory for the actions, aligned to sizeof(size_t).
+ * @param size The size of the buffer, at least ml_getActionsSize().
+ * @return The buffer as a ml_actions_t object to store the actions.
+ *         Or NULL if the model is not present or the buffer is not valid.
+ */
+ml_actions_t* ml_initActions(void *buffer, const size_t size);
+
 /**
  * @brief Get the model actions.
  *
@@ -168,6 +375,24 @@ bool ml_getActions(ml_actions_t *actions_out);
  */
 ml_predictions_t *ml_allocatePredictions();
 
+/**
+ * @brief Get the memory needed for the predictions of the selected model.
+ *
+ * @return The size, in bytes, for ml_initPredictions().
+ *         Or -1 if the model is not present.
+ */
+int ml_getPredictionsSize();
+
+/**
+ * @brief Same as ml_allocatePredictions(), but in caller provided memory.
+ *
+ * @param buffer Memory for the predictions, aligned to sizeof(size_t).
+ * @param size The size of the buffer, at least ml_getPredictionsSize().
+ * @return The buffer as a ml_predictions_t object to store the predictions.
+ *         Or NULL if the model is not present or the buffer is not valid.
+ */
+ml_predictions_t *ml_initPredictions(void *buffer, const size_t size);
+
 /**
  * @brief Run the model and return the index for the predicted action.
  *
@@ -183,9 +408,14 @@ bool ml_predict(const float *input, const size_t in_len, const ml_actions_t *act
 /**
  * @brief Run the model and return the individual predictions for each action.
  *
- * @param input The input data for the model.
+ * Quantized models have their input quantized into the arena, and their
+ * output converted back to float.
+ *
+ * @param input The input data for the model, it is not copied if it is
+ *              ml_getInputBuffer().
  * @param in_len The length of the input data.
- * @param predictions_out An array of floats to store the results.
+ * @param predictions_out An array of floats to store the results, it is not
+ *                        copied if it is ml_getOutputBuffer().
  * @param out_len The length of the predictions_out array.
  * @return True if the model is present and the model run was successful,
  *         False otherwise.
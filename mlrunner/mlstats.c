@@ -0,0 +1,253 @@
+#if defined(__unix__) || defined(__APPLE__)
+// For clock_gettime() in the host builds
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+#define MLSTATS_HOST_CLOCK 1
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include "mlstats.h"
+
+typedef struct mlstats_histogram_s {
+    uint32_t count;
+    uint32_t max;
+    uint32_t last;
+    uint32_t buckets[MLSTATS_BUCKETS];
+} mlstats_histogram_t;
+
+static const char *stage_names[MLSTATS_STAGES_LEN] = {
+    "capture", "ring_insert", "features", "copy_in", "invoke", "copy_out", "argmax",
+};
+static const char *counter_names[MLSTATS_COUNTERS_LEN] = {
+    "inferences_skipped", "record_errors", "sample_drift", "samples_dropped",
+    "inferences_gated",
+};
+
+/*****************************************************************************/
+/* Private API                                                               */
+/*****************************************************************************/
+#if MLSTATS_HOST_CLOCK
+static uint32_t host_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec);
+}
+static mlstats_clock_t stats_clock = host_clock;
+static uint32_t stats_ticks_per_us = 1000;
+#else
+static mlstats_clock_t stats_clock = NULL;
+static uint32_t stats_ticks_per_us = 0;
+#endif
+
+#if MLSTATS_ENABLED
+static mlstats_histogram_t histograms[MLSTATS_STAGES_LEN];
+static uint32_t counters[MLSTATS_COUNTERS_LEN];
+
+/**
+ * Values under 4 have a bucket each, then each power of two is split in
+ * MLSTATS_SUB_BUCKETS buckets using the two bits after the most significant.
+ */
+static inline uint32_t bucket_index(const uint32_t ticks) {
+    if (ticks < MLSTATS_SUB_BUCKETS) {
+        return ticks;
+    }
+    const uint32_t msb = 31 - __builtin_clz(ticks);
+    if (msb >= MLSTATS_MAX_BITS) {
+        return MLSTATS_BUCKETS - 1;
+    }
+    return (msb - 1) * MLSTATS_SUB_BUCKETS + ((ticks >> (msb - 2)) & (MLSTATS_SUB_BUCKETS - 1));
+}
+
+static inline uint32_t bucket_upper_bound(const uint32_t index) {
+    if (index < MLSTATS_SUB_BUCKETS) {
+        return index;
+    }
+    const uint32_t shift = index / MLSTATS_SUB_BUCKETS - 1;
+    const uint32_t sub = index % MLSTATS_SUB_BUCKETS;
+    return ((MLSTATS_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+#endif
+
+/*****************************************************************************/
+/* Public API                                                                */
+/*****************************************************************************/
+void mlstats_setClock(mlstats_clock_t clock, const uint32_t ticks_per_us) {
+    stats_clock = clock;
+    stats_ticks_per_us = ticks_per_us;
+}
+
+uint32_t mlstats_now(void) {
+#if MLSTATS_ENABLED
+    if (stats_clock != NULL) {
+        return stats_clock();
+    }
+#endif
+    return 0;
+}
+
+void mlstats_record(const mlstats_stage_t stage, const uint32_t ticks) {
+#if MLSTATS_ENABLED
+    if ((unsigned)stage >= MLSTATS_STAGES_LEN || stats_clock == NULL) {
+        return;
+    }
+    mlstats_histogram_t *histogram = &histograms[stage];
+    histogram->count++;
+    histogram->last = ticks;
+    histogram->buckets[bucket_index(ticks)]++;
+    if (ticks > histogram->max) {
+        histogram->max = ticks;
+    }
+#else
+    (void)stage;
+    (void)ticks;
+#endif
+}
+
+void mlstats_recordSince(const mlstats_stage_t stage, const uint32_t start) {
+    mlstats_record(stage, mlstats_now() - start);
+}
+
+void mlstats_increment(const mlstats_counter_t counter) {
+#if MLSTATS_ENABLED
+    if ((unsigned)counter < MLSTATS_COUNTERS_LEN) {
+        counters[counter]++;
+    }
+#else
+    (void)counter;
+#endif
+}
+
+void mlstats_reset(void) {
+#if MLSTATS_ENABLED
+    memset(histograms, 0, sizeof(histograms));
+    memset(counters, 0, sizeof(counters));
+#endif
+}
+
+uint32_t mlstats_count(const mlstats_stage_t stage) {
+#if MLSTATS_ENABLED
+    if ((unsigned)stage < MLSTATS_STAGES_LEN) {
+        return histograms[stage].count;
+    }
+#else
+    (void)stage;
+#endif
+    return 0;
+}
+
+uint32_t mlstats_percentile(const mlstats_stage_t stage, const float percentile) {
+#if MLSTATS_ENABLED
+    if ((unsigned)stage >= MLSTATS_STAGES_LEN || histograms[stage].count == 0) {
+        return 0;
+    }
+    const mlstats_histogram_t *histogram = &histograms[stage];
+    // Rank of the value, from 1 to count, with the percentile in hundredths
+    // so that the rounding is exact
+    const float p = percentile < 0.0f ? 0.0f : (percentile > 100.0f ? 100.0f : percentile);
+    const uint64_t hundredths = (uint64_t)(p * 100.0f + 0.5f);
+    uint32_t rank = (uint32_t)((hundredths * histogram->count + 9999) / 10000);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint32_t seen = 0;
+    for (uint32_t i = 0; i < MLSTATS_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            // The last bucket has no upper bound, and no bucket goes above the max
+            const uint32_t upper = (i == MLSTATS_BUCKETS - 1) ? histogram->max : bucket_upper_bound(i);
+            return upper < histogram->max ? upper : histogram->max;
+        }
+    }
+    return histogram->max;
+#else
+    (void)stage;
+    (void)percentile;
+    return 0;
+#endif
+}
+
+uint32_t mlstats_max(const mlstats_stage_t stage) {
+#if MLSTATS_ENABLED
+    if ((unsigned)stage < MLSTATS_STAGES_LEN) {
+        return histograms[stage].max;
+    }
+#else
+    (void)stage;
+#endif
+    return 0;
+}
+
+uint32_t mlstats_last(const mlstats_stage_t stage) {
+#if MLSTATS_ENABLED
+    if ((unsigned)stage < MLSTATS_STAGES_LEN) {
+        return histograms[stage].last;
+    }
+#else
+    (void)stage;
+#endif
+    return 0;
+}
+
+uint32_t mlstats_counter(const mlstats_counter_t counter) {
+#if MLSTATS_ENABLED
+    if ((unsigned)counter < MLSTATS_COUNTERS_LEN) {
+        return counters[counter];
+    }
+#else
+    (void)counter;
+#endif
+    return 0;
+}
+
+float mlstats_ticksToMicros(const uint32_t ticks) {
+    if (stats_ticks_per_us == 0) {
+        return 0.0f;
+    }
+    return (float)ticks / (float)stats_ticks_per_us;
+}
+
+const char *mlstats_stageName(const mlstats_stage_t stage) {
+    if ((unsigned)stage >= MLSTATS_STAGES_LEN) {
+        return NULL;
+    }
+    return stage_names[stage];
+}
+
+const char *mlstats_counterName(const mlstats_counter_t counter) {
+    if ((unsigned)counter >= MLSTATS_COUNTERS_LEN) {
+        return NULL;
+    }
+    return counter_names[counter];
+}
+
+void mlstats_dump(mlstats_print_t print, void *context) {
+    if (print == NULL) {
+        return;
+    }
+    char line[96];
+    // Microseconds with one decimal
+    #define MLSTATS_US(ticks) \
+        (unsigned long)(stats_ticks_per_us ? ((uint64_t)(ticks) * 10 / stats_ticks_per_us) / 10 : 0), \
+        (unsigned long)(stats_ticks_per_us ? ((uint64_t)(ticks) * 10 / stats_ticks_per_us) % 10 : 0)
+
+    snprintf(line, sizeof(line), "%-12s %8s %10s %10s %10s %10s (us)\n",
+             "stage", "count", "p50", "p95", "p99", "max");
+    print(line, context);
+    for (int s = 0; s < MLSTATS_STAGES_LEN; s++) {
+        const mlstats_stage_t stage = (mlstats_stage_t)s;
+        snprintf(line, sizeof(line), "%-12s %8lu %8lu.%lu %8lu.%lu %8lu.%lu %8lu.%lu\n",
+                 stage_names[s], (unsigned long)mlstats_count(stage),
+                 MLSTATS_US(mlstats_percentile(stage, 50.0f)),
+                 MLSTATS_US(mlstats_percentile(stage, 95.0f)),
+                 MLSTATS_US(mlstats_percentile(stage, 99.0f)),
+                 MLSTATS_US(mlstats_max(stage)));
+        print(line, context);
+    }
+    for (int c = 0; c < MLSTATS_COUNTERS_LEN; c++) {
+        snprintf(line, sizeof(line), "%-20s %lu\n",
+                 counter_names[c], (unsigned long)mlstats_counter((mlstats_counter_t)c));
+        print(line, context);
+    }
+    #undef MLSTATS_US
+}
@@ -0,0 +1,168 @@
+/**
+ * @brief Latency histograms of the stages of the ML pipeline, to get the
+ * percentiles and maximum of each stage, not only an average.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * @details
+ * Each stage has a histogram with fixed log-scale buckets, four per power of
+ * two, so recording a duration is constant time and needs no allocation.
+ * Percentiles are reported as the upper bound of their bucket, up to 25%
+ * above the real value, while the maximum is exact.
+ *
+ * Durations are measured in ticks of a clock set with mlstats_setClock(),
+ * the DWT cycle counter on the micro:bit. On Linux and macOS the default
+ * clock is the monotonic clock in nanoseconds, elsewhere nothing is recorded
+ * until a clock is set.
+ *
+ * The instrumentation can be removed by defining MLSTATS_ENABLED to 0, then
+ * all the functions do nothing and report zeros.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef MLSTATS_ENABLED
+#define MLSTATS_ENABLED 1
+#endif
+
+// Durations of this many bits or longer are counted in the last bucket,
+// 2^24 ticks is 0.26 seconds at 64 MHz. The host clock counts nanoseconds,
+// where 24 bits would only be 16.7 ms, so host builds use the whole clock
+#ifndef MLSTATS_MAX_BITS
+#if defined(__unix__) || defined(__APPLE__)
+#define MLSTATS_MAX_BITS 32
+#else
+#define MLSTATS_MAX_BITS 24
+#endif
+#endif
+#define MLSTATS_SUB_BUCKETS 4
+#define MLSTATS_BUCKETS ((MLSTATS_MAX_BITS - 1) * MLSTATS_SUB_BUCKETS)
+
+// Values also used from TypeScript, so they must not change
+typedef enum mlstats_stage_e {
+    MLSTATS_SAMPLE_CAPTURE = 0,         // Reading a sample from the sensor
+    MLSTATS_RING_INSERT = 1,            // recordData()
+    MLSTATS_FEATURE_EXTRACTION = 2,     // Running the filters on a window
+    MLSTATS_COPY_IN = 3,                // Copying or quantizing the input into the arena
+    MLSTATS_INVOKE = 4,                 // Running the model
+    MLSTATS_COPY_OUT = 5,               // Copying or dequantizing the output
+    MLSTATS_ARGMAX = 6,                 // Applying the thresholds and picking the prediction
+    MLSTATS_STAGES_LEN,
+} mlstats_stage_t;
+
+// Events without a duration, also used from TypeScript
+typedef enum mlstats_counter_e {
+    MLSTATS_INFERENCES_SKIPPED = 0,     // A window was ready while the samples were behind
+    MLSTATS_RECORD_ERRORS = 1,          // Samples that couldn't be recorded
+    MLSTATS_SAMPLE_DRIFT = 2,           // Samples not taken at the model sample period
+    MLSTATS_SAMPLES_DROPPED = 3,        // Samples read while the sample queue was full
+    MLSTATS_INFERENCES_GATED = 4,       // Windows not processed as the signal was idle
+    MLSTATS_COUNTERS_LEN,
+} mlstats_counter_t;
+
+/**
+ * @brief A free running clock, it can wrap around, as only the difference
+ * between two values is used.
+ */
+typedef uint32_t (*mlstats_clock_t)(void);
+
+/**
+ * @brief Output of mlstats_dump(), called once per line.
+ */
+typedef void (*mlstats_print_t)(const char *line, void *context);
+
+/**
+ * @brief Set the clock used to measure the stages.
+ *
+ * @param clock The clock, or NULL to stop recording.
+ * @param ticks_per_us Clock ticks per microsecond, to report the durations.
+ */
+void mlstats_setClock(mlstats_clock_t clock, const uint32_t ticks_per_us);
+
+/**
+ * @return The current clock value, 0 if no clock is set.
+ */
+uint32_t mlstats_now(void);
+
+/**
+ * @brief Add a duration to the stage histogram.
+ */
+void mlstats_record(const mlstats_stage_t stage, const uint32_t ticks);
+
+/**
+ * @brief Add the time since start, from mlstats_now(), to the stage
+ * histogram.
+ */
+void mlstats_recordSince(const mlstats_stage_t stage, const uint32_t start);
+
+/**
+ * @brief Increase an event counter by one.
+ */
+void mlstats_increment(const mlstats_counter_t counter);
+
+/**
+ * @brief Clear all the histograms and counters.
+ */
+void mlstats_reset(void);
+
+/**
+ * @return The number of durations recorded for the stage.
+ */
+uint32_t mlstats_count(const mlstats_stage_t stage);
+
+/**
+ * @param percentile From 0 to 100, e.g. 50 for the median.
+ * @return The duration in ticks under which that percentage of the recorded
+ *         durations fall, or 0 if none have been recorded.
+ */
+uint32_t mlstats_percentile(const mlstats_stage_t stage, const float percentile);
+
+/**
+ * @return The longest duration recorded for the stage, in ticks.
+ */
+uint32_t mlstats_max(const mlstats_stage_t stage);
+
+/**
+ * @return The last duration recorded for the stage, in ticks.
+ */
+uint32_t mlstats_last(const mlstats_stage_t stage);
+
+/**
+ * @return The value of an event counter.
+ */
+uint32_t mlstats_counter(const mlstats_counter_t counter);
+
+/**
+ * @return The duration in microseconds, or 0 if no clock is set.
+ */
+float mlstats_ticksToMicros(const uint32_t ticks);
+
+/**
+ * @return A short name for the stage, or NULL if it doesn't exist.
+ */
+const char *mlstats_stageName(const mlstats_stage_t stage);
+
+/**
+ * @return A short name for the counter, or NULL if it doesn't exist.
+ */
+const char *mlstats_counterName(const mlstats_counter_t counter);
+
+/**
+ * @brief Print a table with the count, p50, p95, p99 and max of each stage,
+ * in microseconds, followed by the counters.
+ *
+ * The lines end with a newline, and only use integer formatting, so that
+ * they can be printed where printf doesn't support floats.
+ */
+void mlstats_dump(mlstats_print_t print, void *context);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
@@ -0,0 +1,175 @@
+#include <string.h>
+#include "mlstats.h"
+#include "mltelemetry.h"
+
+#if (MLTELEMETRY_BUFFER_SIZE & (MLTELEMETRY_BUFFER_SIZE - 1)) != 0
+#error "MLTELEMETRY_BUFFER_SIZE must be a power of 2"
+#endif
+
+// Free running positions, only masked to access the buffer, so that
+// head - tail is the number of queued bytes
+static uint8_t tx_buffer[MLTELEMETRY_BUFFER_SIZE];
+static uint32_t tx_head = 0;
+static uint32_t tx_tail = 0;
+static uint8_t tx_seq = 0;
+static uint32_t tx_dropped = 0;
+
+/*****************************************************************************/
+/* Private API                                                               */
+/*****************************************************************************/
+static inline void put_byte(const uint8_t value) {
+    tx_buffer[tx_head & (MLTELEMETRY_BUFFER_SIZE - 1)] = value;
+    tx_head++;
+}
+
+static inline size_t put_u16(uint8_t *out, const uint16_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    return 2;
+}
+
+static inline size_t put_u32(uint8_t *out, const uint32_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    out[2] = (uint8_t)(value >> 16);
+    out[3] = (uint8_t)(value >> 24);
+    return 4;
+}
+
+/*****************************************************************************/
+/* Public API                                                                */
+/*****************************************************************************/
+uint16_t mltelemetry_crc16(uint16_t crc, const uint8_t *data, const size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+bool mltelemetry_send(const mltelemetry_frame_type_t type, const void *payload, const size_t len) {
+    const uint8_t seq = tx_seq++;
+    const size_t frame_size = MLTELEMETRY_HEADER_SIZE + len + MLTELEMETRY_CRC_SIZE;
+    if (len > MLTELEMETRY_MAX_PAYLOAD || (payload == NULL && len > 0) ||
+            frame_size > MLTELEMETRY_BUFFER_SIZE - mltelemetry_pending()) {
+        tx_dropped++;
+        return false;
+    }
+    const uint8_t header[3] = {(uint8_t)type, seq, (uint8_t)len};
+    uint16_t crc = mltelemetry_crc16(0xFFFF, header, sizeof(header));
+    crc = mltelemetry_crc16(crc, (const uint8_t *)payload, len);
+
+    put_byte(MLTELEMETRY_SYNC0);
+    put_byte(MLTELEMETRY_SYNC1);
+    for (size_t i = 0; i < sizeof(header); i++) {
+        put_byte(header[i]);
+    }
+    // Copied in up to two parts, as the frame can wrap around the buffer end
+    const uint32_t start = tx_head & (MLTELEMETRY_BUFFER_SIZE - 1);
+    const size_t first = (len < MLTELEMETRY_BUFFER_SIZE - start) ? len : MLTELEMETRY_BUFFER_SIZE - start;
+    if (len > 0) {
+        memcpy(&tx_buffer[start], payload, first);
+        memcpy(tx_buffer, (const uint8_t *)payload + first, len - first);
+        tx_head += len;
+    }
+    put_byte((uint8_t)crc);
+    put_byte((uint8_t)(crc >> 8));
+    return true;
+}
+
+bool mltelemetry_sendPrediction(
+    const uint32_t time_ms, const int index, const float *predictions, const size_t len
+) {
+    uint8_t payload[MLTELEMETRY_MAX_PAYLOAD];
+    if (predictions == NULL || 6 + len * 2 > sizeof(payload)) {
+        tx_seq++;
+        tx_dropped++;
+        return false;
+    }
+    size_t pos = put_u32(payload, time_ms);
+    payload[pos++] = (uint8_t)(int8_t)index;
+    payload[pos++] = (uint8_t)len;
+    for (size_t i = 0; i < len; i++) {
+        const float p = predictions[i] < 0.0f ? 0.0f : (predictions[i] > 1.0f ? 1.0f : predictions[i]);
+        pos += put_u16(&payload[pos], (uint16_t)(p * 65535.0f + 0.5f));
+    }
+    return mltelemetry_send(MLTELEMETRY_PREDICTION, payload, pos);
+}
+
+bool mltelemetry_sendTimings(const uint32_t time_ms) {
+    uint8_t payload[5 + MLSTATS_STAGES_LEN * 4];
+    size_t pos = put_u32(payload, time_ms);
+    payload[pos++] = MLSTATS_STAGES_LEN;
+    for (int s = 0; s < MLSTATS_STAGES_LEN; s++) {
+        const float ns = mlstats_ticksToMicros(mlstats_last((mlstats_stage_t)s)) * 1000.0f;
+        pos += put_u32(&payload[pos], (uint32_t)(ns + 0.5f));
+    }
+    return mltelemetry_send(MLTELEMETRY_TIMINGS, payload, pos);
+}
+
+bool mltelemetry_sendCounters(const uint32_t time_ms) {
+    uint8_t payload[5 + (MLSTATS_COUNTERS_LEN + 1) * 4];
+    size_t pos = put_u32(payload, time_ms);
+    payload[pos++] = MLSTATS_COUNTERS_LEN + 1;
+    for (int c = 0; c < MLSTATS_COUNTERS_LEN; c++) {
+        pos += put_u32(&payload[pos], mlstats_counter((mlstats_counter_t)c));
+    }
+    pos += put_u32(&payload[pos], tx_dropped);
+    return mltelemetry_send(MLTELEMETRY_COUNTERS, payload, pos);
+}
+
+bool mltelemetry_sendSamples(
+    const uint32_t time_ms, const int16_t *samples, const uint8_t dimensions, const uint8_t count
+) {
+    uint8_t payload[MLTELEMETRY_MAX_PAYLOAD];
+    const size_t values = (size_t)dimensions * count;
+    if (samples == NULL || 6 + values * 2 > sizeof(payload)) {
+        tx_seq++;
+        tx_dropped++;
+        return false;
+    }
+    size_t pos = put_u32(payload, time_ms);
+    payload[pos++] = dimensions;
+    payload[pos++] = count;
+    for (size_t i = 0; i < values; i++) {
+        pos += put_u16(&payload[pos], (uint16_t)samples[i]);
+    }
+    return mltelemetry_send(MLTELEMETRY_SAMPLES, payload, pos);
+}
+
+bool mltelemetry_sendText(const char *text) {
+    if (text == NULL) {
+        return false;
+    }
+    const size_t len = strlen(text);
+    return mltelemetry_send(MLTELEMETRY_TEXT, text, len < MLTELEMETRY_MAX_PAYLOAD ? len : MLTELEMETRY_MAX_PAYLOAD);
+}
+
+size_t mltelemetry_peek(const uint8_t **data) {
+    const uint32_t start = tx_tail & (MLTELEMETRY_BUFFER_SIZE - 1);
+    const size_t pending = mltelemetry_pending();
+    if (data != NULL) {
+        *data = &tx_buffer[start];
+    }
+    return (pending < MLTELEMETRY_BUFFER_SIZE - start) ? pending : MLTELEMETRY_BUFFER_SIZE - start;
+}
+
+void mltelemetry_consume(size_t len) {
+    const size_t pending = mltelemetry_pending();
+    tx_tail += (len < pending) ? len : pending;
+}
+
+size_t mltelemetry_pending(void) {
+    return tx_head - tx_tail;
+}
+
+uint32_t mltelemetry_dropped(void) {
+    return tx_dropped;
+}
+
+void mltelemetry_reset(void) {
+    tx_tail = tx_head;
+    tx_dropped = 0;
+}
@@ -0,0 +1,151 @@
+/**
+ * @brief Compact binary telemetry frames, written to a transmit ring buffer
+ * without blocking, to send the debug data of every inference through serial.
+ *
+ * @copyright
+ * Copyright 2024 Micro:bit Educational Foundation.
+ * SPDX-License-Identifier: MIT
+ *
+ * @details
+ * Formatting the predictions with printf and waiting for the UART takes
+ * milliseconds per inference, so instead the values are packed into frames.
+ * The frames are queued whole in a ring buffer, or dropped if they don't
+ * fit, and the transport takes the bytes out with mltelemetry_peek() and
+ * mltelemetry_consume() as fast as it can send them.
+ *
+ * Frame layout, all values little endian:
+ *
+ *     sync0 sync1 type seq len payload[len] crc16
+ *
+ * The CRC-16/CCITT-FALSE is calculated over type, seq, len and the payload.
+ * The sequence number increases for every frame, including dropped ones, so
+ * the receiver can count the frames that were lost. Bytes outside frames
+ * (e.g. printf text) can be mixed in the same stream, the receiver finds the
+ * frames by their sync bytes and CRC.
+ *
+ * Payloads, all starting with the time in milliseconds as a uint32:
+ * - MLTELEMETRY_PREDICTION: int8 predicted index (-1 for none), uint8 len,
+ *   len uint16 predictions, in 1/65535 units.
+ * - MLTELEMETRY_TIMINGS: uint8 len, len uint32 last durations in
+ *   nanoseconds, one per mlstats_stage_t.
+ * - MLTELEMETRY_COUNTERS: uint8 len, len uint32, one per mlstats_counter_t
+ *   followed by the number of frames dropped by the ring buffer.
+ * - MLTELEMETRY_SAMPLES: uint8 dimensions, uint8 count, count * dimensions
+ *   int16 samples, interleaved, in thousandths.
+ * - MLTELEMETRY_TEXT: no time, the payload is the text, not null terminated.
+ *
+ * The functions are not thread safe, they are meant to be used from CODAL
+ * fibers, which are not preempted, and not from interrupts.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MLTELEMETRY_SYNC0 0xA5
+#define MLTELEMETRY_SYNC1 0x5A
+#define MLTELEMETRY_HEADER_SIZE 5
+#define MLTELEMETRY_CRC_SIZE 2
+#define MLTELEMETRY_MAX_PAYLOAD 255
+#define MLTELEMETRY_MAX_FRAME (MLTELEMETRY_HEADER_SIZE + MLTELEMETRY_MAX_PAYLOAD + MLTELEMETRY_CRC_SIZE)
+
+// Size of the transmit ring buffer, it must be a power of 2
+#ifndef MLTELEMETRY_BUFFER_SIZE
+#define MLTELEMETRY_BUFFER_SIZE 512
+#endif
+
+typedef enum mltelemetry_frame_type_e {
+    MLTELEMETRY_PREDICTION = 1,
+    MLTELEMETRY_TIMINGS = 2,
+    MLTELEMETRY_COUNTERS = 3,
+    MLTELEMETRY_SAMPLES = 4,
+    MLTELEMETRY_TEXT = 5,
+} mltelemetry_frame_type_t;
+
+/**
+ * @brief Queue a frame with any payload.
+ *
+ * @return True if the frame has been queued, False if it has been dropped,
+ *         because it doesn't fit in the buffer or the payload is too long.
+ */
+bool mltelemetry_send(const mltelemetry_frame_type_t type, const void *payload, const size_t len);
+
+/**
+ * @brief Queue a MLTELEMETRY_PREDICTION frame.
+ *
+ * @param predictions The prediction of each action, from 0 to 1.
+ * @param len Number of predictions, up to 124.
+ */
+bool mltelemetry_sendPrediction(
+    const uint32_t time_ms, const int index, const float *predictions, const size_t len);
+
+/**
+ * @brief Queue a MLTELEMETRY_TIMINGS frame with the last duration of each
+ * stage recorded by mlstats.
+ */
+bool mltelemetry_sendTimings(const uint32_t time_ms);
+
+/**
+ * @brief Queue a MLTELEMETRY_COUNTERS frame with the mlstats counters and
+ * the dropped frames.
+ */
+bool mltelemetry_sendCounters(const uint32_t time_ms);
+
+/**
+ * @brief Queue a MLTELEMETRY_SAMPLES frame.
+ *
+ * @param samples count * dimensions interleaved samples, in thousandths.
+ */
+bool mltelemetry_sendSamples(
+    const uint32_t time_ms, const int16_t *samples, const uint8_t dimensions, const uint8_t count);
+
+/**
+ * @brief Queue a MLTELEMETRY_TEXT frame, the text is truncated to
+ * MLTELEMETRY_MAX_PAYLOAD characters.
+ */
+bool mltelemetry_sendText(const char *text);
+
+/**
+ * @brief Get the queued bytes that are contiguous in the buffer.
+ *
+ * @param data Set to the first queued byte.
+ * @return The number of bytes at data, 0 if nothing is queued. More bytes
+ *         can be queued after them if the buffer wraps around.
+ */
+size_t mltelemetry_peek(const uint8_t **data);
+
+/**
+ * @brief Remove bytes that have been sent, from the start of the queue.
+ */
+void mltelemetry_consume(size_t len);
+
+/**
+ * @return The number of bytes waiting to be sent.
+ */
+size_t mltelemetry_pending(void);
+
+/**
+ * @return The number of frames dropped because the buffer was full.
+ */
+uint32_t mltelemetry_dropped(void);
+
+/**
+ * @brief Discard the queued bytes and clear the dropped frames count.
+ */
+void mltelemetry_reset(void);
+
+/**
+ * @brief CRC-16/CCITT-FALSE, for the receivers to check the frames.
+ *
+ * @param crc 0xFFFF to start, or the result of the previous data.
+ */
+uint16_t mltelemetry_crc16(uint16_t crc, const uint8_t *data, const size_t len);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
@@ -1,6 +1,7 @@
 #include <pxt.h>
 #include "modeltest.h"
 #include "mldataprocessor.h"
+#include "mlrecording.h"
 //#include "testdata.h"
 //#include "testoutput.h"
 
@@ -82,6 +83,45 @@ static void runModelTest(
     DBG_PRINT("\n\n");
 }
 
+#if ML_TEST_RECORDING_ADDRESS
+// Samples read from flash per recordData() call
+#define ML_TEST_RECORDING_CHUNK 16
+
+void testModel(const ml_actions_t *actions, ml_predictions_t *predictions) {
+    // The file is read in place from flash, only a chunk of samples is
+    // copied to RAM at a time
+    const void *address = (const void *)ML_TEST_RECORDING_ADDRESS;
+    MlRecording_t recording;
+    if (!mlrecording_open(&recording, address, mlrecording_fileSize(address)) ||
+            recording.header.dimensions != 3 ||
+            recording.header.features != mlDataProcessor.getProcessedDataSize() ||
+            recording.header.outputs != actions->len) {
+        DBG_PRINT("Invalid recording file at 0x%x\n", ML_TEST_RECORDING_ADDRESS);
+        uBit.panic(893);
+    }
+
+    for (uint32_t recordingIndex = 0; recordingIndex < recording.header.recordings; recordingIndex++) {
+        DBG_PRINT("Recording %d\n", recordingIndex);
+        float samples[ML_TEST_RECORDING_CHUNK * 3];
+        size_t len;
+        uint32_t first = 0;
+        while ((len = mlrecording_readSamples(&recording, recordingIndex, first, ML_TEST_RECORDING_CHUNK, samples)) > 0) {
+            MldpReturn_t recordDataResult = mlDataProcessor.recordData(samples, len * 3);
+            if (recordDataResult != MLDP_SUCCESS) {
+                DBG_PRINT("Failed to record test accelerometer data\n");
+                uBit.panic(892);
+            }
+            first += len;
+        }
+        runModelTest(
+            actions,
+            predictions,
+            mlrecording_features(&recording, recordingIndex),
+            mlrecording_outputs(&recording, recordingIndex)
+        );
+    }
+}
+#else
 #pragma GCC push_options
 #pragma GCC optimize ("O0")
 void testModel(const ml_actions_t *actions, ml_predictions_t *predictions) {
@@ -115,3 +155,4 @@ void testModel(const ml_actions_t *actions, ml_predictions_t *predictions) {
     }
 }
 #pragma GCC pop_options
+#endif
@@ -9,6 +9,16 @@
 #pragma once
 
 #include "mlrunner.h"
+
+// Address of a recording file (mlrecording.h) written to flash, to test the
+// recordings in it instead of the ones in testdata.h, which then is not
+// needed. The file must have the expected filter and model outputs.
+#ifndef ML_TEST_RECORDING_ADDRESS
+#define ML_TEST_RECORDING_ADDRESS 0
+#endif
+
+#if !ML_TEST_RECORDING_ADDRESS
 #include "testdata.h"
+#endif
 
 void testModel(const ml_actions_t *actions, ml_predictions_t *predictions);
@@ -1,6 +1,9 @@
 #include <pxt.h>
 #include "mlrunner/mlrunner.h"
 #include "mlrunner/mldataprocessor.h"
+#include "mlrunner/mlqueue.h"
+#include "mlrunner/mlstats.h"
+#include "mlrunner/mltelemetry.h"
 #if DEVICE_MLRUNNER_USE_EXAMPLE_MODEL
 #include "mlrunner/example_model1.h"
 #endif
@@ -23,6 +26,21 @@
 #define DEBUG_PRINT(...)
 #endif
 
+// Send the debug data of every sample and inference as binary telemetry
+// frames (see mltelemetry.h), instead of formatting it with printf, which
+// takes milliseconds. Decode it with the host mlrunner_telemetry tool.
+// Can be set in pxt.json, only applies when ML_DEBUG_PRINT is enabled.
+#ifndef ML_DEBUG_TELEMETRY
+#define ML_DEBUG_TELEMETRY 1
+#endif
+#if ML_DEBUG_PRINT && ML_DEBUG_TELEMETRY
+#define DEBUG_TELEMETRY 1
+#define DEBUG_PRINT_STREAM(...)
+#else
+#define DEBUG_TELEMETRY 0
+#define DEBUG_PRINT_STREAM(...) DEBUG_PRINT(__VA_ARGS__)
+#endif
+
 // Using defines to avoid MakeCode exposing the enum to enums.d.ts
 #define TEST_RUNNER_ID_INFERENCE 71
 #define TEST_RUNNER_ID_TIMER 72
@@ -33,9 +51,35 @@
 #define ML_INFERENCE_PERIOD_MS 250
 #endif
 
-// Configure the default flags for the model event listeners, can be set in pxt.json
+// Number of accelerometer samples taken from the sample queue, converted and
+// recorded together with a single recordData() call, can be set in pxt.json
+#ifndef ML_SAMPLES_BATCH
+#define ML_SAMPLES_BATCH 1
+#endif
+#if ML_SAMPLES_BATCH > MLQUEUE_CAPACITY
+#error "ML_SAMPLES_BATCH can't be larger than MLQUEUE_CAPACITY"
+#endif
+
+// Keep the window samples as int16 milli-g (MLDP_CONFIG_INT16_SAMPLES) to
+// halve its memory, or as float with MLDP_CONFIG_NONE, can be set in pxt.json.
+// The accelerometer values are whole milli-g, so the output is the same.
+#ifndef ML_SAMPLES_STORAGE_FLAGS
+#define ML_SAMPLES_STORAGE_FLAGS MLDP_CONFIG_INT16_SAMPLES
+#endif
+
+// Skip the inference, and repeat the last prediction, while the accelerometer
+// is idle: when every axis has stayed within a band of this many milli-g since
+// the start of the last window processed. 0 disables it, can be set in pxt.json
+#ifndef ML_ACTIVITY_THRESHOLD_MG
+#define ML_ACTIVITY_THRESHOLD_MG 0
+#endif
+
+// Configure the flags for the sample timer event listener, can be set in pxt.json.
+// With MESSAGE_BUS_LISTENER_IMMEDIATE the samples are read in the timer
+// interrupt, on time even while the model runs, but then nothing else can
+// use the I2C bus (e.g. reading the accelerometer or compass from MakeCode).
 #ifndef ML_EVENT_LISTENER_DEFAULT_FLAGS
-#define ML_EVENT_LISTENER_DEFAULT_FLAGS MESSAGE_BUS_LISTENER_DROP_IF_BUSY
+#define ML_EVENT_LISTENER_DEFAULT_FLAGS MESSAGE_BUS_LISTENER_QUEUE_IF_BUSY
 #endif
 
 
@@ -45,34 +89,10 @@ static inline void start_ticks_cpu() {
     DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 }
 
-static inline uint32_t ticks_cpu() {
+static uint32_t ticks_cpu() {
     return DWT->CYCCNT;
 }
 
-static inline uint32_t calcTicks(uint32_t ticks_start, uint32_t ticks_end) {
-    static uint32_t ticks[10];
-    static uint32_t ticks_index = 0;
-    static bool ticks_start_average = false;
-
-    ticks[ticks_index] = ticks_end - ticks_start;
-    ticks_index++;
-    if (ticks_index >= 9) {
-        ticks_start_average = true;
-        ticks_index = 0;
-    }
-
-    if (!ticks_start_average) {
-        return 0;
-    }
-
-    uint32_t ticksAverage = 0;
-    for (size_t i = 0; i < 10; i++) {
-        ticksAverage += ticks[i];
-    }
-    return ticksAverage / 10;
-}
-
-
 namespace testrunner {
     static bool initialised = false;
     static int samplesPeriodMillisec = 0;
@@ -81,35 +101,86 @@ namespace testrunner {
     static int mlSampleCountsPerInference = 0;
     static const int ML_PREDICTIONS_PER_SECOND = 4;
     static const uint16_t ML_CODAL_TIMER_VALUE = 1;
+    static const uint16_t ML_CODAL_SAMPLES_VALUE = 2;
+    // Send each accelerometer sample in the telemetry
+    static bool telemetrySamples = false;
+    // Samples read by the timer handler, waiting for the inference fiber
+    static MlSampleQueue_t sampleQueue;
+
+    /**
+     * Move as much telemetry as fits into the serial transmit buffer, the
+     * rest is sent in the next call.
+     */
+    static void sendTelemetry() {
+#if DEBUG_TELEMETRY
+        const uint8_t *data;
+        size_t len;
+        while ((len = mltelemetry_peek(&data)) > 0) {
+            const int sent = uBit.serial.send((uint8_t *)data, len, ASYNC);
+            if (sent <= 0) {
+                break;
+            }
+            mltelemetry_consume(sent);
+            if ((size_t)sent < len) {
+                break;
+            }
+        }
+#endif
+    }
+
+    /**
+     * Send all the telemetry queued, waiting for it, so that other serial
+     * output doesn't land in the middle of a frame.
+     */
+    static void flushTelemetry() {
+#if DEBUG_TELEMETRY
+        const uint8_t *data;
+        size_t len;
+        while ((len = mltelemetry_peek(&data)) > 0) {
+            uBit.serial.send((uint8_t *)data, len, SYNC_SPINWAIT);
+            mltelemetry_consume(len);
+        }
+#endif
+    }
 
     // Order is important for the outputData as set in:
     // https://github.com/microbit-foundation/ml-trainer/blob/v0.6.0/src/script/stores/mlStore.ts#L122-L131
+    // filterMlTrainer calculates (in a single pass) the same output as:
+    // filterMax, filterMean, filterMin, filterStdDev, filterPeaks,
+    // filterTotalAcc, filterZcr, filterRms
     static const MlDataFilters_t mlTrainerDataFilters[] = {
-        {1, filterMax},
-        {1, filterMean},
-        {1, filterMin},
-        {1, filterStdDev},
-        {1, filterPeaks},
-        {1, filterTotalAcc},
-        {1, filterZcr},
-        {1, filterRms},
+        {MLDP_ML_TRAINER_FEATURES, filterMlTrainer, MLDP_FILTER_INTERLEAVED_OUTPUT},
     };
     static const int mlTrainerDataFiltersLen = sizeof(mlTrainerDataFilters) / sizeof(mlTrainerDataFilters[0]);
+    // The accelerometer samples are in milli-g, the filters use g
+    static const float mlAccelerometerScale[3] = {1000.0f, 1000.0f, 1000.0f};
 
-    void runModel() {
-        if (!initialised) return;
-
+    static void runModel() {
+#if !DEBUG_TELEMETRY
         unsigned int time_start = system_timer_current_time_us();
+#endif
 
-        uint32_t ticks_start = ticks_cpu();
-        float *modelData = mlDataProcessor.getProcessedData();
-        uint32_t ticks_end = ticks_cpu();
+        // When supported, the processor writes directly into the model input
+        // tensor, so that ml_predict() doesn't need to copy it. Quantized
+        // models have no float input tensor, ml_predict() quantizes the data.
+        const uint32_t ticks_start = mlstats_now();
+        float *modelData = ml_getInputBuffer();
+        if (mlDataProcessor.writeProcessedData != NULL && modelData != NULL) {
+            if (mlDataProcessor.writeProcessedData(modelData, mlDataProcessor.getProcessedDataSize()) != MLDP_SUCCESS) {
+                modelData = NULL;
+            }
+        } else {
+            modelData = mlDataProcessor.getProcessedData();
+        }
+        mlstats_recordSince(MLSTATS_FEATURE_EXTRACTION, ticks_start);
         if (modelData == NULL) {
             DEBUG_PRINT("Failed to processed data for the model\n");
             uBit.panic(TEST_RUNNER_ERROR + 21);
         }
 
+#if !DEBUG_TELEMETRY
         unsigned int time_mid = system_timer_current_time_us();
+#endif
 
         bool success = ml_predict(
             modelData, mlDataProcessor.getProcessedDataSize(), actions, predictions);
@@ -118,10 +189,16 @@ namespace testrunner {
             uBit.panic(TEST_RUNNER_ERROR + 22);
         }
 
+#if DEBUG_TELEMETRY
+        const uint32_t now = uBit.systemTime();
+        mltelemetry_sendPrediction(now, predictions->index, predictions->prediction, predictions->len);
+        mltelemetry_sendTimings(now);
+        mltelemetry_sendCounters(now);
+        sendTelemetry();
+#else
         unsigned int time_end = system_timer_current_time_us();
 
-        DEBUG_PRINT("Prediction (%d micros + %d micros, %d filter ticks): ",
-                    time_mid - time_start, time_end - time_mid, calcTicks(ticks_start, ticks_end));
+        DEBUG_PRINT("Prediction (%d micros + %d micros): ", time_mid - time_start, time_end - time_mid);
         if (predictions->index >= 0) {
             DEBUG_PRINT("%d %s\t\t",
                         predictions->index,
@@ -135,38 +212,131 @@ namespace testrunner {
                         (int)(predictions->prediction[i] * 100));
         }
         DEBUG_PRINT("\n");
+#endif
 
         MicroBitEvent evt(TEST_RUNNER_ID_INFERENCE, predictions->index + 2);
     }
 
-    void recordAccData(MicroBitEvent) {
-        if (!initialised) return;
+    /**
+     * Repeat the last prediction without running the model, as the data hasn't
+     * changed since it was calculated.
+     */
+    static void repeatPrediction() {
+#if DEBUG_TELEMETRY
+        const uint32_t now = uBit.systemTime();
+        mltelemetry_sendPrediction(now, predictions->index, predictions->prediction, predictions->len);
+        mltelemetry_sendCounters(now);
+#else
+        DEBUG_PRINT("Prediction (idle): %d\n", predictions->index);
+#endif
+        MicroBitEvent evt(TEST_RUNNER_ID_INFERENCE, predictions->index + 2);
+    }
 
-#if ML_DEBUG_PRINT
+    /**
+     * Record the samples queued in batches of ML_SAMPLES_BATCH, and run the
+     * model every mlSampleCountsPerInference samples.
+     */
+    static void recordSamples() {
         static uint32_t lastSampleTime = 0;
-        uint32_t now = uBit.systemTime();
-        if ((now - lastSampleTime) != (uint32_t)samplesPeriodMillisec) {
-            DEBUG_PRINT("Sample period drift: %d ms\n", now - lastSampleTime);
+        static int samplesSinceInference = 0;
+        MlSample_t samples[ML_SAMPLES_BATCH];
+        int16_t rawData[ML_SAMPLES_BATCH * 3];
+        float accData[ML_SAMPLES_BATCH * 3];
+
+        while (mlqueue_len(&sampleQueue) >= ML_SAMPLES_BATCH) {
+            const size_t samplesLen = mlqueue_pop(&sampleQueue, samples, ML_SAMPLES_BATCH);
+            for (size_t i = 0; i < samplesLen; i++) {
+                // The timestamps come from the timer events, so this is the
+                // drift of the timer, not of this fiber
+                const int32_t drift = (int32_t)(samples[i].time_us - lastSampleTime) - samplesPeriodMillisec * 1000;
+                if (lastSampleTime != 0 && (drift > 1000 || drift < -1000)) {
+                    mlstats_increment(MLSTATS_SAMPLE_DRIFT);
+                    DEBUG_PRINT_STREAM("Sample period drift: %d us\n", drift);
+                }
+                lastSampleTime = samples[i].time_us;
+                rawData[i * 3 + 0] = samples[i].value[0];
+                rawData[i * 3 + 1] = samples[i].value[1];
+                rawData[i * 3 + 2] = samples[i].value[2];
+#if DEBUG_TELEMETRY
+                if (telemetrySamples) {
+                    mltelemetry_sendSamples(samples[i].time_us / 1000, samples[i].value, 3, 1);
+                }
+#endif
+            }
+
+            // The processor keeps the samples in milli-g, so they don't need
+            // to be converted to g when it can record them as they are
+            const uint32_t ticks_start = mlstats_now();
+            MldpReturn_t recordDataResult;
+            if (mlDataProcessor.recordDataInt16 != NULL) {
+                recordDataResult = mlDataProcessor.recordDataInt16(rawData, samplesLen * 3);
+            } else {
+                mldp_convertInt16(rawData, accData, samplesLen * 3, 1000.0f);
+                recordDataResult = mlDataProcessor.recordData(accData, samplesLen * 3);
+            }
+            mlstats_recordSince(MLSTATS_RING_INSERT, ticks_start);
+            if (recordDataResult != MLDP_SUCCESS) {
+                mlstats_increment(MLSTATS_RECORD_ERRORS);
+                DEBUG_PRINT_STREAM("Failed to record accelerometer data\n");
+                continue;
+            }
+
+            samplesSinceInference += samplesLen;
+            if (samplesSinceInference < mlSampleCountsPerInference || !mlDataProcessor.isDataReady()) {
+                continue;
+            }
+            samplesSinceInference %= mlSampleCountsPerInference;
+            // If the next window is already queued this one is out of date,
+            // skip it to catch up with the timer
+            if (mlqueue_len(&sampleQueue) >= (size_t)mlSampleCountsPerInference) {
+                mlstats_increment(MLSTATS_INFERENCES_SKIPPED);
+                DEBUG_PRINT_STREAM("Skipped inference, samples behind\n");
+            } else if (mlDataProcessor.isIdle != NULL && mlDataProcessor.isIdle()) {
+                mlstats_increment(MLSTATS_INFERENCES_GATED);
+                repeatPrediction();
+            } else {
+                runModel();
+            }
         }
-        lastSampleTime = now;
+#if DEBUG_TELEMETRY
+        sendTelemetry();
 #endif
+    }
+
+    /**
+     * Consumer of the sample queue, it records the samples and runs the model
+     * without blocking the timer handler.
+     */
+    static void inferenceFiber() {
+        while (true) {
+            recordSamples();
+            // A batch queued by an interrupt just before waiting only wakes
+            // this up on the next sample, as the event is raised again
+            fiber_wait_for_event(TEST_RUNNER_ID_TIMER, ML_CODAL_SAMPLES_VALUE);
+        }
+    }
+
+    /**
+     * Producer of the sample queue, called on every sample period, it only
+     * reads the accelerometer.
+     */
+    void recordAccData(MicroBitEvent evt) {
+        if (!initialised) return;
 
+        const uint32_t ticks_start = mlstats_now();
         const Sample3D accSample = uBit.accelerometer.getSample();
-        const float accData[3] = {
-            accSample.x / 1000.0f,
-            accSample.y / 1000.0f,
-            accSample.z / 1000.0f,
+        const MlSample_t sample = {
+            (uint32_t)evt.timestamp,
+            {(int16_t)accSample.x, (int16_t)accSample.y, (int16_t)accSample.z},
         };
-        MldpReturn_t recordDataResult = mlDataProcessor.recordData(accData, 3);
-        if (recordDataResult != MLDP_SUCCESS) {
-            DEBUG_PRINT("Failed to record accelerometer data\n");
+        mlstats_recordSince(MLSTATS_SAMPLE_CAPTURE, ticks_start);
+
+        if (!mlqueue_push(&sampleQueue, &sample)) {
+            mlstats_increment(MLSTATS_SAMPLES_DROPPED);
             return;
         }
-
-        // Run model every mlSampleCountsPerInference samples
-        static unsigned int samplesTaken = 0;
-        if (!(++samplesTaken % mlSampleCountsPerInference) && mlDataProcessor.isDataReady()) {
-            runModel();
+        if (mlqueue_len(&sampleQueue) >= ML_SAMPLES_BATCH) {
+            MicroBitEvent samplesEvt(TEST_RUNNER_ID_TIMER, ML_CODAL_SAMPLES_VALUE);
         }
     }
 
@@ -278,6 +448,12 @@ namespace testrunner {
             .output_length = modelInputLen,
             .filter_size = mlDataFiltersLen,
             .filters = mlDataFilters,
+            // No double buffering, the window is processed by the fiber that
+            // records the samples, so nothing is recorded while it's in use
+            .flags = MLDP_CONFIG_STREAMING_PEAKS | ML_SAMPLES_STORAGE_FLAGS |
+                     (ML_ACTIVITY_THRESHOLD_MG > 0 ? MLDP_CONFIG_ACTIVITY_GATE : MLDP_CONFIG_NONE),
+            .sample_scale = mlAccelerometerScale,
+            .activity_threshold = ML_ACTIVITY_THRESHOLD_MG / 1000.0f,
         };
         MldpReturn_t mlInitResult = mlDataProcessor.init(&mlDataConfig);
         if (mlInitResult != MLDP_SUCCESS) {
@@ -295,15 +471,70 @@ namespace testrunner {
         }
 #endif
 
-        // Set up background timer to collect data and run model
-        uBit.messageBus.listen(TEST_RUNNER_ID_TIMER, ML_CODAL_TIMER_VALUE, &recordAccData, MESSAGE_BUS_LISTENER_DROP_IF_BUSY);
-        // uBit.messageBus.listen(TEST_RUNNER_ID_TIMER, ML_CODAL_TIMER_VALUE, &recordAccData, MESSAGE_BUS_LISTENER_IMMEDIATE);
+        // Set up background timer to collect data, and the fiber to process
+        // it and run the model
+        mlqueue_init(&sampleQueue);
+        create_fiber(inferenceFiber);
+        uBit.messageBus.listen(TEST_RUNNER_ID_TIMER, ML_CODAL_TIMER_VALUE, &recordAccData, ML_EVENT_LISTENER_DEFAULT_FLAGS);
         uBit.timer.eventEvery(samplesPeriodMillisec, TEST_RUNNER_ID_TIMER, ML_CODAL_TIMER_VALUE);
 
         start_ticks_cpu();
+        mlstats_setClock(ticks_cpu, SystemCoreClock / 1000000);
+        mlstats_reset();
+#if DEBUG_TELEMETRY
+        // Large enough for the frames of an inference, so that they are
+        // queued in a single call
+        uBit.serial.setTxBufferSize(128);
+        mltelemetry_reset();
+#endif
 
         initialised = true;
 
         DEBUG_PRINT("\tModel loaded\n");
     }
+
+    //%
+    float latencyPercentile(int stage, float percentile) {
+        return mlstats_ticksToMicros(mlstats_percentile((mlstats_stage_t)stage, percentile));
+    }
+
+    //%
+    float latencyMax(int stage) {
+        return mlstats_ticksToMicros(mlstats_max((mlstats_stage_t)stage));
+    }
+
+    //%
+    int latencyCount(int stage) {
+        return mlstats_count((mlstats_stage_t)stage);
+    }
+
+    //%
+    int statsCounter(int counter) {
+        return mlstats_counter((mlstats_counter_t)counter);
+    }
+
+    //%
+    void resetStats() {
+        mlstats_reset();
+    }
+
+    //%
+    int sampleQueueHighWater() {
+        return sampleQueue.high_water;
+    }
+
+    //%
+    void streamSamples(bool enabled) {
+        telemetrySamples = enabled;
+    }
+
+    static void printStatsLine(const char *line, void *) {
+        uBit.serial.send(line);
+    }
+
+    //%
+    void dumpStats() {
+        flushTelemetry();
+        mlstats_dump(printStatsLine, NULL);
+    }
 }
@@ -18,6 +18,24 @@ const enum MlRunnerIds {
     MlRunnerInference = 71,
     TMlRunnerTimer = 72,
 }
+// Same values as mlstats_stage_t in mlrunner/mlstats.h
+const enum MlStage {
+    SampleCapture = 0,
+    RingInsert = 1,
+    FeatureExtraction = 2,
+    CopyIn = 3,
+    Invoke = 4,
+    CopyOut = 5,
+    Argmax = 6,
+}
+// Same values as mlstats_counter_t in mlrunner/mlstats.h
+const enum MlCounter {
+    InferencesSkipped = 0,
+    RecordErrors = 1,
+    SampleDrift = 2,
+    SamplesDropped = 3,
+    InferencesGated = 4,
+}
 
 //% color=#2b64c3 weight=100 icon="\uf108" block="ML Runner" advanced=false
 namespace testrunner {
@@ -70,4 +88,85 @@ namespace testrunner {
         const modelBlob = getModelBlob() || hex``;
         initRunner(modelBlob);
     }
+
+    /**
+     * Get a percentile of the time taken by a stage of the ML pipeline.
+     *
+     * @param stage The MlStage to query.
+     * @param percentile From 0 to 100, e.g. 99 for the slowest 1%.
+     * @returns The time in microseconds, or 0 if the stage hasn't run.
+     */
+    //% shim=testrunner::latencyPercentile
+    export function latencyPercentile(stage: number, percentile: number): number {
+        return 0;
+    }
+
+    /**
+     * Get the longest time taken by a stage of the ML pipeline.
+     *
+     * @param stage The MlStage to query.
+     * @returns The time in microseconds, or 0 if the stage hasn't run.
+     */
+    //% shim=testrunner::latencyMax
+    export function latencyMax(stage: number): number {
+        return 0;
+    }
+
+    /**
+     * Get how many times a stage of the ML pipeline has run.
+     *
+     * @param stage The MlStage to query.
+     */
+    //% shim=testrunner::latencyCount
+    export function latencyCount(stage: number): number {
+        return 0;
+    }
+
+    /**
+     * Get the value of an event counter, like the number of skipped
+     * inferences.
+     *
+     * @param counter The MlCounter to query.
+     */
+    //% shim=testrunner::statsCounter
+    export function statsCounter(counter: number): number {
+        return 0;
+    }
+
+    /**
+     * Get the most samples that have been waiting at once to be recorded,
+     * while the model was running. If it reaches the queue capacity (32 by
+     * default) samples are being dropped.
+     */
+    //% shim=testrunner::sampleQueueHighWater
+    export function sampleQueueHighWater(): number {
+        return 0;
+    }
+
+    /**
+     * Clear the latency histograms and counters.
+     */
+    //% shim=testrunner::resetStats
+    export function resetStats(): void {
+        return;
+    }
+
+    /**
+     * Send each accelerometer sample in the binary telemetry, to record the
+     * raw data. Only when the ML_DEBUG_TELEMETRY flag is enabled.
+     *
+     * @param enabled True to send the samples, false to stop.
+     */
+    //% shim=testrunner::streamSamples
+    export function streamSamples(enabled: boolean): void {
+        return;
+    }
+
+    /**
+     * Print the latency percentiles of each stage and the counters to serial.
+     */
+    //% shim=testrunner::dumpStats
+    export function dumpStats(): void {
+        return;
+    }
 }